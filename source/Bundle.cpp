@@ -0,0 +1,122 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Bundle.cpp
+//
+// Purpose:
+//   This file contains the definitions of the bundle files of a server.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Method: CreateBundleFolder
+//
+// Description:
+//    This method creates the bundle folder of the server and a file for
+//    each of its bundles. The folder is also created in the dump
+//    directory, like every folder of the tree.
+//
+// Returns:
+//    VOID
+//
+void
+CreateBundleFolder(
+    const string& servername,
+    ServerInfo* serverInfo)
+{
+    string folderPath = LINUX_PATH_DELIM + servername + LINUX_PATH_DELIM BUNDLE_FOLDER_NAME;
+
+    mkdir(CalculateDumpPath(folderPath).c_str(), DEFAULT_PERMISSIONS);
+    g_VirtualTree.AddDirectory(folderPath, servername);
+
+    for (auto&& bundle : serverInfo->m_bundles)
+    {
+        g_VirtualTree.AddFile(VirtualTree::JoinPath(folderPath, bundle.first),
+                              ENTRY_BUNDLE, servername, bundle.first);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: RunBundle
+//
+// Description:
+//    This method sends the queries of the DMV files of the bundle to the
+//    server as one batch, so that reading them costs a single round trip
+//    and a single connection.
+//
+//    The content has each DMV file, in the form given by its extension,
+//    after a "==> <file> <==" line, with a blank line between files.
+//
+//    Each result set also goes to the result cache of its DMV file with
+//    the cacheTTL of the DMV, so opening a member of the bundle right
+//    after the bundle does not query the server again.
+//
+//    The batch fails as a whole - if one of the DMVs cannot be queried,
+//    none of them is.
+//
+// Returns:
+//    0 on success, -1 on error.
+//
+int
+RunBundle(
+    const string& servername,
+    ServerInfo* serverInfo,
+    const string& bundleName,
+    QueryResult& content)
+{
+    string              filename = BUNDLE_FOLDER_NAME LINUX_PATH_DELIM + bundleName;
+    vector<string>      dmvNames;
+    vector<string>      queries;
+    vector<FileFormat>  types;
+    vector<QueryResult> outputs;
+    string              dmvName;
+    string              line;
+    string              data;
+
+    auto bundle = serverInfo->m_bundles.find(bundleName);
+    if (bundle == serverInfo->m_bundles.end())
+    {
+        return -1;
+    }
+
+    for (auto&& member : bundle->second)
+    {
+        dmvName = member;
+        types.push_back(SplitFileFormat(dmvName));
+        queries.push_back(GetDmvQuery(dmvName, types.back()));
+        dmvNames.push_back(dmvName);
+    }
+
+    if (ExecuteBatch(queries, types, outputs, serverInfo,
+                     GetQueryTimeout(serverInfo, filename),
+                     GetQueryStats(servername, filename)))
+    {
+        PrintMsg("Bundle %s of server %s failed\n", bundleName.c_str(), servername.c_str());
+        return -1;
+    }
+
+    content = make_shared<ResultBuffer>();
+
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        serverInfo->m_resultCache->Put(GetDmvCacheKey(dmvNames[i], types[i]),
+                                       GetCacheTtl(serverInfo, dmvNames[i]),
+                                       outputs[i]);
+
+        line = StringFormat("%s" BUNDLE_MEMBER_PREFIX "%s" BUNDLE_MEMBER_SUFFIX "\n",
+                            (i > 0) ? "\n" : "", bundle->second[i].c_str());
+        content->Append(line.data(), line.size());
+
+        data = outputs[i]->ToString();
+        if (!data.empty() && data.back() != '\n')
+        {
+            data += '\n';
+        }
+        content->Append(data.data(), data.size());
+    }
+
+    content->Complete(0);
+
+    return 0;
+}
@@ -0,0 +1,40 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Bundle.h
+//
+// Purpose:
+//   This file contains the declaration of the bundle files of a server -
+//   DMV files read together in one round trip, exposed as:
+//      <MOUNT DIR>/<SERVER NAME>/bundle/<bundle name>
+//
+#pragma once
+
+// Name of the bundle folder of a server.
+//
+#define BUNDLE_FOLDER_NAME          "bundle"
+
+// Line written before the content of each DMV file of a bundle, followed
+// by the file name and BUNDLE_MEMBER_SUFFIX - as "head" does for several
+// files.
+//
+#define BUNDLE_MEMBER_PREFIX        "==> "
+#define BUNDLE_MEMBER_SUFFIX        " <=="
+
+// Creates the bundle folder of the server with a file per bundle of its
+// bundle settings.
+//
+void CreateBundleFolder(
+    const string& servername,
+    ServerInfo* serverInfo);
+
+// Runs the DMV files of a bundle in one batch and sets content to all of
+// their contents. Each result set also goes to the result cache of its
+// DMV file. Returns 0 on success and -1 on error.
+//
+int RunBundle(
+    const string& servername,
+    ServerInfo* serverInfo,
+    const string& bundleName,
+    QueryResult& content);
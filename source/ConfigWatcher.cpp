@@ -0,0 +1,192 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: ConfigWatcher.cpp
+//
+// Purpose:
+//   This file contains the definitions of the watch of the config file.
+//
+#include "UtilsPrivate.h"
+
+// The watch thread, the inotify descriptor and the eventfd that stops
+// the thread.
+//
+static ConfigReloadHandler      g_ConfigReloadHandler;
+static thread                   g_ConfigWatchThread;
+static int                      g_ConfigWatchFd = -1;
+static int                      g_ConfigWatchStopFd = -1;
+
+// ---------------------------------------------------------------------------
+// Method: SetConfigReloadHandler
+//
+// Returns:
+//    VOID
+//
+void
+SetConfigReloadHandler(
+    const ConfigReloadHandler& handler)
+{
+    g_ConfigReloadHandler = handler;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ReadConfigEvents
+//
+// Description:
+//    This method reads the pending inotify events of the config directory.
+//
+// Returns:
+//    true if one of them is about the config file.
+//
+static bool
+ReadConfigEvents(
+    const string& filename)
+{
+    char                            buffer[4096]
+                                        __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event*     event;
+    ssize_t                         length;
+    bool                            changed = false;
+
+    while ((length = read(g_ConfigWatchFd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char* next = buffer; next < buffer + length;
+             next += sizeof(struct inotify_event) + event->len)
+        {
+            event = (const struct inotify_event*)next;
+            if (event->len && filename == event->name)
+            {
+                changed = true;
+            }
+        }
+    }
+
+    return changed;
+}
+
+// ---------------------------------------------------------------------------
+// Method: WatchConfigFile
+//
+// Description:
+//    Body of the watch thread. Once the config file changed, it waits
+//    until CONFIG_RELOAD_DELAY_MS pass without another change and runs
+//    the reload handler.
+//
+// Returns:
+//    VOID
+//
+static void
+WatchConfigFile(
+    string filename)
+{
+    struct pollfd   pollEntries[2];
+    bool            pending = false;
+    int             ready;
+
+    pollEntries[0].fd = g_ConfigWatchFd;
+    pollEntries[0].events = POLLIN;
+    pollEntries[1].fd = g_ConfigWatchStopFd;
+    pollEntries[1].events = POLLIN;
+
+    for (;;)
+    {
+        ready = poll(pollEntries, 2, pending ? CONFIG_RELOAD_DELAY_MS : -1);
+        if (ready == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ready == -1 || (pollEntries[1].revents & POLLIN))
+        {
+            break;
+        }
+
+        if (ready == 0)
+        {
+            // The file did not change for the delay - reload it.
+            //
+            pending = false;
+
+            PrintMsg("Config file %s changed - reloading\n", g_UserPaths.m_confPath.c_str());
+            g_ConfigReloadHandler();
+        }
+        else if (ReadConfigEvents(filename))
+        {
+            pending = true;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: StartConfigWatch
+//
+// Description:
+//    This method starts watching the config file. The directory of the
+//    file is watched rather than the file, as most editors (and config
+//    management tools) save a new file and rename it over the old one.
+//
+// Returns:
+//    VOID
+//
+void
+StartConfigWatch()
+{
+    string  directory;
+    string  filename;
+    size_t  slash;
+
+    if (!g_ConfigReloadHandler || g_ConfigWatchThread.joinable())
+    {
+        return;
+    }
+
+    slash = g_UserPaths.m_confPath.rfind(LINUX_PATH_DELIM);
+    directory = (slash == string::npos) ? "." : g_UserPaths.m_confPath.substr(0, max(slash, (size_t)1));
+    filename = g_UserPaths.m_confPath.substr(slash + 1);
+
+    g_ConfigWatchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    g_ConfigWatchStopFd = eventfd(0, EFD_CLOEXEC);
+
+    if (g_ConfigWatchFd == -1 || g_ConfigWatchStopFd == -1 ||
+        inotify_add_watch(g_ConfigWatchFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+    {
+        PrintMsg("Cannot watch config file %s - %s. Changes need a remount.\n",
+            g_UserPaths.m_confPath.c_str(), strerror(errno));
+        StopConfigWatch();
+        return;
+    }
+
+    g_ConfigWatchThread = thread(WatchConfigFile, filename);
+}
+
+// ---------------------------------------------------------------------------
+// Method: StopConfigWatch
+//
+// Returns:
+//    VOID
+//
+void
+StopConfigWatch()
+{
+    uint64_t stop = 1;
+
+    if (g_ConfigWatchThread.joinable())
+    {
+        if (write(g_ConfigWatchStopFd, &stop, sizeof(stop)) != sizeof(stop))
+        {
+            PrintMsg("Cannot stop the config file watch - %s\n", strerror(errno));
+        }
+        g_ConfigWatchThread.join();
+    }
+
+    if (g_ConfigWatchFd != -1)
+    {
+        close(g_ConfigWatchFd);
+        g_ConfigWatchFd = -1;
+    }
+    if (g_ConfigWatchStopFd != -1)
+    {
+        close(g_ConfigWatchStopFd);
+        g_ConfigWatchStopFd = -1;
+    }
+}
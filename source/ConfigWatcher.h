@@ -0,0 +1,39 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: ConfigWatcher.h
+//
+// Purpose:
+//   This file contains the declaration of the watch of the config file,
+//   which reloads the servers when the file changes.
+//
+#pragma once
+
+// How long the config file must stay unchanged after an event before it
+// is reloaded, so that an editor saving in several steps triggers a
+// single reload.
+//
+#define CONFIG_RELOAD_DELAY_MS  500
+
+// Method called with the config file changed. Runs on the watch thread.
+//
+typedef std::function<void()> ConfigReloadHandler;
+
+// Sets the method run when the config file changes. Nothing is watched
+// without one.
+//
+void
+SetConfigReloadHandler(
+    const ConfigReloadHandler& handler);
+
+// Starts watching the config file with inotify. It must be called after
+// FUSE forked the daemon.
+//
+void
+StartConfigWatch();
+
+// Stops watching the config file, waiting for a reload in progress.
+//
+void
+StopConfigWatch();
@@ -0,0 +1,290 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: ConnectionPool.cpp
+//
+// Purpose:
+//   This file contains the definitions of the per-server pool of
+//   DB-Library connections.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+// Description:
+//    No connection is opened here. The pool fills up lazily as queries
+//    are run against the server.
+//
+ConnectionPool::ConnectionPool(
+    const string& hostname,
+    const string& username,
+    const string& password,
+    int maxSize,
+    int idleTimeoutSec,
+    ServerStats* stats) :
+    m_hostname(hostname),
+    m_username(username),
+    m_password(password),
+    m_maxSize(max(maxSize, 1)),
+    m_idleTimeout(idleTimeoutSec),
+    m_numOpen(0),
+    m_stats(stats),
+    m_retired(false)
+{
+}
+
+// ---------------------------------------------------------------------------
+// Method: Destructor
+//
+// Description:
+//    Closes all the idle connections. Connections still borrowed are
+//    closed by their owner on Release.
+//
+ConnectionPool::~ConnectionPool()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    for (auto&& entry : m_idleConnections)
+    {
+        CloseConnection(entry.m_dbConn);
+    }
+    m_idleConnections.clear();
+}
+
+// ---------------------------------------------------------------------------
+// Method: RemoveExpiredConnections
+//
+// Description:
+//    This method moves the connections that have been idle for longer
+//    than the idle timeout out of the idle list. The caller closes them
+//    after dropping the lock.
+//
+// Returns:
+//    VOID
+//
+void
+ConnectionPool::RemoveExpiredConnections(
+    vector<DBPROCESS*>& expired)
+{
+    auto now = std::chrono::steady_clock::now();
+
+    // The list is most recently used first - so the expired entries
+    // are all at the back.
+    //
+    while (!m_idleConnections.empty() &&
+           now - m_idleConnections.back().m_lastUsed > m_idleTimeout)
+    {
+        expired.push_back(m_idleConnections.back().m_dbConn);
+        m_idleConnections.pop_back();
+        m_numOpen--;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: Acquire
+//
+// Description:
+//    This method hands out the most recently used idle connection that
+//    is still alive. If there is none, a new connection is opened as
+//    long as the pool is not at its maximum size - otherwise wait for
+//    a connection to be released.
+//
+// Returns:
+//    DBPROCESS* on success and NULL on error.
+//
+DBPROCESS*
+ConnectionPool::Acquire()
+{
+    DBPROCESS*          dbConn = NULL;
+    vector<DBPROCESS*>  expired;
+    bool                openNew = false;
+    bool                timedOut = false;
+    bool                waited = false;
+
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+
+        while (!dbConn && !openNew && !timedOut)
+        {
+            RemoveExpiredConnections(expired);
+
+            if (!m_idleConnections.empty())
+            {
+                dbConn = m_idleConnections.front().m_dbConn;
+                m_idleConnections.pop_front();
+
+                // Health check - the server or network could have dropped
+                // the connection while it was idle.
+                //
+                if (DBDEAD(dbConn))
+                {
+                    expired.push_back(dbConn);
+                    dbConn = NULL;
+                    m_numOpen--;
+                }
+            }
+            else if (m_numOpen < m_maxSize)
+            {
+                // Reserve the slot now and login outside the lock.
+                //
+                m_numOpen++;
+                openNew = true;
+            }
+            else
+            {
+                waited = true;
+                timedOut = (m_available.wait_for(guard,
+                                std::chrono::seconds(SQLFS_MAX_POOL_WAIT_SEC)) ==
+                            std::cv_status::timeout);
+            }
+        }
+    }
+
+    for (auto&& conn : expired)
+    {
+        CloseConnection(conn);
+    }
+
+    if (waited)
+    {
+        IncrementStat(m_stats->m_poolWaits);
+    }
+
+    if (openNew)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        dbConn = CreateConnection(m_hostname, m_username, m_password);
+        m_stats->m_loginTime.RecordSince(start);
+        IncrementStat(dbConn ? m_stats->m_logins : m_stats->m_loginFailures);
+
+        if (!dbConn)
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_numOpen--;
+            m_available.notify_one();
+        }
+    }
+
+    if (timedOut)
+    {
+        IncrementStat(m_stats->m_poolTimeouts);
+        LogMsg(LOG_LEVEL_WARNING, "Timed out waiting for a free connection to %s\n", m_hostname.c_str());
+    }
+
+    return dbConn;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Release
+//
+// Description:
+//    This method returns the connection to the idle list. Any pending
+//    results are discarded first so that the next user of the
+//    connection starts from a clean state. A connection that is not
+//    reusable, or released to a retired pool, is closed instead.
+//
+// Returns:
+//    VOID
+//
+void
+ConnectionPool::Release(
+    DBPROCESS* dbConn,
+    bool reusable)
+{
+    if (!dbConn)
+    {
+        return;
+    }
+
+    if (reusable)
+    {
+        reusable = ResetConnection(dbConn);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        // Checked under the lock, so that a connection released while
+        // the pool is retired is not left on its idle list.
+        //
+        if (reusable && !m_retired)
+        {
+            m_idleConnections.push_front({ dbConn, std::chrono::steady_clock::now() });
+            dbConn = NULL;
+        }
+        else
+        {
+            m_numOpen--;
+        }
+    }
+
+    if (dbConn)
+    {
+        CloseConnection(dbConn);
+    }
+
+    m_available.notify_one();
+}
+
+// ---------------------------------------------------------------------------
+// Method: Retire
+//
+// Description:
+//    This method closes the idle connections right away, so that a
+//    server removed from the mount does not keep its sessions open until
+//    its last user is done. The connections in use are closed as they
+//    are released.
+//
+// Returns:
+//    VOID
+//
+void
+ConnectionPool::Retire()
+{
+    vector<DBPROCESS*> idle;
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        m_retired = true;
+        for (auto&& entry : m_idleConnections)
+        {
+            idle.push_back(entry.m_dbConn);
+        }
+        m_numOpen -= idle.size();
+        m_idleConnections.clear();
+    }
+
+    for (auto&& dbConn : idle)
+    {
+        CloseConnection(dbConn);
+    }
+
+    m_available.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetUsage
+//
+// Description:
+//    This method gets the current occupancy of the pool for the
+//    statistics files.
+//
+// Returns:
+//    VOID
+//
+void
+ConnectionPool::GetUsage(
+    int& numOpen,
+    int& numIdle,
+    int& maxSize)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    numOpen = m_numOpen;
+    numIdle = m_idleConnections.size();
+    maxSize = m_maxSize;
+}
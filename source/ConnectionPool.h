@@ -0,0 +1,96 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: ConnectionPool.h
+//
+// Purpose:
+//   This file contains the declaration of the per-server pool of
+//   DB-Library connections used to run queries without a fresh login.
+//
+#pragma once
+
+#define SQLFS_DEFAULT_POOL_SIZE             4
+#define SQLFS_DEFAULT_POOL_IDLE_TIMEOUT_SEC 60
+#define SQLFS_MAX_POOL_WAIT_SEC             10
+
+//--------------------------------------------------------------------
+// Class: ConnectionPool
+//
+// Description:
+//  Keeps a bounded set of logged in DB-Library connections to one
+//  server. Callers borrow a connection with Acquire and hand it back
+//  with Release once the results have been consumed.
+//
+//  Idle connections are kept most recently used first. Connections that
+//  have been idle longer than the idle timeout are closed the next time
+//  the pool is used, and a connection that DB-Library reports as dead
+//  is dropped and replaced by a fresh login.
+//
+class ConnectionPool
+{
+public:
+    // Constructor
+    //
+    ConnectionPool(
+        const string& hostname,
+        const string& username,
+        const string& password,
+        int maxSize,
+        int idleTimeoutSec,
+        ServerStats* stats);
+
+    // Destructor - closes all the idle connections.
+    //
+    ~ConnectionPool();
+
+    // Borrows a connection from the pool, logging in if no idle
+    // connection is available. Returns NULL on error.
+    //
+    DBPROCESS* Acquire();
+
+    // Returns a connection to the pool. If the connection is not
+    // reusable (or is dead) it is closed instead.
+    //
+    void Release(
+        DBPROCESS* dbConn,
+        bool reusable = true);
+
+    // Closes the idle connections, and from now on every connection
+    // released instead of keeping it - for the pool of a server removed
+    // from the mount, which may still have users.
+    //
+    void Retire();
+
+    // Gets the number of connections open, idle and the maximum.
+    //
+    void GetUsage(
+        int& numOpen,
+        int& numIdle,
+        int& maxSize);
+
+private:
+    struct PooledConnection
+    {
+        DBPROCESS*                              m_dbConn;
+        std::chrono::steady_clock::time_point   m_lastUsed;
+    };
+
+    // Closes the connections that were idle for longer than the
+    // idle timeout. Must be called with m_lock held.
+    //
+    void RemoveExpiredConnections(
+        vector<DBPROCESS*>& expired);
+
+    string                      m_hostname;
+    string                      m_username;
+    string                      m_password;
+    int                         m_maxSize;          // Max connections open at once
+    std::chrono::seconds        m_idleTimeout;      // Idle time before closing
+    int                         m_numOpen;          // Connections idle or in use
+    list<PooledConnection>      m_idleConnections;  // Most recently used first
+    std::mutex                  m_lock;
+    std::condition_variable     m_available;
+    ServerStats*                m_stats;            // Logins, waits and timeouts
+    bool                        m_retired;          // Keeps no idle connection
+};
@@ -11,127 +11,586 @@
 #include "UtilsPrivate.h"
 
 // ---------------------------------------------------------------------------
-// Method: ExecuteCustomQuery
+// Structure: CachedQueryText
 //
 // Description:
-//  This method reads the query from queryFilePath and puts the output 
-//  in queryResultPath.
+//    Text of a query file along with the modification time and size the
+//    file had when it was read. The text is read again only if either of
+//    them changes.
 //
-//  queryFilePath - absolute path to a file that contains query.
-//  queryResultPath - absolute path ot a file that is used to store query output.
+struct CachedQueryText
+{
+    struct timespec m_mtime;
+    off_t           m_size;
+    string          m_text;
+};
+
+// Query text cache keyed by the absolute path to the query file.
+//
+static unordered_map<string, CachedQueryText> g_QueryTextCache;
+
+// Modification time of the user custom query directory at the last sync,
+// keyed by server name.
+//
+static unordered_map<string, struct timespec> g_QueryDirSyncTime;
+
+// Lock protecting the maps above.
+//
+static std::mutex g_CustomQueryLock;
+
+// ---------------------------------------------------------------------------
+// Method: IsSameTime
+//
+// Description:
+//  Compare two modification times.
 //
 // Returns:
-//    none.
+//    true if they are equal - otherwise false.
 //
-void
-ExecuteCustomQuery(
+static bool
+IsSameTime(
+    const struct timespec& first,
+    const struct timespec& second)
+{
+    return first.tv_sec == second.tv_sec && first.tv_nsec == second.tv_nsec;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetQueryText
+//
+// Description:
+//  This method gets the text of a query file. The text is cached and the
+//  file is only read again when its modification time or size changes.
+//
+// Returns:
+//    0 on success and -1 on error.
+//
+static int
+GetQueryText(
     const string& queryFilePath,
-    const string& queryResultPath,
-    const string& hostname,
-    const string& username,
-    const string& password)
+    string& query)
 {
-    string responseString;
+    struct stat     statbuf;
+    int             error = 0;
+
+    if (stat(queryFilePath.c_str(), &statbuf) == -1)
+    {
+        PrintMsg("Unable to access custom query %s - %s\n",
+            queryFilePath.c_str(), strerror(errno));
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(g_CustomQueryLock);
+
+        auto cached = g_QueryTextCache.find(queryFilePath);
+        if (cached != g_QueryTextCache.end() &&
+            IsSameTime(cached->second.m_mtime, statbuf.st_mtim) &&
+            cached->second.m_size == statbuf.st_size)
+        {
+            query = cached->second.m_text;
+            return 0;
+        }
+    }
 
     // Read the query
     //
     ifstream ifs(queryFilePath);
-    string query((std::istreambuf_iterator<char>(ifs)),
-                        (std::istreambuf_iterator<char>()));
-    // Execute the query.
-    //
-    // We want the column names as well so use type as TYPE_TSV.
+    if (ifs.fail())
+    {
+        PrintMsg("Unable to open custom query %s\n", queryFilePath.c_str());
+        error = -1;
+    }
+    else
+    {
+        query.assign((std::istreambuf_iterator<char>(ifs)),
+                     (std::istreambuf_iterator<char>()));
+
+        std::lock_guard<std::mutex> guard(g_CustomQueryLock);
+        g_QueryTextCache[queryFilePath] = { statbuf.st_mtim, statbuf.st_size, query };
+    }
+
+    return error;
+}
+
+// ---------------------------------------------------------------------------
+// Structure: QueryParameter
+//
+// Description:
+//    One parameter declared by a query file. The name is in lower case
+//    without the @ (the server does not compare them with case either)
+//    and the type is the lower case type name without its length or
+//    precision, e.g. decimal for decimal(10, 2).
+//
+struct QueryParameter
+{
+    string  m_name;
+    string  m_type;
+};
+
+// ---------------------------------------------------------------------------
+// Method: IsParameterName
+//
+// Returns:
+//    true if the name only has identifier characters.
+//
+static bool
+IsParameterName(
+    const string& name)
+{
+    return !name.empty() &&
+           std::all_of(name.begin(), name.end(),
+                       [](char c) { return isalnum((unsigned char)c) || c == '_'; });
+}
+
+// ---------------------------------------------------------------------------
+// Method: QuoteLiteral
+//
+// Returns:
+//    The text as an N'' string literal.
+//
+static string
+QuoteLiteral(
+    const string& text)
+{
+    return "N'" + StringReplace(text, "'", "''") + "'";
+}
+
+// ---------------------------------------------------------------------------
+// Method: ParseParameterDeclarations
+//
+// Description:
+//  This method finds the "-- params:" line of a query and parses the
+//  parameter list after it - the parameter list of sp_executesql, such
+//  as "@db sysname, @amount decimal(10, 2)".
+//
+// Returns:
+//    false if the parameter list is malformed. A query without the line
+//    declares no parameters.
+//
+static bool
+ParseParameterDeclarations(
+    const string& query,
+    string& declarations,
+    vector<QueryParameter>& parameters)
+{
+    const string        header = CUSTOM_QUERY_PARAMS_HEADER;
+    std::istringstream  lines(query);
+    string              line;
+    string              item;
+    size_t              depth = 0;
+    size_t              start = 0;
+    size_t              nameEnd;
+
+    declarations.clear();
+    parameters.clear();
+
+    while (getline(lines, line))
+    {
+        line = Trim(line);
+        if (StringToLower(line.substr(0, header.size())) == header)
+        {
+            declarations = Trim(line.substr(header.size()));
+            break;
+        }
+    }
+
+    if (declarations.empty())
+    {
+        return true;
+    }
+
+    // The parameters are separated by the commas that are not part of a
+    // type, such as decimal(10, 2).
     //
-    int result = ExecuteQuery(query, responseString, hostname,
-                              username, password, TYPE_TSV);
+    for (size_t i = 0; i <= declarations.size(); i++)
+    {
+        if (i < declarations.size() && declarations[i] == '(')
+        {
+            depth++;
+        }
+        else if (i < declarations.size() && declarations[i] == ')' && depth > 0)
+        {
+            depth--;
+        }
+
+        if (i < declarations.size() && (declarations[i] != ',' || depth > 0))
+        {
+            continue;
+        }
+
+        item = Trim(declarations.substr(start, i - start));
+        start = i + 1;
+
+        nameEnd = item.find_first_of(" \t");
+        if (item.empty() || item[0] != '@' || nameEnd == string::npos ||
+            !IsParameterName(item.substr(1, nameEnd - 1)))
+        {
+            PrintMsg("Invalid parameter declaration \"%s\"\n", item.c_str());
+            return false;
+        }
+
+        QueryParameter parameter;
+        parameter.m_name = StringToLower(item.substr(1, nameEnd - 1));
+        parameter.m_type = StringToLower(Trim(item.substr(nameEnd)));
+        parameter.m_type = parameter.m_type.substr(0, parameter.m_type.find_first_of("( \t"));
+        parameters.push_back(parameter);
+    }
+
+    return true;
+}
 
-    if (!result)
+// ---------------------------------------------------------------------------
+// Method: ParseArguments
+//
+// Description:
+//  This method parses the arguments of a query call - & separated
+//  <name>=<value>, the name with or without its @.
+//
+// Returns:
+//    false if an argument is malformed or given twice.
+//
+static bool
+ParseArguments(
+    const string& arguments,
+    map<string, string>& values)
+{
+    string  name;
+    size_t  equal;
+
+    values.clear();
+
+    for (auto&& item : Split(arguments, '&'))
     {
-        // Open file to write response.
-        //
-        int fd = open(queryResultPath.c_str(), O_RDWR);
-        if (fd == -1)
+        if (item.empty())
         {
-            ReturnErrnoAndPrintError(__FUNCTION__, "open failed");
+            continue;
         }
-        else
+
+        equal = item.find('=');
+        if (equal == string::npos)
         {
-            // Write in the response.
-            //
-            result = pwrite(fd, responseString.c_str(), responseString.length(), 0);
-            if (result == -1)
-            {
-                result = ReturnErrnoAndPrintError(__FUNCTION__, "pwrite failed");
-            }
+            PrintMsg("Invalid query argument \"%s\" - expected <name>=<value>\n", item.c_str());
+            return false;
+        }
 
-            // Close fd after write.
-            //
-            result = close(fd);
-            if (result == -1)
-            {
-                result = ReturnErrnoAndPrintError(__FUNCTION__, "close failed");
-            }
+        name = item.substr(0, equal);
+        if (!name.empty() && name[0] == '@')
+        {
+            name = name.substr(1);
+        }
+
+        if (!IsParameterName(name) ||
+            !values.emplace(StringToLower(name), item.substr(equal + 1)).second)
+        {
+            PrintMsg("Invalid query argument \"%s\"\n", item.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: FormatArgument
+//
+// Description:
+//  This method turns the value of an argument into a literal of the
+//  type of its parameter. Values of integer and decimal types must be
+//  numbers and are passed as such, binary values must be 0x hex. Any
+//  other value is passed as an N'' string literal that the server
+//  converts to the parameter type (date, uniqueidentifier...) - never
+//  as SQL text.
+//
+// Returns:
+//    false if the value is not valid for the type.
+//
+static bool
+FormatArgument(
+    const string& type,
+    const string& value,
+    string& literal)
+{
+    static const set<string>    integerTypes = { "bigint", "int", "smallint", "tinyint", "bit" };
+    static const set<string>    decimalTypes = { "decimal", "numeric", "float", "real", "money", "smallmoney" };
+    char*                       end;
+
+    if (integerTypes.count(type) || decimalTypes.count(type))
+    {
+        if (value.empty() ||
+            value.find_first_not_of(integerTypes.count(type) ? "0123456789+-" : "0123456789+-.eE") != string::npos)
+        {
+            return false;
         }
+
+        strtod(value.c_str(), &end);
+        literal = value;
+
+        return end != value.c_str() && *end == '\0';
     }
+
+    if (type == "binary" || type == "varbinary")
+    {
+        literal = value;
+
+        return value.size() >= 2 && value[0] == '0' && tolower(value[1]) == 'x' &&
+               value.find_first_not_of("0123456789abcdefABCDEF", 2) == string::npos;
+    }
+
+    literal = QuoteLiteral(value);
+
+    return true;
 }
 
 // ---------------------------------------------------------------------------
-// Method: RemoveCustomQueriesOutputFiles
+// Method: BuildQueryBatch
 //
 // Description:
-//  Remove all the files under custom query dump directory.
+//  This method builds the batch that runs a query file with arguments.
+//  A query that declares parameters runs through sp_executesql, so the
+//  server compiles its text once and reuses the plan for any argument.
+//  The query text and the parameter list are passed as string literals
+//  and each argument as a literal of its parameter type. Parameters
+//  without an argument are NULL.
 //
-//  dumpPath - absolute path to a custom query dump directory.
+//  A query without parameters runs as is, and takes no arguments.
 //
 // Returns:
-//    none.
+//    false if the arguments do not match the parameters.
 //
-void 
-RemoveCustomQueriesOutputFiles(
-    DIR* dp,
-    const string& dumpPath)
+static bool
+BuildQueryBatch(
+    const string& query,
+    const string& arguments,
+    string& batch)
 {
-    struct dirent*  de;
-    string          filepath;
+    string                  declarations;
+    vector<QueryParameter>  parameters;
+    map<string, string>     values;
+    string                  literal;
 
-    // Remove old files from custom query dump directory
-    //
-    while ((de = readdir(dp)) != NULL)
+    if (!ParseParameterDeclarations(query, declarations, parameters) ||
+        !ParseArguments(arguments, values))
+    {
+        return false;
+    }
+
+    if (parameters.empty())
     {
-        if (de->d_type == DT_REG)
+        batch = query;
+
+        if (!values.empty())
         {
-            filepath = StringFormat("%s/%s", dumpPath.c_str(), de->d_name);
+            PrintMsg("The query takes no arguments - declare them with a \"%s\" line\n",
+                CUSTOM_QUERY_PARAMS_HEADER);
+            return false;
+        }
 
-            // Do the best to remove the file
-            //
-            (void) remove(filepath.c_str());
+        return true;
+    }
+
+    batch = "EXEC sp_executesql " + QuoteLiteral(query) + ", " + QuoteLiteral(declarations);
+
+    for (auto&& parameter : parameters)
+    {
+        auto value = values.find(parameter.m_name);
+        if (value == values.end())
+        {
+            literal = "NULL";
+        }
+        else if (!FormatArgument(parameter.m_type, value->second, literal))
+        {
+            PrintMsg("Invalid value \"%s\" for parameter @%s %s\n",
+                value->second.c_str(), parameter.m_name.c_str(), parameter.m_type.c_str());
+            return false;
+        }
+        else
+        {
+            values.erase(value);
         }
+
+        batch += ", @" + parameter.m_name + " = " + literal;
+    }
+
+    if (!values.empty())
+    {
+        PrintMsg("Unknown query parameter @%s\n", values.begin()->first.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: SplitCustomQueryCall
+//
+// Description:
+//  This method splits a name of the form <query file>@<arguments>.
+//
+// Returns:
+//    true if the name has arguments - otherwise false.
+//
+bool
+SplitCustomQueryCall(
+    const string& filename,
+    string& queryName,
+    string& arguments)
+{
+    size_t separator = filename.find(CUSTOM_QUERY_ARGS_SEPARATOR);
+
+    if (separator == string::npos || separator == 0)
+    {
+        return false;
+    }
+
+    queryName = filename.substr(0, separator);
+    arguments = filename.substr(separator + 1);
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ValidateCustomQueryCall
+//
+// Description:
+//  This method checks that the arguments match the parameters declared
+//  by the query file.
+//
+// Returns:
+//    bool
+//
+bool
+ValidateCustomQueryCall(
+    const string& queryFilePath,
+    const string& arguments)
+{
+    string query;
+    string batch;
+
+    return GetQueryText(queryFilePath, query) == 0 &&
+           BuildQueryBatch(query, arguments, batch);
+}
+
+// ---------------------------------------------------------------------------
+// Method: ExecuteCustomQuery
+//
+// Description:
+//  This method reads the query from queryFilePath and runs it on the
+//  given server, with the arguments if the query declares parameters.
+//  The output is returned in queryResult.
+//
+//  queryFilePath - absolute path to a file that contains query.
+//  arguments - & separated <name>=<value>, may be empty.
+//  stats - where the query is counted. With the queryStatistics setting
+//  the SET STATISTICS TIME and IO output of the query is kept there.
+//
+// Returns:
+//    0 on success and -1 on error.
+//
+int
+ExecuteCustomQuery(
+    const string& queryFilePath,
+    const string& arguments,
+    ServerInfo* serverInfo,
+    QueryResult& queryResult,
+    QueryStats* stats)
+{
+    string  query;
+    string  batch;
+    int     error;
+
+    error = GetQueryText(queryFilePath, query);
+    if (!error && !BuildQueryBatch(query, arguments, batch))
+    {
+        error = -1;
+    }
+
+    if (!error)
+    {
+        // Execute the query.
+        //
+        // We want the column names as well so use type as TYPE_TSV.
+        // The timeout is looked up by the name of the query file.
+        //
+        error = StartQuery(batch, serverInfo, TYPE_TSV,
+                           GetQueryTimeout(serverInfo,
+                                           queryFilePath.substr(queryFilePath.rfind('/') + 1)),
+                           queryResult, stats, serverInfo->m_queryStatistics);
     }
+
+    return error;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetCustomQueriesDirPath
+//
+// Description:
+//  Get the path (relative to the mount directory) of the custom query
+//  directory of a server.
+//
+// Returns:
+//    Path of the form /<servername>/customQueries.
+//
+string
+GetCustomQueriesDirPath(
+    const string& servername)
+{
+    return StringFormat("/%s/%s", servername.c_str(), CUSTOM_QUERY_FOLDER_NAME);
 }
 
 // ---------------------------------------------------------------------------
-// Method: CreateCustomQueriesOutputFiles
+// Method: SyncCustomQueriesOutputFiles
 //
 // Description:
-//  Create 
+//  Make the custom query output files of the server match the query
+//  files in the custom query directory the user specified. Output files
+//  of queries that were removed are dropped from the virtual tree and
+//  files for new queries are added. Unchanged entries are left as is, so
+//  readers of those files are not affected.
 //
-//  dumpPath - absolute path to a custom query dump directory.
+//  Adding, removing or renaming a file updates the modification time of
+//  the directory, so the directory is only read again when that changed
+//  since the last sync. Repeated listings only cost one stat.
 //
 // Returns:
 //    none.
 //
 void 
-CreateCustomQueriesOutputFiles(
-    const string& servername,
-    const string& dumpPath)
+SyncCustomQueriesOutputFiles(
+    const string& servername)
 {
     DIR*            userQueriesDir;
     string          userQueriesPath;
-    string          filepath;
+    string          dirPath;
     struct dirent*  de;
+    struct stat     statbuf;
+    bool            dirExists = true;
+    set<string>     queryFiles;
+    vector<string>  outputFiles;
+
+    dirPath = GetCustomQueriesDirPath(servername);
 
     userQueriesPath = GetUserCustomQueryPath(servername);
-    if (!userQueriesPath.empty())
+    if (userQueriesPath.empty() ||
+        stat(userQueriesPath.c_str(), &statbuf) == -1)
+    {
+        // No query directory - leave no output files behind.
+        //
+        memset(&statbuf, 0, sizeof(statbuf));
+        dirExists = false;
+    }
+
+    std::lock_guard<std::mutex> guard(g_CustomQueryLock);
+
+    auto syncTime = g_QueryDirSyncTime.find(servername);
+    if (syncTime != g_QueryDirSyncTime.end() &&
+        IsSameTime(syncTime->second, statbuf.st_mtim))
+    {
+        return;
+    }
+    g_QueryDirSyncTime[servername] = statbuf.st_mtim;
+
+    if (dirExists)
     {
         // Open user customQueries dir 
         //
@@ -144,14 +603,57 @@ CreateCustomQueriesOutputFiles(
             {
                 if (de->d_type == DT_REG)
                 {
-                    // Create new files with the same name in
-                    // the dump directory for storing results
-                    //
-                    filepath = StringFormat("%s/%s", dumpPath.c_str(), de->d_name);
-                    CreateFile(filepath.c_str());
+                    queryFiles.insert(de->d_name);
                 }
             }
             closedir(userQueriesDir);
         }
     }
+
+    // Drop the output files (and the cached text) of removed queries.
+    //
+    if (g_VirtualTree.ListDirectory(dirPath, outputFiles))
+    {
+        for (auto&& name : outputFiles)
+        {
+            if (queryFiles.erase(name) == 0)
+            {
+                g_VirtualTree.RemoveFile(VirtualTree::JoinPath(dirPath, name));
+                g_QueryTextCache.erase(
+                    StringFormat("%s/%s", userQueriesPath.c_str(), name.c_str()));
+            }
+        }
+    }
+
+    // Add output files for the new queries.
+    //
+    for (auto&& name : queryFiles)
+    {
+        g_VirtualTree.AddFile(
+            VirtualTree::JoinPath(dirPath, name),
+            ENTRY_CUSTOM_QUERY,
+            servername,
+            name);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: ForgetCustomQueries
+//
+// Description:
+//  Forget the modification time of the query directory of a server at
+//  its last sync. The output files went away with the folder of the
+//  server, and a server added back under the same name must get them
+//  again even though the directory did not change.
+//
+// Returns:
+//    VOID
+//
+void
+ForgetCustomQueries(
+    const string& servername)
+{
+    std::lock_guard<std::mutex> guard(g_CustomQueryLock);
+
+    g_QueryDirSyncTime.erase(servername);
 }
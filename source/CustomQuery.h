@@ -6,7 +6,9 @@
 //
 // Purpose:
 //   This file contains declarations of functions used to enable custom
-//   query support.
+//   query support. A query file declaring parameters can be opened with
+//   arguments:
+//      customQueries/<query file>@<name>=<value>&<name>=<value>
 //
 #pragma once
 
@@ -14,24 +16,63 @@
 //
 #define CUSTOM_QUERY_FOLDER_NAME                    "customQueries"
 
-// Execute a user custom query
+// Separator between the query file name and its arguments.
 //
-void
+#define CUSTOM_QUERY_ARGS_SEPARATOR                 '@'
+
+// Start of the line of a query file declaring its parameters, in the
+// form of the parameter list of sp_executesql, e.g.
+//    -- params: @db sysname, @min_wait_ms int
+//
+#define CUSTOM_QUERY_PARAMS_HEADER                  "-- params:"
+
+// Suffix of the file showing the SET STATISTICS TIME and IO output of the
+// last run of a custom query, with the queryStatistics setting:
+//    customQueries/<query file>.stats
+//
+#define CUSTOM_QUERY_STATISTICS_SUFFIX              ".stats"
+
+// Execute a user custom query - with the given arguments if the query
+// declares parameters.
+//
+int
 ExecuteCustomQuery(
     const string& queryFilePath,
-    const string& queryResultPath,
-    const string& hostname,
-    const string& username,
-    const string& password);
+    const string& arguments,
+    ServerInfo* serverInfo,
+    QueryResult& queryResult,
+    QueryStats* stats);
+
+// Split a custom query file name into the query file name and its
+// arguments. Returns false if the name has no arguments.
+//
+bool
+SplitCustomQueryCall(
+    const string& filename,
+    string& queryName,
+    string& arguments);
+
+// Check that the arguments are valid for the parameters the query file
+// declares.
+//
+bool
+ValidateCustomQueryCall(
+    const string& queryFilePath,
+    const string& arguments);
+
+// Get the path of the custom query directory of a server.
+//
+string
+GetCustomQueriesDirPath(
+    const string& servername);
 
-// Remove all the output files in custom query dump directory.
+// Sync the custom query output files with the user's query files.
 //
-void RemoveCustomQueriesOutputFiles(
-    DIR* dp,
-    const string& dumpPath);
+void SyncCustomQueriesOutputFiles(
+    const string& servername);
 
-// Create output files in custom query dump directory.
+// Forget the last sync of a server whose folder was removed, so that the
+// next sync adds its output files again.
 //
-void CreateCustomQueriesOutputFiles(
-    const string& servername,
-    const string& dumpPath);
\ No newline at end of file
+void ForgetCustomQueries(
+    const string& servername);
@@ -0,0 +1,370 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: DeltaTracker.cpp
+//
+// Purpose:
+//   This file contains the definitions of the delta files of cumulative
+//   DMVs.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Method: GetDefaultDeltaKeys
+//
+// Description:
+//    This method gets the key columns of the cumulative DMVs that have a
+//    delta file by default. The deltaKeys setting of a server adds DMVs
+//    to these or changes their keys.
+//
+// Returns:
+//    Key columns by DMV name.
+//
+unordered_map<string, vector<string>>
+GetDefaultDeltaKeys()
+{
+    return {
+        { "dm_os_wait_stats",           { "wait_type" } },
+        { "dm_io_virtual_file_stats",   { "database_id", "file_id" } },
+        { "dm_os_performance_counters", { "object_name", "counter_name", "instance_name" } },
+    };
+}
+
+// ---------------------------------------------------------------------------
+// Method: SplitRecord
+//
+// Description:
+//    This method splits a TSV line into its values. Unlike Split, empty
+//    values are kept so that the values stay under their column.
+//
+// Returns:
+//    The values.
+//
+static vector<string>
+SplitRecord(
+    const string& data,
+    size_t start,
+    size_t end)
+{
+    vector<string>  values;
+    size_t          tab;
+
+    for (;;)
+    {
+        tab = data.find('\t', start);
+        if (tab == string::npos || tab >= end)
+        {
+            values.push_back(data.substr(start, end - start));
+            return values;
+        }
+
+        values.push_back(data.substr(start, tab - start));
+        start = tab + 1;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: ParseNumber
+//
+// Description:
+//    This method parses a decimal value. Integers are kept as integers
+//    so that large counters do not lose precision. Hexadecimal values
+//    (binary columns) and values with other text are not numbers.
+//
+// Returns:
+//    true if the value is a number.
+//
+static bool
+ParseNumber(
+    const string& value,
+    long long& integer,
+    double& real,
+    bool& isInteger)
+{
+    char* end;
+
+    if (value.empty() || value.find_first_not_of("0123456789+-.eE") != string::npos)
+    {
+        return false;
+    }
+
+    errno = 0;
+    integer = strtoll(value.c_str(), &end, 10);
+    if (*end == '\0' && errno == 0)
+    {
+        real = (double)integer;
+        isInteger = true;
+        return true;
+    }
+
+    real = strtod(value.c_str(), &end);
+    isInteger = false;
+
+    return end != value.c_str() && *end == '\0';
+}
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+DeltaTracker::DeltaTracker(
+    const string& servername,
+    const unordered_map<string, vector<string>>& keys) :
+    m_servername(servername),
+    m_keys(keys)
+{
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsTracked
+//
+// Returns:
+//    true if the DMV has a delta file.
+//
+bool
+DeltaTracker::IsTracked(
+    const string& dmvName) const
+{
+    return m_keys.count(dmvName) != 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetDelta
+//
+// Description:
+//    This method computes the deltas of a TSV snapshot of the DMV since
+//    the previous snapshot, and keeps it as the previous snapshot for
+//    the next call.
+//
+//    The output is TSV: the interval in milliseconds, the key columns,
+//    then the other columns of the DMV in their order. A column whose
+//    values are all numbers gets the difference with the previous row
+//    of the same key, followed by a <column>_per_sec column with the
+//    rate. Other columns show their current value. The difference and
+//    the rate are empty for the first snapshot and for rows whose key
+//    was not in the previous snapshot. A counter that was reset (e.g.
+//    the server restarted) shows a negative difference.
+//
+// Returns:
+//    0 on success, -1 on error.
+//
+int
+DeltaTracker::GetDelta(
+    const string& dmvName,
+    const QueryResult& snapshot,
+    QueryResult& output)
+{
+    auto                                keyItr = m_keys.find(dmvName);
+    string                              data;
+    vector<string>                      header;
+    vector<vector<string>>              rows;
+    vector<size_t>                      keyColumns;
+    vector<bool>                        isKey;
+    vector<bool>                        isNumeric;
+    vector<bool>                        hasValue;
+    unordered_map<string, size_t>       previousColumns;
+    unordered_map<string, vector<string>> currentRows;
+    string                              line;
+    string                              key;
+    long long                           currentInteger;
+    long long                           previousInteger;
+    double                              current;
+    double                              previous;
+    bool                                currentIsInteger;
+    bool                                previousIsInteger;
+    std::chrono::steady_clock::time_point snapshotTime;
+    double                              seconds;
+    size_t                              start;
+    size_t                              end;
+    bool                                usable;
+
+    if (keyItr == m_keys.end() || !snapshot)
+    {
+        return -1;
+    }
+
+    // Registered as a reader so that a streaming result is not cancelled
+    // while it is being copied.
+    //
+    snapshot->AddReader();
+    data = snapshot->ToString();
+    usable = snapshot->IsUsable();
+    snapshotTime = snapshot->GetCompletionTime();
+    snapshot->RemoveReader();
+
+    if (!usable)
+    {
+        return -1;
+    }
+
+    for (start = 0; start < data.size(); start = end + 1)
+    {
+        end = data.find('\n', start);
+        if (end == string::npos)
+        {
+            end = data.size();
+        }
+
+        if (start == 0)
+        {
+            header = SplitRecord(data, start, end);
+        }
+        else if (end > start)
+        {
+            rows.push_back(SplitRecord(data, start, end));
+            rows.back().resize(header.size());
+        }
+    }
+
+    isKey.assign(header.size(), false);
+    for (auto&& keyName : keyItr->second)
+    {
+        auto column = find(header.begin(), header.end(), keyName);
+        if (column == header.end())
+        {
+            PrintMsg("%s of server %s has no key column %s for its delta file\n",
+                dmvName.c_str(), m_servername.c_str(), keyName.c_str());
+            return -1;
+        }
+
+        keyColumns.push_back(column - header.begin());
+        isKey[keyColumns.back()] = true;
+    }
+
+    // A column is a counter if all its values are numbers.
+    //
+    isNumeric.assign(header.size(), true);
+    hasValue.assign(header.size(), false);
+    for (auto&& row : rows)
+    {
+        for (size_t i = 0; i < header.size(); i++)
+        {
+            if (!row[i].empty())
+            {
+                hasValue[i] = true;
+                isNumeric[i] = isNumeric[i] &&
+                    ParseNumber(row[i], currentInteger, current, currentIsInteger);
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    Snapshot& last = m_snapshots[dmvName];
+
+    if (last.m_output && last.m_source.lock() == snapshot)
+    {
+        output = last.m_output;
+        return 0;
+    }
+
+    // The interval is between the two snapshots rather than between the
+    // opens of the file, which can be much later for a cached or
+    // prefetched snapshot.
+    //
+    seconds = last.m_output ?
+        max(std::chrono::duration<double>(snapshotTime - last.m_time).count(), 0.0) : 0;
+
+    for (size_t i = 0; i < last.m_header.size(); i++)
+    {
+        previousColumns[last.m_header[i]] = i;
+    }
+
+    output = make_shared<ResultBuffer>();
+
+    line = DELTA_INTERVAL_COLUMN;
+    for (auto&& column : keyColumns)
+    {
+        line += "\t" + header[column];
+    }
+    for (size_t i = 0; i < header.size(); i++)
+    {
+        if (!isKey[i])
+        {
+            line += "\t" + header[i];
+            if (isNumeric[i] && hasValue[i])
+            {
+                line += "\t" + header[i] + DELTA_RATE_SUFFIX;
+            }
+        }
+    }
+    line += "\n";
+    output->Append(line.data(), line.size());
+
+    for (auto&& row : rows)
+    {
+        key.clear();
+        for (auto&& column : keyColumns)
+        {
+            key += row[column] + "\t";
+        }
+
+        auto previousRow = last.m_rows.find(key);
+
+        line = StringFormat("%lld", (long long)(seconds * 1000));
+
+        for (auto&& column : keyColumns)
+        {
+            line += "\t" + row[column];
+        }
+
+        for (size_t i = 0; i < header.size(); i++)
+        {
+            if (isKey[i])
+            {
+                continue;
+            }
+
+            if (!isNumeric[i] || !hasValue[i])
+            {
+                line += "\t" + row[i];
+                continue;
+            }
+
+            // Joined on the column name, in case the columns moved since
+            // the previous snapshot.
+            //
+            auto previousColumn = previousColumns.find(header[i]);
+
+            if (previousRow == last.m_rows.end() ||
+                previousColumn == previousColumns.end() ||
+                !ParseNumber(row[i], currentInteger, current, currentIsInteger) ||
+                !ParseNumber(previousRow->second[previousColumn->second],
+                             previousInteger, previous, previousIsInteger))
+            {
+                line += "\t\t";
+                continue;
+            }
+
+            if (currentIsInteger && previousIsInteger)
+            {
+                line += StringFormat("\t%lld", currentInteger - previousInteger);
+            }
+            else
+            {
+                line += StringFormat("\t%.15g", current - previous);
+            }
+
+            line += "\t";
+            if (seconds > 0)
+            {
+                line += StringFormat("%.3f", (current - previous) / seconds);
+            }
+        }
+
+        line += "\n";
+        output->Append(line.data(), line.size());
+
+        currentRows[key] = std::move(row);
+    }
+
+    output->Complete(0);
+
+    last.m_source = snapshot;
+    last.m_time = snapshotTime;
+    last.m_header = std::move(header);
+    last.m_rows = std::move(currentRows);
+    last.m_output = output;
+
+    return 0;
+}
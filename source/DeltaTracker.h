@@ -0,0 +1,87 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: DeltaTracker.h
+//
+// Purpose:
+//   This file contains the declaration of the delta files of cumulative
+//   DMVs - <DMV>.delta has the change of each counter since the previous
+//   snapshot of the DMV.
+//
+#pragma once
+
+// Extension of the delta file of a DMV, and name of its column holding
+// the time between the two snapshots.
+//
+#define DELTA_FILE_EXTENSION        ".delta"
+#define DELTA_INTERVAL_COLUMN       "interval_ms"
+
+// Suffix of the column holding the per second rate of a counter.
+//
+#define DELTA_RATE_SUFFIX           "_per_sec"
+
+// Gets the key columns of the cumulative DMVs that have a delta file
+// without any setting - dm_os_wait_stats, dm_io_virtual_file_stats and
+// dm_os_performance_counters.
+//
+unordered_map<string, vector<string>>
+GetDefaultDeltaKeys();
+
+//--------------------------------------------------------------------
+// Class: DeltaTracker
+//
+// Description:
+//  Keeps the previous snapshot of each delta DMV of one server and
+//  turns a new TSV snapshot into its deltas. The rows of the two
+//  snapshots are matched on the key columns of the DMV with a hash
+//  join. Each numeric column gets its difference and its per second
+//  rate; the other columns show their current value.
+//
+//  The snapshot comes from the TSV file of the DMV (its result cache
+//  and prefetch setting apply), so a delta costs one query. A snapshot
+//  that is handed in again (a cache hit) gets the same deltas as the
+//  first time. The previous snapshot is shared by all the readers of
+//  the server - each delta covers the time between the completion of
+//  the snapshot read by the previous open of the file (by anyone) and
+//  that of the current one.
+//
+class DeltaTracker
+{
+public:
+    // Constructor. keys maps the DMVs that have a delta file to their
+    // key columns.
+    //
+    DeltaTracker(
+        const string& servername,
+        const unordered_map<string, vector<string>>& keys);
+
+    // Checks if the DMV has a delta file.
+    //
+    bool IsTracked(
+        const string& dmvName) const;
+
+    // Sets output to the deltas of the TSV snapshot since the previous
+    // one. Returns 0 on success and -1 if the snapshot failed or does
+    // not have the key columns.
+    //
+    int GetDelta(
+        const string& dmvName,
+        const QueryResult& snapshot,
+        QueryResult& output);
+
+private:
+    struct Snapshot
+    {
+        std::weak_ptr<ResultBuffer>             m_source;   // Result the rows were read from
+        std::chrono::steady_clock::time_point   m_time;     // When its query completed
+        vector<string>                          m_header;
+        unordered_map<string, vector<string>>   m_rows;     // By joined key values
+        QueryResult                             m_output;   // Deltas computed from it
+    };
+
+    string                                      m_servername;
+    unordered_map<string, vector<string>>       m_keys;
+    unordered_map<string, Snapshot>             m_snapshots;    // By DMV name
+    std::mutex                                  m_lock;
+};
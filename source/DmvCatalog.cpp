@@ -0,0 +1,593 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: DmvCatalog.cpp
+//
+// Purpose:
+//   This file contains the definitions of the DMV catalog of a server and
+//   of its cache file.
+//
+#include "UtilsPrivate.h"
+
+// Lines of a catalog cache file before the DMV names.
+//
+#define CATALOG_HOST_KEY        "host="
+#define CATALOG_VERSION_KEY     "version="
+
+// ---------------------------------------------------------------------------
+// State of the catalog check thread.
+//
+static thread                   g_CatalogRefreshThread;
+static std::mutex               g_CatalogRefreshLock;
+static std::condition_variable  g_CatalogRefreshWakeup;
+static bool                     g_CatalogRefreshStop = false;
+
+// ---------------------------------------------------------------------------
+// Method: GetDmvFilePaths
+//
+// Description:
+//    This method gets the files a DMV has in a server folder - TSV, CSV,
+//    NDJSON, for servers that build it, JSON, and for the cumulative
+//    DMVs with key columns, delta.
+//
+// Returns:
+//    Pairs of file path and entry type.
+//
+static vector<pair<string, VirtualEntryType>>
+GetDmvFilePaths(
+    const string& serverPath,
+    const string& dmvName,
+    const ServerInfo* serverInfo)
+{
+    const int version = serverInfo->m_version;
+
+    vector<pair<string, VirtualEntryType>> paths;
+
+    paths.push_back(make_pair(VirtualTree::JoinPath(serverPath, dmvName), ENTRY_DMV));
+
+    // Only for SQL Server 2016 (version 16) does the method create the .json.
+    //
+    if (version >= 16)
+    {
+        paths.push_back(make_pair(
+            VirtualTree::JoinPath(serverPath, dmvName + GetFileFormatExtension(TYPE_JSON)),
+            ENTRY_JSON_DMV));
+    }
+
+    // The CSV and NDJSON files are built from the rows by DBFS so they do
+    // not depend on the server version.
+    //
+    paths.push_back(make_pair(
+        VirtualTree::JoinPath(serverPath, dmvName + GetFileFormatExtension(TYPE_CSV)),
+        ENTRY_CSV_DMV));
+    paths.push_back(make_pair(
+        VirtualTree::JoinPath(serverPath, dmvName + GetFileFormatExtension(TYPE_NDJSON)),
+        ENTRY_NDJSON_DMV));
+
+    if (serverInfo->m_deltaTracker && serverInfo->m_deltaTracker->IsTracked(dmvName))
+    {
+        paths.push_back(make_pair(
+            VirtualTree::JoinPath(serverPath, dmvName + DELTA_FILE_EXTENSION),
+            ENTRY_DELTA_DMV));
+    }
+
+    return paths;
+}
+
+// ---------------------------------------------------------------------------
+// Method: MakeDirectories
+//
+// Description:
+//    This method creates a directory and the missing directories above
+//    it, like mkdir -p.
+//
+// Returns:
+//    true if the directory exists.
+//
+static bool
+MakeDirectories(
+    const string& path)
+{
+    struct stat statbuf;
+    size_t      slash = 0;
+
+    while ((slash = path.find('/', slash + 1)) != string::npos)
+    {
+        mkdir(path.substr(0, slash).c_str(), DEFAULT_PERMISSIONS);
+    }
+    mkdir(path.c_str(), DEFAULT_PERMISSIONS);
+
+    return stat(path.c_str(), &statbuf) == 0 && S_ISDIR(statbuf.st_mode);
+}
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+DmvCatalog::DmvCatalog(
+    const string& servername,
+    ServerInfo* serverInfo) :
+    m_servername(servername),
+    m_serverInfo(serverInfo),
+    m_loaded(false)
+{
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetCachePath
+//
+// Description:
+//    This method gets the path of the cache file of the server -
+//    <catalog cache directory>/<server name>.catalog.
+//
+// Returns:
+//    The path - empty if catalogs are not cached.
+//
+string
+DmvCatalog::GetCachePath() const
+{
+    if (g_UserPaths.m_catalogCachePath.empty())
+    {
+        return string();
+    }
+
+    return g_UserPaths.m_catalogCachePath + LINUX_PATH_DELIM +
+           StringReplace(m_servername, '/', '_') + SQLFS_CATALOG_FILE_EXTENSION;
+}
+
+// ---------------------------------------------------------------------------
+// Method: LoadCache
+//
+// Description:
+//    This method reads the cache file of the server and adds its DMV
+//    files to the tree. A cache file written for another host name is
+//    ignored. Called at mount - nothing is asked from the server.
+//
+// Returns:
+//    true if the catalog was loaded from the cache file.
+//
+bool
+DmvCatalog::LoadCache()
+{
+    string          path = GetCachePath();
+    string          line;
+    string          host;
+    string          version;
+    vector<string>  dmvNames;
+
+    if (path.empty())
+    {
+        return false;
+    }
+
+    ifstream file(path);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    while (getline(file, line))
+    {
+        if (IsPrefix(CATALOG_HOST_KEY, line) == 0)
+        {
+            host = line.substr(strlen(CATALOG_HOST_KEY));
+        }
+        else if (IsPrefix(CATALOG_VERSION_KEY, line) == 0)
+        {
+            version = line.substr(strlen(CATALOG_VERSION_KEY));
+        }
+        else if (!line.empty())
+        {
+            dmvNames.push_back(line);
+        }
+    }
+
+    if (host != m_serverInfo->m_hostname || dmvNames.empty())
+    {
+        LogMsg(LOG_LEVEL_INFO, "Ignoring the catalog cache %s of server %s\n",
+            path.c_str(), m_servername.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(m_discoverLock);
+
+    Publish(version, dmvNames);
+
+    PrintMsg("Loaded %zu DMV(s) of server %s from %s\n",
+        dmvNames.size(), m_servername.c_str(), path.c_str());
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: EnsureLoaded
+//
+// Description:
+//    This method discovers the DMVs of the server unless they are in the
+//    tree already. Callers that look up a path of the server folder wait
+//    for the discovery - concurrent callers share it.
+//
+// Returns:
+//    VOID
+//
+void
+DmvCatalog::EnsureLoaded()
+{
+    string          version;
+    vector<string>  dmvNames;
+
+    if (m_loaded)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(m_discoverLock);
+
+    if (m_loaded || std::chrono::steady_clock::now() < m_nextAttempt)
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (Discover(version, dmvNames))
+    {
+        Publish(version, dmvNames);
+        Save(version, dmvNames);
+
+        PrintMsg("Discovered %zu DMV(s) of server %s in %lld ms\n",
+            dmvNames.size(), m_servername.c_str(), ElapsedMs(start));
+    }
+    else
+    {
+        PrintMsg("Failed to query the DMV list of server %s - retrying in %d s\n",
+            m_servername.c_str(), SQLFS_CATALOG_RETRY_SEC);
+
+        m_nextAttempt = std::chrono::steady_clock::now() +
+                        std::chrono::seconds(SQLFS_CATALOG_RETRY_SEC);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: Refresh
+//
+// Description:
+//    This method compares the @@version of the server with the one the
+//    DMV files were read from, and discovers them again if it changed
+//    (the server was upgraded or the host name now points elsewhere).
+//    Catalogs that are not loaded yet are left alone - they are read
+//    from the server when first used.
+//
+// Returns:
+//    VOID
+//
+void
+DmvCatalog::Refresh()
+{
+    string          version;
+    string          loadedVersion;
+    vector<string>  dmvNames;
+
+    if (!m_loaded || !QueryVersion(version))
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        loadedVersion = m_version;
+    }
+
+    if (version == loadedVersion)
+    {
+        return;
+    }
+
+    PrintMsg("Server %s is now %s - refreshing its DMV list\n",
+        m_servername.c_str(), version.c_str());
+
+    std::lock_guard<std::mutex> guard(m_discoverLock);
+
+    if (Discover(version, dmvNames))
+    {
+        Publish(version, dmvNames);
+        Save(version, dmvNames);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: QueryVersion
+//
+// Description:
+//    This method gets the @@version of the server. Its line breaks and
+//    tabs are replaced with spaces so that it fits on one line.
+//
+// Returns:
+//    bool
+//
+bool
+DmvCatalog::QueryVersion(
+    string& version)
+{
+    string          response;
+    vector<string>  lines;
+
+    if (ExecuteQuery("SELECT REPLACE(REPLACE(REPLACE(@@version, CHAR(13), ' '), "
+                     "CHAR(10), ' '), CHAR(9), ' ') AS version",
+                     response, m_serverInfo, TYPE_TSV))
+    {
+        return false;
+    }
+
+    // The first line is the column name.
+    //
+    lines = Split(response, '\n');
+    if (lines.size() < 2)
+    {
+        return false;
+    }
+
+    version = Trim(lines[1]);
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Discover
+//
+// Description:
+//    This method asks the server for its version and its DMVs.
+//
+//    ** Note **
+//    schema_id = 4 selects DMV's (leaves out INFORMATION_SCHEMA).
+//
+// Returns:
+//    true if the server returned at least one DMV.
+//
+bool
+DmvCatalog::Discover(
+    string& version,
+    vector<string>& dmvNames)
+{
+    string          response;
+    vector<string>  lines;
+
+    dmvNames.clear();
+
+    if (!QueryVersion(version) ||
+        ExecuteQuery("SELECT name from sys.system_views where schema_id = 4",
+                     response, m_serverInfo, TYPE_TSV))
+    {
+        return false;
+    }
+
+    // We need to skip the first name because the result of the SQL Query
+    // includes the name of the column as well in the output.
+    //
+    lines = Split(response, '\n');
+    for (size_t i = 1; i < lines.size(); i++)
+    {
+        if (!lines[i].empty())
+        {
+            dmvNames.push_back(lines[i]);
+        }
+    }
+
+    return !dmvNames.empty();
+}
+
+// ---------------------------------------------------------------------------
+// Method: Publish
+//
+// Description:
+//    This method makes the tree have the files of the DMVs given - the
+//    files of the DMVs the server no longer has are removed, those of
+//    new DMVs are added and the fan-out folder gets the new DMVs. Caller
+//    holds m_discoverLock.
+//
+// Returns:
+//    VOID
+//
+void
+DmvCatalog::Publish(
+    const string& version,
+    const vector<string>& dmvNames)
+{
+    string      serverPath = LINUX_PATH_DELIM + m_servername;
+    set<string> names(dmvNames.begin(), dmvNames.end());
+
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    for (auto&& dmvName : m_dmvNames)
+    {
+        if (names.count(dmvName) == 0)
+        {
+            for (auto&& file : GetDmvFilePaths(serverPath, dmvName, m_serverInfo))
+            {
+                g_VirtualTree.RemoveFile(file.first);
+            }
+        }
+    }
+
+    for (auto&& dmvName : names)
+    {
+        if (m_dmvNames.count(dmvName) == 0)
+        {
+            for (auto&& file : GetDmvFilePaths(serverPath, dmvName, m_serverInfo))
+            {
+                g_VirtualTree.AddFile(file.first, file.second, m_servername, dmvName);
+            }
+        }
+    }
+
+    AddFanOutFiles(dmvNames);
+
+    m_dmvNames = names;
+    m_version = version;
+    m_loaded = true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Save
+//
+// Description:
+//    This method writes the cache file of the server. It is written
+//    next to its final name and renamed, so a mount never reads a
+//    partial file. Failing to write it is not fatal.
+//
+// Returns:
+//    VOID
+//
+void
+DmvCatalog::Save(
+    const string& version,
+    const vector<string>& dmvNames)
+{
+    string path = GetCachePath();
+    string tempPath = path + ".tmp";
+
+    if (path.empty())
+    {
+        return;
+    }
+
+    if (!MakeDirectories(g_UserPaths.m_catalogCachePath))
+    {
+        PrintMsg("Could not create the catalog cache directory %s\n",
+            g_UserPaths.m_catalogCachePath.c_str());
+        return;
+    }
+
+    {
+        std::ofstream file(tempPath, ios::trunc);
+
+        file << CATALOG_HOST_KEY << m_serverInfo->m_hostname << "\n";
+        file << CATALOG_VERSION_KEY << version << "\n";
+        for (auto&& dmvName : dmvNames)
+        {
+            file << dmvName << "\n";
+        }
+
+        if (!file.good())
+        {
+            PrintMsg("Could not write the catalog cache %s\n", tempPath.c_str());
+            return;
+        }
+    }
+
+    if (rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        PrintMsg("Could not rename %s - %s\n", tempPath.c_str(), strerror(errno));
+        unlink(tempPath.c_str());
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: RefreshAllCatalogs
+//
+// Description:
+//    Body of the catalog check thread. The first check runs right after
+//    mount, so catalogs loaded from their cache file are corrected
+//    quickly if a server changed since the previous mount.
+//
+// Returns:
+//    VOID
+//
+static void
+RefreshAllCatalogs()
+{
+    std::unique_lock<std::mutex> guard(g_CatalogRefreshLock);
+
+    while (!g_CatalogRefreshStop)
+    {
+        guard.unlock();
+
+        vector<pair<string, shared_ptr<ServerInfo>>> servers = GetServerInfoList();
+
+        RunInParallel(servers.size(), SQLFS_MAX_STARTUP_WORKERS,
+            [&servers](size_t item)
+            {
+                if (servers[item].second->m_catalog)
+                {
+                    servers[item].second->m_catalog->Refresh();
+                }
+            });
+
+        guard.lock();
+        g_CatalogRefreshWakeup.wait_for(guard,
+            std::chrono::seconds(SQLFS_CATALOG_CHECK_INTERVAL_SEC),
+            [] { return g_CatalogRefreshStop; });
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: StartCatalogRefresh
+//
+// Description:
+//    This method starts the catalog check thread. It must be called after
+//    FUSE forked the daemon.
+//
+// Returns:
+//    VOID
+//
+void
+StartCatalogRefresh()
+{
+    if (g_CatalogRefreshThread.joinable())
+    {
+        return;
+    }
+
+    g_CatalogRefreshStop = false;
+    g_CatalogRefreshThread = thread(RefreshAllCatalogs);
+}
+
+// ---------------------------------------------------------------------------
+// Method: StopCatalogRefresh
+//
+// Description:
+//    This method stops the catalog check thread, waiting for the check
+//    in progress.
+//
+// Returns:
+//    VOID
+//
+void
+StopCatalogRefresh()
+{
+    {
+        std::lock_guard<std::mutex> guard(g_CatalogRefreshLock);
+        g_CatalogRefreshStop = true;
+    }
+    g_CatalogRefreshWakeup.notify_all();
+
+    if (g_CatalogRefreshThread.joinable())
+    {
+        g_CatalogRefreshThread.join();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: LoadAllDmvCatalogs
+//
+// Description:
+//    This method makes sure the catalogs of all the servers are loaded.
+//    Used by the fan-out folder, which lists the DMVs of every server.
+//
+// Returns:
+//    VOID
+//
+void
+LoadAllDmvCatalogs()
+{
+    vector<pair<string, shared_ptr<ServerInfo>>> servers = GetServerInfoList();
+
+    RunInParallel(servers.size(), SQLFS_MAX_STARTUP_WORKERS,
+        [&servers](size_t item)
+        {
+            if (servers[item].second->m_catalog)
+            {
+                servers[item].second->m_catalog->EnsureLoaded();
+            }
+        });
+}
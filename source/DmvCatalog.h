@@ -0,0 +1,116 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: DmvCatalog.h
+//
+// Purpose:
+//   This file contains the declaration of the list of DMVs of a server -
+//   discovered on first use and cached on disk across mounts.
+//
+#pragma once
+
+// Extension of the catalog cache files - one per server in the catalog
+// cache directory.
+//
+#define SQLFS_CATALOG_FILE_EXTENSION        ".catalog"
+
+// How long after a failed discovery the server is asked again, and how
+// often the server version of the loaded catalogs is checked.
+//
+#define SQLFS_CATALOG_RETRY_SEC             10
+#define SQLFS_CATALOG_CHECK_INTERVAL_SEC    600
+
+//--------------------------------------------------------------------
+// Class: DmvCatalog
+//
+// Description:
+//  DMV files of one server. Nothing is asked from the server at mount:
+//  the catalog is either loaded from its cache file (written by a
+//  previous mount) or discovered the first time the server folder is
+//  listed or a path in it is looked up.
+//
+//  The cache file holds the @@version of the server the list was read
+//  from. A background check (see StartCatalogRefresh) compares it with
+//  the current @@version of the server, and the DMV files and the cache
+//  file are refreshed when the server version changed.
+//
+class DmvCatalog
+{
+public:
+    // Constructor. Nothing is loaded until LoadCache or EnsureLoaded.
+    //
+    DmvCatalog(
+        const string& servername,
+        ServerInfo* serverInfo);
+
+    // Adds the DMV files of the cache file to the tree, if there is a
+    // cache file for this server. Returns true if it was loaded.
+    //
+    bool LoadCache();
+
+    // Makes sure the DMV files are in the tree, asking the server for
+    // them the first time. Failed discoveries are retried after
+    // SQLFS_CATALOG_RETRY_SEC.
+    //
+    void EnsureLoaded();
+
+    // Checks the server version of a loaded catalog and discovers the
+    // DMVs again if the version changed.
+    //
+    void Refresh();
+
+private:
+    // Asks the server for its version and DMV list.
+    //
+    bool Discover(
+        string& version,
+        vector<string>& dmvNames);
+
+    // Gets the @@version of the server on one line.
+    //
+    bool QueryVersion(
+        string& version);
+
+    // Replaces the DMV files of the server in the tree.
+    //
+    void Publish(
+        const string& version,
+        const vector<string>& dmvNames);
+
+    // Writes the cache file.
+    //
+    void Save(
+        const string& version,
+        const vector<string>& dmvNames);
+
+    // Path of the cache file - empty if catalogs are not cached.
+    //
+    string GetCachePath() const;
+
+    string                                  m_servername;
+    ServerInfo*                             m_serverInfo;
+    std::atomic<bool>                       m_loaded;       // DMV files are in the tree
+    string                                  m_version;      // Version they were read from
+    set<string>                             m_dmvNames;     // DMVs in the tree
+    std::chrono::steady_clock::time_point   m_nextAttempt;  // Of a discovery after a failure
+    std::mutex                              m_discoverLock; // One discovery at a time
+    std::mutex                              m_lock;         // m_version and m_dmvNames
+};
+
+// Starts the thread checking the server version of the catalogs - right
+// away, then every SQLFS_CATALOG_CHECK_INTERVAL_SEC.
+//
+void
+StartCatalogRefresh();
+
+// Stops the catalog check thread.
+//
+void
+StopCatalogRefresh();
+
+// Makes sure the catalogs of all the servers are loaded, discovering
+// several at a time.
+//
+void
+LoadAllDmvCatalogs();
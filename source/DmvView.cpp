@@ -0,0 +1,388 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: DmvView.cpp
+//
+// Purpose:
+//   This file contains the definitions of the DMV views.
+//
+//   Column names and the DMV name only reach the generated query after
+//   they are checked against the catalog of the server (or, for the DMV
+//   name, restricted to identifier characters). Values are always sent
+//   as quoted string literals.
+//
+#include "UtilsPrivate.h"
+
+// Largest TOP accepted.
+//
+#define DMV_VIEW_MAX_TOP        1000000
+
+// Columns of the DMVs already looked up - (server, DMV) -> lower case
+// column name -> column name as in the catalog. The columns of a DMV do
+// not change while the server runs, failed lookups are not kept.
+//
+static std::mutex                                           g_DmvColumnsLock;
+static map<pair<string, string>, map<string, string>>       g_DmvColumns;
+
+// ---------------------------------------------------------------------------
+// Method: ToLower
+//
+// Returns:
+//    Lower case copy of the string.
+//
+static string
+ToLower(
+    string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+    return str;
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsIdentifier
+//
+// Description:
+//    This method checks that the name only has the characters DMV names
+//    are made of.
+//
+// Returns:
+//    bool
+//
+static bool
+IsIdentifier(
+    const string& name)
+{
+    return !name.empty() &&
+           std::all_of(name.begin(), name.end(),
+                       [](char c) { return isalnum((unsigned char)c) || c == '_'; });
+}
+
+// ---------------------------------------------------------------------------
+// Method: ParsePredicate
+//
+// Description:
+//    This method parses a where= value - <column><operator><value>.
+//
+// Returns:
+//    bool
+//
+static bool
+ParsePredicate(
+    const string& text,
+    DmvPredicate& predicate)
+{
+    size_t  opPos;
+    size_t  opLen = 1;
+    string  op;
+
+    opPos = text.find_first_of("=!<>~");
+    if (opPos == string::npos || opPos == 0)
+    {
+        return false;
+    }
+
+    op = text.substr(opPos, 2);
+    if (op == "!=" || op == "<>" || op == "<=" || op == ">=")
+    {
+        opLen = 2;
+    }
+    op = text.substr(opPos, opLen);
+
+    if (op == "!=")
+    {
+        op = "<>";
+    }
+    else if (op == "~")
+    {
+        op = "LIKE";
+    }
+    else if (op == "!")
+    {
+        return false;
+    }
+
+    predicate.m_column = Trim(text.substr(0, opPos));
+    predicate.m_operator = op;
+    predicate.m_value = text.substr(opPos + opLen);
+
+    return !predicate.m_column.empty();
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsDmvViewName
+//
+// Returns:
+//    true if the file name has view parameters.
+//
+bool
+IsDmvViewName(
+    const string& filename)
+{
+    return filename.find(DMV_VIEW_SEPARATOR) != string::npos;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ParseDmvView
+//
+// Description:
+//    This method parses a view file name. The parameters are & separated:
+//      cols=<col>,<col>    columns to select (in that order)
+//      top=<n>             only the first n rows
+//      where=<predicate>   row filter - may be given several times
+//
+//    The extension of the DMV file name gives the form (.json, .csv,
+//    .ndjson or none for TSV).
+//
+// Returns:
+//    bool
+//
+bool
+ParseDmvView(
+    const string& filename,
+    DmvView& view)
+{
+    size_t          separator;
+    vector<string>  param;
+    DmvPredicate    predicate;
+    char*           end;
+    long            top;
+    bool            status = true;
+
+    separator = filename.find(DMV_VIEW_SEPARATOR);
+    if (separator == string::npos)
+    {
+        return false;
+    }
+
+    view.m_dmvName = filename.substr(0, separator);
+    view.m_type = SplitFileFormat(view.m_dmvName);
+    view.m_columns.clear();
+    view.m_top = 0;
+    view.m_predicates.clear();
+
+    status = IsIdentifier(view.m_dmvName);
+
+    for (auto&& item : Split(filename.substr(separator + 1), '&'))
+    {
+        if (!status)
+        {
+            break;
+        }
+
+        param = SplitFirst(item, '=');
+        if (param.size() != 2)
+        {
+            status = false;
+        }
+        else if (param[0] == "cols")
+        {
+            for (auto&& column : Split(param[1], ','))
+            {
+                if (!Trim(column).empty())
+                {
+                    view.m_columns.push_back(Trim(column));
+                }
+            }
+            status = !view.m_columns.empty();
+        }
+        else if (param[0] == "top")
+        {
+            errno = 0;
+            top = strtol(param[1].c_str(), &end, 10);
+            status = !param[1].empty() && *end == '\0' && errno == 0 &&
+                     top > 0 && top <= DMV_VIEW_MAX_TOP;
+            view.m_top = (int)top;
+        }
+        else if (param[0] == "where")
+        {
+            status = ParsePredicate(param[1], predicate);
+            view.m_predicates.push_back(predicate);
+        }
+        else
+        {
+            status = false;
+        }
+    }
+
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetDmvColumns
+//
+// Description:
+//    This method gets the columns of a DMV, querying sys.all_columns the
+//    first time the DMV is seen.
+//
+// Returns:
+//    bool
+//
+static bool
+GetDmvColumns(
+    ServerInfo* serverInfo,
+    const string& servername,
+    const string& dmvName,
+    map<string, string>& columns)
+{
+    string          query;
+    string          response;
+    vector<string>  names;
+    auto            key = make_pair(servername, dmvName);
+
+    {
+        std::lock_guard<std::mutex> guard(g_DmvColumnsLock);
+
+        auto cached = g_DmvColumns.find(key);
+        if (cached != g_DmvColumns.end())
+        {
+            columns = cached->second;
+            return true;
+        }
+    }
+
+    // The DMV name is an identifier (checked by ParseDmvView) so it can
+    // be part of the literal.
+    //
+    query = "SELECT name FROM sys.all_columns WHERE object_id = OBJECT_ID('sys." +
+            dmvName + "') ORDER BY column_id";
+
+    if (ExecuteQuery(query, response, serverInfo, TYPE_TSV))
+    {
+        PrintMsg("Failed to query the columns of %s\n", dmvName.c_str());
+        return false;
+    }
+
+    // Skip the column name of the result itself.
+    //
+    columns.clear();
+    names = Split(response, '\n');
+    for (size_t i = 1; i < names.size(); i++)
+    {
+        if (!names[i].empty())
+        {
+            columns[ToLower(names[i])] = names[i];
+        }
+    }
+
+    if (columns.empty())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(g_DmvColumnsLock);
+    g_DmvColumns[key] = columns;
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ValidateDmvView
+//
+// Description:
+//    This method checks that all the columns named by the view exist in
+//    the DMV. Column names are matched without regard to case (as the
+//    server does) and replaced by their catalog spelling.
+//
+// Returns:
+//    bool
+//
+bool
+ValidateDmvView(
+    ServerInfo* serverInfo,
+    const string& servername,
+    DmvView& view)
+{
+    map<string, string> columns;
+
+    if (!GetDmvColumns(serverInfo, servername, view.m_dmvName, columns))
+    {
+        return false;
+    }
+
+    for (auto&& column : view.m_columns)
+    {
+        auto found = columns.find(ToLower(column));
+        if (found == columns.end())
+        {
+            PrintMsg("Unknown column %s of %s\n", column.c_str(), view.m_dmvName.c_str());
+            return false;
+        }
+        column = found->second;
+    }
+
+    for (auto&& predicate : view.m_predicates)
+    {
+        auto found = columns.find(ToLower(predicate.m_column));
+        if (found == columns.end())
+        {
+            PrintMsg("Unknown column %s of %s\n", predicate.m_column.c_str(), view.m_dmvName.c_str());
+            return false;
+        }
+        predicate.m_column = found->second;
+    }
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: QuoteIdentifier
+//
+// Returns:
+//    The identifier as a bracketed SQL identifier.
+//
+static string
+QuoteIdentifier(
+    const string& name)
+{
+    return "[" + StringReplace(name, "]", "]]") + "]";
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetDmvViewQuery
+//
+// Description:
+//    This method builds the query of a view validated by ValidateDmvView.
+//    Values are compared as N'' literals - the server converts them to
+//    the type of the column.
+//
+// Returns:
+//    The query.
+//
+string
+GetDmvViewQuery(
+    const DmvView& view)
+{
+    string query = "SELECT ";
+
+    if (view.m_top)
+    {
+        query += StringFormat("TOP (%d) ", view.m_top);
+    }
+
+    if (view.m_columns.empty())
+    {
+        query += "*";
+    }
+    for (size_t i = 0; i < view.m_columns.size(); i++)
+    {
+        query += (i ? ", " : "") + QuoteIdentifier(view.m_columns[i]);
+    }
+
+    query += " FROM [master].[sys]." + QuoteIdentifier(view.m_dmvName);
+
+    for (size_t i = 0; i < view.m_predicates.size(); i++)
+    {
+        query += (i ? " AND " : " WHERE ") +
+                 QuoteIdentifier(view.m_predicates[i].m_column) + " " +
+                 view.m_predicates[i].m_operator + " N'" +
+                 StringReplace(view.m_predicates[i].m_value, "'", "''") + "'";
+    }
+
+    if (view.m_type == TYPE_JSON)
+    {
+        query += " FOR JSON AUTO, ROOT('info')";
+    }
+
+    return query;
+}
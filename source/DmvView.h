@@ -0,0 +1,76 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: DmvView.h
+//
+// Purpose:
+//   This file contains the declarations of the DMV views - DMV files
+//   opened with a query string that selects columns and filters rows:
+//      <DMV file>?cols=<col>,<col>&top=<n>&where=<col><op><value>
+//
+#pragma once
+
+// Separator between the DMV file name and the view parameters.
+//
+#define DMV_VIEW_SEPARATOR      '?'
+
+// ---------------------------------------------------------------------------
+// Structure: DmvPredicate
+//
+// Description:
+//    One where= parameter. m_operator is one of =, <>, <, <=, >, >= or
+//    LIKE (written ~ in the file name).
+//
+struct DmvPredicate
+{
+    string  m_column;
+    string  m_operator;
+    string  m_value;
+};
+
+// ---------------------------------------------------------------------------
+// Structure: DmvView
+//
+// Description:
+//    Parsed view parameters. An empty column list selects all the
+//    columns and a m_top of 0 means no limit. Predicates are combined
+//    with AND.
+//
+struct DmvView
+{
+    string                  m_dmvName;
+    FileFormat              m_type;
+    vector<string>          m_columns;
+    int                     m_top;
+    vector<DmvPredicate>    m_predicates;
+};
+
+// This method checks if the file name has view parameters.
+//
+bool
+IsDmvViewName(
+    const string& filename);
+
+// This method parses a file name of the form <DMV file>?<parameters>.
+// It does not check the column names.
+//
+bool
+ParseDmvView(
+    const string& filename,
+    DmvView& view);
+
+// This method checks the columns of the view against the columns of the
+// DMV on the server and replaces them with their catalog spelling.
+//
+bool
+ValidateDmvView(
+    ServerInfo* serverInfo,
+    const string& servername,
+    DmvView& view);
+
+// This method builds the query of a validated view.
+//
+string
+GetDmvViewQuery(
+    const DmvView& view);
@@ -0,0 +1,332 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: FanOut.cpp
+//
+// Purpose:
+//   This file contains the definitions of the fan-out folder, whose DMV
+//   files merge the results of every configured server.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Method: FindRecordEnd
+//
+// Description:
+//    This method finds the end of the record (line) starting at start. A
+//    newline inside a quoted CSV value does not end the record - TSV and
+//    NDJSON have no raw newline in a value.
+//
+// Returns:
+//    Offset just past the newline ending the record, or the size of the
+//    data for a last record without one.
+//
+static size_t
+FindRecordEnd(
+    const string& data,
+    size_t start,
+    const FileFormat type)
+{
+    bool inQuotes = false;
+
+    for (size_t i = start; i < data.size(); i++)
+    {
+        if (type == TYPE_CSV && data[i] == '"')
+        {
+            // An escaped quote ("") toggles twice.
+            //
+            inQuotes = !inQuotes;
+        }
+        else if (data[i] == '\n' && !inQuotes)
+        {
+            return i + 1;
+        }
+    }
+
+    return data.size();
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendServerRows
+//
+// Description:
+//    This method appends the records of data from start on to the output,
+//    each preceded by the name of the server - as the first value for
+//    TSV and CSV, and as the first key of the object for NDJSON.
+//
+// Returns:
+//    VOID
+//
+static void
+AppendServerRows(
+    ResultBuffer& output,
+    const string& data,
+    size_t start,
+    const string& servername,
+    const FileFormat type)
+{
+    const char  separator = (type == TYPE_CSV) ? ',' : '\t';
+    string      prefix;
+    size_t      end;
+
+    if (type == TYPE_NDJSON)
+    {
+        prefix = "{\"" FANOUT_SERVER_COLUMN "\":" + RowSerializer::QuoteText(servername, type);
+    }
+    else
+    {
+        prefix = RowSerializer::QuoteText(servername, type) + separator;
+    }
+
+    for (; start < data.size(); start = end)
+    {
+        end = FindRecordEnd(data, start, type);
+
+        if (type == TYPE_NDJSON)
+        {
+            // Replace the opening brace of the object.
+            //
+            if (data[start] != '{')
+            {
+                continue;
+            }
+
+            output.Append(prefix.data(), prefix.size());
+            if (start + 1 < end && data[start + 1] != '}')
+            {
+                output.Append(',');
+            }
+            output.Append(data.data() + start + 1, end - start - 1);
+        }
+        else
+        {
+            output.Append(prefix.data(), prefix.size());
+            output.Append(data.data() + start, end - start);
+        }
+
+        if (data[end - 1] != '\n')
+        {
+            output.Append('\n');
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendErrorRow
+//
+// Description:
+//    This method appends the row standing for a server whose result could
+//    not be merged - the message follows the server name as the first
+//    value (TSV and CSV) or under an "error" key (NDJSON).
+//
+// Returns:
+//    VOID
+//
+static void
+AppendErrorRow(
+    ResultBuffer& output,
+    const string& servername,
+    const string& message,
+    const FileFormat type)
+{
+    string row;
+
+    if (type == TYPE_NDJSON)
+    {
+        row = "{\"" FANOUT_SERVER_COLUMN "\":" + RowSerializer::QuoteText(servername, type) +
+              ",\"error\":" + RowSerializer::QuoteText(message, type) + "}\n";
+    }
+    else
+    {
+        row = RowSerializer::QuoteText(servername, type) + (type == TYPE_CSV ? "," : "\t") +
+              RowSerializer::QuoteText("error: " + message, type) + "\n";
+    }
+
+    output.Append(row.data(), row.size());
+}
+
+// ---------------------------------------------------------------------------
+// Method: CreateFanOutFolder
+//
+// Description:
+//    This method creates the fan-out folder, empty until the catalogs of
+//    the servers add their DMVs to it (AddFanOutFiles).
+//
+//    The folder is also created in the dump directory so that nothing
+//    can be created under that name. It is not created if a server has
+//    the same name.
+//
+// Returns:
+//    VOID
+//
+void
+CreateFanOutFolder()
+{
+    const string dirPath = LINUX_PATH_DELIM FANOUT_FOLDER_NAME;
+
+    if (GetServerInfo(FANOUT_FOLDER_NAME))
+    {
+        PrintMsg("A server is named %s - the fan-out folder is not created\n",
+            FANOUT_FOLDER_NAME);
+        return;
+    }
+
+    mkdir(CalculateDumpPath(dirPath).c_str(), DEFAULT_PERMISSIONS);
+    g_VirtualTree.AddDirectory(dirPath, "");
+}
+
+// ---------------------------------------------------------------------------
+// Method: AddFanOutFiles
+//
+// Description:
+//    This method adds a TSV, a CSV and an NDJSON file to the fan-out
+//    folder for each DMV given that is not there yet. JSON files are
+//    left out as their documents are built by each server. Files are
+//    not removed when a server no longer has the DMV - the server then
+//    gets an error row.
+//
+// Returns:
+//    VOID
+//
+void
+AddFanOutFiles(
+    const vector<string>& dmvNames)
+{
+    const string        dirPath = LINUX_PATH_DELIM FANOUT_FOLDER_NAME;
+    const FileFormat    types[] = { TYPE_TSV, TYPE_CSV, TYPE_NDJSON };
+    string              filename;
+    string              path;
+
+    if (!g_VirtualTree.Lookup(dirPath))
+    {
+        return;
+    }
+
+    for (auto&& dmvName : dmvNames)
+    {
+        for (auto&& type : types)
+        {
+            filename = dmvName + GetFileFormatExtension(type);
+            path = VirtualTree::JoinPath(dirPath, filename);
+
+            if (!g_VirtualTree.Lookup(path))
+            {
+                g_VirtualTree.AddFile(path, ENTRY_FANOUT_DMV, "", filename);
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetFanOutFileContent
+//
+// Description:
+//    This method fetches the DMV file from every server, up to
+//    SQLFS_MAX_FANOUT_WORKERS at a time, and merges the results in the
+//    order of the server names. Each server goes through fetch, so its
+//    result cache, prefetched snapshots and query timeouts apply.
+//
+//    TSV and CSV get the header of the first server that answered,
+//    preceded by the server column. A server that failed, or whose
+//    columns differ from that header (another version of SQL Server),
+//    gets an error row instead of its rows - the rest of the file is
+//    still served. NDJSON objects are keyed, so the rows of all the
+//    servers are merged whatever their columns.
+//
+// Returns:
+//    0
+//
+int
+GetFanOutFileContent(
+    const string& filename,
+    const ServerFileFetcher& fetch,
+    QueryResult& content)
+{
+    vector<pair<string, shared_ptr<ServerInfo>>>   servers = GetServerInfoList();
+    vector<string>                      outputs(servers.size());
+    vector<int>                         errors(servers.size(), -1);
+    string                              dmvName = filename;
+    FileFormat                          type = SplitFileFormat(dmvName);
+    const char                          separator = (type == TYPE_CSV) ? ',' : '\t';
+    string                              header;
+    string                              headerServer;
+    string                              line;
+    size_t                              headerEnd;
+
+    sort(servers.begin(), servers.end());
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    RunInParallel(servers.size(), SQLFS_MAX_FANOUT_WORKERS,
+        [&](size_t item)
+        {
+            QueryResult serverContent;
+
+            errors[item] = fetch(servers[item].first, filename, serverContent);
+            if (errors[item] == 0 && serverContent)
+            {
+                // Registered as a reader so that a streaming result is
+                // not cancelled while it is being copied.
+                //
+                serverContent->AddReader();
+                outputs[item] = serverContent->ToString();
+                errors[item] = serverContent->IsUsable() ? 0 : -1;
+                serverContent->RemoveReader();
+            }
+            else if (errors[item] == 0)
+            {
+                errors[item] = -1;
+            }
+        });
+
+    content = make_shared<ResultBuffer>();
+
+    if (type != TYPE_NDJSON)
+    {
+        for (size_t i = 0; i < servers.size() && header.empty(); i++)
+        {
+            if (errors[i] == 0)
+            {
+                header = outputs[i].substr(0, FindRecordEnd(outputs[i], 0, type));
+                headerServer = servers[i].first;
+            }
+        }
+
+        line = string(FANOUT_SERVER_COLUMN) + separator +
+               (header.empty() ? string("error\n") : header);
+        content->Append(line.data(), line.size());
+    }
+
+    for (size_t i = 0; i < servers.size(); i++)
+    {
+        if (errors[i])
+        {
+            AppendErrorRow(*content, servers[i].first,
+                (errors[i] == -ENOENT) ? "no such DMV on the server" : "query failed", type);
+            continue;
+        }
+
+        headerEnd = 0;
+        if (type != TYPE_NDJSON)
+        {
+            headerEnd = FindRecordEnd(outputs[i], 0, type);
+            if (outputs[i].compare(0, headerEnd, header) != 0)
+            {
+                AppendErrorRow(*content, servers[i].first,
+                    "columns differ from server " + headerServer + " - see /" +
+                    servers[i].first + "/" + filename, type);
+                continue;
+            }
+        }
+
+        AppendServerRows(*content, outputs[i], headerEnd, servers[i].first, type);
+    }
+
+    content->Complete(0);
+
+    LogMsg(LOG_LEVEL_INFO, "Fanned out %s to %zu server(s) in %lld ms\n",
+        filename.c_str(), servers.size(), ElapsedMs(startTime));
+
+    return 0;
+}
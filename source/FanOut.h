@@ -0,0 +1,52 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: FanOut.h
+//
+// Purpose:
+//   This file contains the declarations of the fan-out folder - DMV
+//   files that query every configured server at once:
+//      <MOUNT DIR>/_all/<DMV file>
+//
+#pragma once
+
+// Name of the fan-out folder and of the column naming the server of
+// each row.
+//
+#define FANOUT_FOLDER_NAME          "_all"
+#define FANOUT_SERVER_COLUMN        "server"
+
+// Most servers queried at a time for a fan-out file.
+//
+#define SQLFS_MAX_FANOUT_WORKERS    16
+
+// Gets the content of a DMV file (name with extension) of a server, the
+// way opening <MOUNT DIR>/<server>/<file> would. Returns 0 on success,
+// -ENOENT if the server has no such file and -1 on error.
+//
+typedef std::function<int(const string& servername,
+                          const string& filename,
+                          QueryResult& content)> ServerFileFetcher;
+
+// Creates the fan-out folder. Called at mount before the DMV files of
+// the servers are added.
+//
+void
+CreateFanOutFolder();
+
+// Adds the TSV, CSV and NDJSON files of the DMVs of a server to the
+// fan-out folder.
+//
+void
+AddFanOutFiles(
+    const vector<string>& dmvNames);
+
+// Fetches the file from every server in parallel and merges the results
+// into content, with a leading server column.
+//
+int
+GetFanOutFileContent(
+    const string& filename,
+    const ServerFileFetcher& fetch,
+    QueryResult& content);
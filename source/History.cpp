@@ -0,0 +1,416 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: History.cpp
+//
+// Purpose:
+//   This file contains the definitions of the in-memory history of the
+//   prefetched DMVs of a server.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Method: FormatSnapshotTime
+//
+// Description:
+//    This method formats a time as the name of a snapshot file - UTC in
+//    ISO 8601 with milliseconds, so that the files sort by time.
+//
+// Returns:
+//    The file name.
+//
+static string
+FormatSnapshotTime(
+    std::chrono::system_clock::time_point time)
+{
+    auto    sinceEpoch = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             time.time_since_epoch()).count();
+    time_t  seconds = sinceEpoch / 1000;
+    tm      utc;
+    char    buffer[32];
+
+    gmtime_r(&seconds, &utc);
+    strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &utc);
+
+    return StringFormat("%s.%03dZ", buffer, (int)(sinceEpoch % 1000));
+}
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+HistoryStore::HistoryStore(
+    const string& servername,
+    size_t memoryLimit) :
+    m_servername(servername),
+    m_memoryLimit(memoryLimit),
+    m_memoryUsed(0)
+{
+}
+
+// ---------------------------------------------------------------------------
+// Method: Destructor
+//
+HistoryStore::~HistoryStore()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    while (!m_snapshots.empty())
+    {
+        DropOldest();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetFolderPath
+//
+// Returns:
+//    The path of the history folder of the server.
+//
+string
+HistoryStore::GetFolderPath() const
+{
+    return LINUX_PATH_DELIM + m_servername + LINUX_PATH_DELIM HISTORY_FOLDER_NAME;
+}
+
+// ---------------------------------------------------------------------------
+// Method: CreateFolder
+//
+// Description:
+//    This method creates the history folder of the server. It is also
+//    created in the dump directory, like every folder of the tree.
+//
+// Returns:
+//    VOID
+//
+void
+HistoryStore::CreateFolder()
+{
+    mkdir(CalculateDumpPath(GetFolderPath()).c_str(), DEFAULT_PERMISSIONS);
+    g_VirtualTree.AddDirectory(GetFolderPath(), m_servername);
+}
+
+// ---------------------------------------------------------------------------
+// Method: AddValue
+//
+// Description:
+//    This method gets the id of a value in the dictionary of the server,
+//    adding the value if it is not there, and counts one more use of it.
+//    Caller holds m_lock.
+//
+// Returns:
+//    The value id.
+//
+uint32_t
+HistoryStore::AddValue(
+    const string& value)
+{
+    uint32_t id;
+
+    auto itr = m_valueIds.find(value);
+    if (itr != m_valueIds.end())
+    {
+        m_refCounts[itr->second]++;
+        return itr->second;
+    }
+
+    if (m_freeIds.empty())
+    {
+        id = m_values.size();
+        m_values.push_back(NULL);
+        m_refCounts.push_back(0);
+    }
+    else
+    {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+    }
+
+    // The keys of an unordered_map do not move, so the dictionary keeps
+    // a single copy of the value.
+    //
+    itr = m_valueIds.emplace(value, id).first;
+    m_values[id] = &itr->first;
+    m_refCounts[id] = 1;
+
+    m_memoryUsed += value.size() + HISTORY_VALUE_OVERHEAD;
+
+    return id;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ReleaseValue
+//
+// Description:
+//    This method counts one less use of the value and frees it once no
+//    snapshot uses it. Caller holds m_lock.
+//
+// Returns:
+//    VOID
+//
+void
+HistoryStore::ReleaseValue(
+    uint32_t id)
+{
+    if (--m_refCounts[id] > 0)
+    {
+        return;
+    }
+
+    m_memoryUsed -= m_values[id]->size() + HISTORY_VALUE_OVERHEAD;
+
+    m_valueIds.erase(*m_values[id]);
+    m_values[id] = NULL;
+    m_freeIds.push_back(id);
+}
+
+// ---------------------------------------------------------------------------
+// Method: DropOldest
+//
+// Description:
+//    This method drops the oldest snapshot of the server and removes its
+//    file from the tree. Caller holds m_lock.
+//
+// Returns:
+//    VOID
+//
+void
+HistoryStore::DropOldest()
+{
+    Snapshot& oldest = m_snapshots.front();
+
+    g_VirtualTree.RemoveFile(VirtualTree::JoinPath(
+        VirtualTree::JoinPath(GetFolderPath(), oldest.m_dmvName), oldest.m_time));
+
+    for (auto&& id : oldest.m_values)
+    {
+        ReleaseValue(id);
+    }
+
+    m_memoryUsed -= oldest.m_bytes;
+    m_snapshots.pop_front();
+}
+
+// ---------------------------------------------------------------------------
+// Method: Record
+//
+// Description:
+//    This method adds a TSV snapshot of the DMV to the history, and drops
+//    the oldest snapshots until the history fits in the memory limit. A
+//    snapshot larger than the limit is dropped right away.
+//
+//    The first snapshot of a DMV creates its folder and its stream file.
+//
+// Returns:
+//    VOID
+//
+void
+HistoryStore::Record(
+    const string& dmvName,
+    const QueryResult& snapshot)
+{
+    string      data;
+    string      time = FormatSnapshotTime(std::chrono::system_clock::now());
+    string      dmvPath = VirtualTree::JoinPath(GetFolderPath(), dmvName);
+    string      filePath = VirtualTree::JoinPath(dmvPath, time);
+    Snapshot    entry;
+    size_t      start;
+    size_t      end;
+    size_t      tab;
+
+    if (!snapshot || !snapshot->IsComplete() || !snapshot->IsUsable())
+    {
+        return;
+    }
+
+    data = snapshot->ToString();
+
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    // Two refreshes in the same millisecond keep the first.
+    //
+    if (g_VirtualTree.Lookup(filePath))
+    {
+        return;
+    }
+
+    for (start = 0; start < data.size(); start = end + 1)
+    {
+        end = data.find('\n', start);
+        if (end == string::npos)
+        {
+            end = data.size();
+        }
+
+        for (;;)
+        {
+            tab = data.find('\t', start);
+            if (tab == string::npos || tab > end)
+            {
+                tab = end;
+            }
+
+            entry.m_values.push_back(AddValue(data.substr(start, tab - start)));
+
+            if (tab == end)
+            {
+                break;
+            }
+            start = tab + 1;
+        }
+
+        entry.m_rowEnds.push_back(entry.m_values.size());
+    }
+
+    entry.m_dmvName = dmvName;
+    entry.m_time = time;
+    entry.m_bytes = HISTORY_SNAPSHOT_OVERHEAD + dmvName.size() + time.size() +
+                    (entry.m_values.size() + entry.m_rowEnds.size()) * sizeof(uint32_t);
+
+    m_memoryUsed += entry.m_bytes;
+    m_snapshots.push_back(std::move(entry));
+
+    if (m_dmvFolders.insert(dmvName).second)
+    {
+        mkdir(CalculateDumpPath(dmvPath).c_str(), DEFAULT_PERMISSIONS);
+        g_VirtualTree.AddDirectory(dmvPath, m_servername);
+        g_VirtualTree.AddFile(dmvPath + HISTORY_STREAM_EXTENSION, ENTRY_HISTORY_STREAM,
+                              m_servername, dmvName);
+    }
+
+    g_VirtualTree.AddFile(filePath, ENTRY_HISTORY_SNAPSHOT, m_servername,
+                          VirtualTree::JoinPath(dmvName, time));
+
+    while (m_memoryUsed > m_memoryLimit && !m_snapshots.empty())
+    {
+        if (m_snapshots.size() == 1)
+        {
+            LogMsg(LOG_LEVEL_WARNING, "Snapshot of %s on server %s is larger than its historyMemory - not kept\n",
+                dmvName.c_str(), m_servername.c_str());
+        }
+
+        DropOldest();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendRows
+//
+// Description:
+//    This method decodes the rows [firstRow, endRow) of a snapshot (row 0
+//    is the header) into TSV lines, each preceded by prefix. Caller holds
+//    m_lock.
+//
+// Returns:
+//    VOID
+//
+void
+HistoryStore::AppendRows(
+    const Snapshot& snapshot,
+    size_t firstRow,
+    size_t endRow,
+    const string& prefix,
+    ResultBuffer& content) const
+{
+    string  line;
+    size_t  start = (firstRow > 0) ? snapshot.m_rowEnds[firstRow - 1] : 0;
+
+    endRow = min(endRow, snapshot.m_rowEnds.size());
+
+    for (size_t row = firstRow; row < endRow; row++)
+    {
+        line = prefix;
+        for (size_t i = start; i < snapshot.m_rowEnds[row]; i++)
+        {
+            if (i > start)
+            {
+                line += '\t';
+            }
+            line += *m_values[snapshot.m_values[i]];
+        }
+        line += '\n';
+
+        content.Append(line.data(), line.size());
+        start = snapshot.m_rowEnds[row];
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetSnapshot
+//
+// Description:
+//    This method gets a snapshot of the DMV back as the TSV it was
+//    recorded from.
+//
+// Returns:
+//    0 on success, -ENOENT if the snapshot was dropped.
+//
+int
+HistoryStore::GetSnapshot(
+    const string& dmvName,
+    const string& time,
+    QueryResult& content)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    for (auto itr = m_snapshots.rbegin(); itr != m_snapshots.rend(); ++itr)
+    {
+        if (itr->m_time == time && itr->m_dmvName == dmvName)
+        {
+            content = make_shared<ResultBuffer>();
+            AppendRows(*itr, 0, itr->m_rowEnds.size(), "", *content);
+            content->Complete(0);
+
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetStream
+//
+// Description:
+//    This method gets all the kept snapshots of the DMV as one TSV - the
+//    header of the oldest snapshot preceded by the snapshot_time column,
+//    then the rows of every snapshot, oldest first, preceded by their
+//    snapshot time.
+//
+// Returns:
+//    0
+//
+int
+HistoryStore::GetStream(
+    const string& dmvName,
+    QueryResult& content)
+{
+    bool header = false;
+
+    content = make_shared<ResultBuffer>();
+
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    for (auto&& snapshot : m_snapshots)
+    {
+        if (snapshot.m_dmvName != dmvName || snapshot.m_rowEnds.empty())
+        {
+            continue;
+        }
+
+        // The header of the oldest snapshot - later snapshots have the
+        // same columns unless the server was upgraded in between.
+        //
+        if (!header)
+        {
+            AppendRows(snapshot, 0, 1, HISTORY_TIME_COLUMN "\t", *content);
+            header = true;
+        }
+
+        AppendRows(snapshot, 1, snapshot.m_rowEnds.size(), snapshot.m_time + "\t", *content);
+    }
+
+    content->Complete(0);
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: History.h
+//
+// Purpose:
+//   This file contains the declaration of the history of the prefetched
+//   DMVs of a server - past snapshots kept in memory and exposed as:
+//      <MOUNT DIR>/<SERVER NAME>/history/<DMV>/<snapshot time>
+//      <MOUNT DIR>/<SERVER NAME>/history/<DMV>.tsv
+//
+#pragma once
+
+// Name of the history folder of a server, extension of the file of all
+// the snapshots of a DMV and name of its column with the snapshot time.
+//
+#define HISTORY_FOLDER_NAME         "history"
+#define HISTORY_STREAM_EXTENSION    ".tsv"
+#define HISTORY_TIME_COLUMN         "snapshot_time"
+
+// Bytes counted for each distinct value and each snapshot on top of
+// their data - roughly the hash table node and vector headers.
+//
+#define HISTORY_VALUE_OVERHEAD      64
+#define HISTORY_SNAPSHOT_OVERHEAD   128
+
+//--------------------------------------------------------------------
+// Class: HistoryStore
+//
+// Description:
+//  Ring buffer of the TSV snapshots of the prefetched DMVs of one
+//  server, bounded by the historyMemory setting. The prefetcher records
+//  each refresh, so the history costs no query of its own.
+//
+//  Values are dictionary encoded: each distinct value (a wait type, a
+//  session status, a column name...) is stored once for the server,
+//  and a snapshot is a list of 4 byte value ids. Values are reference
+//  counted and freed with the last snapshot using them. When a new
+//  snapshot brings the memory used above the limit, the oldest
+//  snapshots of the server (of any DMV) are dropped.
+//
+//  Each snapshot is a file of the virtual tree named after its UTC time
+//  (e.g. 2026-10-14T15:30:00.250Z), added when it is recorded and
+//  removed when it is dropped.
+//
+class HistoryStore
+{
+public:
+    // Constructor. Nothing is recorded above memoryLimit bytes.
+    //
+    HistoryStore(
+        const string& servername,
+        size_t memoryLimit);
+
+    // Removes the files of the snapshots from the tree.
+    //
+    ~HistoryStore();
+
+    // Creates the history folder of the server.
+    //
+    void CreateFolder();
+
+    // Records a complete TSV snapshot of the DMV.
+    //
+    void Record(
+        const string& dmvName,
+        const QueryResult& snapshot);
+
+    // Gets the snapshot of the DMV taken at the time in the file name.
+    // Returns 0 on success and -ENOENT if it was dropped.
+    //
+    int GetSnapshot(
+        const string& dmvName,
+        const string& time,
+        QueryResult& content);
+
+    // Gets all the snapshots of the DMV, oldest first, each row preceded
+    // by the snapshot time.
+    //
+    int GetStream(
+        const string& dmvName,
+        QueryResult& content);
+
+private:
+    struct Snapshot
+    {
+        string              m_dmvName;
+        string              m_time;         // File name
+        vector<uint32_t>    m_values;       // Value ids - header first
+        vector<uint32_t>    m_rowEnds;      // End of each row in m_values
+        size_t              m_bytes;        // Counted in m_memoryUsed
+    };
+
+    // Gets the id of a value, adding it to the dictionary if needed.
+    //
+    uint32_t AddValue(
+        const string& value);
+
+    // Drops a reference to a value.
+    //
+    void ReleaseValue(
+        uint32_t id);
+
+    // Drops the oldest snapshot and removes its file.
+    //
+    void DropOldest();
+
+    // Appends the rows [firstRow, endRow) of a snapshot to the content,
+    // each preceded by prefix.
+    //
+    void AppendRows(
+        const Snapshot& snapshot,
+        size_t firstRow,
+        size_t endRow,
+        const string& prefix,
+        ResultBuffer& content) const;
+
+    // Path of the history folder of the server.
+    //
+    string GetFolderPath() const;
+
+    string                                  m_servername;
+    size_t                                  m_memoryLimit;
+    size_t                                  m_memoryUsed;
+    std::deque<Snapshot>                    m_snapshots;    // Oldest first
+    unordered_map<string, uint32_t>         m_valueIds;     // Dictionary
+    vector<const string*>                   m_values;       // Id -> key of m_valueIds
+    vector<uint32_t>                        m_refCounts;    // Id -> snapshot cells using it
+    vector<uint32_t>                        m_freeIds;      // Ids of released values
+    set<string>                             m_dmvFolders;   // DMVs with a folder
+    std::mutex                              m_lock;
+};
@@ -55,6 +55,31 @@ const char COMMENT_DELIM2           = '#';
 const char SECTION_START_DELIM      = '[';
 const char SECTION_END_DELIM        = ']';
 const char NAME_VALUE_PAIR_DELIM    = '=';
+const char WHITESPACE[]             = " \n\r\t";
+
+// ---------------------------------------------------------------------------
+// Method: TrimView
+//
+// Description:
+//    This method trims whitespace off the beginning and end of a view,
+//    like Trim does for a string.
+//
+// Returns:
+//    The trimmed view.
+//
+static string_view
+TrimView(
+    string_view s) // The view to trim.
+{
+    size_t startpos = s.find_first_not_of(WHITESPACE);
+
+    if (startpos == string_view::npos)
+    {
+        return string_view();
+    }
+
+    return s.substr(startpos, s.find_last_not_of(WHITESPACE) - startpos + 1);
+}
 
 // ---------------------------------------------------------------------------
 // Method: Default contructor
@@ -67,6 +92,7 @@ const char NAME_VALUE_PAIR_DELIM    = '=';
 //    none
 //
 INIFile::INIFile() :
+    m_position(0),
     m_allowDuplicateValues(false),  // Allow duplicate values by default
     m_lineno(0),                    // Line number of 0
     m_isLoaded(false)               // Loaded is false
@@ -77,8 +103,8 @@ INIFile::INIFile() :
 // Method: LoadFile
 //
 // Description:
-//    This method takes a fully qualified file path and name, opens the file
-//    for reading and parses it.
+//    This method takes a fully qualified file path and name, reads the
+//    file into memory once and parses that copy.
 //
 // Returns:
 //    none
@@ -88,17 +114,38 @@ INIFile::LoadFile(
     string fileName,                // Fully qualified file path and name
     bool   allowDuplicateValueKeys) // allow dup value keys
 {
+    int         fd;
+    char        buffer[64 * 1024];
+    ssize_t     bytesRead = -1;
+
     if (m_isLoaded)
     {
         throw runtime_error(
             StringFormat("INI file class cannot be loaded twice.").c_str());
     }
 
-    // Opening a read filestream to the file given
+    // Reading the file given. An editor truncating or rewriting it in
+    // place only changes what is read - unlike a mapping, which faults
+    // past the new end of the file.
     //
-    m_fileStream.open(fileName.c_str(), ios::in | ios::binary);
-    if (m_fileStream.fail())
+    fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd != -1)
+    {
+        do
+        {
+            bytesRead = read(fd, buffer, sizeof(buffer));
+            if (bytesRead > 0)
+            {
+                m_content.append(buffer, bytesRead);
+            }
+        } while (bytesRead > 0 || (bytesRead == -1 && errno == EINTR));
+
+        close(fd);
+    }
+
+    if (bytesRead == -1)
     {
+        m_content.clear();
         throw runtime_error(
             StringFormat("File cannot be opened. Filename = %s", 
                             fileName.c_str()).c_str());
@@ -135,16 +182,15 @@ INIFile::GetSections()
 //
 INIFile::~INIFile()
 {
-    m_fileStream.close();
 };
 
 // ---------------------------------------------------------------------------
 // Method: ParseFile
 //
 // Description:
-//    This method takes a file containing the content of the INI file and
-//    parses the content.  Filling in the Sections class property in the
-//    process.  Any errors will result in exceptions being thrown.
+//    This method takes the content read from the INI file and parses the
+//    content.  Filling in the Sections class property in the process.
+//    Any errors will result in exceptions being thrown.
 //
 // Returns:
 //    none
@@ -152,8 +198,9 @@ INIFile::~INIFile()
 void
 INIFile::ParseFile()
 {
-    string fileLine;
+    string_view fileLine;
     string sectionName;
+    SectionNameValuePair* section = NULL;
     IniStateMap iniState = IniStateMap::Start;
 
     while (iniState != IniStateMap::End)
@@ -208,14 +255,14 @@ INIFile::ParseFile()
                                        sectionName.c_str()).c_str());
             }
 
-            m_sections[sectionName] = SectionNameValuePair();
+            section = &m_sections[sectionName];
             iniState = IniStateMap::Values;
         }
         break;
 
         case IniStateMap::Values:
         {
-            tuple<string, string> value;
+            pair<string_view, string_view> value;
 
             if (GetNextLine(fileLine))
             {
@@ -229,10 +276,13 @@ INIFile::ParseFile()
                     else
                     {
                         value = GetNameValuePair(fileLine);
-                        if (m_sections[sectionName].count(get<0>(value)) == 0 ||
+                        string name(value.first.data(), value.first.size());
+
+                        if (section->count(name) == 0 ||
                             m_allowDuplicateValues)
                         {
-                            m_sections[sectionName].emplace(get<0>(value), get<1>(value));
+                            section->emplace(std::move(name),
+                                             string(value.second.data(), value.second.size()));
                         }
                         else
                         {
@@ -240,7 +290,7 @@ INIFile::ParseFile()
                                       StringFormat("Line %u: The INI file is formatted incorrectly."
                                                    "  The section [%s] has a duplicate value name [%s].",
                                                    m_lineno, sectionName.c_str(),
-                                                   get<0>(value).c_str()).c_str());
+                                                   name.c_str()).c_str());
                         }
                     }
                 }
@@ -293,9 +343,9 @@ INIFile::ParseFile()
 //
 bool
 INIFile::IsEmptyOrComment(
-    string line) // The string to interrogate.
+    string_view line) // The string to interrogate.
 {
-    string trimmedLine = Trim(line);
+    string_view trimmedLine = TrimView(line);
     size_t commentPosition = min(line.find(COMMENT_DELIM1, 0), line.find(COMMENT_DELIM2, 0));
     size_t sectionStartPosition = line.find(SECTION_START_DELIM, 0);
     size_t nvpPosition = line.find(NAME_VALUE_PAIR_DELIM, 0);
@@ -335,7 +385,7 @@ INIFile::IsEmptyOrComment(
 //
 bool
 INIFile::IsSectionHeader(
-    string line) // The string to be interrogated.
+    string_view line) // The string to be interrogated.
 {
     // Note this check assumes that you have already checked and the line is not a comment.
     //
@@ -360,13 +410,12 @@ INIFile::IsSectionHeader(
 //
 string
 INIFile::ExtractSectionName(
-    string line) // INI File line containing section name
+    string_view line) // INI File line containing section name
 {
     size_t sectionStartPosition = line.find(SECTION_START_DELIM, 0);
     size_t sectionEndPosition = line.find(SECTION_END_DELIM, 0);
-    string result = Trim(line.substr(sectionStartPosition + 1,
-                                     sectionEndPosition - sectionStartPosition - 1));
-    string extraText = Trim(line.substr(sectionEndPosition + 1));
+    string_view result;
+    string_view extraText;
 
     if (sectionEndPosition <= sectionStartPosition)
     {
@@ -375,6 +424,10 @@ INIFile::ExtractSectionName(
                                "  An invalid section header was found.", m_lineno).c_str());
     }
 
+    result = TrimView(line.substr(sectionStartPosition + 1,
+                                  sectionEndPosition - sectionStartPosition - 1));
+    extraText = TrimView(line.substr(sectionEndPosition + 1));
+
     if (result.length() == 0)
     {
         throw ParseException(
@@ -393,7 +446,7 @@ INIFile::ExtractSectionName(
                                "  Only whitespace can follow a section header.", m_lineno).c_str());
     }
 
-    return result;
+    return string(result.data(), result.size());
 }
 
 // ---------------------------------------------------------------------------
@@ -407,17 +460,16 @@ INIFile::ExtractSectionName(
 //    only splits at the first separator.
 //
 // Returns:
-//    A pair containing the separated name and value.
+//    A pair containing the separated name and value, trimmed - views into
+//    the line.
 //
-tuple<string, string>
+pair<string_view, string_view>
 INIFile::GetNameValuePair(
-    string line) // The string to Split into name and value.
+    string_view line) // The string to Split into name and value.
 {
     size_t nvpSeparatorPosition = line.find(NAME_VALUE_PAIR_DELIM, 0);
-    vector<string> values = SplitFirst(line, NAME_VALUE_PAIR_DELIM);
 
-    if (nvpSeparatorPosition == string::npos ||
-        values.size() != 2)
+    if (nvpSeparatorPosition == string_view::npos)
     {
         throw ParseException(
                   StringFormat("Line %u: The INI file is formatted incorrectly."
@@ -425,38 +477,44 @@ INIFile::GetNameValuePair(
                                m_lineno).c_str());
     }
 
-    return tuple<string, string>(Trim(values[0]), Trim(values[1]));
+    return pair<string_view, string_view>(TrimView(line.substr(0, nvpSeparatorPosition)),
+                                          TrimView(line.substr(nvpSeparatorPosition + 1)));
 }
 
 // ---------------------------------------------------------------------------
 // Method: GetNextLine
 //
 // Description:
-//    This methods reads the next line from the internal open
-//    file stream and fills in the string provided with it.
+//    This methods gets the next line of the content - up to the next
+//    '\n' or the end of the file - and moves past it. A '\r' before the
+//    '\n' stays in the line, the other methods trim it.
 //
 // Returns:
 //    bool
 //
 bool
 INIFile::GetNextLine(
-    string& fileLine)
+    string_view& fileLine)
 {
-    bool status;
+    size_t end;
 
-    status = true;
-
-    // Read line.
-    //
-    getline(m_fileStream, fileLine);
-    if (m_fileStream.fail())
+    if (m_position >= m_content.size())
     {
-        // Clear the string in case no other line left.
+        // Clear the view in case no other line left.
         //
-        fileLine.clear();
-        status = false;
+        fileLine = string_view();
+        return false;
     }
 
-    return status;
+    end = m_content.find('\n', m_position);
+    if (end == string::npos)
+    {
+        end = m_content.size();
+    }
+
+    fileLine = string_view(m_content.data() + m_position, end - m_position);
+    m_position = end + 1;
+
+    return true;
 }
 
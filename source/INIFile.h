@@ -66,6 +66,11 @@ typedef map<
 //  PAL code currently uses duplicate keys for arrays of items like
 //  registry keys.
 //
+//  The file is read into memory at once and parsed in a single pass.
+//  Lines are string_views into that copy, so only the section names,
+//  names and values that are kept get copied again. The file is not
+//  mapped, as it may be rewritten in place while it is reloaded.
+//
 //  Usage:
 //     There are two methods to creating the class and parsing an INI file.
 //     First you can just create the class using default constructor and call
@@ -120,7 +125,7 @@ public:
     SectionList& GetSections();
 
 private:
-    // Parses the INI file into the class state.
+    // Parses the content of the INI file into the class state.
     //
     void ParseFile();
 
@@ -128,35 +133,34 @@ private:
     // contains a comment.
     //
     bool IsEmptyOrComment(
-        string line); // Line to check for comment or whitespace
+        string_view line); // Line to check for comment or whitespace
 
     // Helper method to determine if a INI file line contains a section
     // header.
     //
     bool IsSectionHeader(
-        string line); // Line to check for section header
+        string_view line); // Line to check for section header
 
     // Helper method to extract a section name from a line containing
     // a section header.
     //
     string ExtractSectionName(
-        string line); // Line to extract section name from.
+        string_view line); // Line to extract section name from.
 
     // Helper method to parse a INI file line containing a
     // name=value line.
     //
-    tuple<string, string> GetNameValuePair(
-        string line); // Line to extract name value pair from.
+    pair<string_view, string_view> GetNameValuePair(
+        string_view line); // Line to extract name value pair from.
 
-    // This methods reads the next line from the internal open
-    // file stream and fills in the string provided with it.
+    // This methods gets the next line of the content, without its
+    // end of line.
     //
     bool GetNextLine(
-        string& fileLine);
+        string_view& fileLine);
 
-    ifstream m_fileStream;       // Filestream to the open
-                                 // file that the class is 
-                                 //loaded with
+    string m_content;            // The file as read
+    size_t m_position;           // Start of the next line
     bool m_allowDuplicateValues; // Determines whether or not
                                  // duplicate keys can exist
                                  // within a section header.
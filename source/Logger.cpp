@@ -0,0 +1,493 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Logger.cpp
+//
+// Purpose:
+//   This file contains the definitions of the asynchronous logger.
+//
+//   Callers reserve a slot of a bounded lock-free ring (multiple
+//   producers, one consumer), format their message into it and publish
+//   it with a release store of the slot sequence. A single log thread
+//   drains the ring and does all the stdio work, so logging from a FUSE
+//   callback costs no lock and no system call.
+//
+#include "UtilsPrivate.h"
+
+static_assert((SQLFS_LOG_RING_SIZE & (SQLFS_LOG_RING_SIZE - 1)) == 0,
+              "SQLFS_LOG_RING_SIZE must be a power of two");
+
+// ---------------------------------------------------------------------------
+// Structure: LogRecord
+//
+// Description:
+//    Slot of the ring. m_sequence equals the position of the slot when it
+//    is free for that position and position + 1 once the message is
+//    published.
+//
+struct LogRecord
+{
+    std::atomic<uint64_t>   m_sequence;
+    struct timespec         m_time;
+    pid_t                   m_threadId;
+    LogLevel                m_level;
+    int                     m_length;
+    char                    m_text[SQLFS_LOG_MESSAGE_LEN];
+};
+
+static const char* g_LogLevelNames[] = { "error", "warning", "info", "debug" };
+
+// Log file shared by all the threads. Opened once at startup by OpenLogFile.
+//
+static FILE* g_LogFile = NULL;
+
+static LogRecord                g_LogRing[SQLFS_LOG_RING_SIZE];
+alignas(64) static std::atomic<uint64_t> g_LogEnqueuePos(0);
+alignas(64) static uint64_t     g_LogDequeuePos = 0;    // Only used by the consumer
+static std::atomic<uint64_t>    g_LogDropped(0);
+static std::atomic<bool>        g_LogThreadRunning(false);
+static std::atomic<bool>        g_LogThreadStop(false);
+static thread                   g_LogThread;
+
+// Serializes the writes to the log stream - between the log thread and
+// the callers writing directly while there is no log thread.
+//
+static std::mutex               g_LogWriteLock;
+
+// ---------------------------------------------------------------------------
+// Method: GetLogStream
+//
+// Description:
+//    This method gets the stream messages need to be written to.
+//
+// Returns:
+//    The log file, STDERR if no log file was given or NULL if the log
+//    file could not be opened.
+//
+static FILE*
+GetLogStream()
+{
+    return g_UseLogFile ? g_LogFile : stderr;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetThreadId
+//
+// Description:
+//    This method gets the kernel id of the calling thread (the one shown
+//    by ps and top), looked up once per thread.
+//
+// Returns:
+//    Thread id.
+//
+static pid_t
+GetThreadId()
+{
+    static thread_local pid_t threadId = (pid_t)syscall(SYS_gettid);
+
+    return threadId;
+}
+
+// ---------------------------------------------------------------------------
+// Method: FillRecord
+//
+// Description:
+//    This method formats the message into the record. Trailing newlines
+//    are dropped as the writer ends every message with one.
+//
+// Returns:
+//    VOID
+//
+static void
+FillRecord(
+    LogRecord& record,
+    LogLevel level,
+    const char* format,
+    va_list args)
+{
+    int length;
+
+    clock_gettime(CLOCK_REALTIME, &record.m_time);
+    record.m_threadId = GetThreadId();
+    record.m_level = level;
+
+    length = vsnprintf(record.m_text, sizeof(record.m_text), format, args);
+    length = max(0, min(length, (int)sizeof(record.m_text) - 1));
+
+    while (length > 0 && record.m_text[length - 1] == '\n')
+    {
+        length--;
+    }
+    record.m_length = length;
+}
+
+// ---------------------------------------------------------------------------
+// Method: WriteRecord
+//
+// Description:
+//    This method writes a message as
+//      <date> <time>.<ms> [<thread id>] <level> <message>
+//    The caller holds g_LogWriteLock.
+//
+// Returns:
+//    VOID
+//
+static void
+WriteRecord(
+    FILE* outFile,
+    const LogRecord& record)
+{
+    struct tm   localTime;
+    char        timestamp[32];
+
+    localtime_r(&record.m_time.tv_sec, &localTime);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &localTime);
+
+    fprintf(outFile, "%s.%03ld [%d] %s %.*s\n",
+            timestamp, record.m_time.tv_nsec / 1000000,
+            (int)record.m_threadId, g_LogLevelNames[record.m_level],
+            record.m_length, record.m_text);
+}
+
+// ---------------------------------------------------------------------------
+// Method: DrainRing
+//
+// Description:
+//    This method writes all the published messages of the ring and frees
+//    their slots. Only the log thread (or CloseLogFile once the thread is
+//    gone) calls this.
+//
+// Returns:
+//    Number of messages written.
+//
+static size_t
+DrainRing()
+{
+    LogRecord*  record;
+    FILE*       outFile;
+    size_t      numWritten = 0;
+    uint64_t    dropped;
+
+    std::lock_guard<std::mutex> guard(g_LogWriteLock);
+
+    outFile = GetLogStream();
+
+    for (;;)
+    {
+        record = &g_LogRing[g_LogDequeuePos & (SQLFS_LOG_RING_SIZE - 1)];
+        if (record->m_sequence.load(std::memory_order_acquire) != g_LogDequeuePos + 1)
+        {
+            break;
+        }
+
+        if (outFile)
+        {
+            WriteRecord(outFile, *record);
+        }
+
+        record->m_sequence.store(g_LogDequeuePos + SQLFS_LOG_RING_SIZE, std::memory_order_release);
+        g_LogDequeuePos++;
+        numWritten++;
+    }
+
+    dropped = g_LogDropped.exchange(0, std::memory_order_relaxed);
+    if (outFile && dropped)
+    {
+        fprintf(outFile, "%llu log messages dropped - the log ring was full\n",
+                (unsigned long long)dropped);
+    }
+
+    if (outFile && (numWritten || dropped))
+    {
+        fflush(outFile);
+    }
+
+    return numWritten;
+}
+
+// ---------------------------------------------------------------------------
+// Method: LogThreadMain
+//
+// Description:
+//    Body of the log thread. Drains the ring until asked to stop, and
+//    sleeps a little whenever the ring is empty.
+//
+// Returns:
+//    VOID
+//
+static void
+LogThreadMain()
+{
+    while (!g_LogThreadStop.load(std::memory_order_acquire))
+    {
+        if (DrainRing() == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(SQLFS_LOG_POLL_INTERVAL_MS));
+        }
+    }
+
+    DrainRing();
+}
+
+// ---------------------------------------------------------------------------
+// Method: ParseLogLevel
+//
+// Description:
+//    This method parses the name of a log level.
+//
+// Returns:
+//    true if the name is a log level - otherwise false.
+//
+bool
+ParseLogLevel(
+    const string& name,
+    LogLevel& level)
+{
+    bool status = false;
+
+    for (size_t i = 0; i < sizeof(g_LogLevelNames) / sizeof(g_LogLevelNames[0]); i++)
+    {
+        if (strcasecmp(name.c_str(), g_LogLevelNames[i]) == 0)
+        {
+            level = (LogLevel)i;
+            status = true;
+        }
+    }
+
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Method: OpenLogFile
+//
+// Description:
+//    This method opens (and truncates) the log file if one was given and
+//    keeps it open for the lifetime of the process. The stream is fully
+//    buffered - the log thread flushes it after each batch of messages.
+//
+// Returns:
+//    true on success (or if no log file is used) - otherwise false.
+//
+bool
+OpenLogFile()
+{
+    bool status = true;
+
+    if (g_InVerbose && g_UseLogFile)
+    {
+        g_LogFile = fopen(g_UserPaths.m_logfilePath.c_str(), "w");
+        if (!g_LogFile)
+        {
+            status = false;
+        }
+    }
+
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Method: CloseLogFile
+//
+// Description:
+//    This method stops the log thread (which writes the messages still in
+//    the ring) and closes the log file opened by OpenLogFile.
+//
+// Returns:
+//    VOID
+//
+void
+CloseLogFile()
+{
+    if (g_LogThreadRunning.exchange(false))
+    {
+        g_LogThreadStop.store(true, std::memory_order_release);
+        g_LogThread.join();
+
+        // Messages published by callers that saw the thread running just
+        // before it stopped.
+        //
+        DrainRing();
+    }
+
+    std::lock_guard<std::mutex> guard(g_LogWriteLock);
+
+    if (g_LogFile)
+    {
+        fclose(g_LogFile);
+        g_LogFile = NULL;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: StartLogThread
+//
+// Description:
+//    This method starts the log thread. Nothing is started if verbose
+//    mode is off since nothing is logged then.
+//
+// Returns:
+//    VOID
+//
+void
+StartLogThread()
+{
+    if (!g_InVerbose || g_LogThreadRunning.load())
+    {
+        return;
+    }
+
+    for (uint64_t i = 0; i < SQLFS_LOG_RING_SIZE; i++)
+    {
+        g_LogRing[i].m_sequence.store(i, std::memory_order_relaxed);
+    }
+    g_LogEnqueuePos.store(0, std::memory_order_relaxed);
+    g_LogDequeuePos = 0;
+    g_LogThreadStop.store(false, std::memory_order_relaxed);
+
+    g_LogThread = thread(LogThreadMain);
+    g_LogThreadRunning.store(true, std::memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsLogEnabled
+//
+// Description:
+//    This method checks if messages of the given level are logged. Lets
+//    callers skip building a message nobody will see.
+//
+// Returns:
+//    bool
+//
+bool
+IsLogEnabled(
+    LogLevel level)
+{
+    return g_InVerbose && level <= g_LogLevel;
+}
+
+// ---------------------------------------------------------------------------
+// Method: WriteDirect
+//
+// Description:
+//    This method writes a message from the calling thread, bypassing the
+//    ring.
+//
+// Returns:
+//    VOID
+//
+static void
+WriteDirect(
+    LogLevel level,
+    const char* format,
+    va_list args)
+{
+    LogRecord   record;
+    FILE*       outFile;
+
+    FillRecord(record, level, format, args);
+
+    std::lock_guard<std::mutex> guard(g_LogWriteLock);
+
+    outFile = GetLogStream();
+    if (outFile)
+    {
+        WriteRecord(outFile, record);
+        fflush(outFile);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: LogMsgV
+//
+// Description:
+//    This method logs a message. While the log thread runs, the message is
+//    formatted into the next free slot of the ring - if the ring is full
+//    the message is dropped rather than blocking the caller (errors are
+//    written out directly instead). Otherwise it is written out right
+//    away.
+//
+// Returns:
+//    VOID
+//
+void
+LogMsgV(
+    LogLevel level,
+    const char* format,
+    va_list args)
+{
+    LogRecord*  record;
+    uint64_t    pos;
+    int64_t     diff;
+
+    if (!IsLogEnabled(level))
+    {
+        return;
+    }
+
+    if (!g_LogThreadRunning.load(std::memory_order_acquire))
+    {
+        WriteDirect(level, format, args);
+        return;
+    }
+
+    // Claim the slot at the enqueue position.
+    //
+    pos = g_LogEnqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        record = &g_LogRing[pos & (SQLFS_LOG_RING_SIZE - 1)];
+        diff = (int64_t)(record->m_sequence.load(std::memory_order_acquire) - pos);
+
+        if (diff == 0)
+        {
+            if (g_LogEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // The slot still holds a message from the previous lap. Errors
+            // are written right away, anything else is dropped.
+            //
+            if (level == LOG_LEVEL_ERROR)
+            {
+                WriteDirect(level, format, args);
+            }
+            else
+            {
+                g_LogDropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            return;
+        }
+        else
+        {
+            pos = g_LogEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    FillRecord(*record, level, format, args);
+    record->m_sequence.store(pos + 1, std::memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// Method: LogMsg
+//
+// Description:
+//    This method logs a message of the given level.
+//
+// Returns:
+//    VOID
+//
+void
+LogMsg(
+    LogLevel level,
+    const char* format, ...)
+{
+    va_list argptr;
+
+    va_start(argptr, format);
+    LogMsgV(level, format, argptr);
+    va_end(argptr);
+}
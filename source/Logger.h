@@ -0,0 +1,84 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Logger.h
+//
+// Purpose:
+//   This file contains the declarations of the asynchronous logger used
+//   in verbose mode.
+//
+#pragma once
+
+// Number of messages the ring buffer holds. Must be a power of two.
+// Messages logged while the ring is full are dropped (and counted).
+//
+#define SQLFS_LOG_RING_SIZE             4096
+
+// Longest message kept - longer messages are truncated.
+//
+#define SQLFS_LOG_MESSAGE_LEN           480
+
+// How often the log thread looks for new messages when the ring is
+// empty.
+//
+#define SQLFS_LOG_POLL_INTERVAL_MS      10
+
+// ---------------------------------------------------------------------------
+// Severity of a log message. Messages above the level given with
+// -L/--log-level are not logged.
+//
+enum LogLevel
+{
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG
+};
+
+// This method parses the name of a log level (error, warning, info or
+// debug).
+//
+bool
+ParseLogLevel(
+    const string& name,
+    LogLevel& level);
+
+// This method opens the log file once for all the threads.
+//
+bool
+OpenLogFile();
+
+// This method stops the log thread, writes the messages still in the
+// ring and closes the log file.
+//
+void
+CloseLogFile();
+
+// This method starts the thread writing the log. Until then (and after
+// CloseLogFile) messages are written by the caller. It must be called
+// after FUSE forked the daemon.
+//
+void
+StartLogThread();
+
+// This method checks if messages of the given level are logged.
+//
+bool
+IsLogEnabled(
+    LogLevel level);
+
+// This method logs a message. The caller only formats the message into
+// a slot of the ring, the log thread adds the timestamp, thread id and
+// level and writes it out.
+//
+void
+LogMsg(
+    LogLevel level,
+    const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+void
+LogMsgV(
+    LogLevel level,
+    const char* format,
+    va_list args);
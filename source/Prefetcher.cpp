@@ -0,0 +1,303 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Prefetcher.cpp
+//
+// Purpose:
+//   This file contains the definitions of the background refresher of
+//   prefetched DMV files.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+// Description:
+//    Sets up a task per entry. The extension of the file name (.json,
+//    .csv, .ndjson or none for TSV) gives the form refreshed. An entry in
+//    the bundle folder refreshes all the DMV files of the bundle in one
+//    batch.
+//
+Prefetcher::Prefetcher(
+    const string& servername,
+    ServerInfo* serverInfo,
+    const vector<PrefetchEntry>& entries) :
+    m_servername(servername),
+    m_serverInfo(serverInfo),
+    m_stop(false)
+{
+    PrefetchTask    task;
+    string          dmvName;
+    const string    bundlePrefix = BUNDLE_FOLDER_NAME LINUX_PATH_DELIM;
+
+    for (auto&& entry : entries)
+    {
+        if (m_taskIndex.count(entry.m_filename))
+        {
+            continue;
+        }
+
+        task.m_bundleName.clear();
+        dmvName = entry.m_filename;
+
+        if (IsPrefix(bundlePrefix, entry.m_filename) == 0)
+        {
+            task.m_bundleName = entry.m_filename.substr(bundlePrefix.length());
+            if (!serverInfo->m_bundles.count(task.m_bundleName))
+            {
+                PrintMsg("Prefetch entry %s of server %s is not a bundle of the server - ignored\n",
+                    entry.m_filename.c_str(), servername.c_str());
+                continue;
+            }
+        }
+
+        task.m_type = task.m_bundleName.empty() ? SplitFileFormat(dmvName) : TYPE_TSV;
+
+        task.m_filename = entry.m_filename;
+        task.m_query = task.m_bundleName.empty() ? GetDmvQuery(dmvName, task.m_type) : "";
+        task.m_timeout = GetQueryTimeout(serverInfo, dmvName);
+        task.m_interval = max(entry.m_interval, std::chrono::milliseconds(1));
+        task.m_stats = GetQueryStats(servername, entry.m_filename);
+        task.m_sharedVersion = 0;
+
+        m_taskIndex[entry.m_filename] = m_tasks.size();
+        m_tasks.push_back(task);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: Destructor
+//
+Prefetcher::~Prefetcher()
+{
+    Stop();
+}
+
+// ---------------------------------------------------------------------------
+// Method: Start
+//
+// Description:
+//    This method starts the scheduler thread. It must be called after
+//    FUSE forked the daemon.
+//
+// Returns:
+//    VOID
+//
+void
+Prefetcher::Start()
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if (m_thread.joinable() || m_tasks.empty())
+    {
+        return;
+    }
+
+    for (auto&& task : m_tasks)
+    {
+        task.m_nextRun = now;
+    }
+
+    m_stop = false;
+    m_thread = thread(&Prefetcher::Run, this);
+}
+
+// ---------------------------------------------------------------------------
+// Method: Stop
+//
+// Description:
+//    This method stops the scheduler thread. A refresh in progress is not
+//    interrupted - it ends within the query timeout of the connection.
+//
+// Returns:
+//    VOID
+//
+void
+Prefetcher::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stop = true;
+    }
+    m_wakeup.notify_all();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsPrefetched
+//
+// Description:
+//    This method checks if the file is refreshed by the prefetcher.
+//
+// Returns:
+//    bool
+//
+bool
+Prefetcher::IsPrefetched(
+    const string& filename) const
+{
+    return m_taskIndex.count(filename) != 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetSnapshot
+//
+// Description:
+//    This method gets the latest published snapshot of the file.
+//
+// Returns:
+//    The snapshot or NULL.
+//
+QueryResult
+Prefetcher::GetSnapshot(
+    const string& filename) const
+{
+    auto itr = m_taskIndex.find(filename);
+
+    if (itr == m_taskIndex.end())
+    {
+        return QueryResult();
+    }
+
+    return std::atomic_load(&m_tasks[itr->second].m_snapshot);
+}
+
+// ---------------------------------------------------------------------------
+// Method: Refresh
+//
+// Description:
+//    This method runs the query of the task (or the batch of its bundle)
+//    into a new buffer and publishes the buffer if it succeeded. TSV
+//    snapshots of DMV files are also added to the history of the server,
+//    if it keeps one.
+//
+//    With shared snapshots, the snapshot published by another instance
+//    is taken instead of querying, and the snapshots of the publisher
+//    are published for the others.
+//
+// Returns:
+//    VOID
+//
+void
+Prefetcher::Refresh(
+    PrefetchTask& task)
+{
+    SharedSnapshotStore*    shared = m_serverInfo->m_sharedSnapshots;
+    QueryResult             snapshot = make_shared<ResultBuffer>();
+    int                     error = -1;
+    bool                    publish = false;
+
+    if (shared && !shared->TryPublish())
+    {
+        error = shared->Read(task.m_filename, task.m_sharedVersion, snapshot);
+
+        // Not refreshed by the publisher since the last read (or being
+        // written) - the current snapshot stays.
+        //
+        if (error == 1 || error == -EBUSY)
+        {
+            return;
+        }
+    }
+    else
+    {
+        publish = (shared != NULL);
+    }
+
+    // Not published by another instance - query the server.
+    //
+    if (error && task.m_bundleName.empty())
+    {
+        snapshot = make_shared<ResultBuffer>();
+        error = ExecuteQuery(task.m_query, *snapshot, m_serverInfo, task.m_type,
+                             task.m_timeout, task.m_stats);
+    }
+    else if (error)
+    {
+        error = RunBundle(m_servername, m_serverInfo, task.m_bundleName, snapshot);
+    }
+    else
+    {
+        LogMsg(LOG_LEVEL_DEBUG, "Prefetch of %s on server %s taken from the shared snapshots\n",
+            task.m_filename.c_str(), m_servername.c_str());
+    }
+
+    if (error == 0)
+    {
+        std::atomic_store(&task.m_snapshot, snapshot);
+
+        if (publish)
+        {
+            shared->Publish(task.m_filename, snapshot);
+        }
+
+        if (m_serverInfo->m_history && task.m_bundleName.empty() && task.m_type == TYPE_TSV)
+        {
+            m_serverInfo->m_history->Record(task.m_filename, snapshot);
+        }
+    }
+    else
+    {
+        LogMsg(LOG_LEVEL_WARNING, "Prefetch of %s on server %s failed - keeping the previous snapshot\n",
+            task.m_filename.c_str(), m_servername.c_str());
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: Run
+//
+// Description:
+//    Body of the scheduler thread. Refreshes the files that are due, then
+//    sleeps until the next one is due or Stop is called.
+//
+//    The next run of a file is scheduled from its previous due time so
+//    refreshes do not drift. If a refresh took longer than the interval,
+//    the missed runs are skipped rather than run back to back.
+//
+// Returns:
+//    VOID
+//
+void
+Prefetcher::Run()
+{
+    std::chrono::steady_clock::time_point   nextWakeup;
+    std::chrono::steady_clock::time_point   now;
+
+    std::unique_lock<std::mutex> guard(m_lock);
+
+    while (!m_stop)
+    {
+        for (auto&& task : m_tasks)
+        {
+            now = std::chrono::steady_clock::now();
+            if (m_stop || task.m_nextRun > now)
+            {
+                continue;
+            }
+
+            guard.unlock();
+            Refresh(task);
+            guard.lock();
+
+            task.m_nextRun += task.m_interval;
+            now = std::chrono::steady_clock::now();
+            if (task.m_nextRun <= now)
+            {
+                task.m_nextRun = now + task.m_interval;
+            }
+        }
+
+        nextWakeup = m_tasks.front().m_nextRun;
+        for (auto&& task : m_tasks)
+        {
+            nextWakeup = min(nextWakeup, task.m_nextRun);
+        }
+
+        m_wakeup.wait_until(guard, nextWakeup, [this] { return m_stop; });
+    }
+}
@@ -0,0 +1,114 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Prefetcher.h
+//
+// Purpose:
+//   This file contains the declaration of the background refresher of
+//   the DMV files listed in the prefetch setting of a server.
+//
+#pragma once
+
+// ---------------------------------------------------------------------------
+// Structure: PrefetchEntry
+//
+// Description:
+//    One entry of the prefetch setting - the DMV file (e.g.
+//    dm_exec_requests or dm_exec_requests.json) and how often it is
+//    refreshed. bundle/<name> refreshes a bundle of the server.
+//
+struct PrefetchEntry
+{
+    string                      m_filename;
+    std::chrono::milliseconds   m_interval;
+};
+
+//--------------------------------------------------------------------
+// Class: Prefetcher
+//
+// Description:
+//  Refreshes the prefetched DMV files of one server on their interval
+//  from a scheduler thread, using the connection pool of the server.
+//
+//  Each file has a published snapshot (the front buffer) that readers
+//  get right away, while the next refresh is serialized into a new
+//  buffer (the back buffer). The new buffer only replaces the snapshot
+//  once its query completed, so readers never wait for the server and
+//  never see a partial or failed result - if a refresh fails the
+//  previous snapshot stays published.
+//
+//  The files of a server are refreshed one at a time, so a server gets
+//  at most one prefetch query at once.
+//
+//  With shared snapshots, only the instance publishing the snapshots of
+//  the server queries it. The other instances take the snapshots it
+//  published, and only query the files it does not prefetch.
+//
+class Prefetcher
+{
+public:
+    // Constructor. Nothing runs until Start.
+    //
+    Prefetcher(
+        const string& servername,
+        ServerInfo* serverInfo,
+        const vector<PrefetchEntry>& entries);
+
+    // Destructor - stops the scheduler thread.
+    //
+    ~Prefetcher();
+
+    // Starts the scheduler thread. Each file is refreshed right away and
+    // then on its interval.
+    //
+    void Start();
+
+    // Stops the scheduler thread, waiting for the refresh in progress.
+    //
+    void Stop();
+
+    // Checks if the file is in the prefetch setting.
+    //
+    bool IsPrefetched(
+        const string& filename) const;
+
+    // Returns the latest snapshot of the file - NULL if the file is not
+    // prefetched or its first refresh did not complete yet.
+    //
+    QueryResult GetSnapshot(
+        const string& filename) const;
+
+private:
+    struct PrefetchTask
+    {
+        string                                  m_filename;
+        string                                  m_bundleName;   // Empty for a DMV file
+        string                                  m_query;
+        FileFormat                              m_type;
+        std::chrono::milliseconds               m_timeout;
+        std::chrono::milliseconds               m_interval;
+        std::chrono::steady_clock::time_point   m_nextRun;      // Only used by the scheduler
+        QueryResult                             m_snapshot;     // Accessed with atomic_load/store
+        QueryStats*                             m_stats;
+        uint64_t                                m_sharedVersion;    // Of the last shared snapshot read
+    };
+
+    // Body of the scheduler thread.
+    //
+    void Run();
+
+    // Runs the query of the task and publishes the result.
+    //
+    void Refresh(
+        PrefetchTask& task);
+
+    string                          m_servername;
+    ServerInfo*                     m_serverInfo;
+    vector<PrefetchTask>            m_tasks;        // Not resized after construction
+    unordered_map<string, size_t>   m_taskIndex;    // File name -> index in m_tasks
+    thread                          m_thread;
+    std::mutex                      m_lock;
+    std::condition_variable         m_wakeup;
+    bool                            m_stop;
+};
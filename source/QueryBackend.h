@@ -0,0 +1,80 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: QueryBackend.h
+//
+// Purpose:
+//   This file contains the declaration of the interface that lets the
+//   queries of DBFS run somewhere other than DB-Library.
+//
+#pragma once
+
+//--------------------------------------------------------------------
+// Class: QueryBackend
+//
+// Description:
+//  Runs the queries of DBFS in place of DB-Library once installed with
+//  SetQueryBackend. Every query (DMV files, views, custom queries and
+//  the DMV list at mount time) goes through ExecuteQuery and server
+//  checks go through VerifyServerInfo, so a backend sees all the traffic
+//  a server would.
+//
+//  Used by the benchmarks to drive the file system without a server.
+//  Implementations must be thread-safe - queries run on the FUSE, cache
+//  and prefetch threads at once.
+//
+class QueryBackend
+{
+public:
+    virtual ~QueryBackend() {}
+
+    // Runs the query, appends the rows to output in the given form and
+    // marks output complete. Same contract as ::ExecuteQuery.
+    //
+    virtual int ExecuteQuery(
+        const string& query,
+        ResultBuffer& output,
+        ServerInfo* serverInfo,
+        const FileFormat type,
+        std::chrono::milliseconds timeout,
+        QueryStats* stats) = 0;
+
+    // Runs several queries in one round trip, each into its own output
+    // (allocated by the caller). Same contract as ::ExecuteBatch - by
+    // default the queries run one by one.
+    //
+    virtual int ExecuteBatch(
+        const vector<string>& queries,
+        const vector<FileFormat>& types,
+        vector<QueryResult>& outputs,
+        ServerInfo* serverInfo,
+        std::chrono::milliseconds timeout,
+        QueryStats* stats)
+    {
+        int result = 0;
+
+        for (size_t i = 0; i < queries.size(); i++)
+        {
+            if (ExecuteQuery(queries[i], *outputs[i], serverInfo, types[i], timeout, stats))
+            {
+                result = -1;
+            }
+        }
+
+        return result;
+    }
+
+    // Checks that the server can be queried.
+    //
+    virtual bool VerifyServerInfo(
+        ServerInfo* serverInfo) = 0;
+};
+
+// This method installs the backend the queries run on. NULL (the
+// default) runs them with DB-Library. Must be called before any query
+// runs - the backend is not owned.
+//
+void
+SetQueryBackend(
+    QueryBackend* backend);
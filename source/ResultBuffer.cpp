@@ -0,0 +1,519 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: ResultBuffer.cpp
+//
+// Purpose:
+//   This file contains the definitions of the buffer that holds the
+//   output of a query.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+ResultBuffer::ResultBuffer() :
+    m_numResident(0),
+    m_written(0),
+    m_published(0),
+    m_complete(false),
+    m_error(0),
+    m_numReaders(0),
+    m_cancelled(false)
+{
+}
+
+// ---------------------------------------------------------------------------
+// Method: Destructor
+//
+ResultBuffer::~ResultBuffer()
+{
+    AddResidentBytes(-(ssize_t)(m_numResident * SQLFS_RESULT_CHUNK_SIZE));
+}
+
+// ---------------------------------------------------------------------------
+// Method: Append
+//
+// Description:
+//    This method copies the data into the chunk being filled,
+//    allocating a new chunk when the current one is full. Readers only
+//    look at published data, so the copy is done without the lock. Each
+//    full chunk is published as soon as it is filled, and spilled if the
+//    results are over their memory budget.
+//
+// Returns:
+//    VOID
+//
+void
+ResultBuffer::Append(
+    const char* data,
+    size_t length)
+{
+    size_t  offsetInChunk;
+    size_t  toCopy;
+
+    while (length)
+    {
+        offsetInChunk = m_written % SQLFS_RESULT_CHUNK_SIZE;
+        if (offsetInChunk == 0 && m_written / SQLFS_RESULT_CHUNK_SIZE == m_chunks.size())
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_chunks.emplace_back(new char[SQLFS_RESULT_CHUNK_SIZE], std::default_delete<char[]>());
+            m_numResident++;
+            AddResidentBytes(SQLFS_RESULT_CHUNK_SIZE);
+        }
+
+        toCopy = min(length, (size_t)SQLFS_RESULT_CHUNK_SIZE - offsetInChunk);
+        memcpy(m_chunks.back().get() + offsetInChunk, data, toCopy);
+
+        m_written += toCopy;
+        data += toCopy;
+        length -= toCopy;
+
+        if (m_written % SQLFS_RESULT_CHUNK_SIZE == 0)
+        {
+            Publish();
+
+            if (ShouldSpill(m_written))
+            {
+                Spill(m_chunks.size() - 1);
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: Spill
+//
+// Description:
+//    This method writes a full chunk to the spill file and drops it from
+//    memory. A reader copying the chunk keeps its own reference, so the
+//    memory goes away once the last copy is done. If the chunk cannot be
+//    written it stays in memory.
+//
+// Returns:
+//    VOID
+//
+void
+ResultBuffer::Spill(
+    size_t index)
+{
+    SpilledChunk location;
+
+    if (!m_spillFile)
+    {
+        m_spillFile.reset(new SpillFile());
+    }
+
+    if (m_spillFile->Write(m_chunks[index].get(), location))
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        m_spilled.resize(index + 1);
+        m_spilled[index] = location;
+        m_chunks[index].reset();
+        m_numResident--;
+    }
+
+    AddResidentBytes(-SQLFS_RESULT_CHUNK_SIZE);
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetChunks
+//
+// Description:
+//    This method gets a reference to each chunk of the range, so that it
+//    can be copied without the lock.
+//
+// Returns:
+//    VOID
+//
+void
+ResultBuffer::GetChunks(
+    size_t start,
+    size_t length,
+    vector<ChunkRef>& chunks)
+{
+    ChunkRef ref;
+
+    for (size_t i = start / SQLFS_RESULT_CHUNK_SIZE;
+         i <= (start + length - 1) / SQLFS_RESULT_CHUNK_SIZE;
+         i++)
+    {
+        ref.m_chunk = m_chunks[i];
+        if (!ref.m_chunk)
+        {
+            ref.m_location = m_spilled[i];
+        }
+        chunks.push_back(ref);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: CopyChunks
+//
+// Description:
+//    This method copies the range out of its chunks, decompressing the
+//    spilled ones.
+//
+// Returns:
+//    0 or -EIO.
+//
+int
+ResultBuffer::CopyChunks(
+    const vector<ChunkRef>& chunks,
+    size_t start,
+    size_t length,
+    char* buf)
+{
+    unique_ptr<char[]>  spilled;
+    const char*         data;
+    size_t              copied = 0;
+    size_t              offsetInChunk;
+    size_t              toCopy;
+
+    for (auto&& chunk : chunks)
+    {
+        data = chunk.m_chunk.get();
+        if (!data)
+        {
+            if (!spilled)
+            {
+                spilled.reset(new char[SQLFS_RESULT_CHUNK_SIZE]);
+            }
+            if (m_spillFile->Read(chunk.m_location, spilled.get()))
+            {
+                return -EIO;
+            }
+            data = spilled.get();
+        }
+
+        offsetInChunk = (start + copied) % SQLFS_RESULT_CHUNK_SIZE;
+        toCopy = min(length - copied, (size_t)SQLFS_RESULT_CHUNK_SIZE - offsetInChunk);
+        memcpy(buf + copied, data + offsetInChunk, toCopy);
+        copied += toCopy;
+    }
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Append
+//
+// Description:
+//    Single character variant of Append, used for the separators.
+//
+// Returns:
+//    VOID
+//
+void
+ResultBuffer::Append(
+    char c)
+{
+    Append(&c, 1);
+}
+
+// ---------------------------------------------------------------------------
+// Method: Publish
+//
+// Description:
+//    This method makes the data appended so far visible to the readers
+//    and wakes up the readers waiting for it.
+//
+// Returns:
+//    VOID
+//
+void
+ResultBuffer::Publish()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_published = m_written;
+    }
+
+    m_dataAvailable.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// Method: Complete
+//
+// Description:
+//    This method publishes the remaining data and marks the output as
+//    complete.
+//
+// Returns:
+//    VOID
+//
+void
+ResultBuffer::Complete(
+    int error)
+{
+    Complete(error, std::chrono::steady_clock::now());
+}
+
+// ---------------------------------------------------------------------------
+// Method: Complete
+//
+// Description:
+//    This method marks the output as complete as of completionTime,
+//    which readers get as the time of the snapshot.
+//
+// Returns:
+//    VOID
+//
+void
+ResultBuffer::Complete(
+    int error,
+    std::chrono::steady_clock::time_point completionTime)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_published = m_written;
+        m_complete = true;
+        m_error = error;
+        m_completionTime = completionTime;
+    }
+
+    m_dataAvailable.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsCancelled
+//
+// Description:
+//    This method is polled by the producer between rows.
+//
+// Returns:
+//    true if the producer should stop.
+//
+bool
+ResultBuffer::IsCancelled() const
+{
+    return m_cancelled.load(std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Method: Read
+//
+// Description:
+//    This method waits until the requested range is published or the
+//    output is complete, then copies what is available. The published
+//    data never changes, so it is copied without the lock.
+//
+//    With isInterrupted the wait is done in slices of
+//    SQLFS_QUERY_POLL_INTERVAL_MS so that an interrupted reader does not
+//    wait for the rest of a slow query.
+//
+// Returns:
+//    Number of bytes copied, -EIO or -EINTR.
+//
+int
+ResultBuffer::Read(
+    char* buf,
+    size_t size,
+    off_t offset,
+    bool (*isInterrupted)())
+{
+    size_t              start;
+    size_t              available;
+    int                 error;
+    vector<ChunkRef>    chunks;
+
+    if (offset < 0)
+    {
+        return -EINVAL;
+    }
+    if (size == 0)
+    {
+        return 0;
+    }
+    start = (size_t)offset;
+
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+
+        auto isReadable = [&] {
+            return m_complete || m_published >= start + size;
+        };
+
+        if (!isInterrupted)
+        {
+            m_dataAvailable.wait(guard, isReadable);
+        }
+        else
+        {
+            while (!m_dataAvailable.wait_for(guard,
+                                             std::chrono::milliseconds(SQLFS_QUERY_POLL_INTERVAL_MS),
+                                             isReadable))
+            {
+                if (isInterrupted())
+                {
+                    return -EINTR;
+                }
+            }
+        }
+
+        if (start >= m_published)
+        {
+            return (m_error && m_complete) ? -EIO : 0;
+        }
+
+        available = min(size, m_published - start);
+        GetChunks(start, available, chunks);
+    }
+
+    error = CopyChunks(chunks, start, available, buf);
+
+    return error ? error : (int)available;
+}
+
+// ---------------------------------------------------------------------------
+// Method: AddReader
+//
+// Description:
+//    This method registers a reader (an open file) of the output.
+//
+// Returns:
+//    VOID
+//
+void
+ResultBuffer::AddReader()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_numReaders++;
+}
+
+// ---------------------------------------------------------------------------
+// Method: RemoveReader
+//
+// Description:
+//    This method unregisters a reader. When the last reader leaves
+//    before the output is complete, the query is no longer needed and
+//    the buffer is marked as cancelled.
+//
+// Returns:
+//    VOID
+//
+void
+ResultBuffer::RemoveReader()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    m_numReaders--;
+    if (m_numReaders == 0 && !m_complete)
+    {
+        m_cancelled = true;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsComplete
+//
+// Returns:
+//    true if the producer is done.
+//
+bool
+ResultBuffer::IsComplete()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_complete;
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsUsable
+//
+// Description:
+//    This method tells the result cache whether the output can be given
+//    to a new reader. A cancelled output is not, even once complete - the
+//    producer stops at the first row it sees the cancel, so the output
+//    is likely truncated.
+//
+// Returns:
+//    bool
+//
+bool
+ResultBuffer::IsUsable()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return !m_cancelled && (!m_complete || m_error == 0);
+}
+
+// ---------------------------------------------------------------------------
+// Method: ToString
+//
+// Description:
+//    This method waits for the output to be complete and copies it into
+//    a single string.
+//
+// Returns:
+//    The output - empty if a spilled chunk cannot be read back.
+//
+string
+ResultBuffer::ToString()
+{
+    string              output;
+    vector<ChunkRef>    chunks;
+
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+        m_dataAvailable.wait(guard, [this] { return m_complete; });
+
+        if (m_published == 0)
+        {
+            return output;
+        }
+        GetChunks(0, m_published, chunks);
+        output.resize(m_published);
+    }
+
+    if (CopyChunks(chunks, 0, output.size(), &output[0]))
+    {
+        output.clear();
+    }
+
+    return output;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetSize
+//
+// Description:
+//    This method waits for the output to be complete and returns its
+//    size. Used to report the size of a file before it is read.
+//
+// Returns:
+//    Size of the output in bytes - 0 if the query failed.
+//
+size_t
+ResultBuffer::GetSize()
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_dataAvailable.wait(guard, [this] { return m_complete; });
+
+    return m_error ? 0 : m_published;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetCompletionTime
+//
+// Description:
+//    This method waits for the output to be complete and returns when
+//    it was completed. Used to time the interval between two snapshots
+//    of a DMV.
+//
+// Returns:
+//    The completion time.
+//
+std::chrono::steady_clock::time_point
+ResultBuffer::GetCompletionTime()
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_dataAvailable.wait(guard, [this] { return m_complete; });
+
+    return m_completionTime;
+}
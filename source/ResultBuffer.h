@@ -0,0 +1,172 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: ResultBuffer.h
+//
+// Purpose:
+//   This file contains the declaration of the buffer that holds the
+//   output of a query while it is produced and read.
+//
+#pragma once
+
+// Size of each chunk of a result buffer. Readers of a streamed result
+// see the output one chunk at a time.
+//
+#define SQLFS_RESULT_CHUNK_SIZE     (64 * 1024)
+
+//--------------------------------------------------------------------
+// Class: ResultBuffer
+//
+// Description:
+//  Output of a query stored as a list of fixed-size chunks. It is
+//  written by one producer and read by any number of readers.
+//
+//  The producer appends the serialized rows and calls Complete once
+//  the query is done. Readers can read while the query is still
+//  running - a read past the data produced so far blocks until more
+//  is available or the query completes.
+//
+//  Readers register with AddReader/RemoveReader. If the last reader
+//  goes away before the query completes, the buffer is marked as
+//  cancelled so that the producer can stop the query early.
+//
+//  Once the results in memory are over their budget, the full chunks
+//  of a large result are compressed into its spill file as they are
+//  filled (see Spill.h). A read of a spilled chunk decompresses it.
+//
+class ResultBuffer
+{
+public:
+    // Constructor
+    //
+    ResultBuffer();
+
+    // Frees the chunks and the spill file.
+    //
+    ~ResultBuffer();
+
+    // Producer methods.
+    //
+    // Appends the data given to the end of the buffer.
+    //
+    void Append(
+        const char* data,
+        size_t length);
+
+    void Append(
+        char c);
+
+    // Marks the output as complete. error is 0 on success.
+    //
+    void Complete(
+        int error);
+
+    // Same, for a copy of an output completed at completionTime.
+    //
+    void Complete(
+        int error,
+        std::chrono::steady_clock::time_point completionTime);
+
+    // Returns true if all the readers went away before completion.
+    //
+    bool IsCancelled() const;
+
+    // Reader methods.
+    //
+    // Copies up to size bytes at offset into buf, waiting for the
+    // producer if needed. Returns the number of bytes copied (0 at the
+    // end of the output) or -EIO if the query failed before producing
+    // data at offset.
+    //
+    // If isInterrupted is given, it is checked while waiting and the
+    // read returns -EINTR once it returns true.
+    //
+    int Read(
+        char* buf,
+        size_t size,
+        off_t offset,
+        bool (*isInterrupted)() = NULL);
+
+    void AddReader();
+
+    void RemoveReader();
+
+    // Returns true if the output is complete.
+    //
+    bool IsComplete();
+
+    // Returns true if the output has not been cancelled, and the query
+    // succeeded or is still running. A cancelled output may be
+    // truncated, so it is never usable, even once complete.
+    //
+    bool IsUsable();
+
+    // Returns the whole output once complete.
+    //
+    string ToString();
+
+    // Returns the size of the output once complete (0 if the query
+    // failed).
+    //
+    size_t GetSize();
+
+    // Returns when the output was completed, once complete - the time
+    // of the snapshot it holds.
+    //
+    std::chrono::steady_clock::time_point GetCompletionTime();
+
+private:
+    // A chunk needed by a read - in memory, or its frame in the spill
+    // file if chunk is NULL.
+    //
+    struct ChunkRef
+    {
+        shared_ptr<char>        m_chunk;
+        SpilledChunk            m_location;
+    };
+
+    // Makes the data appended so far visible to readers.
+    //
+    void Publish();
+
+    // Moves a full chunk to the spill file. Producer only.
+    //
+    void Spill(
+        size_t index);
+
+    // Gets the chunks of the published range [start, start + length).
+    // Caller holds m_lock.
+    //
+    void GetChunks(
+        size_t start,
+        size_t length,
+        vector<ChunkRef>& chunks);
+
+    // Copies the range from the chunks GetChunks returned for it.
+    // Returns 0 or -EIO if a spilled chunk cannot be read back.
+    //
+    int CopyChunks(
+        const vector<ChunkRef>& chunks,
+        size_t start,
+        size_t length,
+        char* buf);
+
+    vector<shared_ptr<char>>    m_chunks;       // Output chunks, NULL once spilled
+    vector<SpilledChunk>        m_spilled;      // Location of the spilled chunks
+    unique_ptr<SpillFile>       m_spillFile;    // Created on the first spill
+    size_t                      m_numResident;  // Chunks in memory
+    size_t                      m_written;      // Bytes appended (producer only)
+    size_t                      m_published;    // Bytes visible to readers
+    bool                        m_complete;     // Producer is done
+    int                         m_error;        // Outcome of the query
+    std::chrono::steady_clock::time_point m_completionTime;    // Set by Complete
+    int                         m_numReaders;   // Registered readers
+    std::atomic<bool>           m_cancelled;    // All the readers left early
+    std::mutex                  m_lock;
+    std::condition_variable     m_dataAvailable;
+};
+
+// Query result shared between the result cache and the readers of a file.
+//
+typedef shared_ptr<ResultBuffer> QueryResult;
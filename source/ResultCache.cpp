@@ -0,0 +1,275 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: ResultCache.cpp
+//
+// Purpose:
+//   This file contains the definitions of the in-memory cache of query
+//   results.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+ResultCache::ResultCache(
+    ServerStats* stats,
+    QueryThrottle* throttle) :
+    m_stats(stats),
+    m_throttle(throttle)
+{
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetEntry
+//
+// Returns:
+//    The entry of the key, created empty if there is none.
+//
+shared_ptr<ResultCache::CacheEntry>&
+ResultCache::GetEntry(
+    const string& key)
+{
+    auto& slot = m_entries[key];
+    if (!slot)
+    {
+        slot = make_shared<CacheEntry>();
+        slot->m_ttl = std::chrono::milliseconds(0);
+        slot->m_keepStale = false;
+        slot->m_inFlight = false;
+        slot->m_error = 0;
+    }
+
+    return slot;
+}
+
+// ---------------------------------------------------------------------------
+// Method: PruneExpired
+//
+// Description:
+//    This method drops the results that can no longer be returned - past
+//    their ttl and not kept stale for the throttle. Entries with a fetch
+//    in flight stay, their waiters hold them anyway.
+//
+// Returns:
+//    VOID
+//
+void
+ResultCache::PruneExpired(
+    std::chrono::steady_clock::time_point now)
+{
+    for (auto itr = m_entries.begin(); itr != m_entries.end(); )
+    {
+        const CacheEntry& entry = *itr->second;
+
+        if (!entry.m_inFlight &&
+            !entry.m_keepStale &&
+            (!entry.m_result || now - entry.m_fetchedAt >= entry.m_ttl))
+        {
+            itr = m_entries.erase(itr);
+        }
+        else
+        {
+            ++itr;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetOrFetch
+//
+// Description:
+//    This method looks up the key in the cache. There are three cases:
+//    1. A result younger than ttl is cached - it is returned right away.
+//    2. Another thread is fetching the key - wait for it and share its
+//       result or error.
+//    3. Otherwise this thread runs the fetch. The lock is not held while
+//       the query runs so other keys are not blocked.
+//
+//    With a ttl of zero, the result is only shared with the lookups that
+//    were waiting for it and is dropped from the cache afterwards - unless
+//    the server has a throttle and keepStale is set. Then the last result
+//    is kept, and case 3 returns it (however old) while the server is
+//    throttled. Caching a result prunes the ones that expired.
+//
+// Returns:
+//    0 on success and the error returned by fetch on failure.
+//
+int
+ResultCache::GetOrFetch(
+    const string& key,
+    std::chrono::milliseconds ttl,
+    const QueryFetcher& fetch,
+    QueryResult& result,
+    bool keepStale)
+{
+    shared_ptr<CacheEntry>  entry;
+    QueryResult             output;
+    int                     error;
+
+    keepStale = keepStale && m_throttle;
+
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+
+        entry = GetEntry(key);
+
+        if (entry->m_inFlight)
+        {
+            // Single-flight - wait for the query that is already running.
+            //
+            IncrementStat(m_stats->m_cacheWaits);
+            entry->m_fetchDone.wait(guard, [&entry] { return !entry->m_inFlight; });
+
+            result = entry->m_result;
+            return entry->m_error;
+        }
+
+        if (entry->m_result &&
+            entry->m_result->IsUsable() &&
+            std::chrono::steady_clock::now() - entry->m_fetchedAt < ttl)
+        {
+            IncrementStat(m_stats->m_cacheHits);
+            result = entry->m_result;
+            return 0;
+        }
+
+        if (keepStale &&
+            entry->m_result &&
+            entry->m_result->IsUsable() &&
+            m_throttle->IsThrottled())
+        {
+            IncrementStat(m_stats->m_throttleStale);
+            result = entry->m_result;
+            return 0;
+        }
+
+        IncrementStat(m_stats->m_cacheMisses);
+        entry->m_inFlight = true;
+    }
+
+    error = fetch(output);
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        entry->m_inFlight = false;
+        entry->m_error = error;
+        if (!error)
+        {
+            entry->m_result = output;
+            entry->m_fetchedAt = std::chrono::steady_clock::now();
+            entry->m_ttl = ttl;
+            entry->m_keepStale = keepStale;
+        }
+        else
+        {
+            entry->m_result.reset();
+        }
+        result = entry->m_result;
+
+        // Nothing is kept around if this key is not cached, or kept stale
+        // for the throttle.
+        //
+        if ((ttl.count() <= 0 && !keepStale) || error)
+        {
+            m_entries.erase(key);
+        }
+        else
+        {
+            PruneExpired(entry->m_fetchedAt);
+        }
+    }
+
+    entry->m_fetchDone.notify_all();
+
+    return error;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Peek
+//
+// Description:
+//    This method looks a key up like GetOrFetch, but never queries nor
+//    waits: a result that is not cached, or still being fetched, is not
+//    returned. It is not counted as a hit or a miss.
+//
+// Returns:
+//    true if result was set.
+//
+bool
+ResultCache::Peek(
+    const string& key,
+    std::chrono::milliseconds ttl,
+    QueryResult& result,
+    bool keepStale)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    auto itr = m_entries.find(key);
+    if (itr == m_entries.end())
+    {
+        return false;
+    }
+
+    auto& entry = itr->second;
+
+    if (entry->m_inFlight ||
+        !entry->m_result ||
+        !entry->m_result->IsComplete() ||
+        !entry->m_result->IsUsable())
+    {
+        return false;
+    }
+
+    if (std::chrono::steady_clock::now() - entry->m_fetchedAt >= ttl &&
+        !(keepStale && m_throttle && m_throttle->IsThrottled()))
+    {
+        return false;
+    }
+
+    result = entry->m_result;
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Put
+//
+// Description:
+//    This method caches a result that was fetched without GetOrFetch -
+//    the result sets of a bundle populate the cache of their DMVs. A
+//    fetch in flight for the key is left alone, its result is about to
+//    replace this one anyway. The result is kept stale for the throttle
+//    like the ones of GetOrFetch.
+//
+// Returns:
+//    VOID
+//
+void
+ResultCache::Put(
+    const string& key,
+    std::chrono::milliseconds ttl,
+    const QueryResult& result)
+{
+    if (ttl.count() <= 0 || !result || !result->IsUsable())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    auto& slot = GetEntry(key);
+
+    if (!slot->m_inFlight)
+    {
+        slot->m_result = result;
+        slot->m_fetchedAt = std::chrono::steady_clock::now();
+        slot->m_ttl = ttl;
+        slot->m_keepStale = (m_throttle != NULL);
+        slot->m_error = 0;
+
+        PruneExpired(slot->m_fetchedAt);
+    }
+}
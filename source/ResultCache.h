@@ -0,0 +1,109 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: ResultCache.h
+//
+// Purpose:
+//   This file contains the declaration of the in-memory cache of query
+//   results shared by all the readers of a server's DMV files.
+//
+#pragma once
+
+// Method used by the cache to run the query on a miss. Returns 0 on
+// success and sets result. The result can still be streaming in when
+// the method returns.
+//
+typedef std::function<int(QueryResult& result)> QueryFetcher;
+
+//--------------------------------------------------------------------
+// Class: ResultCache
+//
+// Description:
+//  Caches query results by key (DMV name and format) for a
+//  configurable time to live.
+//
+//  Lookups that miss while the same key is already being queried do
+//  not start another query - they wait for the one in flight and
+//  share its result (single-flight). So concurrent opens of the same
+//  DMV cost one round trip to the server even with a TTL of zero.
+//
+//  A streamed result is shared as soon as the query starts, and is
+//  dropped if its query fails or is cancelled.
+//
+//  With a throttle, the last result of each key is kept whatever the
+//  ttl, and a lookup that misses while the server is throttled gets it
+//  instead of waiting for a query - unless the key is not kept stale
+//  (a DMV view, as any number of them can be opened).
+//
+//  Results past their ttl (that are not kept stale) are dropped each
+//  time a result is cached, so the keys read once go away.
+//
+class ResultCache
+{
+public:
+    // Constructor - hits, misses and waits are counted in stats. throttle
+    // may be NULL.
+    //
+    ResultCache(
+        ServerStats* stats,
+        QueryThrottle* throttle = NULL);
+
+    // Returns the cached result for the key if it is younger than ttl.
+    // Otherwise runs fetch (or waits for the fetch already running) and
+    // caches the outcome. keepStale is false for the keys whose result is
+    // not kept past ttl for the throttle.
+    //
+    // Returns 0 on success and the error from fetch on failure.
+    //
+    int GetOrFetch(
+        const string& key,
+        std::chrono::milliseconds ttl,
+        const QueryFetcher& fetch,
+        QueryResult& result,
+        bool keepStale = true);
+
+    // Gets the result GetOrFetch would return for the key without a
+    // fetch - only if it is complete. Returns true if there is one.
+    //
+    bool Peek(
+        const string& key,
+        std::chrono::milliseconds ttl,
+        QueryResult& result,
+        bool keepStale = true);
+
+    // Caches a result fetched elsewhere (a member of a bundle) as if it
+    // was fetched now. Nothing is cached for a zero ttl.
+    //
+    void Put(
+        const string& key,
+        std::chrono::milliseconds ttl,
+        const QueryResult& result);
+
+private:
+    struct CacheEntry
+    {
+        QueryResult                             m_result;       // Last successful result
+        std::chrono::steady_clock::time_point   m_fetchedAt;    // When m_result was fetched
+        std::chrono::milliseconds               m_ttl;          // Of m_result
+        bool                                    m_keepStale;    // m_result is kept past m_ttl
+        bool                                    m_inFlight;     // A fetch is running
+        int                                     m_error;        // Outcome of the last fetch
+        std::condition_variable                 m_fetchDone;    // Signalled when a fetch ends
+    };
+
+    // Creates the entry of a key. Caller holds m_lock.
+    //
+    shared_ptr<CacheEntry>& GetEntry(
+        const string& key);
+
+    // Drops the results past their ttl. Caller holds m_lock.
+    //
+    void PruneExpired(
+        std::chrono::steady_clock::time_point now);
+
+    unordered_map<string, shared_ptr<CacheEntry>>   m_entries;
+    std::mutex                                      m_lock;
+    ServerStats*                                    m_stats;
+    QueryThrottle*                                  m_throttle;     // Of the server, or NULL
+};
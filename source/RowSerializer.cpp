@@ -0,0 +1,1147 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: RowSerializer.cpp
+//
+// Purpose:
+//   This file contains the definitions of the serializer of result set
+//   rows.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Method: IsTextType
+//
+// Description:
+//    This method checks if values of the given column type are already
+//    text and can be copied as is.
+//
+// Returns:
+//    bool
+//
+static bool
+IsTextType(
+    int type)
+{
+    switch (type)
+    {
+    case SYBCHAR:
+    case SYBVARCHAR:
+    case SYBTEXT:
+    case SYBNTEXT:
+    case SYBNVARCHAR:
+    case XSYBCHAR:
+    case XSYBVARCHAR:
+    case XSYBNCHAR:
+    case XSYBNVARCHAR:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsNumericType
+//
+// Description:
+//    This method checks if values of the given column type convert to a
+//    number (they are written unquoted in NDJSON).
+//
+// Returns:
+//    bool
+//
+static bool
+IsNumericType(
+    int type)
+{
+    switch (type)
+    {
+    case SYBFLT8:
+    case SYBREAL:
+    case SYBFLTN:
+    case SYBDECIMAL:
+    case SYBNUMERIC:
+    case SYBMONEY:
+    case SYBMONEY4:
+    case SYBMONEYN:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsFormattedType
+//
+// Description:
+//    This method checks if values of the given column type are formatted
+//    from their native form in CSV and NDJSON. TSV keeps the dbconvert
+//    text of these types, which is what the files had when every column
+//    was bound as a string.
+//
+// Returns:
+//    bool
+//
+static bool
+IsFormattedType(
+    int type)
+{
+    switch (type)
+    {
+    case SYBFLT8:
+    case SYBREAL:
+    case SYBMONEY:
+    case SYBMONEY4:
+    case SYBDATETIME:
+    case SYBDATETIME4:
+    case SYBUNIQUE:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsJsonNumber
+//
+// Description:
+//    This method checks that the text is a number as JSON writes them -
+//    so an infinite float is quoted rather than breaking the object.
+//
+// Returns:
+//    bool
+//
+static bool
+IsJsonNumber(
+    const char* data,
+    size_t length)
+{
+    size_t  i = 0;
+    size_t  digits;
+
+    auto skipDigits = [&]()
+    {
+        size_t start = i;
+        while (i < length && isdigit((unsigned char)data[i]))
+        {
+            i++;
+        }
+        return i - start;
+    };
+
+    if (i < length && data[i] == '-')
+    {
+        i++;
+    }
+
+    digits = skipDigits();
+    if (digits == 0 || (digits > 1 && data[i - digits] == '0'))
+    {
+        return false;
+    }
+
+    if (i < length && data[i] == '.')
+    {
+        i++;
+        if (skipDigits() == 0)
+        {
+            return false;
+        }
+    }
+
+    if (i < length && (data[i] == 'e' || data[i] == 'E'))
+    {
+        i++;
+        if (i < length && (data[i] == '+' || data[i] == '-'))
+        {
+            i++;
+        }
+        if (skipDigits() == 0)
+        {
+            return false;
+        }
+    }
+
+    return i == length;
+}
+
+// ---------------------------------------------------------------------------
+// Method: TrimmedLength
+//
+// Description:
+//    This method gets the length of the value without its trailing blanks
+//    (the way NTBSTRINGBIND returns it).
+//
+// Returns:
+//    Length without the trailing blanks.
+//
+static size_t
+TrimmedLength(
+    const char* data,
+    size_t length)
+{
+    const uint64_t  blanks = 0x2020202020202020ULL;
+    uint64_t        word;
+
+    // nchar columns are mostly padding - skip it eight bytes at a time.
+    //
+    while (length >= sizeof(word))
+    {
+        memcpy(&word, data + length - sizeof(word), sizeof(word));
+        if (word != blanks)
+        {
+            break;
+        }
+        length -= sizeof(word);
+    }
+
+    while (length > 0 && data[length - 1] == ' ')
+    {
+        length--;
+    }
+
+    return length;
+}
+
+// ---------------------------------------------------------------------------
+// Method: FormatDigits
+//
+// Description:
+//    This method writes the value as exactly width decimal digits (zero
+//    padded).
+//
+// Returns:
+//    Pointer past the last digit written.
+//
+static char*
+FormatDigits(
+    char* dest,
+    unsigned long long value,
+    int width)
+{
+    for (int i = width - 1; i >= 0; i--)
+    {
+        dest[i] = (char)('0' + value % 10);
+        value /= 10;
+    }
+
+    return dest + width;
+}
+
+// ---------------------------------------------------------------------------
+// Method: FormatFloat
+//
+// Description:
+//    This method writes the value with the given number of significant
+//    digits, as printf("%.*g") would. std::to_chars does it without the
+//    locale and format string handling of printf where the C++ library
+//    implements it for floating point.
+//
+// Returns:
+//    The length written, without the terminating NUL.
+//
+static int
+FormatFloat(
+    char* dest,
+    double value,
+    int precision)
+{
+#if defined(__cpp_lib_to_chars)
+    std::to_chars_result    converted;
+
+    converted = std::to_chars(dest, dest + SQLFS_MAX_CONVERTED_VALUE_LEN - 1, value,
+                              std::chars_format::general, precision);
+    *converted.ptr = '\0';
+
+    return (int)(converted.ptr - dest);
+#else
+    return snprintf(dest, SQLFS_MAX_CONVERTED_VALUE_LEN, "%.*g", precision, value);
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Method: CivilFromDays
+//
+// Description:
+//    This method converts a number of days since 1970-01-01 to a date of
+//    the proleptic Gregorian calendar (the calendar of SQL Server).
+//
+// Returns:
+//    VOID
+//
+static void
+CivilFromDays(
+    long long days,
+    long long& year,
+    unsigned& month,
+    unsigned& day)
+{
+    long long   era;
+    unsigned    dayOfEra;
+    unsigned    yearOfEra;
+    unsigned    dayOfYear;
+    unsigned    shiftedMonth;
+
+    // Count from 0000-03-01 so the leap day ends the year.
+    //
+    days += 719468;
+    era = (days >= 0 ? days : days - 146096) / 146097;
+    dayOfEra = (unsigned)(days - era * 146097);
+    yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    shiftedMonth = (5 * dayOfYear + 2) / 153;
+
+    day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+    month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+    year = (long long)yearOfEra + era * 400 + (month <= 2);
+}
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+RowSerializer::RowSerializer(
+    ResultBuffer& output,
+    FileFormat format) :
+    m_output(output),
+    m_format(format),
+    m_separator((format == TYPE_CSV || format == TYPE_NDJSON) ? ',' : '\t'),
+    m_arena(SQLFS_RESULT_CHUNK_SIZE),
+    m_used(0),
+    m_hasRows(false)
+{
+}
+
+// ---------------------------------------------------------------------------
+// Method: Reserve
+//
+// Description:
+//    This method makes sure there is room for length more bytes in the
+//    arena. The arena only grows - its capacity is reused for the rows
+//    that follow.
+//
+// Returns:
+//    Pointer to the first free byte of the arena.
+//
+char*
+RowSerializer::Reserve(
+    size_t length)
+{
+    if (m_used + length > m_arena.size())
+    {
+        m_arena.resize(max(m_arena.size() * 2, m_used + length));
+    }
+
+    return m_arena.data() + m_used;
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendRaw
+//
+// Description:
+//    This method copies the data to the end of the arena.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::AppendRaw(
+    const char* data,
+    size_t length)
+{
+    memcpy(Reserve(length), data, length);
+    m_used += length;
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendInteger
+//
+// Description:
+//    This method writes the decimal form of the value into the arena.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::AppendInteger(
+    long long value)
+{
+    char                digits[24];
+    char*               end = digits + sizeof(digits);
+    char*               start = end;
+    unsigned long long  magnitude;
+
+    magnitude = (value < 0) ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+
+    do
+    {
+        *--start = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0)
+    {
+        *--start = '-';
+    }
+
+    AppendRaw(start, end - start);
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendFloat
+//
+// Description:
+//    This method writes a float or real. Most values read back exactly
+//    with the shorter precision (and print as the server shows them) -
+//    the full precision is only used for the others. Values without a JSON form
+//    are null in NDJSON.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::AppendFloat(
+    double value,
+    bool isReal)
+{
+    const int   precision = isReal ? 7 : 15;
+    const int   maxPrecision = isReal ? 9 : 17;
+    char*       dest;
+    int         length;
+    bool        exact;
+
+    if (!std::isfinite(value) && m_format == TYPE_NDJSON)
+    {
+        AppendRaw("null", 4);
+        return;
+    }
+
+    dest = Reserve(SQLFS_MAX_CONVERTED_VALUE_LEN);
+
+    length = FormatFloat(dest, value, precision);
+    exact = isReal ? (double)strtof(dest, NULL) == value : strtod(dest, NULL) == value;
+    if (!exact)
+    {
+        length = FormatFloat(dest, value, maxPrecision);
+    }
+
+    m_used += max(0, min(length, SQLFS_MAX_CONVERTED_VALUE_LEN - 1));
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendMoney
+//
+// Description:
+//    This method writes a money value (in ten-thousandths) with its four
+//    decimals.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::AppendMoney(
+    long long value)
+{
+    unsigned long long  magnitude;
+    char                fraction[5] = { '.' };
+
+    magnitude = (value < 0) ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+
+    if (value < 0)
+    {
+        AppendRaw("-", 1);
+    }
+    AppendInteger((long long)(magnitude / 10000));
+
+    FormatDigits(fraction + 1, magnitude % 10000, 4);
+    AppendRaw(fraction, sizeof(fraction));
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendDateTime
+//
+// Description:
+//    This method writes a date and time as yyyy-mm-dd hh:mm:ss[.mmm] -
+//    quoted in NDJSON.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::AppendDateTime(
+    long long days,
+    long long milliseconds,
+    bool withMilliseconds)
+{
+    const long long daysFrom1970To1900 = -25567;
+    long long       year;
+    unsigned        month;
+    unsigned        day;
+    char            text[32];
+    char*           end = text;
+
+    CivilFromDays(days + daysFrom1970To1900, year, month, day);
+
+    if (m_format == TYPE_NDJSON)
+    {
+        *end++ = '"';
+    }
+
+    end = FormatDigits(end, (unsigned long long)year, 4);
+    *end++ = '-';
+    end = FormatDigits(end, month, 2);
+    *end++ = '-';
+    end = FormatDigits(end, day, 2);
+    *end++ = ' ';
+    end = FormatDigits(end, milliseconds / 3600000, 2);
+    *end++ = ':';
+    end = FormatDigits(end, milliseconds / 60000 % 60, 2);
+    *end++ = ':';
+    end = FormatDigits(end, milliseconds / 1000 % 60, 2);
+
+    if (withMilliseconds)
+    {
+        *end++ = '.';
+        end = FormatDigits(end, milliseconds % 1000, 3);
+    }
+
+    if (m_format == TYPE_NDJSON)
+    {
+        *end++ = '"';
+    }
+
+    AppendRaw(text, end - text);
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendGuid
+//
+// Description:
+//    This method writes a uniqueidentifier the way the server shows it.
+//    DB-Library gives the first three groups as native integers and the
+//    last eight bytes in order.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::AppendGuid(
+    const BYTE* data)
+{
+    static const char   hexDigits[] = "0123456789ABCDEF";
+    uint32_t            data1;
+    uint16_t            data2;
+    uint16_t            data3;
+    char                text[38];
+    char*               end = text;
+
+    auto appendHex = [&](unsigned long long value, int numDigits)
+    {
+        for (int i = numDigits - 1; i >= 0; i--)
+        {
+            end[i] = hexDigits[value & 0xf];
+            value >>= 4;
+        }
+        end += numDigits;
+    };
+
+    memcpy(&data1, data, sizeof(data1));
+    memcpy(&data2, data + 4, sizeof(data2));
+    memcpy(&data3, data + 6, sizeof(data3));
+
+    if (m_format == TYPE_NDJSON)
+    {
+        *end++ = '"';
+    }
+
+    appendHex(data1, 8);
+    *end++ = '-';
+    appendHex(data2, 4);
+    *end++ = '-';
+    appendHex(data3, 4);
+    *end++ = '-';
+    for (int i = 8; i < 16; i++)
+    {
+        if (i == 10)
+        {
+            *end++ = '-';
+        }
+        appendHex(data[i], 2);
+    }
+
+    if (m_format == TYPE_NDJSON)
+    {
+        *end++ = '"';
+    }
+
+    AppendRaw(text, end - text);
+}
+
+// ---------------------------------------------------------------------------
+// Method: EscapeText
+//
+// Description:
+//    This method writes a text value through append, quoted and escaped
+//    as the format needs. CSV values holding a separator, quote or line
+//    break are quoted with their quotes doubled. NDJSON values are JSON
+//    strings - runs of characters that need no escape are copied in one
+//    go. TSV values are written as is.
+//
+// Returns:
+//    VOID
+//
+template <typename Append>
+static void
+EscapeText(
+    FileFormat format,
+    const char* data,
+    size_t length,
+    Append&& append)
+{
+    static const char   hexDigits[] = "0123456789abcdef";
+    size_t              runStart = 0;
+    unsigned char       c;
+    char                escape[6] = { '\\', 'u', '0', '0', 0, 0 };
+
+    if (format == TYPE_CSV)
+    {
+        bool needsQuotes = false;
+
+        for (size_t i = 0; i < length && !needsQuotes; i++)
+        {
+            c = data[i];
+            needsQuotes = (c == ',' || c == '"' || c == '\n' || c == '\r');
+        }
+
+        if (!needsQuotes)
+        {
+            append(data, length);
+            return;
+        }
+
+        append("\"", 1);
+        for (size_t i = 0; i < length; i++)
+        {
+            if (data[i] == '"')
+            {
+                append(data + runStart, i + 1 - runStart);
+                runStart = i;
+            }
+        }
+        append(data + runStart, length - runStart);
+        append("\"", 1);
+    }
+    else if (format == TYPE_NDJSON)
+    {
+        append("\"", 1);
+        for (size_t i = 0; i < length; i++)
+        {
+            c = data[i];
+            if (c >= 0x20 && c != '"' && c != '\\')
+            {
+                continue;
+            }
+
+            append(data + runStart, i - runStart);
+            runStart = i + 1;
+
+            switch (c)
+            {
+            case '"':
+                append("\\\"", 2);
+                break;
+
+            case '\\':
+                append("\\\\", 2);
+                break;
+
+            case '\n':
+                append("\\n", 2);
+                break;
+
+            case '\r':
+                append("\\r", 2);
+                break;
+
+            case '\t':
+                append("\\t", 2);
+                break;
+
+            default:
+                escape[4] = hexDigits[c >> 4];
+                escape[5] = hexDigits[c & 0xf];
+                append(escape, sizeof(escape));
+                break;
+            }
+        }
+        append(data + runStart, length - runStart);
+        append("\"", 1);
+    }
+    else
+    {
+        append(data, length);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendText
+//
+// Description:
+//    This method writes a text value to the arena, quoted and escaped as
+//    the format needs.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::AppendText(
+    const char* data,
+    size_t length)
+{
+    EscapeText(m_format, data, length,
+               [this](const char* text, size_t textLength)
+               {
+                   AppendRaw(text, textLength);
+               });
+}
+
+// ---------------------------------------------------------------------------
+// Method: QuoteText
+//
+// Description:
+//    This method escapes a text value the way AppendText writes it, for
+//    the values written outside of a serializer.
+//
+// Returns:
+//    The value as written in the output.
+//
+string
+RowSerializer::QuoteText(
+    const string& value,
+    FileFormat format)
+{
+    string quoted;
+
+    EscapeText(format, value.data(), value.size(),
+               [&quoted](const char* text, size_t textLength)
+               {
+                   quoted.append(text, textLength);
+               });
+
+    return quoted;
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendConverted
+//
+// Description:
+//    This method writes a value DB-Library has to convert to text (dates,
+//    floats, decimals, binary...). For TSV the value is converted in
+//    place in the arena. Otherwise it is converted into a scratch buffer
+//    first as it may need quoting - in NDJSON only numbers are left
+//    unquoted.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::AppendConverted(
+    DBPROCESS* dbConn,
+    int type,
+    const BYTE* data,
+    DBINT length)
+{
+    char*       dest;
+    DBINT       destLen;
+    DBINT       converted;
+    size_t      trimmed;
+
+    // Binary values take two characters per byte.
+    //
+    destLen = max((DBINT)SQLFS_MAX_CONVERTED_VALUE_LEN, 2 * length + 3);
+
+    if (m_format == TYPE_TSV || m_format == TYPE_JSON)
+    {
+        dest = Reserve(destLen);
+
+        converted = dbconvert(dbConn, type, data, length, SYBCHAR,
+                              (BYTE*)dest, destLen);
+        if (converted > 0)
+        {
+            m_used += TrimmedLength(dest, min(converted, destLen));
+        }
+        return;
+    }
+
+    if (m_scratch.size() < (size_t)destLen)
+    {
+        m_scratch.resize(destLen);
+    }
+    dest = m_scratch.data();
+
+    converted = dbconvert(dbConn, type, data, length, SYBCHAR,
+                          (BYTE*)dest, destLen);
+    if (converted <= 0)
+    {
+        if (m_format == TYPE_NDJSON)
+        {
+            AppendRaw("null", 4);
+        }
+        return;
+    }
+
+    trimmed = TrimmedLength(dest, min(converted, destLen));
+    while (trimmed > 0 && *dest == ' ')
+    {
+        dest++;
+        trimmed--;
+    }
+
+    if (m_format == TYPE_NDJSON && IsNumericType(type) && IsJsonNumber(dest, trimmed))
+    {
+        AppendRaw(dest, trimmed);
+    }
+    else
+    {
+        AppendText(dest, trimmed);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendValue
+//
+// Description:
+//    This method writes one value, preceded by a separator unless it is
+//    the first column. In NDJSON the value is preceded by its key.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::AppendValue(
+    DBPROCESS* dbConn,
+    int column,
+    int type,
+    const BYTE* data,
+    DBINT length)
+{
+    DBSMALLINT  smallValue;
+    DBINT       intValue;
+    DBBIGINT    bigValue;
+    DBFLT8      floatValue;
+    DBREAL      realValue;
+    DBMONEY     moneyValue;
+    DBMONEY4    smallMoneyValue;
+    DBDATETIME  dateTimeValue;
+    DBDATETIME4 smallDateTimeValue;
+    string      name;
+
+    if (column != 0)
+    {
+        *Reserve(1) = m_separator;
+        m_used++;
+    }
+
+    if (m_format == TYPE_NDJSON)
+    {
+        // Columns without a name from AppendColumnNames are keyed by
+        // their number.
+        //
+        while (m_keys.size() <= (size_t)column)
+        {
+            name = to_string(m_keys.size() + 1);
+            m_keys.push_back("\"" + name + "\":");
+        }
+        AppendRaw(m_keys[column].data(), m_keys[column].size());
+    }
+
+    // NULL values are empty (null in NDJSON).
+    //
+    if (!data || length <= 0)
+    {
+        if (m_format == TYPE_NDJSON)
+        {
+            if (data && IsTextType(type))
+            {
+                AppendRaw("\"\"", 2);
+            }
+            else
+            {
+                AppendRaw("null", 4);
+            }
+        }
+        return;
+    }
+
+    if ((m_format == TYPE_TSV || m_format == TYPE_JSON) && IsFormattedType(type))
+    {
+        AppendConverted(dbConn, type, data, length);
+        return;
+    }
+
+    switch (type)
+    {
+    case SYBBIT:
+        if (m_format == TYPE_NDJSON)
+        {
+            *data ? AppendRaw("true", 4) : AppendRaw("false", 5);
+        }
+        else
+        {
+            AppendInteger(*data);
+        }
+        break;
+
+    case SYBINT1:
+        AppendInteger(*data);
+        break;
+
+    case SYBINT2:
+        memcpy(&smallValue, data, sizeof(smallValue));
+        AppendInteger(smallValue);
+        break;
+
+    case SYBINT4:
+        memcpy(&intValue, data, sizeof(intValue));
+        AppendInteger(intValue);
+        break;
+
+    case SYBINT8:
+        memcpy(&bigValue, data, sizeof(bigValue));
+        AppendInteger(bigValue);
+        break;
+
+    case SYBFLT8:
+        memcpy(&floatValue, data, sizeof(floatValue));
+        AppendFloat(floatValue, false);
+        break;
+
+    case SYBREAL:
+        memcpy(&realValue, data, sizeof(realValue));
+        AppendFloat(realValue, true);
+        break;
+
+    case SYBMONEY:
+        memcpy(&moneyValue, data, sizeof(moneyValue));
+        AppendMoney((long long)(((unsigned long long)(uint32_t)moneyValue.mnyhigh << 32) |
+                                moneyValue.mnylow));
+        break;
+
+    case SYBMONEY4:
+        memcpy(&smallMoneyValue, data, sizeof(smallMoneyValue));
+        AppendMoney(smallMoneyValue.mny4);
+        break;
+
+    case SYBDATETIME:
+        // The time is in 1/300 of a second, rounded to the millisecond
+        // the way the server does.
+        //
+        memcpy(&dateTimeValue, data, sizeof(dateTimeValue));
+        AppendDateTime(dateTimeValue.dtdays,
+                       ((long long)(uint32_t)dateTimeValue.dttime * 20 + 3) / 6,
+                       true);
+        break;
+
+    case SYBDATETIME4:
+        memcpy(&smallDateTimeValue, data, sizeof(smallDateTimeValue));
+        AppendDateTime(smallDateTimeValue.days,
+                       smallDateTimeValue.minutes * 60000LL,
+                       false);
+        break;
+
+    case SYBUNIQUE:
+        if (length >= 16)
+        {
+            AppendGuid(data);
+        }
+        break;
+
+    default:
+        if (IsTextType(type))
+        {
+            AppendText((const char*)data, TrimmedLength((const char*)data, length));
+        }
+        else
+        {
+            AppendConverted(dbConn, type, data, length);
+        }
+        break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: BeginRow
+//
+// Description:
+//    This method starts a row - NDJSON rows are objects.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::BeginRow()
+{
+    if (m_format == TYPE_NDJSON)
+    {
+        AppendRaw("{", 1);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: EndRow
+//
+// Description:
+//    This method ends the row with a newline (except for the fragments
+//    of a FOR JSON document). Once a chunk worth of data
+//    is in the arena, it is handed to the output so readers of a streamed
+//    result see it.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::EndRow()
+{
+    if (m_format == TYPE_NDJSON)
+    {
+        AppendRaw("}", 1);
+    }
+
+    // A newline between the fragments of a FOR JSON document could end
+    // up inside one of its strings.
+    //
+    if (m_format != TYPE_JSON)
+    {
+        *Reserve(1) = '\n';
+        m_used++;
+    }
+    m_hasRows = true;
+
+    if (m_used >= SQLFS_RESULT_CHUNK_SIZE)
+    {
+        Flush();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendColumnNames
+//
+// Description:
+//    This method writes the header line with the names of the columns.
+//    NDJSON has no header - the escaped names are kept as the keys of the
+//    objects of the rows.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::AppendColumnNames(
+    DBPROCESS* dbConn,
+    int numColumns)
+{
+    const char* name;
+    size_t      start;
+
+    // Column numbering starts from 1 (hence i+1).
+    //
+    if (m_format == TYPE_NDJSON)
+    {
+        m_keys.clear();
+
+        for (int i = 0; i < numColumns; i++)
+        {
+            name = dbcolname(dbConn, i + 1);
+
+            // Escape the name at the end of the arena and take it back out.
+            //
+            start = m_used;
+            AppendText(name ? name : "", name ? strlen(name) : 0);
+            AppendRaw(":", 1);
+            m_keys.push_back(string(m_arena.data() + start, m_used - start));
+            m_used = start;
+        }
+        return;
+    }
+
+    for (int i = 0; i < numColumns; i++)
+    {
+        name = dbcolname(dbConn, i + 1);
+        AppendValue(dbConn, i, SYBCHAR, (const BYTE*)name, name ? strlen(name) : 0);
+    }
+
+    EndRow();
+}
+
+// ---------------------------------------------------------------------------
+// Method: AppendRow
+//
+// Description:
+//    This method writes the values of the current row.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::AppendRow(
+    DBPROCESS* dbConn,
+    int numColumns)
+{
+    BeginRow();
+
+    for (int i = 0; i < numColumns; i++)
+    {
+        AppendValue(dbConn,
+                    i,
+                    dbcoltype(dbConn, i + 1),
+                    dbdata(dbConn, i + 1),
+                    dbdatlen(dbConn, i + 1));
+    }
+
+    EndRow();
+}
+
+// ---------------------------------------------------------------------------
+// Method: Flush
+//
+// Description:
+//    This method hands the data in the arena to the output and empties
+//    the arena (keeping its capacity).
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::Flush()
+{
+    if (m_used)
+    {
+        m_output.Append(m_arena.data(), m_used);
+        m_used = 0;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: Finish
+//
+// Description:
+//    This method ends the result - the FOR JSON document gets the newline
+//    its fragments did not - and hands it to the output.
+//
+// Returns:
+//    VOID
+//
+void
+RowSerializer::Finish()
+{
+    if (m_format == TYPE_JSON && m_hasRows)
+    {
+        *Reserve(1) = '\n';
+        m_used++;
+    }
+    m_hasRows = false;
+
+    Flush();
+}
@@ -0,0 +1,169 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: RowSerializer.h
+//
+// Purpose:
+//   This file contains the declaration of the serializer that turns the
+//   rows of a result set into the TSV, CSV or NDJSON output of a file.
+//
+#pragma once
+
+// Size of the conversion buffer for the values that DB-Library has to
+// convert to text (decimals, date/time2...).
+//
+#define SQLFS_MAX_CONVERTED_VALUE_LEN   64
+
+//--------------------------------------------------------------------
+// Class: RowSerializer
+//
+// Description:
+//  Writes column names and row values straight into a reusable arena
+//  and hands the arena to the ResultBuffer in chunk sized blocks.
+//
+//  Values are read with dbdata/dbdatlen, so no column is bound and no
+//  null-terminated copy is scanned with strlen. Character data is copied
+//  with one memcpy and (n)varchar(max) and xml values are read in place
+//  whatever their size. Integers, floats, money, datetime and
+//  uniqueidentifier values are formatted from their native form in CSV
+//  and NDJSON:
+//    float/real            shortest form that reads back as the same value
+//    money/smallmoney      four decimals
+//    datetime              yyyy-mm-dd hh:mm:ss.mmm
+//    smalldatetime         yyyy-mm-dd hh:mm:ss
+//    uniqueidentifier      XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX
+//  TSV keeps the dbconvert text of these types, so the existing files
+//  are unchanged. Only the other types go through dbconvert in CSV and
+//  NDJSON. As with NTBSTRINGBIND,
+//  trailing blanks are trimmed and NULL is written as an empty value.
+//
+//  The arena keeps its capacity between rows, so serialization does not
+//  allocate once it has grown to the widest row.
+//
+//  TSV is written as is. The FOR JSON fragments of TYPE_JSON are
+//  concatenated, as the server splits the document at any character. CSV
+//  quotes the values that need it (RFC 4180). NDJSON writes one object
+//  per row keyed by column name, with integers, bits and numbers
+//  unquoted and NULL as null.
+//
+class RowSerializer
+{
+public:
+    // Constructor
+    //
+    RowSerializer(
+        ResultBuffer& output,
+        FileFormat format = TYPE_TSV);
+
+    // Writes the header line with the names of the columns. For NDJSON
+    // nothing is written - the names are kept as keys of the objects.
+    //
+    void AppendColumnNames(
+        DBPROCESS* dbConn,
+        int numColumns);
+
+    // Writes the values of the current row and a newline.
+    //
+    void AppendRow(
+        DBPROCESS* dbConn,
+        int numColumns);
+
+    // Starts a row.
+    //
+    void BeginRow();
+
+    // Writes one value. Column 0 is not preceded by a separator. dbConn
+    // is only used to convert types that are not text or integers.
+    //
+    void AppendValue(
+        DBPROCESS* dbConn,
+        int column,
+        int type,
+        const BYTE* data,
+        DBINT length);
+
+    // Ends the current row.
+    //
+    void EndRow();
+
+    // Hands everything serialized so far to the output.
+    //
+    void Flush();
+
+    // Ends the result (the JSON document gets its newline) and flushes.
+    //
+    void Finish();
+
+    // Returns the value quoted and escaped as AppendValue writes text in
+    // the format.
+    //
+    static string QuoteText(
+        const string& value,
+        FileFormat format);
+
+private:
+    // Returns space for length more bytes at the end of the arena.
+    //
+    char* Reserve(
+        size_t length);
+
+    // Appends the data to the arena.
+    //
+    void AppendRaw(
+        const char* data,
+        size_t length);
+
+    // Appends a signed integer as text.
+    //
+    void AppendInteger(
+        long long value);
+
+    // Appends a float (or a real) as the shorter of %.15g and %.17g (%.7g
+    // and %.9g) that reads back as the same value.
+    //
+    void AppendFloat(
+        double value,
+        bool isReal);
+
+    // Appends a money value given in ten-thousandths.
+    //
+    void AppendMoney(
+        long long value);
+
+    // Appends a date and time given as days since 1900-01-01 and
+    // milliseconds since midnight.
+    //
+    void AppendDateTime(
+        long long days,
+        long long milliseconds,
+        bool withMilliseconds);
+
+    // Appends a uniqueidentifier.
+    //
+    void AppendGuid(
+        const BYTE* data);
+
+    // Appends a text value, quoted and escaped as the format needs.
+    //
+    void AppendText(
+        const char* data,
+        size_t length);
+
+    // Appends a value converted by dbconvert.
+    //
+    void AppendConverted(
+        DBPROCESS* dbConn,
+        int type,
+        const BYTE* data,
+        DBINT length);
+
+    ResultBuffer&   m_output;       // Where the serialized rows go
+    FileFormat      m_format;
+    char            m_separator;    // Between the values of a row
+    vector<char>    m_arena;        // Serialized data not handed out yet
+    size_t          m_used;         // Bytes of m_arena in use
+    vector<string>  m_keys;         // NDJSON - "<column name>": of each column
+    vector<char>    m_scratch;      // Converted values that may get quoted
+    bool            m_hasRows;      // A row was written since the last Finish
+};
@@ -10,12 +10,138 @@
 //
 #include "UtilsPrivate.h"
 
+// ---------------------------------------------------------------------------
+// Structure: ConnectionContext
+//
+// Description:
+//    Per-connection state saved with dbsetuserdata. DB-Library handlers
+//    are process wide, so the error and message handlers record the
+//    errors of a connection here rather than in shared state. This lets
+//    several queries run on different threads at the same time.
+//
+//    The context also holds the limits of what the connection is waiting
+//    for. DB-Library calls the error handler with SYBETIME every
+//    SQLFS_QUERY_CHECK_INTERVAL_SEC while it waits for the server, and
+//    the handler cancels the wait once one of them is crossed.
+//
+struct ConnectionContext
+{
+    ConnectionContext() :
+        m_output(NULL),
+        m_interruptible(false),
+        m_messages(NULL)
+    {
+        SetHousekeepingDeadline();
+    }
+
+    // Waits that are not part of a query (login, dbuse, draining the
+    // results left unread) keep the old fixed limit.
+    //
+    void SetHousekeepingDeadline()
+    {
+        m_output = NULL;
+        m_interruptible = false;
+        m_deadline = std::chrono::steady_clock::now() +
+                     std::chrono::seconds(SQLFS_MAX_RESPONSE_WAIT_SEC);
+    }
+
+    // Last error reported for the connection by DB-Library or the server.
+    //
+    string m_lastError;
+
+    // Output of the query running - it is cancelled once all its
+    // readers are gone. NULL if the query has no readers.
+    //
+    const ResultBuffer* m_output;
+
+    // Whether the interrupt check applies - only while a query runs on
+    // the thread of the request that needs it.
+    //
+    bool m_interruptible;
+
+    // Time after which the wait is cancelled.
+    //
+    std::chrono::steady_clock::time_point m_deadline;
+
+    // Where the informational messages of the server (the SET STATISTICS
+    // output) are appended - NULL if they are not captured.
+    //
+    string* m_messages;
+};
+
+// Backend installed with SetQueryBackend - NULL to use DB-Library.
+//
+static QueryBackend* g_QueryBackend = NULL;
+
+// Check installed with SetQueryInterruptCheck - NULL if queries are
+// never interrupted.
+//
+static QueryInterruptCheck g_QueryInterruptCheck = NULL;
+
+// ---------------------------------------------------------------------------
+// Method: GetConnectionContext
+//
+// Description:
+//    This method gets the context attached to a connection.
+//
+// Returns:
+//    ConnectionContext pointer (NULL if none).
+//
+static ConnectionContext*
+GetConnectionContext(
+    DBPROCESS* dbproc)
+{
+    return dbproc ? (ConnectionContext*)dbgetuserdata(dbproc) : NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetCancelReason
+//
+// Description:
+//    This method checks whether what the connection waits for should be
+//    given up - the deadline passed, all the readers of the output went
+//    away or the request the query runs for was interrupted.
+//
+// Returns:
+//    The reason to cancel - NULL to keep waiting.
+//
+static const char*
+GetCancelReason(
+    const ConnectionContext* context)
+{
+    if (!context)
+    {
+        return "no context";
+    }
+
+    if (std::chrono::steady_clock::now() >= context->m_deadline)
+    {
+        return "timed out";
+    }
+
+    if (context->m_output && context->m_output->IsCancelled())
+    {
+        return "all the readers are gone";
+    }
+
+    if (context->m_interruptible && g_QueryInterruptCheck && g_QueryInterruptCheck())
+    {
+        return "interrupted";
+    }
+
+    return NULL;
+}
+
 // ---------------------------------------------------------------------------
 // Method: DBErrorHandler
 //
 // Description:
 //    This method is invoked whenever DB-Library determines that an 
-//    error has occurred.
+//    error has occurred. The error is recorded in the context of the
+//    connection it occurred on.
+//
+//    Timeouts (SYBETIME) are DB-Library checking in while it waits for
+//    the server - the wait goes on unless it should be cancelled.
 //
 // Returns:
 //    int
@@ -28,22 +154,92 @@ int DBErrorHandler(
     char* dberrstr,
     char* oserrstr)
 {
+    ConnectionContext* context;
+    const char*        reason;
+
+    if (dberr == SYBETIME && dbproc && !DBDEAD(dbproc))
+    {
+        context = GetConnectionContext(dbproc);
+        reason = GetCancelReason(context);
+        if (!reason)
+        {
+            return INT_CONTINUE;
+        }
+
+        LogMsg(LOG_LEVEL_WARNING, "Cancelling the wait for the server - %s\n", reason);
+        if (context)
+        {
+            context->m_lastError = StringFormat("Query %s", reason);
+        }
+
+        return INT_CANCEL;
+    }
+
     if ((dbproc == NULL) || (DBDEAD(dbproc)))
     {
-        fprintf(stderr, "DB process structure failed to initialize.\n");
-        return(INT_CANCEL);
+        LogMsg(LOG_LEVEL_ERROR, "DB process structure failed to initialize. %s\n",
+            dberrstr ? dberrstr : "");
     }
     else
     {
-        fprintf(stderr, "DB-Library error:\n\t%s\n", dberrstr);
+        LogMsg(LOG_LEVEL_ERROR, "DB-Library error:\n\t%s\n", dberrstr);
 
         if (oserr != DBNOERR)
         {
-            fprintf(stderr, "Operating-system \error:\n\t%s\n", oserrstr);
+            LogMsg(LOG_LEVEL_ERROR, "Operating-system error:\n\t%s\n", oserrstr);
         }
+    }
+
+    context = GetConnectionContext(dbproc);
+    if (context && dberrstr)
+    {
+        context->m_lastError = dberrstr;
+    }
+
+    return(INT_CANCEL);
+}
+
+// ---------------------------------------------------------------------------
+// Method: DBMessageHandler
+//
+// Description:
+//    This method is invoked for the messages sent by the server. Errors
+//    (severity above 10) are recorded in the context of the connection.
+//    Informational messages, like the database context changes, are
+//    ignored unless the connection captures them.
+//
+// Returns:
+//    0
+//
+int DBMessageHandler(
+    DBPROCESS* dbproc,
+    DBINT msgno,
+    int msgstate,
+    int severity,
+    char* msgtext,
+    char* srvname,
+    char* procname,
+    int line)
+{
+    ConnectionContext* context = GetConnectionContext(dbproc);
 
-        return(INT_CANCEL);
+    if (severity > 10 && msgtext)
+    {
+        LogMsg(LOG_LEVEL_ERROR, "SQL Server message %d, severity %d:\n\t%s\n",
+            msgno, severity, msgtext);
+
+        if (context)
+        {
+            context->m_lastError = msgtext;
+        }
     }
+    else if (msgtext && context && context->m_messages)
+    {
+        *context->m_messages += msgtext;
+        *context->m_messages += '\n';
+    }
+
+    return 0;
 }
 
 // ---------------------------------------------------------------------------
@@ -58,6 +254,7 @@ int DBErrorHandler(
 void InstallDBHandlers()
 {
     dberrhandle(DBErrorHandler);
+    dbmsghandle(DBMessageHandler);
 }
 
 // ---------------------------------------------------------------------------
@@ -72,32 +269,46 @@ void InstallDBHandlers()
 void UninstallDBHandlers()
 {
     dberrhandle(NULL);
+    dbmsghandle(NULL);
 }
 
 // ---------------------------------------------------------------------------
-// Method: CreateConnectionAndRunQuery
+// Method: GetLastConnectionError
 //
 // Description:
-//    This method opens up a DB connection to the provided server
-//    and executes the query given.
+//    This method gets the last error recorded for the connection.
 //
 // Returns:
-//    Query repsonse connection pointer (DBPROCESS *) on success
-//    NULL on error.
+//    The error message - empty if there was no error.
 //
-static RETCODE
-CreateConnectionAndRunQuery(
-    const string& query,
-    const string& dbServer,
-    const string& username,
-    const string& password,
-    DBPROCESS*& dbConn)
+string
+GetLastConnectionError(
+    DBPROCESS* dbConn)
 {
-    LOGINREC*   login;
-    RETCODE     status = SUCCEED;
-    char        hostname[MAXHOSTNAMELEN];
-    int         maxLen = MAXHOSTNAMELEN;
-    dbConn = NULL;
+    ConnectionContext* context = GetConnectionContext(dbConn);
+
+    return context ? context->m_lastError : string();
+}
+
+// ---------------------------------------------------------------------------
+// Method: InitializeDBLibrary
+//
+// Description:
+//    This method initializes DB-Library for the process. It needs to be
+//    called once before any connection is opened because connections are
+//    kept open across queries (see ConnectionPool) and dbexit() would
+//    close all of them.
+//
+//    Process wide settings (handlers and timeouts) are only set here so
+//    that queries running on several threads never change them.
+//
+// Returns:
+//    bool.
+//
+bool
+InitializeDBLibrary()
+{
+    RETCODE status = SUCCEED;
 
     // Init the DB library.
     //
@@ -109,7 +320,10 @@ CreateConnectionAndRunQuery(
 
     // Install error-handler and message-handlers.
     //
-    InstallDBHandlers();
+    if (status == SUCCEED)
+    {
+        InstallDBHandlers();
+    }
 
     // Set the login timeout.
     //
@@ -122,18 +336,74 @@ CreateConnectionAndRunQuery(
         }
     }
 
-    // Allocate a login params structure.
+    // Set how often the waits for the server check in with the error
+    // handler. The limits themselves are per connection - see
+    // ConnectionContext.
     //
     if (status == SUCCEED)
     {
-        login = dblogin();
-        if (!login)
+        status = dbsettime(SQLFS_QUERY_CHECK_INTERVAL_SEC);
+        if (status == FAIL)
         {
-            PrintMsg("Could not initialize dblogin() structure.\n");
-            status = FAIL;
+            PrintMsg("Could not set the timeout for sql server response\n");
         }
     }
 
+    return (status == SUCCEED);
+}
+
+// ---------------------------------------------------------------------------
+// Method: ShutdownDBLibrary
+//
+// Description:
+//    This method closes all the remaining connections and releases the
+//    DB-Library state. No query can be run after this.
+//
+// Returns:
+//    none.
+//
+void
+ShutdownDBLibrary()
+{
+    // Uninstall error-handler and message-handlers.
+    //
+    UninstallDBHandlers();
+
+    dbexit();
+}
+
+// ---------------------------------------------------------------------------
+// Method: CreateConnection
+//
+// Description:
+//    This method opens up a DB connection to the provided server and
+//    switches it to the master database.
+//
+// Returns:
+//    Connection pointer (DBPROCESS *) on success
+//    NULL on error.
+//
+DBPROCESS*
+CreateConnection(
+    const string& dbServer,
+    const string& username,
+    const string& password)
+{
+    LOGINREC*   login;
+    DBPROCESS*  dbConn = NULL;
+    RETCODE     status = SUCCEED;
+    char        hostname[MAXHOSTNAMELEN];
+    int         maxLen = MAXHOSTNAMELEN;
+
+    // Allocate a login params structure.
+    //
+    login = dblogin();
+    if (!login)
+    {
+        PrintMsg("Could not initialize dblogin() structure.\n");
+        status = FAIL;
+    }
+
     // Initialize the login params in the structure.
     //
     if (status == SUCCEED)
@@ -152,6 +422,10 @@ CreateConnectionAndRunQuery(
             PrintMsg("Could not connect to DB Server: %s\n", dbServer.c_str());
             status = FAIL;
         }
+        else
+        {
+            dbsetuserdata(dbConn, (BYTE*)new ConnectionContext());
+        }
 
         // login structure no longer needed after logging in.
         //
@@ -165,210 +439,589 @@ CreateConnectionAndRunQuery(
         {
             PrintMsg("Could not switch to database %s on DB Server %s\n",
                 dbName, dbServer.c_str());
-        }
-    }
 
-    // Set the timeout to get response for SQL command.
-    //
-    if (status == SUCCEED)
-    {
-        status = dbsettime(SQLFS_MAX_RESPONSE_WAIT_SEC);
-        if (status == FAIL)
-        {
-            PrintMsg("Could not set the timeout for sql server response\n");
+            CloseConnection(dbConn);
+            dbConn = NULL;
         }
     }
 
-    // Now prepare a SQL statement.
+    // Large values are returned whole rather than cut at the default
+    // TEXTSIZE. Failing to set it is not fatal.
     //
-    if (status == SUCCEED)
-    {
-        dbcmd(dbConn, query.c_str());
-
-        // Now execute the SQL statement.
-        //
-        status = dbsqlexec(dbConn);
-        if (status == FAIL)
-        {
-            PrintMsg("Could not execute the sql statement\n");
-        }
-    }
-
-    if (status == SUCCEED)
+    if (status == SUCCEED &&
+        dbsetopt(dbConn, DBTEXTSIZE, SQLFS_MAX_TEXT_SIZE, 0) == FAIL)
     {
-        dbresults(dbConn);
+        PrintMsg("Could not set the text size on DB Server %s\n", dbServer.c_str());
     }
 
-    return status;
+    return dbConn;
 }
 
 // ---------------------------------------------------------------------------
-// Method: BindStringVector
+// Method: CloseConnection
 //
 // Description:
-//    This method resizes the vector to hold the required number of
-//    entries (equal to number of columns). Also resizes each string
-//    taking into account the maximum size of entry in the column.
+//    This method closes a connection opened by CreateConnection.
 //
 // Returns:
-//    VOID
+//    none.
 //
-static void
-    BindStringVector(
-    DBPROCESS* dbConn,
-    int numColumns,
-    vector<string>& stringVector)
+void
+CloseConnection(
+    DBPROCESS* dbConn)
 {
-    int     maxColumnEntryLen;
-    int     columnLen;
-    char*   stringPtr;
-
-    // Extend vector to hold appropriate number of strings.
-    //
-    stringVector.resize(numColumns);
-
-    for (int i = 0; i < numColumns; i++)
-    {
-        maxColumnEntryLen = MAX_COLUMN_ENTRY_LEN;
-        columnLen = 0;
-
-        // Calculate column entry length.
-        //
-        if ((columnLen = dbcollen(dbConn, i + 1)) > maxColumnEntryLen)
-        {
-            maxColumnEntryLen = columnLen;
-        }
+    ConnectionContext* context = GetConnectionContext(dbConn);
 
-        // Resize string.
-        //
-        stringVector[i].resize(maxColumnEntryLen);
+    dbsetuserdata(dbConn, NULL);
+    delete context;
 
-        // Now bind the returned columns to the variables
-        // Column numbers start from 1
-        // The fourth argument is to specify the maximum size(bytes)
-        // that can be copied into the buffer. This avoids memory corruption.
-        //
-        stringPtr = (char*)stringVector[i].c_str();
-        dbbind(dbConn, i + 1, NTBSTRINGBIND, maxColumnEntryLen,
-            (BYTE*)stringPtr);
-    }
+    dbclose(dbConn);
 }
 
 // ---------------------------------------------------------------------------
-// Method: CopyColumnNames
+// Method: ResetConnection
 //
 // Description:
-//    This methods copies the names of columns (tab seperated) into the 
-//    given string. 
+//    This method discards any results left unread on the connection and
+//    switches it back to the master database (a custom query could have
+//    changed it) so that it can be reused for the next query.
 //
 // Returns:
-//    VOID
+//    true if the connection can be reused - false otherwise.
 //
-static void
-    CopyColumnNames(
-    DBPROCESS* dbConn,
-    int numColumns,
-    ostringstream& stream)
+bool
+ResetConnection(
+    DBPROCESS* dbConn)
 {
+    RETCODE     status = SUCCEED;
+    const char* currentDb;
+    ConnectionContext* context = GetConnectionContext(dbConn);
+
+    if (context)
+    {
+        context->SetHousekeepingDeadline();
+    }
 
-    // Copy name of columns.
+    // Drain the rows and result sets left unread, if any.
     //
-    for (int i = 0; i < numColumns; i++)
+    if (!DBDEAD(dbConn))
     {
-        // Insert a tab between two column names
-        // This is not needed for the first entry.
-        //
-        if (i != 0)
+        dbcanquery(dbConn);
+        while ((status = dbresults(dbConn)) == SUCCEED)
         {
-            stream << '\t';
+            dbcanquery(dbConn);
         }
+    }
 
-        // Copy columnn name into output string
-        // Column numbering starts from 1 (hence i+1).
-        //
-        stream << dbcolname(dbConn, i + 1);
+    dbfreebuf(dbConn);
+
+    if (context)
+    {
+        context->m_lastError.clear();
+    }
+
+    if (DBDEAD(dbConn) || status == FAIL)
+    {
+        return false;
+    }
+
+    currentDb = dbname(dbConn);
+    if (!currentDb || strcmp(currentDb, dbName) != 0)
+    {
+        status = dbuse(dbConn, dbName);
     }
-    stream << '\n';
+
+    return (status == SUCCEED);
 }
 
 // ---------------------------------------------------------------------------
-// Method: CopyAllRowData
+// Method: WaitForResponse
 //
 // Description:
-//    This methods copies the contents from all the rows into the 
-//    given string. This is done for all the columns.
+//    This method waits for the server to start answering the query sent
+//    on the connection. The socket is polled in short slices so that the
+//    wait ends as soon as the query times out, its readers go away or
+//    its request is interrupted - the query is then cancelled on the
+//    server with dbcancel.
 //
 // Returns:
-//    VOID
+//    SUCCEED once the response can be read and FAIL if it was cancelled.
 //
-static void
-    CopyAllRowData(
-    DBPROCESS* dbConn,
-    int numColumns,
-    ostringstream& stream,
-    vector<string>& stringVector)
+static RETCODE
+WaitForResponse(
+    DBPROCESS* dbConn)
 {
-    size_t dataLen;
-    const char* data;
+    ConnectionContext*  context = GetConnectionContext(dbConn);
+    struct pollfd       pollEntry;
+    const char*         reason;
+    int                 ready;
 
-    // Loop thru the result set.
-    //
-    while (dbnextrow(dbConn) != NO_MORE_ROWS)
+    pollEntry.fd = dbiordesc(dbConn);
+    pollEntry.events = POLLIN;
+
+    for (;;)
     {
-        // copy out the data for each row.
-        //
-        for (int i = 0; i < numColumns; i++)
+        reason = GetCancelReason(context);
+        if (reason)
         {
-            // Insert a tab between two column names
-            // This is not needed for the first entry.
-            //
-            if (i != 0)
-            {
-                stream << '\t';
-            }
-
-            data = stringVector[i].c_str();
+            break;
+        }
 
-            // Calculate length of data for this row.
-            //
-            dataLen = strlen(data);
+        pollEntry.revents = 0;
+        ready = poll(&pollEntry, 1, SQLFS_QUERY_POLL_INTERVAL_MS);
 
-            // Copy columnn name into output string.
-            //
-            stream.write(data, dataLen);
+        // Errors on the socket are reported by dbsqlok.
+        //
+        if (ready > 0 || (ready < 0 && errno != EINTR))
+        {
+            return SUCCEED;
         }
-        stream << '\n';
     }
+
+    PrintMsg("Cancelling the query - %s\n", reason);
+    if (context)
+    {
+        context->m_lastError = StringFormat("Query %s", reason);
+        context->SetHousekeepingDeadline();
+    }
+    dbcancel(dbConn);
+
+    return FAIL;
 }
 
 // ---------------------------------------------------------------------------
-// Method: ExecuteQuery
+// Method: RunQuery
 //
 // Description:
-//    This method executes the provided SQL query on the given server.
-//    If JSON is requested, the function does not copy the column name into
-//    provided buffer because that is not a part of the JSON object.
+//    This method sends the query given on an open connection, waits for
+//    the response and moves to the first result set.
+//
+//    The query is cancelled after timeout (zero for no limit) and once
+//    all the readers of output (if given) are gone.
 //
 // Returns:
-//    0 on success and -1 on error.
+//    SUCCEED on success and FAIL on error.
 //
-int
-ExecuteQuery(
+static RETCODE
+RunQuery(
+    DBPROCESS* dbConn,
     const string& query,
-    string& output,
-    const string& dbServer,
-    const string& username,
-    const string& password,
-    const FileFormat type)
+    std::chrono::milliseconds timeout,
+    const ResultBuffer* output)
 {
-    DBPROCESS*      dbConn;
+    RETCODE             status;
+    ConnectionContext*  context = GetConnectionContext(dbConn);
+
+    if (context)
+    {
+        context->m_output = output;
+        context->m_interruptible = true;
+        context->m_deadline = timeout.count() ?
+            std::chrono::steady_clock::now() + timeout :
+            std::chrono::steady_clock::time_point::max();
+    }
+
+    // Now prepare a SQL statement.
+    //
+    status = dbcmd(dbConn, query.c_str());
+
+    // Send the statement without waiting for the server.
+    //
+    if (status == SUCCEED)
+    {
+        status = dbsqlsend(dbConn);
+    }
+
+    if (status == SUCCEED)
+    {
+        status = WaitForResponse(dbConn);
+    }
+
+    if (status == SUCCEED)
+    {
+        status = dbsqlok(dbConn);
+    }
+
+    if (status == FAIL)
+    {
+        PrintMsg("Could not execute the sql statement: %s\n",
+            GetLastConnectionError(dbConn).c_str());
+    }
+
+    if (status == SUCCEED)
+    {
+        dbresults(dbConn);
+    }
+
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Method: StartStatistics
+//
+// Description:
+//    This method turns on SET STATISTICS TIME and IO on the connection and
+//    captures the informational messages of the server into messages
+//    until StopStatistics. The statistics come as such messages while the
+//    results of the query are read.
+//
+// Returns:
+//    VOID - a query whose statistics cannot be turned on still runs.
+//
+static void
+StartStatistics(
+    DBPROCESS* dbConn,
+    string& messages)
+{
+    ConnectionContext*  context = GetConnectionContext(dbConn);
+    RETCODE             status;
+
+    status = dbcmd(dbConn, "SET STATISTICS TIME, IO ON");
+    if (status == SUCCEED)
+    {
+        status = dbsqlexec(dbConn);
+    }
+    while (status == SUCCEED)
+    {
+        status = dbresults(dbConn);
+    }
+
+    if (status == FAIL)
+    {
+        PrintMsg("Could not turn on the query statistics: %s\n",
+            GetLastConnectionError(dbConn).c_str());
+    }
+    else if (context)
+    {
+        context->m_messages = &messages;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: StopStatistics
+//
+// Description:
+//    This method reads the rest of the results of the query, so that the
+//    statistics sent after its rows are captured too, then turns the
+//    statistics off for the next user of the connection.
+//
+// Returns:
+//    true if the connection can be reused.
+//
+static bool
+StopStatistics(
+    DBPROCESS* dbConn)
+{
+    ConnectionContext*  context = GetConnectionContext(dbConn);
+    RETCODE             status = SUCCEED;
+
+    if (!context || !context->m_messages)
+    {
+        return true;
+    }
+
+    dbcanquery(dbConn);
+    while ((status = dbresults(dbConn)) == SUCCEED)
+    {
+        dbcanquery(dbConn);
+    }
+    context->m_messages = NULL;
+
+    if (status != FAIL)
+    {
+        status = dbcmd(dbConn, "SET STATISTICS TIME, IO OFF");
+    }
+    if (status == SUCCEED)
+    {
+        status = dbsqlexec(dbConn);
+    }
+
+    // The connection is dropped rather than handed out with the
+    // statistics still on.
+    //
+    return status == SUCCEED;
+}
+
+// ---------------------------------------------------------------------------
+// Method: MicrosecondsBetween
+//
+// Returns:
+//    The duration from start to end in microseconds.
+//
+static uint64_t
+MicrosecondsBetween(
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+}
+
+// ---------------------------------------------------------------------------
+// Method: CopyAllRowData
+//
+// Description:
+//    This methods copies the contents from all the rows into the 
+//    given buffer. This is done for all the columns.
+//
+//    If all the readers of the buffer go away, the rest of the result
+//    set is discarded with dbcancel. A wait for more rows that is
+//    cancelled by the error handler ends the result set early too.
+//
+// Returns:
+//    SUCCEED on success and FAIL if the rows could not all be read.
+//    numRows is set to the number of rows copied.
+//
+static RETCODE
+    CopyAllRowData(
+    DBPROCESS* dbConn,
+    int numColumns,
+    ResultBuffer& output,
+    RowSerializer& serializer,
+    uint64_t& numRows)
+{
+    STATUS      rowStatus;
+
+    numRows = 0;
+
+    // Loop thru the result set.
+    //
+    while ((rowStatus = dbnextrow(dbConn)) != NO_MORE_ROWS)
+    {
+        if (rowStatus == FAIL)
+        {
+            break;
+        }
+
+        if (output.IsCancelled())
+        {
+            PrintMsg("All the readers are gone - cancelling the query\n");
+            dbcancel(dbConn);
+            break;
+        }
+
+        // copy out the data for each row.
+        //
+        serializer.AppendRow(dbConn, numColumns);
+        numRows++;
+    }
+
+    serializer.Finish();
+
+    if (rowStatus == FAIL)
+    {
+        PrintMsg("Could not read the rows: %s\n",
+            GetLastConnectionError(dbConn).c_str());
+    }
+
+    return (rowStatus == FAIL) ? FAIL : SUCCEED;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetFileFormatExtension
+//
+// Description:
+//    This method gets the extension of the DMV files of a format.
+//
+// Returns:
+//    The extension (with its dot) - empty for TSV.
+//
+const char*
+GetFileFormatExtension(
+    const FileFormat type)
+{
+    switch (type)
+    {
+    case TYPE_JSON:
+        return ".json";
+
+    case TYPE_CSV:
+        return ".csv";
+
+    case TYPE_NDJSON:
+        return ".ndjson";
+
+    default:
+        return "";
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: SplitFileFormat
+//
+// Description:
+//    This method removes the format extension (if any) from the name of a
+//    DMV file, leaving the DMV name.
+//
+// Returns:
+//    The format of the file - TYPE_TSV if there is no known extension.
+//
+FileFormat
+SplitFileFormat(
+    string& filename)
+{
+    const FileFormat    types[] = { TYPE_JSON, TYPE_CSV, TYPE_NDJSON };
+    string              extension;
+
+    for (auto&& type : types)
+    {
+        extension = GetFileFormatExtension(type);
+
+        if (filename.length() > extension.length() &&
+            filename.compare(filename.length() - extension.length(),
+                             extension.length(), extension) == 0)
+        {
+            filename.erase(filename.length() - extension.length());
+            return type;
+        }
+    }
+
+    return TYPE_TSV;
+}
+
+// ---------------------------------------------------------------------------
+// Method: SetQueryBackend
+//
+// Description:
+//    This method installs the backend the queries run on.
+//
+// Returns:
+//    VOID
+//
+void
+SetQueryBackend(
+    QueryBackend* backend)
+{
+    g_QueryBackend = backend;
+}
+
+// ---------------------------------------------------------------------------
+// Method: SetQueryInterruptCheck
+//
+// Description:
+//    This method installs the check that interrupts the queries running
+//    for a request.
+//
+// Returns:
+//    VOID
+//
+void
+SetQueryInterruptCheck(
+    QueryInterruptCheck check)
+{
+    g_QueryInterruptCheck = check;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetDmvQuery
+//
+// Description:
+//    This method builds the query returning the content of a DMV in the
+//    given form.
+//
+// Returns:
+//    The query.
+//
+string
+GetDmvQuery(
+    const string& dmvName,
+    const FileFormat type)
+{
+    if (type == TYPE_JSON)
+    {
+        return "SELECT * FROM [master].[sys].[" + dmvName + "] FOR JSON AUTO, ROOT('info')";
+    }
+
+    return "SELECT * FROM [master].[sys].[" + dmvName + "]";
+}
+
+// ---------------------------------------------------------------------------
+// Method: ExecuteQuery
+//
+// Description:
+//    This method executes the provided SQL query on the given server
+//    using a connection from the server's connection pool. The rows are
+//    appended to the output buffer as they arrive and the buffer is
+//    marked complete at the end.
+//    If JSON is requested, the function does not copy the column name into
+//    provided buffer because that is not a part of the JSON object.
+//
+//    If stats is given, the query is counted there along with its
+//    execution and fetch times, rows and bytes, and becomes the last
+//    query of the file if it succeeds. With withStatistics the SET
+//    STATISTICS TIME and IO output of the query is kept there too.
+//
+//    The query is cancelled on the server once timeout (zero for no
+//    limit) passes, all the readers of output go away or the request
+//    it runs for is interrupted. A query that is cancelled before all
+//    its rows were read fails, unless its readers are gone.
+//
+//    If the server has a throttle, the query first waits until it admits
+//    it - or the request it runs for is interrupted. Its latency for the
+//    throttle only starts once it has a connection.
+//
+//    If a backend was installed with SetQueryBackend the query runs there
+//    instead.
+//
+// Returns:
+//    0 on success, -EINTR if interrupted waiting for the throttle and -1
+//    on error.
+//
+int
+ExecuteQuery(
+    const string& query,
+    ResultBuffer& output,
+    ServerInfo* serverInfo,
+    const FileFormat type,
+    std::chrono::milliseconds timeout,
+    QueryStats* stats,
+    bool withStatistics)
+{
+    DBPROCESS*      dbConn;
     RETCODE         status = FAIL;
     int             numColumns;
-    vector<string>  stringVector;
     int             result = -1;
-    ostringstream   stream;
+    uint64_t        numRows = 0;
+    bool            reusable;
+    LastQuery       lastQuery;
+
+    ThrottledQuery  throttled(serverInfo->m_throttle, g_QueryInterruptCheck);
+
+    if (throttled.GetError())
+    {
+        output.Complete(-1);
+        return throttled.GetError();
+    }
+
+    if (g_QueryBackend)
+    {
+        return g_QueryBackend->ExecuteQuery(query, output, serverInfo, type, timeout, stats);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    dbConn = serverInfo->m_connectionPool->Acquire();
+    lastQuery.m_loginUs = MicrosecondsBetween(start, std::chrono::steady_clock::now());
+    throttled.Started();
+
+    if (dbConn && withStatistics && stats)
+    {
+        StartStatistics(dbConn, lastQuery.m_statistics);
+    }
 
-    status = CreateConnectionAndRunQuery(query, dbServer, username, password, dbConn);
+    auto sent = std::chrono::steady_clock::now();
+    if (dbConn)
+    {
+        status = RunQuery(dbConn, query, timeout, &output);
+    }
+    throttled.Executed();
+
+    auto executed = std::chrono::steady_clock::now();
+    if (stats)
+    {
+        stats->m_acquireTime.Record(lastQuery.m_loginUs);
+        stats->m_execTime.Record(MicrosecondsBetween(sent, executed));
+        start = executed;
+    }
 
     if (status == SUCCEED)
     {
@@ -376,38 +1029,338 @@ ExecuteQuery(
         //
         numColumns = dbnumcols(dbConn);
 
-        BindStringVector(dbConn, numColumns, stringVector);
+        RowSerializer serializer(output, type);
 
         // In JSON there is just one row and the row name is a weird
         // string - basically not the JSON object.
         //
         if (type != TYPE_JSON)
         {
-            CopyColumnNames(dbConn, numColumns, stream);
+            serializer.AppendColumnNames(dbConn, numColumns);
         }
 
         // Copy row data.
         //
-        CopyAllRowData(dbConn, numColumns, stream, stringVector);
+        status = CopyAllRowData(dbConn, numColumns, output, serializer, numRows);
+        if (status == SUCCEED)
+        {
+            result = 0;
+        }
+    }
 
-        // Clean up.
-        //
-        dbfreebuf(dbConn);
-        dbclose(dbConn);
-        dbexit();
+    auto fetched = std::chrono::steady_clock::now();
 
-        result = 0;
+    reusable = (status == SUCCEED);
+    if (dbConn && !StopStatistics(dbConn))
+    {
+        reusable = false;
     }
 
-    // Uninstall error-handler and message-handlers.
+    // Hand the connection back for the next query.
     //
-    UninstallDBHandlers();
+    serverInfo->m_connectionPool->Release(dbConn, reusable);
 
-    output = stream.str();
+    output.Complete(result);
+
+    if (stats)
+    {
+        IncrementStat(stats->m_queries);
+        if (result)
+        {
+            IncrementStat(stats->m_errors);
+        }
+        else
+        {
+            stats->m_fetchTime.RecordSince(start);
+            IncrementStat(stats->m_rows, numRows);
+            IncrementStat(stats->m_bytes, output.GetSize());
+
+            lastQuery.m_execUs = MicrosecondsBetween(sent, executed);
+            lastQuery.m_fetchUs = MicrosecondsBetween(executed, fetched);
+            lastQuery.m_rows = numRows;
+            lastQuery.m_bytes = output.GetSize();
+            RecordLastQuery(stats, lastQuery);
+        }
+    }
 
     return result;
 }
 
+// ---------------------------------------------------------------------------
+// Method: ExecuteQuery
+//
+// Description:
+//    This variant of ExecuteQuery returns the whole output in a string.
+//    Used for the internal queries whose output is parsed by dbfs.
+//
+// Returns:
+//    0 on success and -1 on error.
+//
+int
+ExecuteQuery(
+    const string& query,
+    string& output,
+    ServerInfo* serverInfo,
+    const FileFormat type)
+{
+    ResultBuffer    buffer;
+    int             result;
+
+    result = ExecuteQuery(query, buffer, serverInfo, type, serverInfo->m_queryTimeout);
+    output = buffer.ToString();
+
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ExecuteBatch
+//
+// Description:
+//    This method sends all the queries to the given server as one batch,
+//    so they cost a single round trip, then reads their result sets in
+//    order with the dbresults loop. Each query gets its own output, in
+//    the form of the same index in types, marked complete once its rows
+//    are read.
+//
+//    The timeout applies to the whole batch. If a result set cannot be
+//    read, it and the ones after it fail.
+//
+//    The batch is counted once in stats if given, with the rows and
+//    bytes of all its result sets, and is one query for the throttle of
+//    the server - admitted and timed like one run by ExecuteQuery.
+//
+//    If a backend was installed with SetQueryBackend the batch runs there
+//    instead.
+//
+// Returns:
+//    0 if all the queries succeeded, -EINTR if interrupted waiting for
+//    the throttle and -1 otherwise.
+//
+int
+ExecuteBatch(
+    const vector<string>& queries,
+    const vector<FileFormat>& types,
+    vector<QueryResult>& outputs,
+    ServerInfo* serverInfo,
+    std::chrono::milliseconds timeout,
+    QueryStats* stats)
+{
+    DBPROCESS*      dbConn = NULL;
+    RETCODE         status = FAIL;
+    string          batch;
+    int             numColumns;
+    uint64_t        numRows = 0;
+    uint64_t        totalRows = 0;
+    size_t          totalBytes = 0;
+    LastQuery       lastQuery;
+
+    outputs.clear();
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+        outputs.push_back(make_shared<ResultBuffer>());
+    }
+
+    ThrottledQuery throttled(serverInfo->m_throttle, g_QueryInterruptCheck);
+
+    if (throttled.GetError())
+    {
+        for (auto&& output : outputs)
+        {
+            output->Complete(-1);
+        }
+        return throttled.GetError();
+    }
+
+    if (g_QueryBackend)
+    {
+        return g_QueryBackend->ExecuteBatch(queries, types, outputs, serverInfo, timeout, stats);
+    }
+
+    for (auto&& query : queries)
+    {
+        batch += query + ";\n";
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (!queries.empty())
+    {
+        dbConn = serverInfo->m_connectionPool->Acquire();
+    }
+    lastQuery.m_loginUs = MicrosecondsBetween(start, std::chrono::steady_clock::now());
+    throttled.Started();
+
+    auto sent = std::chrono::steady_clock::now();
+    if (dbConn)
+    {
+        status = RunQuery(dbConn, batch, timeout, NULL);
+    }
+    throttled.Executed();
+
+    auto executed = std::chrono::steady_clock::now();
+    if (stats)
+    {
+        stats->m_acquireTime.Record(lastQuery.m_loginUs);
+        stats->m_execTime.Record(MicrosecondsBetween(sent, executed));
+        start = executed;
+    }
+
+    // RunQuery moved to the first result set - the next ones are read
+    // with dbresults.
+    //
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+        if (status == SUCCEED && i > 0)
+        {
+            status = dbresults(dbConn);
+            if (status != SUCCEED)
+            {
+                PrintMsg("Result set %zu of the batch is missing: %s\n",
+                    i + 1, GetLastConnectionError(dbConn).c_str());
+                status = FAIL;
+            }
+        }
+
+        if (status == SUCCEED)
+        {
+            numColumns = dbnumcols(dbConn);
+
+            RowSerializer serializer(*outputs[i], types[i]);
+
+            if (types[i] != TYPE_JSON)
+            {
+                serializer.AppendColumnNames(dbConn, numColumns);
+            }
+
+            status = CopyAllRowData(dbConn, numColumns, *outputs[i], serializer, numRows);
+            totalRows += numRows;
+        }
+
+        // The size of an output is only known once it is complete.
+        //
+        outputs[i]->Complete((status == SUCCEED) ? 0 : -1);
+        if (status == SUCCEED)
+        {
+            totalBytes += outputs[i]->GetSize();
+        }
+    }
+
+    // Hand the connection back for the next query.
+    //
+    serverInfo->m_connectionPool->Release(dbConn, status == SUCCEED);
+
+    if (stats)
+    {
+        IncrementStat(stats->m_queries);
+        if (status != SUCCEED)
+        {
+            IncrementStat(stats->m_errors);
+        }
+        else
+        {
+            stats->m_fetchTime.RecordSince(start);
+            IncrementStat(stats->m_rows, totalRows);
+            IncrementStat(stats->m_bytes, totalBytes);
+
+            lastQuery.m_execUs = MicrosecondsBetween(sent, executed);
+            lastQuery.m_fetchUs = MicrosecondsBetween(executed, std::chrono::steady_clock::now());
+            lastQuery.m_rows = totalRows;
+            lastQuery.m_bytes = totalBytes;
+            RecordLastQuery(stats, lastQuery);
+        }
+    }
+
+    return (status == SUCCEED) ? 0 : -1;
+}
+
+// ---------------------------------------------------------------------------
+// Streaming queries still running. DestroySQLFs waits for them before the
+// connection pools are deleted.
+//
+static std::mutex               g_StreamingQueriesLock;
+static std::condition_variable  g_StreamingQueriesDone;
+static int                      g_NumStreamingQueries = 0;
+
+// ---------------------------------------------------------------------------
+// Method: StartQuery
+//
+// Description:
+//    This method runs the query on the given server for a file being
+//    opened.
+//
+//    If the server is configured to stream results, the query runs on a
+//    separate thread and the result buffer is returned right away, so
+//    the reader can start reading the first rows while the rest are
+//    being fetched. Otherwise the query runs on the calling thread.
+//
+//    A streamed query is not interrupted with the request that started
+//    it - it is cancelled once all its readers are gone.
+//
+// Returns:
+//    0 on success and -1 on error.
+//
+int
+StartQuery(
+    const string& query,
+    ServerInfo* serverInfo,
+    const FileFormat type,
+    std::chrono::milliseconds timeout,
+    QueryResult& result,
+    QueryStats* stats,
+    bool withStatistics)
+{
+    int error = 0;
+
+    result = make_shared<ResultBuffer>();
+
+    if (serverInfo->m_streamResults)
+    {
+        {
+            std::lock_guard<std::mutex> guard(g_StreamingQueriesLock);
+            g_NumStreamingQueries++;
+        }
+
+        // Holds the entry of the server, in case it is removed from the
+        // mount while the query runs.
+        //
+        shared_ptr<ServerInfo> owner = serverInfo->weak_from_this().lock();
+
+        thread producer([query, serverInfo, owner, type, timeout, result, stats, withStatistics]()
+        {
+            ExecuteQuery(query, *result, serverInfo, type, timeout, stats, withStatistics);
+
+            {
+                std::lock_guard<std::mutex> guard(g_StreamingQueriesLock);
+                g_NumStreamingQueries--;
+            }
+            g_StreamingQueriesDone.notify_all();
+        });
+        producer.detach();
+    }
+    else
+    {
+        error = ExecuteQuery(query, *result, serverInfo, type, timeout, stats, withStatistics);
+    }
+
+    return error;
+}
+
+// ---------------------------------------------------------------------------
+// Method: WaitForStreamingQueries
+//
+// Description:
+//    This method waits for all the streaming queries to finish.
+//
+// Returns:
+//    none.
+//
+void
+WaitForStreamingQueries()
+{
+    std::unique_lock<std::mutex> guard(g_StreamingQueriesLock);
+    g_StreamingQueriesDone.wait(guard, [] { return g_NumStreamingQueries == 0; });
+}
+
 // ---------------------------------------------------------------------------
 // Method: VerifyServerInfo
 //
@@ -416,48 +1369,44 @@ ExecuteQuery(
 //    credentials of the given IP address. Also implicitly checks if the IP
 //    address is reachable.
 //
+//    The connection is opened through the pool of the server and is kept
+//    there, so the DMV enumeration at mount time does not login again.
+//
 // Returns:
 //    bool.
 //
 bool
 VerifyServerInfo(
-    string hostname,
-    string username,
-    string password)
+    ServerInfo* serverInfo)
 {
     DBPROCESS* dbConn;
     RETCODE result = FAIL;
     string  query;
     bool status = true;
 
+    if (g_QueryBackend)
+    {
+        return g_QueryBackend->VerifyServerInfo(serverInfo);
+    }
+
     // Just a basic query to test connection with server.
     //
     query = "SELECT @@version";
 
-    result = CreateConnectionAndRunQuery(query, 
-                                        hostname,
-                                        username, 
-                                        password, 
-                                        dbConn);
-
-    if (result == SUCCEED)
+    dbConn = serverInfo->m_connectionPool->Acquire();
+    if (dbConn)
     {
-        // Clean up.
-        //
-        dbfreebuf(dbConn);
-        dbclose(dbConn);
-        dbexit();
+        result = RunQuery(dbConn, query, serverInfo->m_queryTimeout, NULL);
+
+        serverInfo->m_connectionPool->Release(dbConn, result == SUCCEED);
     }
-    else
+
+    if (result != SUCCEED)
     {
         PrintMsg("Provided combination of hostname, username and password don't work. "
                  "This section would be ignored.\n");
         status = false;
     }
 
-    // Un-install error-handler and message-handlers.
-    //
-    UninstallDBHandlers();
-
     return status;
 }
@@ -12,35 +12,152 @@
 
 #define progName                        "sqlserverFS"
 #define dbName                          "master"
-#define MAX_COLUMN_ENTRY_LEN            32
 #define SQLFS_MAX_LOGIN_TIMEOUT_SEC     3
 #define SQLFS_MAX_RESPONSE_WAIT_SEC     5
 
+// Default time a query may run before it is cancelled (queryTimeout).
+//
+#define SQLFS_DEFAULT_QUERY_TIMEOUT_SEC 30
+
+// How often a query waiting for the server checks whether it timed out
+// or its readers went away - while waiting for the first response and
+// while waiting for more rows.
+//
+#define SQLFS_QUERY_POLL_INTERVAL_MS    100
+#define SQLFS_QUERY_CHECK_INTERVAL_SEC  1
+
+// TEXTSIZE of the connections - the largest value (in bytes) of a
+// varchar(max), nvarchar(max), xml, text or image column returned. The
+// server default truncates query plans and long batch texts.
+//
+#define SQLFS_MAX_TEXT_SIZE             "2147483647"
+
 
-// Current format of outputs supported from SQL Query
+// Current format of outputs supported from SQL Query. TSV, CSV and NDJSON
+// are serialized by DBFS from the rows, JSON is built by the server with
+// FOR JSON.
 //
 enum FileFormat 
 {
     TYPE_TSV,
-    TYPE_JSON
+    TYPE_JSON,
+    TYPE_CSV,
+    TYPE_NDJSON
 };
 
-// This method executes the provided SQL query on the given server.
+// This method gets the extension of the DMV files of a format - empty
+// for TSV.
+//
+const char*
+GetFileFormatExtension(
+    const FileFormat type);
+
+// This method removes the format extension from a DMV file name and
+// returns the format it stands for.
+//
+FileFormat
+SplitFileFormat(
+    string& filename);
+
+// This method initializes DB-Library once for the process.
+//
+bool
+InitializeDBLibrary();
+
+// This method releases the DB-Library state at exit.
+//
+void
+ShutdownDBLibrary();
+
+// This method opens a connection to the given server.
+//
+DBPROCESS*
+CreateConnection(
+    const string& dbServer,
+    const string& username,
+    const string& password);
+
+// This method closes a connection opened by CreateConnection.
+//
+void
+CloseConnection(
+    DBPROCESS* dbConn);
+
+// This method prepares a used connection to run the next query.
+//
+bool
+ResetConnection(
+    DBPROCESS* dbConn);
+
+// This method builds the query returning the content of a DMV.
+//
+string
+GetDmvQuery(
+    const string& dmvName,
+    const FileFormat type);
+
+// This method executes the provided SQL query on the given server,
+// cancelling it after timeout (zero for no limit) and counting it in
+// stats if given. With withStatistics the SET STATISTICS TIME and IO
+// output of the query is kept in the last query of stats.
 //
+int ExecuteQuery(
+    const string& query,
+    ResultBuffer& output,
+    ServerInfo* serverInfo,
+    const FileFormat type,
+    std::chrono::milliseconds timeout,
+    QueryStats* stats = NULL,
+    bool withStatistics = false);
+
 int ExecuteQuery(
     const string& query,
     string& output,
-    const string& dbServer,
-    const string& username,
-    const string& password,
+    ServerInfo* serverInfo,
     const FileFormat type);
 
-// This method checks if DB-Lib is able to connect with the given 
-// credentials of the given IP address.
+// This method sends several queries to the given server in one batch
+// and reads each result set, in its own form, into its own output.
+//
+int ExecuteBatch(
+    const vector<string>& queries,
+    const vector<FileFormat>& types,
+    vector<QueryResult>& outputs,
+    ServerInfo* serverInfo,
+    std::chrono::milliseconds timeout,
+    QueryStats* stats = NULL);
+
+// This method runs the query for a file being opened, streaming the
+// result if the server is configured to.
+//
+int StartQuery(
+    const string& query,
+    ServerInfo* serverInfo,
+    const FileFormat type,
+    std::chrono::milliseconds timeout,
+    QueryResult& result,
+    QueryStats* stats = NULL,
+    bool withStatistics = false);
+
+// This method installs the check run while a query waits for the server.
+// It returns true if the request the query runs for on the calling
+// thread was interrupted, so that the query is cancelled. NULL (the
+// default) to never interrupt queries.
+//
+typedef bool (*QueryInterruptCheck)();
+
+void
+SetQueryInterruptCheck(
+    QueryInterruptCheck check);
+
+// This method waits for the streaming queries still running.
+//
+void WaitForStreamingQueries();
+
+// This method checks if DB-Lib is able to connect to the server with the
+// credentials of the given server entry.
 //
 bool
 VerifyServerInfo(
-    string hostname,
-    string username,
-    string password);
+    ServerInfo* serverInfo);
 
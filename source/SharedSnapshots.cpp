@@ -0,0 +1,564 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: SharedSnapshots.cpp
+//
+// Purpose:
+//   This file contains the definitions of the shared snapshot segment of
+//   a server.
+//
+#include "UtilsPrivate.h"
+
+// Passes over the slots a reader makes while the publisher keeps
+// changing them, before it gives up until its next refresh.
+//
+#define SHARED_SNAPSHOT_READ_ATTEMPTS   8
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+SharedSnapshotStore::SharedSnapshotStore(
+    const string& servername,
+    const string& path,
+    size_t size) :
+    m_servername(servername),
+    m_path(path),
+    m_size(size),
+    m_fd(-1),
+    m_segment(NULL),
+    m_mappedSize(0),
+    m_isPublisher(false),
+    m_refused(false)
+{
+}
+
+// ---------------------------------------------------------------------------
+// Method: Destructor
+//
+// Description:
+//    Closing the file releases the publisher lock, so that another
+//    instance takes over on its next refresh.
+//
+SharedSnapshotStore::~SharedSnapshotStore()
+{
+    if (m_segment)
+    {
+        munmap(m_segment, m_mappedSize);
+    }
+
+    if (m_fd != -1)
+    {
+        close(m_fd);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetPath
+//
+// Description:
+//    This method gets the path of the segment of a server login. The
+//    characters of the hostname and user name that do not belong in a
+//    file name (such as the , before a port) are replaced by _.
+//
+// Returns:
+//    The path.
+//
+string
+SharedSnapshotStore::GetPath(
+    const string& directory,
+    const string& hostname,
+    const string& username)
+{
+    string name = "dbfs-" + hostname + "-" + username;
+
+    for (auto&& c : name)
+    {
+        if (!isalnum((unsigned char)c) && c != '.' && c != '-' && c != '_')
+        {
+            c = '_';
+        }
+    }
+
+    return VirtualTree::JoinPath(directory, name + SHARED_SNAPSHOT_EXTENSION);
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsValid
+//
+// Description:
+//    This method checks that the mapped segment was initialized by a
+//    publisher with this layout, and that its ring fits in the mapping.
+//    Caller holds m_lock.
+//
+// Returns:
+//    bool
+//
+bool
+SharedSnapshotStore::IsValid() const
+{
+    const SegmentHeader* header = (const SegmentHeader*)m_segment;
+    size_t ringOffset = sizeof(SegmentHeader) + SHARED_SNAPSHOT_SLOTS * sizeof(Slot);
+
+    return m_segment &&
+           header->m_magic.load(std::memory_order_acquire) == SHARED_SNAPSHOT_MAGIC &&
+           header->m_layout == SHARED_SNAPSHOT_LAYOUT &&
+           header->m_numSlots == SHARED_SNAPSHOT_SLOTS &&
+           header->m_capacity > 0 &&
+           ringOffset + header->m_capacity <= m_mappedSize;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Open
+//
+// Description:
+//    This method opens the segment file, creating it if needed. Its name
+//    is predictable and /dev/shm is writable by everyone, so another
+//    local user could create it first - to serve forged snapshots or
+//    hold the publisher lock. A symbolic link is not followed, and the
+//    file must belong to this user and be writable by nobody else. A
+//    refused file is only reported the first time. Caller holds m_lock.
+//
+// Returns:
+//    true if the file is open.
+//
+bool
+SharedSnapshotStore::Open()
+{
+    struct stat st;
+
+    m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (m_fd == -1)
+    {
+        PrintMsg("Unable to open the shared snapshots %s - %s\n", m_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    if (fstat(m_fd, &st) == -1 ||
+        !S_ISREG(st.st_mode) ||
+        st.st_uid != geteuid() ||
+        (st.st_mode & (S_IWGRP | S_IWOTH)))
+    {
+        if (!m_refused)
+        {
+            PrintMsg("Not using the shared snapshots %s - not a file owned and only writable by this user\n",
+                m_path.c_str());
+            m_refused = true;
+        }
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Map
+//
+// Description:
+//    This method maps the segment file. Only the publisher sizes the
+//    file (if it is new) and initializes the segment, so a segment is
+//    never resized while it is mapped - an existing segment keeps its
+//    size whatever the setting of the new publisher.
+//
+//    A publisher taking over from one that exited while writing a slot
+//    drops the snapshot of that slot. Caller holds m_lock.
+//
+// Returns:
+//    true if the segment is mapped and valid.
+//
+bool
+SharedSnapshotStore::Map(
+    bool publisher)
+{
+    size_t          ringOffset = sizeof(SegmentHeader) + SHARED_SNAPSHOT_SLOTS * sizeof(Slot);
+    size_t          minimumSize = ringOffset + 4096;
+    struct stat     st;
+    SegmentHeader*  header;
+    Slot*           slots;
+    uint64_t        sequence;
+
+    if (m_fd == -1 && !Open())
+    {
+        return false;
+    }
+
+    if (fstat(m_fd, &st) == -1)
+    {
+        return false;
+    }
+
+    if (publisher && (size_t)st.st_size < minimumSize)
+    {
+        st.st_size = max(m_size, minimumSize);
+        if (ftruncate(m_fd, st.st_size) == -1)
+        {
+            PrintMsg("Unable to size the shared snapshots %s - %s\n", m_path.c_str(), strerror(errno));
+            return false;
+        }
+    }
+
+    // Not created by a publisher yet.
+    //
+    if ((size_t)st.st_size < minimumSize)
+    {
+        return false;
+    }
+
+    if (!m_segment)
+    {
+        m_segment = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (m_segment == MAP_FAILED)
+        {
+            PrintMsg("Unable to map the shared snapshots %s - %s\n", m_path.c_str(), strerror(errno));
+            m_segment = NULL;
+            return false;
+        }
+        m_mappedSize = st.st_size;
+    }
+
+    header = (SegmentHeader*)m_segment;
+    slots = (Slot*)(header + 1);
+
+    if (publisher && !IsValid())
+    {
+        header->m_magic.store(0, std::memory_order_relaxed);
+        header->m_layout = SHARED_SNAPSHOT_LAYOUT;
+        header->m_numSlots = SHARED_SNAPSHOT_SLOTS;
+        header->m_capacity = m_mappedSize - ringOffset;
+        header->m_reservedEnd.store(0, std::memory_order_relaxed);
+
+        for (size_t i = 0; i < SHARED_SNAPSHOT_SLOTS; i++)
+        {
+            slots[i].m_sequence.store(0, std::memory_order_relaxed);
+            slots[i].m_name[0] = '\0';
+            slots[i].m_version = 0;
+        }
+
+        header->m_magic.store(SHARED_SNAPSHOT_MAGIC, std::memory_order_release);
+    }
+    else if (publisher)
+    {
+        for (size_t i = 0; i < SHARED_SNAPSHOT_SLOTS; i++)
+        {
+            sequence = slots[i].m_sequence.load(std::memory_order_relaxed);
+            if (sequence & 1)
+            {
+                slots[i].m_name[0] = '\0';
+                slots[i].m_version = 0;
+                slots[i].m_sequence.store(sequence + 1, std::memory_order_release);
+            }
+        }
+    }
+
+    if (publisher)
+    {
+        header->m_publisherPid.store(getpid(), std::memory_order_relaxed);
+    }
+
+    return IsValid();
+}
+
+// ---------------------------------------------------------------------------
+// Method: TryPublish
+//
+// Description:
+//    This method checks if this instance is the publisher of the server,
+//    taking the publisher lock if it is free - nobody published yet or
+//    the previous publisher exited. The lock is held until the store is
+//    deleted.
+//
+// Returns:
+//    true if this instance publishes the snapshots.
+//
+bool
+SharedSnapshotStore::TryPublish()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (m_isPublisher)
+    {
+        return true;
+    }
+
+    if (m_fd == -1 && !Open())
+    {
+        return false;
+    }
+
+    if (flock(m_fd, LOCK_EX | LOCK_NB) == -1)
+    {
+        return false;
+    }
+
+    if (!Map(true))
+    {
+        flock(m_fd, LOCK_UN);
+        return false;
+    }
+
+    m_isPublisher = true;
+
+    LogMsg(LOG_LEVEL_INFO, "Publishing the snapshots of server %s in %s\n",
+        m_servername.c_str(), m_path.c_str());
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: FindSlot
+//
+// Description:
+//    This method finds the slot of the file for the publisher, taking a
+//    free slot if allocate is set and the file has none. Only the
+//    publisher writes the slot names, so it reads them without the
+//    seqlock. Caller holds m_lock.
+//
+// Returns:
+//    The slot or NULL.
+//
+SharedSnapshotStore::Slot*
+SharedSnapshotStore::FindSlot(
+    const string& filename,
+    bool allocate)
+{
+    Slot* slots = (Slot*)((SegmentHeader*)m_segment + 1);
+    Slot* freeSlot = NULL;
+
+    if (filename.size() >= SHARED_SNAPSHOT_NAME_LENGTH)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < SHARED_SNAPSHOT_SLOTS; i++)
+    {
+        if (filename == slots[i].m_name)
+        {
+            return &slots[i];
+        }
+
+        if (!freeSlot && slots[i].m_name[0] == '\0')
+        {
+            freeSlot = &slots[i];
+        }
+    }
+
+    return allocate ? freeSlot : NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Publish
+//
+// Description:
+//    This method copies a snapshot at the end of the ring and points the
+//    slot of the file at it.
+//
+//    The reserved end of the ring moves before the blob is written, so a
+//    reader still copying a blob the new one overwrites sees it. The
+//    slot is then updated under its seqlock. A snapshot larger than half
+//    the ring is not published - it would leave no room for the others.
+//
+// Returns:
+//    VOID
+//
+void
+SharedSnapshotStore::Publish(
+    const string& filename,
+    const QueryResult& snapshot)
+{
+    SegmentHeader*  header;
+    char*           ring;
+    Slot*           slot;
+    string          data;
+    uint64_t        start;
+    uint64_t        sequence;
+
+    if (!snapshot || !snapshot->IsComplete() || !snapshot->IsUsable())
+    {
+        return;
+    }
+
+    data = snapshot->ToString();
+
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (!m_isPublisher || !IsValid())
+    {
+        return;
+    }
+
+    header = (SegmentHeader*)m_segment;
+    ring = (char*)((Slot*)(header + 1) + SHARED_SNAPSHOT_SLOTS);
+
+    if (data.size() > header->m_capacity / 2)
+    {
+        LogMsg(LOG_LEVEL_WARNING, "Snapshot of %s on server %s is too large to be shared\n",
+            filename.c_str(), m_servername.c_str());
+        return;
+    }
+
+    slot = FindSlot(filename, true);
+    if (!slot)
+    {
+        LogMsg(LOG_LEVEL_WARNING, "No shared snapshot slot left for %s on server %s\n",
+            filename.c_str(), m_servername.c_str());
+        return;
+    }
+
+    // A blob does not wrap - it starts over at the beginning of the ring.
+    //
+    start = header->m_reservedEnd.load(std::memory_order_relaxed);
+    if (start % header->m_capacity + data.size() > header->m_capacity)
+    {
+        start += header->m_capacity - start % header->m_capacity;
+    }
+
+    header->m_reservedEnd.store(start + data.size(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    memcpy(ring + start % header->m_capacity, data.data(), data.size());
+
+    sequence = slot->m_sequence.load(std::memory_order_relaxed);
+    slot->m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    strncpy(slot->m_name, filename.c_str(), SHARED_SNAPSHOT_NAME_LENGTH - 1);
+    slot->m_name[SHARED_SNAPSHOT_NAME_LENGTH - 1] = '\0';
+    slot->m_start = start;
+    slot->m_length = data.size();
+    slot->m_version++;
+    slot->m_publishTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              std::chrono::system_clock::now().time_since_epoch()).count();
+
+    slot->m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// Method: Read
+//
+// Description:
+//    This method copies the latest snapshot of the file out of the
+//    segment, with the reader protocol described in the header. A slot
+//    or a blob that changed while it was copied is read again, up to
+//    SHARED_SNAPSHOT_READ_ATTEMPTS times.
+//
+// Returns:
+//    0 if snapshot was set to a newer snapshot (version is updated), 1 if
+//    the snapshot is still version, -ENOENT if the file is not published
+//    and -EBUSY if the publisher kept changing it.
+//
+int
+SharedSnapshotStore::Read(
+    const string& filename,
+    uint64_t& version,
+    QueryResult& snapshot)
+{
+    SegmentHeader*  header;
+    Slot*           slots;
+    const char*     ring;
+    char            name[SHARED_SNAPSHOT_NAME_LENGTH];
+    uint64_t        sequence;
+    uint64_t        start;
+    uint64_t        length;
+    uint64_t        slotVersion;
+    int64_t         publishTime;
+    int64_t         age;
+    string          data;
+    bool            busy;
+
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (!IsValid() && !Map(false))
+    {
+        return -ENOENT;
+    }
+
+    header = (SegmentHeader*)m_segment;
+    slots = (Slot*)(header + 1);
+    ring = (const char*)(slots + SHARED_SNAPSHOT_SLOTS);
+
+    for (size_t attempt = 0; attempt < SHARED_SNAPSHOT_READ_ATTEMPTS; attempt++)
+    {
+        busy = false;
+
+        for (size_t i = 0; i < SHARED_SNAPSHOT_SLOTS; i++)
+        {
+            sequence = slots[i].m_sequence.load(std::memory_order_acquire);
+            if (sequence & 1)
+            {
+                busy = true;
+                continue;
+            }
+
+            memcpy(name, slots[i].m_name, sizeof(name));
+            start = slots[i].m_start;
+            length = slots[i].m_length;
+            slotVersion = slots[i].m_version;
+            publishTime = slots[i].m_publishTime;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slots[i].m_sequence.load(std::memory_order_relaxed) != sequence)
+            {
+                busy = true;
+                continue;
+            }
+
+            name[sizeof(name) - 1] = '\0';
+            if (filename != name)
+            {
+                continue;
+            }
+
+            if (slotVersion == 0)
+            {
+                return -ENOENT;
+            }
+
+            if (slotVersion == version)
+            {
+                return 1;
+            }
+
+            if (length > header->m_capacity - start % header->m_capacity)
+            {
+                busy = true;
+                break;
+            }
+
+            data.assign(ring + start % header->m_capacity, length);
+
+            // Overwritten by newer blobs while it was copied.
+            //
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header->m_reservedEnd.load(std::memory_order_relaxed) - start > header->m_capacity)
+            {
+                busy = true;
+                break;
+            }
+
+            // Timed as of its publication rather than of this copy, so
+            // that the deltas of a DMV cover the right interval.
+            //
+            age = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::system_clock::now().time_since_epoch()).count() - publishTime;
+
+            snapshot = make_shared<ResultBuffer>();
+            snapshot->Append(data.data(), data.size());
+            snapshot->Complete(0, std::chrono::steady_clock::now() -
+                                  std::chrono::milliseconds(max(age, (int64_t)0)));
+            version = slotVersion;
+
+            return 0;
+        }
+
+        if (!busy)
+        {
+            return -ENOENT;
+        }
+
+        std::this_thread::yield();
+    }
+
+    return -EBUSY;
+}
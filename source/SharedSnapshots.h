@@ -0,0 +1,153 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: SharedSnapshots.h
+//
+// Purpose:
+//   This file contains the declaration of the shared snapshot segment of
+//   a server - the prefetched snapshots of one DBFS instance, published
+//   in shared memory for the other instances (and any other process) on
+//   the same host to read without querying the server.
+//
+#pragma once
+
+// Segment format. A reader must check the magic and the layout before
+// trusting the rest of the header.
+//
+#define SHARED_SNAPSHOT_MAGIC           0x44424653      // "DBFS"
+#define SHARED_SNAPSHOT_LAYOUT          1
+#define SHARED_SNAPSHOT_SLOTS           256
+#define SHARED_SNAPSHOT_NAME_LENGTH     112
+
+// Default size of a segment, and extension of its file.
+//
+#define SHARED_SNAPSHOT_DEFAULT_SIZE    (64 * 1024 * 1024)
+#define SHARED_SNAPSHOT_EXTENSION       ".snapshots"
+
+//--------------------------------------------------------------------
+// Class: SharedSnapshotStore
+//
+// Description:
+//  Memory mapped file (in /dev/shm by default) holding the latest
+//  snapshot of each prefetched file of a server, shared by all the DBFS
+//  instances that mount the server with the same login. It is named
+//  after the hostname and user name, not the section name.
+//
+//  One instance is the publisher - the one holding the flock of the
+//  file. It queries the server and publishes each refresh. The others
+//  read the snapshots instead of querying. If the publisher exits the
+//  lock is released and the next instance to refresh takes over.
+//
+//  Layout: a SegmentHeader, SHARED_SNAPSHOT_SLOTS Slots, then the data
+//  ring of m_capacity bytes. A snapshot is written once at the end of
+//  the ring and never changed. Positions in the ring are logical
+//  (offset = position % capacity) so that a reader can tell if the
+//  publisher wrapped over a blob while it was copied: the header has
+//  the end of the area reserved so far. Each slot (file name, position,
+//  length and version of its latest snapshot) is updated under a
+//  seqlock - odd while it is being written.
+//
+//  Reader protocol, for a client outside DBFS:
+//      1. s1 = slot.m_sequence (acquire) - retry if odd
+//      2. copy the slot, acquire fence, retry if m_sequence != s1
+//      3. copy m_length bytes at m_start % m_capacity of the ring
+//      4. acquire fence - retry if m_reservedEnd - m_start > m_capacity
+//
+class SharedSnapshotStore
+{
+public:
+    // Constructor. Nothing is opened until the first call.
+    //
+    SharedSnapshotStore(
+        const string& servername,
+        const string& path,
+        size_t size);
+
+    // Unmaps the segment and releases the publisher lock.
+    //
+    ~SharedSnapshotStore();
+
+    // Checks if this instance publishes the snapshots - taking the
+    // publisher lock if nobody holds it.
+    //
+    bool TryPublish();
+
+    // Publishes a complete snapshot of the file. Only the publisher may
+    // call this.
+    //
+    void Publish(
+        const string& filename,
+        const QueryResult& snapshot);
+
+    // Reads the latest snapshot of the file published by another
+    // instance. Returns 0 and updates version if there is a newer one
+    // than version, 1 if it did not change and -ENOENT if the file is
+    // not published.
+    //
+    int Read(
+        const string& filename,
+        uint64_t& version,
+        QueryResult& snapshot);
+
+    // Gets the path of the segment of a server login in the directory.
+    //
+    static string GetPath(
+        const string& directory,
+        const string& hostname,
+        const string& username);
+
+private:
+    struct SegmentHeader
+    {
+        std::atomic<uint32_t>   m_magic;        // Set last by the publisher
+        uint32_t                m_layout;
+        uint32_t                m_numSlots;
+        uint32_t                m_reserved;
+        uint64_t                m_capacity;     // Bytes of the ring
+        std::atomic<uint64_t>   m_reservedEnd;  // Logical end of the blobs written
+        std::atomic<int32_t>    m_publisherPid;
+    };
+
+    struct Slot
+    {
+        std::atomic<uint64_t>   m_sequence;     // Seqlock - odd while written
+        char                    m_name[SHARED_SNAPSHOT_NAME_LENGTH];
+        uint64_t                m_start;        // Logical position in the ring
+        uint64_t                m_length;
+        uint64_t                m_version;      // 0 if never published
+        int64_t                 m_publishTime;  // Milliseconds since the epoch
+    };
+
+    // Opens (or creates) the file, refusing one that another user could
+    // have planted or can write. Caller holds m_lock.
+    //
+    bool Open();
+
+    // Opens and maps the file. The publisher creates it with m_size
+    // bytes and initializes it.
+    //
+    bool Map(
+        bool publisher);
+
+    // Checks the header of the mapped segment.
+    //
+    bool IsValid() const;
+
+    // Gets the slot of the file - a free one for the publisher if the
+    // file has none. NULL if there is none.
+    //
+    Slot* FindSlot(
+        const string& filename,
+        bool allocate);
+
+    string                  m_servername;
+    string                  m_path;
+    size_t                  m_size;
+    int                     m_fd;
+    void*                   m_segment;
+    size_t                  m_mappedSize;
+    bool                    m_isPublisher;
+    bool                    m_refused;      // The file was refused (reported once)
+    std::mutex              m_lock;
+};
@@ -0,0 +1,248 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Spill.cpp
+//
+// Purpose:
+//   This file contains the definitions of the on-disk spill of large
+//   query results.
+//
+#include "UtilsPrivate.h"
+
+// Memory budget of the results and what they use. Updated with relaxed
+// atomics - the budget is a soft limit.
+//
+static size_t                   g_ResultMemoryLimit = 0;
+static std::atomic<int64_t>     g_ResidentBytes{0};
+static std::atomic<int64_t>     g_SpilledBytes{0};
+static std::atomic<int64_t>     g_SpillFileBytes{0};
+
+// ---------------------------------------------------------------------------
+// Method: SetResultMemoryLimit
+//
+// Returns:
+//    VOID
+//
+void
+SetResultMemoryLimit(
+    size_t limit)
+{
+    g_ResultMemoryLimit = limit;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ShouldSpill
+//
+// Description:
+//    This method decides where the next full chunk of a result goes. It
+//    spills once the results in memory are over the budget, if the result
+//    is large enough that spilling is worth it.
+//
+// Returns:
+//    true if the chunk should spill.
+//
+bool
+ShouldSpill(
+    size_t resultSize)
+{
+    return g_ResultMemoryLimit != 0 &&
+           resultSize > SQLFS_SPILL_MIN_RESULT_SIZE &&
+           g_ResidentBytes.load(std::memory_order_relaxed) > (int64_t)g_ResultMemoryLimit;
+}
+
+// ---------------------------------------------------------------------------
+// Method: AddResidentBytes
+//
+// Returns:
+//    VOID
+//
+void
+AddResidentBytes(
+    ssize_t bytes)
+{
+    g_ResidentBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetSpillUsage
+//
+// Returns:
+//    VOID
+//
+void
+GetSpillUsage(
+    size_t& resident,
+    size_t& spilled,
+    size_t& spillFileSize)
+{
+    resident = max(g_ResidentBytes.load(std::memory_order_relaxed), (int64_t)0);
+    spilled = max(g_SpilledBytes.load(std::memory_order_relaxed), (int64_t)0);
+    spillFileSize = max(g_SpillFileBytes.load(std::memory_order_relaxed), (int64_t)0);
+}
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+SpillFile::SpillFile() :
+    m_fd(-1),
+    m_size(0),
+    m_numChunks(0),
+    m_failed(false)
+{
+}
+
+// ---------------------------------------------------------------------------
+// Method: Destructor
+//
+SpillFile::~SpillFile()
+{
+    if (m_fd != -1)
+    {
+        close(m_fd);
+    }
+
+    g_SpilledBytes.fetch_sub(m_numChunks * SQLFS_RESULT_CHUNK_SIZE, std::memory_order_relaxed);
+    g_SpillFileBytes.fetch_sub(m_size, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Method: Open
+//
+// Description:
+//    This method creates the file. It has no name, so it is not seen
+//    through the mount and cannot be left behind: O_TMPFILE where the
+//    file system supports it, or a file unlinked right after it is
+//    created.
+//
+// Returns:
+//    true on success.
+//
+bool
+SpillFile::Open()
+{
+    string path = g_UserPaths.m_dumpPath + LINUX_PATH_DELIM ".spill-XXXXXX";
+
+    m_fd = open(g_UserPaths.m_dumpPath.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (m_fd == -1)
+    {
+        m_fd = mkostemp(&path[0], O_CLOEXEC);
+        if (m_fd != -1)
+        {
+            unlink(path.c_str());
+        }
+    }
+
+    if (m_fd == -1)
+    {
+        LogMsg(LOG_LEVEL_WARNING, "Cannot create a spill file in %s - %s\n",
+            g_UserPaths.m_dumpPath.c_str(), strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Write
+//
+// Description:
+//    This method compresses the chunk into a frame and appends it to the
+//    file. The frames are written by one thread (the producer) and never
+//    change once written, so readers use pread without a lock. The frame
+//    buffer is reused for every chunk.
+//
+//    Once the file could not be created or written (disk full, read-only
+//    dump directory), it is failed: the warning is logged once and the
+//    later chunks stay in memory without another attempt.
+//
+// Returns:
+//    0 on success, -1 on error - the chunk then stays in memory.
+//
+int
+SpillFile::Write(
+    const char* chunk,
+    SpilledChunk& location)
+{
+    const char*         data;
+    int                 length;
+
+    if (m_failed)
+    {
+        return -1;
+    }
+
+    if (m_fd == -1 && !Open())
+    {
+        m_failed = true;
+        return -1;
+    }
+
+    if (m_frame.empty())
+    {
+        m_frame.resize(LZ4_COMPRESSBOUND(SQLFS_RESULT_CHUNK_SIZE));
+    }
+    data = m_frame.data();
+
+    length = LZ4_compress_default(chunk, m_frame.data(), SQLFS_RESULT_CHUNK_SIZE,
+                                  (int)m_frame.size());
+    if (length <= 0 || length >= SQLFS_RESULT_CHUNK_SIZE)
+    {
+        data = chunk;
+        length = SQLFS_RESULT_CHUNK_SIZE;
+    }
+
+    if (pwrite(m_fd, data, length, m_size) != length)
+    {
+        LogMsg(LOG_LEVEL_WARNING, "Cannot write to a spill file in %s - %s\n",
+            g_UserPaths.m_dumpPath.c_str(), strerror(errno));
+        m_failed = true;
+        return -1;
+    }
+
+    location.m_offset = m_size;
+    location.m_length = length;
+    m_size += length;
+    m_numChunks++;
+
+    g_SpilledBytes.fetch_add(SQLFS_RESULT_CHUNK_SIZE, std::memory_order_relaxed);
+    g_SpillFileBytes.fetch_add(length, std::memory_order_relaxed);
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Read
+//
+// Description:
+//    This method reads the frame of one chunk and decompresses it - a
+//    read at any offset of a spilled result costs the frames it covers
+//    only.
+//
+// Returns:
+//    0 on success, -EIO on error.
+//
+int
+SpillFile::Read(
+    const SpilledChunk& location,
+    char* chunk)
+{
+    unique_ptr<char[]>  frame;
+
+    if (location.m_length == SQLFS_RESULT_CHUNK_SIZE)
+    {
+        return (pread(m_fd, chunk, SQLFS_RESULT_CHUNK_SIZE, location.m_offset) ==
+                SQLFS_RESULT_CHUNK_SIZE) ? 0 : -EIO;
+    }
+
+    frame.reset(new char[location.m_length]);
+    if (pread(m_fd, frame.get(), location.m_length, location.m_offset) != (ssize_t)location.m_length ||
+        LZ4_decompress_safe(frame.get(), chunk, location.m_length, SQLFS_RESULT_CHUNK_SIZE) !=
+            SQLFS_RESULT_CHUNK_SIZE)
+    {
+        LogMsg(LOG_LEVEL_ERROR, "Cannot read back a spilled chunk - %s\n", strerror(errno));
+        return -EIO;
+    }
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Spill.h
+//
+// Purpose:
+//   This file contains the declaration of the on-disk spill of large
+//   query results - LZ4 compressed chunks in unnamed files of the dump
+//   directory, used once the results in memory reach their budget.
+//
+#pragma once
+
+// Only results larger than this spill, so the small results read most
+// often always stay in memory.
+//
+#define SQLFS_SPILL_MIN_RESULT_SIZE     (16 * SQLFS_RESULT_CHUNK_SIZE)
+
+// ---------------------------------------------------------------------------
+// Structure: SpilledChunk
+//
+// Description:
+//    Location of a chunk in the spill file of its result. A chunk that
+//    LZ4 cannot shrink is stored as is, with m_length equal to the size
+//    of the chunk.
+//
+struct SpilledChunk
+{
+    off_t       m_offset;
+    uint32_t    m_length;
+};
+
+//--------------------------------------------------------------------
+// Class: SpillFile
+//
+// Description:
+//  Unnamed file of the dump directory holding the spilled chunks of one
+//  result, one compressed frame per chunk. The index of the frames is
+//  kept by the result. The file goes away when it is closed.
+//
+class SpillFile
+{
+public:
+    // Constructor. The file is created on the first Write.
+    //
+    SpillFile();
+
+    // Closes the file, freeing its space.
+    //
+    ~SpillFile();
+
+    // Compresses a full chunk and appends it to the file. Only the
+    // producer of the result writes. Returns 0 on success. After the
+    // first error, the file is failed and nothing more is written.
+    //
+    int Write(
+        const char* chunk,
+        SpilledChunk& location);
+
+    // Reads a chunk back and decompresses it into chunk, which has room
+    // for SQLFS_RESULT_CHUNK_SIZE bytes. Returns 0 on success.
+    //
+    int Read(
+        const SpilledChunk& location,
+        char* chunk);
+
+private:
+    // Creates the file in the dump directory.
+    //
+    bool Open();
+
+    int             m_fd;
+    off_t           m_size;         // Bytes written
+    size_t          m_numChunks;    // Chunks written
+    bool            m_failed;       // Could not be created or written
+    vector<char>    m_frame;        // Compressed frame of the chunk written
+};
+
+// Sets how much memory the query results may use before the large ones
+// spill. 0 for no limit.
+//
+void
+SetResultMemoryLimit(
+    size_t limit);
+
+// Checks if the next chunk of a result of the given size should spill.
+//
+bool
+ShouldSpill(
+    size_t resultSize);
+
+// Counts chunks allocated (positive) or freed (negative) in memory.
+//
+void
+AddResidentBytes(
+    ssize_t bytes);
+
+// Gets the bytes of the results in memory, the bytes spilled and the size
+// of their spill files.
+//
+void
+GetSpillUsage(
+    size_t& resident,
+    size_t& spilled,
+    size_t& spillFileSize);
@@ -0,0 +1,712 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Stats.cpp
+//
+// Purpose:
+//   This file contains the definitions of the counters and latency
+//   histograms DBFS keeps about itself and their text renderings.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Names of the FUSE operations, in FuseOp order.
+//
+static const char* g_FuseOpNames[FUSE_OP_COUNT] =
+{
+    "getattr", "readlink", "mknod", "mkdir", "unlink", "rmdir", "symlink",
+    "rename", "link", "chmod", "chown", "truncate", "open", "read", "write",
+    "statfs", "release", "fsync", "setxattr", "getxattr", "listxattr",
+    "removexattr", "opendir", "readdir", "releasedir", "access", "utimens",
+    "read_buf", "fallocate"
+};
+
+// ---------------------------------------------------------------------------
+// Structure: FuseOpShard
+//
+// Description:
+//    FUSE operation counters of one thread. Only the owning thread writes
+//    them, RenderStats sums all the shards.
+//
+struct FuseOpShard
+{
+    std::atomic<uint64_t> m_counts[FUSE_OP_COUNT];
+};
+
+// Registry of all the statistics. The lock is only taken to create an
+// entry (once per key, or once per thread for the shards) and to render.
+//
+static std::mutex                                       g_StatsLock;
+static map<string, unique_ptr<ServerStats>>             g_ServerStats;
+static map<pair<string, string>, unique_ptr<QueryStats>> g_QueryStats;
+static list<FuseOpShard>                                g_FuseOpShards;
+static vector<FuseOpShard*>                             g_FreeFuseOpShards;
+
+// ---------------------------------------------------------------------------
+// Class: FuseOpShardOwner
+//
+// Description:
+//    Gives each thread its own FuseOpShard. When the thread exits the
+//    shard goes back to a free list (keeping its counts) so that threads
+//    FUSE starts later reuse it instead of adding shards.
+//
+class FuseOpShardOwner
+{
+public:
+    FuseOpShard* Get()
+    {
+        if (!m_shard)
+        {
+            std::lock_guard<std::mutex> guard(g_StatsLock);
+
+            if (!g_FreeFuseOpShards.empty())
+            {
+                m_shard = g_FreeFuseOpShards.back();
+                g_FreeFuseOpShards.pop_back();
+            }
+            else
+            {
+                g_FuseOpShards.emplace_back();
+                m_shard = &g_FuseOpShards.back();
+
+                for (auto&& count : m_shard->m_counts)
+                {
+                    count.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        return m_shard;
+    }
+
+    ~FuseOpShardOwner()
+    {
+        if (m_shard)
+        {
+            std::lock_guard<std::mutex> guard(g_StatsLock);
+            g_FreeFuseOpShards.push_back(m_shard);
+        }
+    }
+
+private:
+    FuseOpShard* m_shard = nullptr;
+};
+
+static thread_local FuseOpShardOwner t_FuseOpShard;
+
+// Per-thread cache of GetQueryStats lookups.
+//
+static thread_local unordered_map<string, QueryStats*> t_QueryStatsCache;
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+LatencyHistogram::LatencyHistogram()
+{
+    for (auto&& bucket : m_buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sumUs.store(0, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Method: Record
+//
+// Description:
+//    This method adds a duration to the histogram.
+//
+// Returns:
+//    VOID
+//
+void
+LatencyHistogram::Record(
+    uint64_t durationUs)
+{
+    int bucket = 0;
+
+    // Number of significant bits - durationUs < 2^bucket.
+    //
+    if (durationUs)
+    {
+        bucket = 64 - __builtin_clzll(durationUs);
+    }
+    bucket = min(bucket, STATS_HISTOGRAM_BUCKETS - 1);
+
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumUs.fetch_add(durationUs, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Method: RecordSince
+//
+// Description:
+//    This method adds the time elapsed since start to the histogram.
+//
+// Returns:
+//    VOID
+//
+void
+LatencyHistogram::RecordSince(
+    std::chrono::steady_clock::time_point start)
+{
+    Record(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+// ---------------------------------------------------------------------------
+// Method: Snapshot
+//
+// Description:
+//    This method copies the histogram. The copy is not atomic as a whole,
+//    which is fine for reporting.
+//
+// Returns:
+//    VOID
+//
+void
+LatencyHistogram::Snapshot(
+    uint64_t buckets[STATS_HISTOGRAM_BUCKETS],
+    uint64_t& count,
+    uint64_t& sumUs) const
+{
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+    {
+        buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    }
+    count = m_count.load(std::memory_order_relaxed);
+    sumUs = m_sumUs.load(std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetServerStats
+//
+// Description:
+//    This method looks up (or creates) the statistics of a server.
+//
+// Returns:
+//    ServerStats pointer.
+//
+ServerStats*
+GetServerStats(
+    const string& servername)
+{
+    std::lock_guard<std::mutex> guard(g_StatsLock);
+
+    auto& stats = g_ServerStats[servername];
+    if (!stats)
+    {
+        stats.reset(new ServerStats());
+    }
+
+    return stats.get();
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetQueryStats
+//
+// Description:
+//    This method looks up (or creates) the statistics of a file of a
+//    server. Each thread keeps the pointers it looked up, so the lock is
+//    only taken the first time a thread sees a file.
+//
+// Returns:
+//    QueryStats pointer.
+//
+QueryStats*
+GetQueryStats(
+    const string& servername,
+    const string& filename)
+{
+    string cacheKey = servername + '\n' + filename;
+
+    auto cached = t_QueryStatsCache.find(cacheKey);
+    if (cached != t_QueryStatsCache.end())
+    {
+        return cached->second;
+    }
+
+    std::lock_guard<std::mutex> guard(g_StatsLock);
+
+    auto& stats = g_QueryStats[make_pair(servername, filename)];
+    if (!stats)
+    {
+        stats.reset(new QueryStats());
+    }
+    t_QueryStatsCache[cacheKey] = stats.get();
+
+    return stats.get();
+}
+
+// ---------------------------------------------------------------------------
+// Method: RecordLastQuery
+//
+// Returns:
+//    VOID
+//
+void
+RecordLastQuery(
+    QueryStats* stats,
+    LastQuery& query)
+{
+    query.m_completedAt = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> guard(stats->m_lastQueryLock);
+    stats->m_lastQuery = std::move(query);
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetLastQuery
+//
+// Returns:
+//    true if the file has a last query.
+//
+bool
+GetLastQuery(
+    QueryStats* stats,
+    LastQuery& query)
+{
+    std::lock_guard<std::mutex> guard(stats->m_lastQueryLock);
+
+    if (stats->m_lastQuery.m_completedAt == std::chrono::steady_clock::time_point())
+    {
+        return false;
+    }
+
+    query = stats->m_lastQuery;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: CountFuseOp
+//
+// Description:
+//    This method counts a call to a FUSE callback in the shard of the
+//    calling thread. There is a single writer per shard so a relaxed
+//    load and store is enough.
+//
+// Returns:
+//    VOID
+//
+void
+CountFuseOp(
+    FuseOp op)
+{
+    std::atomic<uint64_t>& count = t_FuseOpShard.Get()->m_counts[op];
+
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetPercentile
+//
+// Description:
+//    This method estimates a percentile of the histogram.
+//
+// Returns:
+//    Upper bound (in microseconds) of the bucket holding the percentile.
+//
+static uint64_t
+GetPercentile(
+    const uint64_t buckets[STATS_HISTOGRAM_BUCKETS],
+    uint64_t count,
+    double percentile)
+{
+    uint64_t seen = 0;
+
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen && seen >= percentile * count)
+        {
+            return 1ULL << i;
+        }
+    }
+
+    return 1ULL << (STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+// ---------------------------------------------------------------------------
+// Method: RenderHistogramText
+//
+// Description:
+//    This method renders a histogram as "name_count=.. name_avg_us=..
+//    name_p50_us=.. name_p99_us=..".
+//
+// Returns:
+//    VOID
+//
+static void
+RenderHistogramText(
+    ostringstream& out,
+    const char* name,
+    const LatencyHistogram& histogram)
+{
+    uint64_t buckets[STATS_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sumUs;
+
+    histogram.Snapshot(buckets, count, sumUs);
+
+    out << " " << name << "_count=" << count
+        << " " << name << "_avg_us=" << (count ? sumUs / count : 0)
+        << " " << name << "_p50_us=" << (count ? GetPercentile(buckets, count, 0.5) : 0)
+        << " " << name << "_p99_us=" << (count ? GetPercentile(buckets, count, 0.99) : 0);
+}
+
+// ---------------------------------------------------------------------------
+// Method: EscapeLabel
+//
+// Description:
+//    This method escapes a Prometheus label value.
+//
+// Returns:
+//    The escaped value.
+//
+static string
+EscapeLabel(
+    const string& value)
+{
+    string escaped;
+
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (c == '\n')
+        {
+            escaped += "\\n";
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+// ---------------------------------------------------------------------------
+// Method: RenderHistogramPrometheus
+//
+// Description:
+//    This method renders a histogram in the Prometheus text format with
+//    the durations in seconds.
+//
+// Returns:
+//    VOID
+//
+static void
+RenderHistogramPrometheus(
+    ostringstream& out,
+    const char* name,
+    const string& labels,
+    const LatencyHistogram& histogram)
+{
+    uint64_t buckets[STATS_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sumUs;
+    uint64_t cumulative = 0;
+
+    histogram.Snapshot(buckets, count, sumUs);
+
+    for (int i = 0; i < STATS_HISTOGRAM_BUCKETS - 1; i++)
+    {
+        cumulative += buckets[i];
+        out << name << "_bucket{" << labels << ",le=\""
+            << (double)(1ULL << i) / 1000000 << "\"} " << cumulative << "\n";
+    }
+    out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << count << "\n";
+    out << name << "_sum{" << labels << "} " << (double)sumUs / 1000000 << "\n";
+    out << name << "_count{" << labels << "} " << count << "\n";
+}
+
+// ---------------------------------------------------------------------------
+// Method: RenderStatsText
+//
+// Description:
+//    This method renders the statistics as one line per FUSE operation,
+//    server, connection pool and file.
+//
+// Returns:
+//    VOID
+//
+static void
+RenderStatsText(
+    ostringstream& out,
+    const uint64_t fuseOps[FUSE_OP_COUNT])
+{
+    int     numOpen;
+    int     numIdle;
+    int     maxSize;
+    double  scale;
+    size_t  resident;
+    size_t  spilled;
+    size_t  spillFileSize;
+
+    for (int i = 0; i < FUSE_OP_COUNT; i++)
+    {
+        out << "fuse " << g_FuseOpNames[i] << " count=" << fuseOps[i] << "\n";
+    }
+
+    for (auto&& itr : g_ServerStats)
+    {
+        const ServerStats& stats = *itr.second;
+
+        out << "server " << itr.first
+            << " logins=" << stats.m_logins.load(std::memory_order_relaxed)
+            << " login_failures=" << stats.m_loginFailures.load(std::memory_order_relaxed)
+            << " cache_hits=" << stats.m_cacheHits.load(std::memory_order_relaxed)
+            << " cache_misses=" << stats.m_cacheMisses.load(std::memory_order_relaxed)
+            << " cache_waits=" << stats.m_cacheWaits.load(std::memory_order_relaxed)
+            << " pool_waits=" << stats.m_poolWaits.load(std::memory_order_relaxed)
+            << " pool_timeouts=" << stats.m_poolTimeouts.load(std::memory_order_relaxed)
+            << " throttle_waits=" << stats.m_throttleWaits.load(std::memory_order_relaxed)
+            << " throttle_stale=" << stats.m_throttleStale.load(std::memory_order_relaxed);
+        RenderHistogramText(out, "login", stats.m_loginTime);
+        out << "\n";
+    }
+
+    for (auto&& itr : GetServerInfoList())
+    {
+        if (!itr.second->m_connectionPool)
+        {
+            continue;
+        }
+        itr.second->m_connectionPool->GetUsage(numOpen, numIdle, maxSize);
+
+        out << "pool " << itr.first
+            << " open=" << numOpen
+            << " idle=" << numIdle
+            << " in_use=" << numOpen - numIdle
+            << " max=" << maxSize << "\n";
+    }
+
+    for (auto&& itr : GetServerInfoList())
+    {
+        if (!itr.second->m_throttle)
+        {
+            continue;
+        }
+        itr.second->m_throttle->GetUsage(scale, numOpen, maxSize);
+
+        out << "throttle " << itr.first
+            << " scale=" << scale
+            << " running=" << numOpen
+            << " max_running=" << maxSize << "\n";
+    }
+
+    GetSpillUsage(resident, spilled, spillFileSize);
+    out << "results resident=" << resident
+        << " spilled=" << spilled
+        << " spill_file=" << spillFileSize << "\n";
+
+    for (auto&& itr : g_QueryStats)
+    {
+        const QueryStats& stats = *itr.second;
+
+        out << "query " << itr.first.first << " " << itr.first.second
+            << " queries=" << stats.m_queries.load(std::memory_order_relaxed)
+            << " errors=" << stats.m_errors.load(std::memory_order_relaxed)
+            << " rows=" << stats.m_rows.load(std::memory_order_relaxed)
+            << " bytes=" << stats.m_bytes.load(std::memory_order_relaxed);
+        RenderHistogramText(out, "acquire", stats.m_acquireTime);
+        RenderHistogramText(out, "exec", stats.m_execTime);
+        RenderHistogramText(out, "fetch", stats.m_fetchTime);
+        out << "\n";
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: RenderStatsPrometheus
+//
+// Description:
+//    This method renders the statistics in the Prometheus text format.
+//
+// Returns:
+//    VOID
+//
+static void
+RenderStatsPrometheus(
+    ostringstream& out,
+    const uint64_t fuseOps[FUSE_OP_COUNT])
+{
+    int     numOpen;
+    int     numIdle;
+    int     maxSize;
+    double  scale;
+    size_t  resident;
+    size_t  spilled;
+    size_t  spillFileSize;
+    string  labels;
+
+    out << "# TYPE dbfs_fuse_ops_total counter\n";
+    for (int i = 0; i < FUSE_OP_COUNT; i++)
+    {
+        out << "dbfs_fuse_ops_total{op=\"" << g_FuseOpNames[i] << "\"} " << fuseOps[i] << "\n";
+    }
+
+    const struct
+    {
+        const char*                     m_name;
+        std::atomic<uint64_t> ServerStats::* m_counter;
+    } serverCounters[] =
+    {
+        { "dbfs_logins_total",          &ServerStats::m_logins },
+        { "dbfs_login_failures_total",  &ServerStats::m_loginFailures },
+        { "dbfs_cache_hits_total",      &ServerStats::m_cacheHits },
+        { "dbfs_cache_misses_total",    &ServerStats::m_cacheMisses },
+        { "dbfs_cache_waits_total",     &ServerStats::m_cacheWaits },
+        { "dbfs_pool_waits_total",      &ServerStats::m_poolWaits },
+        { "dbfs_pool_timeouts_total",   &ServerStats::m_poolTimeouts },
+        { "dbfs_throttle_waits_total",  &ServerStats::m_throttleWaits },
+        { "dbfs_throttle_stale_total",  &ServerStats::m_throttleStale },
+    };
+
+    for (auto&& counter : serverCounters)
+    {
+        out << "# TYPE " << counter.m_name << " counter\n";
+        for (auto&& itr : g_ServerStats)
+        {
+            out << counter.m_name << "{server=\"" << EscapeLabel(itr.first) << "\"} "
+                << ((*itr.second).*counter.m_counter).load(std::memory_order_relaxed) << "\n";
+        }
+    }
+
+    out << "# TYPE dbfs_login_duration_seconds histogram\n";
+    for (auto&& itr : g_ServerStats)
+    {
+        RenderHistogramPrometheus(out, "dbfs_login_duration_seconds",
+            "server=\"" + EscapeLabel(itr.first) + "\"", itr.second->m_loginTime);
+    }
+
+    out << "# TYPE dbfs_pool_connections gauge\n";
+    out << "# TYPE dbfs_pool_max_connections gauge\n";
+    for (auto&& itr : GetServerInfoList())
+    {
+        if (!itr.second->m_connectionPool)
+        {
+            continue;
+        }
+        itr.second->m_connectionPool->GetUsage(numOpen, numIdle, maxSize);
+        labels = "server=\"" + EscapeLabel(itr.first) + "\"";
+
+        out << "dbfs_pool_connections{" << labels << ",state=\"idle\"} " << numIdle << "\n";
+        out << "dbfs_pool_connections{" << labels << ",state=\"in_use\"} " << numOpen - numIdle << "\n";
+        out << "dbfs_pool_max_connections{" << labels << "} " << maxSize << "\n";
+    }
+
+    out << "# TYPE dbfs_throttle_scale gauge\n";
+    out << "# TYPE dbfs_throttle_running_queries gauge\n";
+    for (auto&& itr : GetServerInfoList())
+    {
+        if (!itr.second->m_throttle)
+        {
+            continue;
+        }
+        itr.second->m_throttle->GetUsage(scale, numOpen, maxSize);
+        labels = "server=\"" + EscapeLabel(itr.first) + "\"";
+
+        out << "dbfs_throttle_scale{" << labels << "} " << scale << "\n";
+        out << "dbfs_throttle_running_queries{" << labels << "} " << numOpen << "\n";
+    }
+
+    GetSpillUsage(resident, spilled, spillFileSize);
+    out << "# TYPE dbfs_result_bytes gauge\n";
+    out << "dbfs_result_bytes{state=\"resident\"} " << resident << "\n";
+    out << "dbfs_result_bytes{state=\"spilled\"} " << spilled << "\n";
+    out << "# TYPE dbfs_spill_file_bytes gauge\n";
+    out << "dbfs_spill_file_bytes " << spillFileSize << "\n";
+
+    const struct
+    {
+        const char*                     m_name;
+        std::atomic<uint64_t> QueryStats::* m_counter;
+    } queryCounters[] =
+    {
+        { "dbfs_queries_total",         &QueryStats::m_queries },
+        { "dbfs_query_errors_total",    &QueryStats::m_errors },
+        { "dbfs_query_rows_total",      &QueryStats::m_rows },
+        { "dbfs_query_bytes_total",     &QueryStats::m_bytes },
+    };
+
+    for (auto&& counter : queryCounters)
+    {
+        out << "# TYPE " << counter.m_name << " counter\n";
+        for (auto&& itr : g_QueryStats)
+        {
+            out << counter.m_name << "{server=\"" << EscapeLabel(itr.first.first)
+                << "\",file=\"" << EscapeLabel(itr.first.second) << "\"} "
+                << ((*itr.second).*counter.m_counter).load(std::memory_order_relaxed) << "\n";
+        }
+    }
+
+    out << "# TYPE dbfs_query_acquire_duration_seconds histogram\n";
+    for (auto&& itr : g_QueryStats)
+    {
+        RenderHistogramPrometheus(out, "dbfs_query_acquire_duration_seconds",
+            "server=\"" + EscapeLabel(itr.first.first) + "\",file=\"" +
+            EscapeLabel(itr.first.second) + "\"", itr.second->m_acquireTime);
+    }
+
+    out << "# TYPE dbfs_query_exec_duration_seconds histogram\n";
+    for (auto&& itr : g_QueryStats)
+    {
+        RenderHistogramPrometheus(out, "dbfs_query_exec_duration_seconds",
+            "server=\"" + EscapeLabel(itr.first.first) + "\",file=\"" +
+            EscapeLabel(itr.first.second) + "\"", itr.second->m_execTime);
+    }
+
+    out << "# TYPE dbfs_query_fetch_duration_seconds histogram\n";
+    for (auto&& itr : g_QueryStats)
+    {
+        RenderHistogramPrometheus(out, "dbfs_query_fetch_duration_seconds",
+            "server=\"" + EscapeLabel(itr.first.first) + "\",file=\"" +
+            EscapeLabel(itr.first.second) + "\"", itr.second->m_fetchTime);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: RenderStats
+//
+// Description:
+//    This method renders all the statistics for the .dbfs/stats and
+//    .dbfs/stats.prom files.
+//
+// Returns:
+//    The rendered statistics.
+//
+string
+RenderStats(
+    bool prometheus)
+{
+    ostringstream   out;
+    uint64_t        fuseOps[FUSE_OP_COUNT] = { 0 };
+
+    std::lock_guard<std::mutex> guard(g_StatsLock);
+
+    for (auto&& shard : g_FuseOpShards)
+    {
+        for (int i = 0; i < FUSE_OP_COUNT; i++)
+        {
+            fuseOps[i] += shard.m_counts[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    if (prometheus)
+    {
+        RenderStatsPrometheus(out, fuseOps);
+    }
+    else
+    {
+        RenderStatsText(out, fuseOps);
+    }
+
+    return out.str();
+}
@@ -0,0 +1,230 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Stats.h
+//
+// Purpose:
+//   This file contains the declarations of the counters and latency
+//   histograms DBFS keeps about itself. They are exposed through the
+//   read-only files .dbfs/stats (text) and .dbfs/stats.prom (Prometheus
+//   text format) under the mount directory.
+//
+#pragma once
+
+// Folder under the mount root holding the DBFS statistics files.
+//
+#define STATS_FOLDER_NAME               ".dbfs"
+#define STATS_TEXT_FILE_NAME            "stats"
+#define STATS_PROMETHEUS_FILE_NAME      "stats.prom"
+
+// Number of buckets of a latency histogram. Bucket i counts durations
+// below 2^i microseconds, the last bucket counts everything else.
+//
+#define STATS_HISTOGRAM_BUCKETS         26
+
+// ---------------------------------------------------------------------------
+// FUSE operations that are counted. Keep in sync with g_FuseOpNames.
+//
+enum FuseOp
+{
+    FUSE_OP_GETATTR,
+    FUSE_OP_READLINK,
+    FUSE_OP_MKNOD,
+    FUSE_OP_MKDIR,
+    FUSE_OP_UNLINK,
+    FUSE_OP_RMDIR,
+    FUSE_OP_SYMLINK,
+    FUSE_OP_RENAME,
+    FUSE_OP_LINK,
+    FUSE_OP_CHMOD,
+    FUSE_OP_CHOWN,
+    FUSE_OP_TRUNCATE,
+    FUSE_OP_OPEN,
+    FUSE_OP_READ,
+    FUSE_OP_WRITE,
+    FUSE_OP_STATFS,
+    FUSE_OP_RELEASE,
+    FUSE_OP_FSYNC,
+    FUSE_OP_SETXATTR,
+    FUSE_OP_GETXATTR,
+    FUSE_OP_LISTXATTR,
+    FUSE_OP_REMOVEXATTR,
+    FUSE_OP_OPENDIR,
+    FUSE_OP_READDIR,
+    FUSE_OP_RELEASEDIR,
+    FUSE_OP_ACCESS,
+    FUSE_OP_UTIMENS,
+    FUSE_OP_READ_BUF,
+    FUSE_OP_FALLOCATE,
+    FUSE_OP_COUNT
+};
+
+//--------------------------------------------------------------------
+// Class: LatencyHistogram
+//
+// Description:
+//  Log2 bucketed histogram of durations in microseconds. Recording is
+//  a few relaxed atomic increments - no lock.
+//
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    // Records a duration in microseconds.
+    //
+    void Record(
+        uint64_t durationUs);
+
+    // Records the time elapsed since start.
+    //
+    void RecordSince(
+        std::chrono::steady_clock::time_point start);
+
+    // Copies the current bucket counts, total count and sum.
+    //
+    void Snapshot(
+        uint64_t buckets[STATS_HISTOGRAM_BUCKETS],
+        uint64_t& count,
+        uint64_t& sumUs) const;
+
+private:
+    std::atomic<uint64_t>   m_buckets[STATS_HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t>   m_count;
+    std::atomic<uint64_t>   m_sumUs;
+};
+
+// ---------------------------------------------------------------------------
+// Structure: LastQuery
+//
+// Description:
+//    Timings and size of the last successful query of a file, exposed as
+//    the user.dbfs.* extended attributes of the file.
+//
+struct LastQuery
+{
+    uint64_t                                m_loginUs = 0;  // Getting a connection (and logging in)
+    uint64_t                                m_execUs = 0;   // dbsqlexec until the first results
+    uint64_t                                m_fetchUs = 0;  // Reading and serializing the rows
+    uint64_t                                m_rows = 0;
+    uint64_t                                m_bytes = 0;
+    std::chrono::steady_clock::time_point   m_completedAt;
+    string                                  m_statistics;   // SET STATISTICS output, if captured
+};
+
+// ---------------------------------------------------------------------------
+// Structure: QueryStats
+//
+// Description:
+//    Statistics of the queries of one file (DMV or custom query) of a
+//    server. Updated with relaxed atomics, except for the last query
+//    which is updated under its lock.
+//
+struct QueryStats
+{
+    std::atomic<uint64_t>   m_queries{0};
+    std::atomic<uint64_t>   m_errors{0};
+    std::atomic<uint64_t>   m_rows{0};
+    std::atomic<uint64_t>   m_bytes{0};
+    LatencyHistogram        m_acquireTime;  // Getting a connection (and logging in)
+    LatencyHistogram        m_execTime;     // dbsqlexec until the first results
+    LatencyHistogram        m_fetchTime;    // Reading and serializing the rows
+    LastQuery               m_lastQuery;
+    std::mutex              m_lastQueryLock;
+};
+
+// ---------------------------------------------------------------------------
+// Structure: ServerStats
+//
+// Description:
+//    Statistics of one server. Updated with relaxed atomics.
+//
+struct ServerStats
+{
+    std::atomic<uint64_t>   m_logins{0};
+    std::atomic<uint64_t>   m_loginFailures{0};
+    std::atomic<uint64_t>   m_cacheHits{0};
+    std::atomic<uint64_t>   m_cacheMisses{0};
+    std::atomic<uint64_t>   m_cacheWaits{0};    // Lookups that joined a query in flight
+    std::atomic<uint64_t>   m_poolWaits{0};     // Acquires that waited for a connection
+    std::atomic<uint64_t>   m_poolTimeouts{0};
+    std::atomic<uint64_t>   m_throttleWaits{0}; // Queries that waited for the throttle
+    std::atomic<uint64_t>   m_throttleStale{0}; // Lookups served a stale result while throttled
+    LatencyHistogram        m_loginTime;
+};
+
+// Increments a relaxed counter.
+//
+inline void
+IncrementStat(
+    std::atomic<uint64_t>& counter,
+    uint64_t value = 1)
+{
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+// Returns the statistics of a server, creating them on first use. The
+// pointer stays valid for the lifetime of the process.
+//
+ServerStats*
+GetServerStats(
+    const string& servername);
+
+// Returns the statistics of a file of a server, creating them on first
+// use. Lookups are served from a per-thread cache. The pointer stays
+// valid for the lifetime of the process.
+//
+QueryStats*
+GetQueryStats(
+    const string& servername,
+    const string& filename);
+
+// Records the last successful query of a file, completed now.
+//
+void
+RecordLastQuery(
+    QueryStats* stats,
+    LastQuery& query);
+
+// Gets the last successful query of a file. Returns false if no query
+// of the file succeeded yet.
+//
+bool
+GetLastQuery(
+    QueryStats* stats,
+    LastQuery& query);
+
+// Counts a FUSE operation. Each thread counts into its own shard so
+// FUSE threads never share a cache line for this.
+//
+void
+CountFuseOp(
+    FuseOp op);
+
+// Renders all the statistics as text or in the Prometheus text format.
+//
+string
+RenderStats(
+    bool prometheus);
+
+// ---------------------------------------------------------------------------
+// Wrapper used in InitializeFuseOperations to count the calls to each
+// FUSE callback:
+//      sqlFsOperations->getattr = COUNTED_FUSE_OP(FUSE_OP_GETATTR, GetattrLocalImpl);
+//
+template <FuseOp op, typename Func, Func func>
+struct CountedFuseOp;
+
+template <FuseOp op, typename Ret, typename... Args, Ret (*func)(Args...)>
+struct CountedFuseOp<op, Ret (*)(Args...), func>
+{
+    static Ret Call(Args... args)
+    {
+        CountFuseOp(op);
+        return func(args...);
+    }
+};
+
+#define COUNTED_FUSE_OP(op, func) \
+    CountedFuseOp<op, decltype(&func), &func>::Call
@@ -0,0 +1,361 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Throttle.cpp
+//
+// Purpose:
+//   This file contains the definitions of the per-server query throttle.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+// Description:
+//    The bucket starts full, so the first burst of queries after the
+//    mount is not delayed.
+//
+QueryThrottle::QueryThrottle(
+    const string& servername,
+    double rate,
+    double burst,
+    int maxConcurrent,
+    bool adaptive,
+    ServerStats* stats) :
+    m_servername(servername),
+    m_rate(rate),
+    m_burst(max(burst, 1.0)),
+    m_maxConcurrent(maxConcurrent),
+    m_adaptive(adaptive),
+    m_tokens(m_burst),
+    m_lastRefill(std::chrono::steady_clock::now()),
+    m_numActive(0),
+    m_scale(1),
+    m_latencyMs(0),
+    m_baselineMs(0),
+    m_lastAdjust(m_lastRefill),
+    m_stats(stats)
+{
+}
+
+// ---------------------------------------------------------------------------
+// Method: Refill
+//
+// Description:
+//    This method adds the tokens earned at the current rate since the
+//    last refill, up to the burst.
+//
+// Returns:
+//    VOID
+//
+void
+QueryThrottle::Refill(
+    std::chrono::steady_clock::time_point now)
+{
+    std::chrono::duration<double> elapsed = now - m_lastRefill;
+
+    if (m_rate > 0)
+    {
+        m_tokens = min(m_burst, m_tokens + elapsed.count() * m_rate * m_scale);
+    }
+    m_lastRefill = now;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetMaxActive
+//
+// Returns:
+//    The concurrency cap at the current scale - at least one query - or
+//    0 if the concurrency is not limited.
+//
+int
+QueryThrottle::GetMaxActive() const
+{
+    if (m_maxConcurrent == 0)
+    {
+        return 0;
+    }
+
+    return max(1, (int)(m_maxConcurrent * m_scale + 0.5));
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsThrottled
+//
+// Returns:
+//    true if a query starting now would have to wait.
+//
+bool
+QueryThrottle::IsThrottled()
+{
+    int maxActive;
+
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    Refill(std::chrono::steady_clock::now());
+    maxActive = GetMaxActive();
+
+    return (m_rate > 0 && m_tokens < 1) ||
+           (maxActive > 0 && m_numActive >= maxActive);
+}
+
+// ---------------------------------------------------------------------------
+// Method: BeginQuery
+//
+// Description:
+//    This method waits for a token and for a free slot under the
+//    concurrency cap, then takes both. Waiting for a token sleeps until
+//    the bucket refills enough, waiting for a slot until a query ends.
+//
+//    With isInterrupted the wait is done in slices of
+//    SQLFS_QUERY_POLL_INTERVAL_MS, so that a reader blocked in the
+//    throttle can be interrupted.
+//
+// Returns:
+//    0 once admitted, -EINTR if interrupted.
+//
+int
+QueryThrottle::BeginQuery(
+    bool (*isInterrupted)())
+{
+    bool                            waited = false;
+    bool                            hasToken;
+    bool                            hasSlot;
+    int                             maxActive;
+    std::chrono::duration<double>   pollInterval = std::chrono::milliseconds(SQLFS_QUERY_POLL_INTERVAL_MS);
+
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+
+        for (;;)
+        {
+            Refill(std::chrono::steady_clock::now());
+            maxActive = GetMaxActive();
+
+            hasToken = (m_rate <= 0 || m_tokens >= 1);
+            hasSlot = (maxActive == 0 || m_numActive < maxActive);
+            if (hasToken && hasSlot)
+            {
+                break;
+            }
+
+            if (waited && isInterrupted && isInterrupted())
+            {
+                IncrementStat(m_stats->m_throttleWaits);
+                return -EINTR;
+            }
+
+            waited = true;
+            if (!hasToken)
+            {
+                std::chrono::duration<double> refill((1 - m_tokens) / (m_rate * m_scale));
+
+                m_admitted.wait_for(guard, isInterrupted ? min(refill, pollInterval) : refill);
+            }
+            else if (isInterrupted)
+            {
+                m_admitted.wait_for(guard, pollInterval);
+            }
+            else
+            {
+                m_admitted.wait(guard);
+            }
+        }
+
+        if (m_rate > 0)
+        {
+            m_tokens -= 1;
+        }
+        m_numActive++;
+    }
+
+    if (waited)
+    {
+        IncrementStat(m_stats->m_throttleWaits);
+    }
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Adapt
+//
+// Description:
+//    This method adds the latency of a query to the moving average and,
+//    in adaptive mode, backs off or recovers depending on how it compares
+//    with the baseline. The baseline follows the average down right away
+//    but only drifts up slowly, so a server that stays slower (a bigger
+//    workload, a new DMV in the prefetch) ends up with a new baseline
+//    instead of being throttled forever.
+//
+// Returns:
+//    VOID
+//
+void
+QueryThrottle::Adapt(
+    std::chrono::steady_clock::duration latency)
+{
+    auto    now = std::chrono::steady_clock::now();
+    double  latencyMs = std::chrono::duration<double, std::milli>(latency).count();
+
+    if (m_latencyMs == 0)
+    {
+        m_latencyMs = latencyMs;
+        m_baselineMs = latencyMs;
+    }
+    else
+    {
+        m_latencyMs += (latencyMs - m_latencyMs) * THROTTLE_LATENCY_WEIGHT;
+    }
+
+    if (m_latencyMs < m_baselineMs)
+    {
+        m_baselineMs = m_latencyMs;
+    }
+    else
+    {
+        m_baselineMs += (m_latencyMs - m_baselineMs) * THROTTLE_BASELINE_DRIFT;
+    }
+
+    if (!m_adaptive ||
+        now - m_lastAdjust < std::chrono::milliseconds(THROTTLE_ADJUST_INTERVAL_MS))
+    {
+        return;
+    }
+
+    if (m_latencyMs > m_baselineMs * THROTTLE_BACKOFF_RATIO && m_scale > THROTTLE_MIN_SCALE)
+    {
+        m_scale = max(m_scale * THROTTLE_BACKOFF_FACTOR, THROTTLE_MIN_SCALE);
+        m_lastAdjust = now;
+
+        LogMsg(LOG_LEVEL_WARNING, "Query latency of server %s is %.0f ms (usually %.0f ms) - throttling to %.0f%%\n",
+            m_servername.c_str(), m_latencyMs, m_baselineMs, m_scale * 100);
+    }
+    else if (m_latencyMs < m_baselineMs * THROTTLE_RECOVER_RATIO && m_scale < 1)
+    {
+        m_scale = min(m_scale + THROTTLE_RECOVER_STEP, 1.0);
+        m_lastAdjust = now;
+
+        if (m_scale == 1)
+        {
+            LogMsg(LOG_LEVEL_INFO, "Query latency of server %s is back to %.0f ms - no longer throttled\n",
+                m_servername.c_str(), m_latencyMs);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: EndQuery
+//
+// Description:
+//    This method frees the slot of the query and wakes up the queries
+//    waiting for one.
+//
+// Returns:
+//    VOID
+//
+void
+QueryThrottle::EndQuery(
+    std::chrono::steady_clock::duration latency)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        m_numActive--;
+        Adapt(latency);
+    }
+
+    m_admitted.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetUsage
+//
+// Returns:
+//    VOID
+//
+void
+QueryThrottle::GetUsage(
+    double& scale,
+    int& numActive,
+    int& maxActive)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    scale = m_scale;
+    numActive = m_numActive;
+    maxActive = GetMaxActive();
+}
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+ThrottledQuery::ThrottledQuery(
+    QueryThrottle* throttle,
+    bool (*isInterrupted)()) :
+    m_throttle(throttle),
+    m_executed(false),
+    m_error(0)
+{
+    if (m_throttle)
+    {
+        m_error = m_throttle->BeginQuery(isInterrupted);
+    }
+    m_start = std::chrono::steady_clock::now();
+}
+
+// ---------------------------------------------------------------------------
+// Method: Destructor
+//
+ThrottledQuery::~ThrottledQuery()
+{
+    if (!m_executed)
+    {
+        Executed();
+    }
+
+    // A query that was not admitted holds nothing.
+    //
+    if (m_throttle && !m_error)
+    {
+        m_throttle->EndQuery(m_latency);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetError
+//
+// Returns:
+//    0 if the query was admitted, -EINTR otherwise.
+//
+int
+ThrottledQuery::GetError() const
+{
+    return m_error;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Started
+//
+// Returns:
+//    VOID
+//
+void
+ThrottledQuery::Started()
+{
+    m_start = std::chrono::steady_clock::now();
+}
+
+// ---------------------------------------------------------------------------
+// Method: Executed
+//
+// Returns:
+//    VOID
+//
+void
+ThrottledQuery::Executed()
+{
+    m_latency = std::chrono::steady_clock::now() - m_start;
+    m_executed = true;
+}
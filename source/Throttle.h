@@ -0,0 +1,167 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: Throttle.h
+//
+// Purpose:
+//   This file contains the declaration of the per-server query throttle -
+//   the rate limit and concurrency cap that keep DBFS from overloading a
+//   server.
+//
+#pragma once
+
+// Adaptive mode. The query latency is an exponentially weighted moving
+// average, compared with a baseline that follows its lowest value and
+// drifts slowly towards the current one. Above THROTTLE_BACKOFF_RATIO
+// times the baseline the rate and the concurrency are cut by
+// THROTTLE_BACKOFF_FACTOR, below THROTTLE_RECOVER_RATIO times the
+// baseline they recover by THROTTLE_RECOVER_STEP - at most once per
+// THROTTLE_ADJUST_INTERVAL_MS.
+//
+#define THROTTLE_LATENCY_WEIGHT     0.2
+#define THROTTLE_BASELINE_DRIFT     0.001
+#define THROTTLE_BACKOFF_RATIO      2.0
+#define THROTTLE_RECOVER_RATIO      1.25
+#define THROTTLE_BACKOFF_FACTOR     0.5
+#define THROTTLE_RECOVER_STEP       0.1
+#define THROTTLE_MIN_SCALE          0.1
+#define THROTTLE_ADJUST_INTERVAL_MS 1000
+
+//--------------------------------------------------------------------
+// Class: QueryThrottle
+//
+// Description:
+//  Limits the queries sent to one server: a token bucket of rateLimit
+//  queries per second holding up to rateBurst queries, and at most
+//  maxConcurrentQueries queries running at once. Every query of the
+//  server goes through it - file reads, prefetch refreshes and catalog
+//  queries alike - and waits until it is admitted.
+//
+//  Reads of a cached file do not wait: while the server is throttled,
+//  the result cache serves them the last result it has instead.
+//
+//  In adaptive mode the rate and the concurrency are scaled down while
+//  the latency of the server rises above its usual latency, and back up
+//  once it is back to normal.
+//
+class QueryThrottle
+{
+public:
+    // Constructor. A rate of 0 does not limit the rate and a maxConcurrent
+    // of 0 does not limit the concurrency.
+    //
+    QueryThrottle(
+        const string& servername,
+        double rate,
+        double burst,
+        int maxConcurrent,
+        bool adaptive,
+        ServerStats* stats);
+
+    // Checks if a query would have to wait to be admitted now.
+    //
+    bool IsThrottled();
+
+    // Waits until a query can start - a token is available and fewer
+    // queries than the cap are running - and counts it as running.
+    // If isInterrupted is given, it is checked while waiting and the
+    // wait is given up once it returns true.
+    //
+    // Returns 0 once admitted, -EINTR if interrupted.
+    //
+    int BeginQuery(
+        bool (*isInterrupted)() = NULL);
+
+    // Counts a query as done. latency is how long the server took to
+    // answer it.
+    //
+    void EndQuery(
+        std::chrono::steady_clock::duration latency);
+
+    // Gets the current scale of the limits (1 unless adaptive mode backed
+    // off), the queries running and the current concurrency cap (0 for
+    // no limit).
+    //
+    void GetUsage(
+        double& scale,
+        int& numActive,
+        int& maxActive);
+
+private:
+    // Adds the tokens earned since the last refill. Caller holds m_lock.
+    //
+    void Refill(
+        std::chrono::steady_clock::time_point now);
+
+    // Gets the concurrency cap at the current scale. Caller holds m_lock.
+    //
+    int GetMaxActive() const;
+
+    // Updates the latency average and adjusts the scale. Caller holds
+    // m_lock.
+    //
+    void Adapt(
+        std::chrono::steady_clock::duration latency);
+
+    string                                  m_servername;
+    double                                  m_rate;         // Tokens per second, 0 for no limit
+    double                                  m_burst;        // Tokens the bucket holds
+    int                                     m_maxConcurrent;// 0 for no limit
+    bool                                    m_adaptive;
+    double                                  m_tokens;
+    std::chrono::steady_clock::time_point   m_lastRefill;
+    int                                     m_numActive;    // Queries running
+    double                                  m_scale;        // Of the rate and the cap, 1 at full speed
+    double                                  m_latencyMs;    // Moving average, 0 before the first query
+    double                                  m_baselineMs;
+    std::chrono::steady_clock::time_point   m_lastAdjust;
+    std::mutex                              m_lock;
+    std::condition_variable                 m_admitted;     // Signalled when a query ends
+    ServerStats*                            m_stats;        // Waits
+};
+
+//--------------------------------------------------------------------
+// Class: ThrottledQuery
+//
+// Description:
+//  Holds an admission of the throttle of a server for the lifetime of a
+//  query. Nothing is throttled for a NULL throttle.
+//
+class ThrottledQuery
+{
+public:
+    // Waits until the query is admitted or isInterrupted returns true.
+    //
+    ThrottledQuery(
+        QueryThrottle* throttle,
+        bool (*isInterrupted)() = NULL);
+
+    // Ends the query. Its latency is the time from Started until
+    // Executed, or until the end of its lifetime if Executed was not
+    // called.
+    //
+    ~ThrottledQuery();
+
+    // Returns 0 if the query was admitted, -EINTR if the wait was
+    // interrupted - the query must not run then.
+    //
+    int GetError() const;
+
+    // Marks the query as sent to the server - once it has a connection,
+    // so waiting for a pool slot or a login is not server latency. The
+    // latency starts at admission if Started is not called.
+    //
+    void Started();
+
+    // Marks the first results of the query as received.
+    //
+    void Executed();
+
+private:
+    QueryThrottle*                          m_throttle;
+    std::chrono::steady_clock::time_point   m_start;
+    std::chrono::steady_clock::duration     m_latency;
+    bool                                    m_executed;
+    int                                     m_error;
+};
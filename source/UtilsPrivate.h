@@ -17,11 +17,13 @@
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cmath>
 #include <codecvt>
 #include <condition_variable>
 #include <deque>
 #include <exception>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <list>
 #include <locale>
@@ -29,6 +31,7 @@
 #include <memory>
 #include <mutex>
 #include <set>
+#include <shared_mutex>
 #include <sstream>
 #include <stack>
 #include <string>
@@ -37,6 +40,8 @@
 #include <unordered_set>
 #include <vector>
 #include <iterator>
+#include <string_view>
+#include <charconv>
 
 // ---------------------------------------------------------------------------
 // Using directives to include specific STL types
@@ -60,6 +65,7 @@ using std::set;
 using std::shared_ptr;
 using std::stack;
 using std::string;
+using std::string_view;
 using std::stringstream;
 using std::thread;
 using std::tuple;
@@ -68,6 +74,7 @@ using std::unique_ptr;
 using std::unordered_map;
 using std::unordered_multimap;
 using std::unordered_multiset;
+using std::unordered_set;
 using std::vector;
 using std::wstring_convert;
 using std::shared_ptr;
@@ -112,6 +119,8 @@ using std::cin;
 #include <sys/uio.h>
 #include <sys/epoll.h>
 #include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
 #include <sys/signalfd.h>
@@ -134,6 +143,7 @@ using std::cin;
 #include <sybfront.h>
 #include <sybdb.h>
 #include <syberror.h>
+#include <lz4.h>
 #include <termios.h>
 #include <cstddef>
 
@@ -141,18 +151,40 @@ using std::cin;
 // Local headers of utility files
 //
 #include "StringUtils.h"
+#include "Stats.h"
+#include "ConnectionPool.h"
+#include "Throttle.h"
+#include "Spill.h"
+#include "ResultBuffer.h"
+#include "ResultCache.h"
 #include "sqlfs.h"
 #include "SQLQuery.h"
+#include "QueryBackend.h"
+#include "RowSerializer.h"
+#include "Prefetcher.h"
+#include "DeltaTracker.h"
+#include "History.h"
+#include "SharedSnapshots.h"
+#include "Bundle.h"
+#include "DmvCatalog.h"
+#include "DmvView.h"
 #include "helper.h"
+#include "Logger.h"
+#include "VirtualTree.h"
 #include "INIFile.h"
 #include "ParseException.h"
 #include "CustomQuery.h"
+#include "FanOut.h"
+#include "ConfigWatcher.h"
 
 // Common symbols needed by all files.
 //
 extern struct SQLFsPaths g_UserPaths;
 extern bool g_InVerbose;
-extern unordered_map<string, class ServerInfo*> g_ServerInfoMap;
+extern LogLevel g_LogLevel;
+extern unordered_map<string, shared_ptr<class ServerInfo>> g_ServerInfoMap;
+extern std::mutex g_ServerInfoMapLock;
 extern bool g_UseLogFile;
 extern bool g_RunInForeground;
-extern char g_LocallyGeneratedFiles[];
+extern bool g_RunSingleThreaded;
+extern VirtualTree g_VirtualTree;
@@ -0,0 +1,325 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: VirtualTree.cpp
+//
+// Purpose:
+//   This file contains the definitions of the in-memory table of the
+//   directories and files exposed by DBFS.
+//
+#include "UtilsPrivate.h"
+
+// ---------------------------------------------------------------------------
+// Method: GetParentPath
+//
+// Description:
+//    This method gets the path of the directory containing the given path.
+//
+// Returns:
+//    Parent path - "/" for entries in the root directory.
+//
+static string
+GetParentPath(
+    const string& path)
+{
+    size_t found = path.find_last_of('/');
+
+    if (found == string::npos || found == 0)
+    {
+        return LINUX_PATH_DELIM;
+    }
+
+    return path.substr(0, found);
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetBaseName
+//
+// Description:
+//    This method gets the last component of the given path.
+//
+// Returns:
+//    Name of the entry.
+//
+static string
+GetBaseName(
+    const string& path)
+{
+    size_t found = path.find_last_of('/');
+
+    return (found == string::npos) ? path : path.substr(found + 1);
+}
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+// Description:
+//    Creates the tree with only the root directory in it.
+//
+VirtualTree::VirtualTree()
+{
+    auto root = make_shared<VirtualEntry>();
+
+    root->m_type = ENTRY_DIRECTORY;
+    root->m_mtime = time(NULL);
+
+    m_entries[LINUX_PATH_DELIM] = root;
+    m_children[LINUX_PATH_DELIM];
+}
+
+// ---------------------------------------------------------------------------
+// Method: AddEntry
+//
+// Description:
+//    This method adds the entry at the path, replacing any entry already
+//    there, and adds its name to the parent directory. The caller must
+//    hold the lock in exclusive mode.
+//
+// Returns:
+//    VOID
+//
+void
+VirtualTree::AddEntry(
+    const string& path,
+    VirtualEntryPtr entry)
+{
+    m_entries[path] = entry;
+    m_children[GetParentPath(path)].insert(GetBaseName(path));
+}
+
+// ---------------------------------------------------------------------------
+// Method: AddDirectory
+//
+// Description:
+//    This method adds a directory to the tree.
+//
+// Returns:
+//    VOID
+//
+void
+VirtualTree::AddDirectory(
+    const string& path,
+    const string& servername)
+{
+    auto entry = make_shared<VirtualEntry>();
+
+    entry->m_type = ENTRY_DIRECTORY;
+    entry->m_servername = servername;
+    entry->m_mtime = time(NULL);
+
+    std::lock_guard<std::shared_timed_mutex> guard(m_lock);
+
+    AddEntry(path, entry);
+    m_children[path];
+}
+
+// ---------------------------------------------------------------------------
+// Method: AddFile
+//
+// Description:
+//    This method adds a file to the tree. Its content is produced on open
+//    according to its type.
+//
+// Returns:
+//    VOID
+//
+void
+VirtualTree::AddFile(
+    const string& path,
+    VirtualEntryType type,
+    const string& servername,
+    const string& name)
+{
+    auto entry = make_shared<VirtualEntry>();
+
+    entry->m_type = type;
+    entry->m_servername = servername;
+    entry->m_name = name;
+    entry->m_mtime = time(NULL);
+
+    std::lock_guard<std::shared_timed_mutex> guard(m_lock);
+
+    AddEntry(path, entry);
+}
+
+// ---------------------------------------------------------------------------
+// Method: RemoveFile
+//
+// Description:
+//    This method removes a file from the tree. Files that are open keep
+//    working as their handle holds the content.
+//
+// Returns:
+//    VOID
+//
+void
+VirtualTree::RemoveFile(
+    const string& path)
+{
+    std::lock_guard<std::shared_timed_mutex> guard(m_lock);
+
+    auto entry = m_entries.find(path);
+    if (entry != m_entries.end() && entry->second->m_type != ENTRY_DIRECTORY)
+    {
+        m_entries.erase(entry);
+
+        auto parent = m_children.find(GetParentPath(path));
+        if (parent != m_children.end())
+        {
+            parent->second.erase(GetBaseName(path));
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: RemoveDirectory
+//
+// Description:
+//    This method removes a directory, the entries under it and its name
+//    in the parent directory. Files that are open keep working as their
+//    handle holds the content.
+//
+// Returns:
+//    VOID
+//
+void
+VirtualTree::RemoveDirectory(
+    const string& path)
+{
+    string prefix = path + LINUX_PATH_DELIM;
+
+    std::lock_guard<std::shared_timed_mutex> guard(m_lock);
+
+    if (m_entries.erase(path) == 0)
+    {
+        return;
+    }
+    m_children.erase(path);
+
+    for (auto itr = m_entries.begin(); itr != m_entries.end();)
+    {
+        if (itr->first.compare(0, prefix.size(), prefix) == 0)
+        {
+            m_children.erase(itr->first);
+            itr = m_entries.erase(itr);
+        }
+        else
+        {
+            ++itr;
+        }
+    }
+
+    auto parent = m_children.find(GetParentPath(path));
+    if (parent != m_children.end())
+    {
+        parent->second.erase(GetBaseName(path));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: Lookup
+//
+// Description:
+//    This method looks up the entry at the given path.
+//
+// Returns:
+//    The entry or NULL if the path is not in the tree.
+//
+VirtualEntryPtr
+VirtualTree::Lookup(
+    const string& path) const
+{
+    std::shared_lock<std::shared_timed_mutex> guard(m_lock);
+
+    auto entry = m_entries.find(path);
+
+    return (entry != m_entries.end()) ? entry->second : VirtualEntryPtr();
+}
+
+// ---------------------------------------------------------------------------
+// Method: ListDirectory
+//
+// Description:
+//    This method gets the names of the entries in the given directory,
+//    in sorted order.
+//
+// Returns:
+//    true if the path is a directory of the tree - otherwise false.
+//
+bool
+VirtualTree::ListDirectory(
+    const string& path,
+    vector<string>& names) const
+{
+    bool status = false;
+
+    std::shared_lock<std::shared_timed_mutex> guard(m_lock);
+
+    auto children = m_children.find(path);
+    if (children != m_children.end())
+    {
+        names.assign(children->second.begin(), children->second.end());
+        status = true;
+    }
+
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Method: FillStat
+//
+// Description:
+//    This method fills in the attributes of an entry. Files are read only
+//    and owned by the user running DBFS. The size of a file is not known
+//    until it is opened so it is reported as zero.
+//
+// Returns:
+//    VOID
+//
+void
+VirtualTree::FillStat(
+    const VirtualEntry& entry,
+    struct stat* stbuf)
+{
+    memset(stbuf, 0, sizeof(struct stat));
+
+    if (entry.m_type == ENTRY_DIRECTORY)
+    {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+    }
+    else
+    {
+        stbuf->st_mode = S_IFREG | 0444;
+        stbuf->st_nlink = 1;
+    }
+
+    stbuf->st_uid = getuid();
+    stbuf->st_gid = getgid();
+    stbuf->st_atime = entry.m_mtime;
+    stbuf->st_mtime = entry.m_mtime;
+    stbuf->st_ctime = entry.m_mtime;
+}
+
+// ---------------------------------------------------------------------------
+// Method: JoinPath
+//
+// Description:
+//    This method builds the path of an entry in the given directory.
+//
+// Returns:
+//    Path of the entry.
+//
+string
+VirtualTree::JoinPath(
+    const string& dirPath,
+    const string& name)
+{
+    if (dirPath == LINUX_PATH_DELIM)
+    {
+        return dirPath + name;
+    }
+
+    return dirPath + LINUX_PATH_DELIM + name;
+}
@@ -0,0 +1,132 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: VirtualTree.h
+//
+// Purpose:
+//   This file contains the declaration of the in-memory table of the
+//   directories and files that DBFS exposes (server folders, DMV files
+//   and custom query output files).
+//
+#pragma once
+
+// ---------------------------------------------------------------------------
+// Type of an entry of the virtual tree. The type decides how the content
+// of a file is produced so no lookup in the dump directory is needed.
+//
+enum VirtualEntryType
+{
+    ENTRY_DIRECTORY,        // Root, server folder or custom query folder
+    ENTRY_DMV,              // DMV in TSV form
+    ENTRY_JSON_DMV,         // DMV in JSON form
+    ENTRY_CSV_DMV,          // DMV in CSV form
+    ENTRY_NDJSON_DMV,       // DMV as one JSON object per line
+    ENTRY_DMV_VIEW,         // Columns / rows of a DMV selected by the file name
+    ENTRY_DELTA_DMV,        // Deltas of a cumulative DMV since its previous snapshot
+    ENTRY_HISTORY_SNAPSHOT, // Past snapshot of a DMV - m_name is <DMV>/<time>
+    ENTRY_HISTORY_STREAM,   // All the past snapshots of a DMV
+    ENTRY_BUNDLE,           // DMV files of a bundle read in one round trip
+    ENTRY_FANOUT_DMV,       // DMV of all the servers - m_name has the extension
+    ENTRY_CUSTOM_QUERY,     // Output of a query file of the user
+    ENTRY_QUERY_STATISTICS, // SET STATISTICS output of the last run of a custom query
+    ENTRY_STATS,            // DBFS statistics in text form
+    ENTRY_STATS_PROMETHEUS  // DBFS statistics in the Prometheus text format
+};
+
+// ---------------------------------------------------------------------------
+// Structure: VirtualEntry
+//
+// Description:
+//    Entry of the virtual tree. Entries are never changed once added -
+//    an entry that needs to change is replaced, so a looked up entry can
+//    be used without holding the tree lock.
+//
+struct VirtualEntry
+{
+    VirtualEntryType    m_type;
+    string              m_servername;   // Server the entry belongs to (empty for root)
+    string              m_name;         // DMV name (no extension) or query file name
+    time_t              m_mtime;        // Time the entry was added
+};
+
+typedef shared_ptr<const VirtualEntry> VirtualEntryPtr;
+
+//--------------------------------------------------------------------
+// Class: VirtualTree
+//
+// Description:
+//  In-memory inode table of DBFS. Paths are the ones FUSE passes in
+//  (relative to the mount directory and starting with '/').
+//
+//  getattr, readdir and open resolve DBFS entries here. Only paths that
+//  are not in the tree (files the user created in the mount directory)
+//  are passed through to the dump directory.
+//
+//  The root directory is always present. Lookups take a shared lock so
+//  concurrent FUSE threads do not serialize on the table.
+//
+class VirtualTree
+{
+public:
+    VirtualTree();
+
+    // Adds a directory (and its name to the parent directory).
+    //
+    void AddDirectory(
+        const string& path,
+        const string& servername);
+
+    // Adds a file (and its name to the parent directory).
+    //
+    void AddFile(
+        const string& path,
+        VirtualEntryType type,
+        const string& servername,
+        const string& name);
+
+    // Removes a file from the tree.
+    //
+    void RemoveFile(
+        const string& path);
+
+    // Removes a directory and everything under it from the tree.
+    //
+    void RemoveDirectory(
+        const string& path);
+
+    // Looks up an entry. Returns NULL if the path is not in the tree.
+    //
+    VirtualEntryPtr Lookup(
+        const string& path) const;
+
+    // Gets the names of the entries in a directory. Returns false if the
+    // path is not a directory of the tree.
+    //
+    bool ListDirectory(
+        const string& path,
+        vector<string>& names) const;
+
+    // Fills in the stat structure for an entry.
+    //
+    static void FillStat(
+        const VirtualEntry& entry,
+        struct stat* stbuf);
+
+    // Builds the path of an entry from its directory and name.
+    //
+    static string JoinPath(
+        const string& dirPath,
+        const string& name);
+
+private:
+    // Adds an entry and links it to its parent. Caller holds m_lock.
+    //
+    void AddEntry(
+        const string& path,
+        VirtualEntryPtr entry);
+
+    unordered_map<string, VirtualEntryPtr>  m_entries;      // Path to entry
+    unordered_map<string, set<string>>      m_children;     // Directory path to names
+    mutable std::shared_timed_mutex         m_lock;
+};
@@ -0,0 +1,486 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: FakeDbLib.cpp
+//
+// Purpose:
+//   This file contains the definitions of the fake DB-Library of the FUSE
+//   benchmark. The functions below are the ones the query path of DBFS
+//   calls - being defined in the benchmark, they take the place of those
+//   of FreeTDS when it is linked, so SQLQuery.cpp and ConnectionPool.cpp
+//   run unchanged.
+//
+#include "UtilsPrivate.h"
+#include "FakeQueryBackend.h"
+#include "FakeDbLib.h"
+
+// Backend the result sets come from.
+//
+static FakeQueryBackend* g_FakeDbLibBackend = NULL;
+
+// ---------------------------------------------------------------------------
+// Structure: FakeLogin
+//
+// Description:
+//    What dblogin returns. The login settings are not used.
+//
+struct FakeLogin
+{
+    bool    m_unused;
+};
+
+// ---------------------------------------------------------------------------
+// Structure: FakeConnection
+//
+// Description:
+//    What dbopen returns - the state of one connection.
+//
+struct FakeConnection
+{
+    BYTE*               m_userData = NULL;
+    string              m_database;
+    string              m_command;              // Filled by dbcmd
+    vector<string>      m_statements;           // Of the batch sent
+    size_t              m_nextStatement = 0;    // Result set of the next dbresults
+    bool                m_inResults = false;    // A result set is being read
+    size_t              m_numRows = 0;          // Of the current result set
+    size_t              m_row = 0;              // Rows read by dbnextrow
+    vector<FakeValue>   m_values;               // Of the current row
+};
+
+// ---------------------------------------------------------------------------
+// Method: SetFakeDbLibBackend
+//
+// Returns:
+//    VOID
+//
+void
+SetFakeDbLibBackend(
+    FakeQueryBackend* backend)
+{
+    g_FakeDbLibBackend = backend;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetFakeConnection
+//
+// Returns:
+//    The state of the connection.
+//
+static FakeConnection*
+GetFakeConnection(
+    DBPROCESS* dbproc)
+{
+    return (FakeConnection*)dbproc;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetCurrentValue
+//
+// Returns:
+//    The value of the given column (from 1) of the current row - NULL
+//    before the first row or for a column that does not exist.
+//
+static const FakeValue*
+GetCurrentValue(
+    DBPROCESS* dbproc,
+    int column)
+{
+    FakeConnection* connection = GetFakeConnection(dbproc);
+
+    if (connection->m_row == 0 || column < 1 || (size_t)column > connection->m_values.size())
+    {
+        return NULL;
+    }
+
+    return &connection->m_values[column - 1];
+}
+
+// ---------------------------------------------------------------------------
+// Method: dblogin
+//
+LOGINREC*
+dblogin(void)
+{
+    return (LOGINREC*)new FakeLogin();
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbsetlname
+//
+RETCODE
+dbsetlname(
+    LOGINREC* login,
+    const char* value,
+    int which)
+{
+    (void)login;
+    (void)value;
+    (void)which;
+
+    return SUCCEED;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbloginfree
+//
+void
+dbloginfree(
+    LOGINREC* login)
+{
+    delete (FakeLogin*)login;
+}
+
+// ---------------------------------------------------------------------------
+// Method: tdsdbopen
+//
+// Description:
+//    What dbopen expands to - a login that always succeeds.
+//
+DBPROCESS*
+tdsdbopen(
+    LOGINREC* login,
+    const char* server,
+    int msdblib)
+{
+    (void)login;
+    (void)server;
+    (void)msdblib;
+
+    return (DBPROCESS*)new FakeConnection();
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbclose
+//
+void
+dbclose(
+    DBPROCESS* dbproc)
+{
+    delete GetFakeConnection(dbproc);
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbdead
+//
+DBBOOL
+dbdead(
+    DBPROCESS* dbproc)
+{
+    (void)dbproc;
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbsetuserdata
+//
+void
+dbsetuserdata(
+    DBPROCESS* dbproc,
+    BYTE* ptr)
+{
+    GetFakeConnection(dbproc)->m_userData = ptr;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbgetuserdata
+//
+BYTE*
+dbgetuserdata(
+    DBPROCESS* dbproc)
+{
+    return GetFakeConnection(dbproc)->m_userData;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbuse
+//
+RETCODE
+dbuse(
+    DBPROCESS* dbproc,
+    const char* name)
+{
+    GetFakeConnection(dbproc)->m_database = name;
+
+    return SUCCEED;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbname
+//
+char*
+dbname(
+    DBPROCESS* dbproc)
+{
+    return &GetFakeConnection(dbproc)->m_database[0];
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbsetopt
+//
+RETCODE
+dbsetopt(
+    DBPROCESS* dbproc,
+    int option,
+    const char* char_param,
+    int int_param)
+{
+    (void)dbproc;
+    (void)option;
+    (void)char_param;
+    (void)int_param;
+
+    return SUCCEED;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbcmd
+//
+RETCODE
+dbcmd(
+    DBPROCESS* dbproc,
+    const char cmdstring[])
+{
+    GetFakeConnection(dbproc)->m_command += cmdstring;
+
+    return SUCCEED;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbfreebuf
+//
+void
+dbfreebuf(
+    DBPROCESS* dbproc)
+{
+    GetFakeConnection(dbproc)->m_command.clear();
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbsqlsend
+//
+// Description:
+//    Sends the command as a batch - each statement (ExecuteBatch ends
+//    them with ";\n") gets a result set. The answer is ready once the
+//    latency of the round trip elapsed.
+//
+RETCODE
+dbsqlsend(
+    DBPROCESS* dbproc)
+{
+    FakeConnection* connection = GetFakeConnection(dbproc);
+    const string    separator = ";\n";
+    size_t          start = 0;
+    size_t          end;
+
+    connection->m_statements.clear();
+    connection->m_nextStatement = 0;
+    connection->m_inResults = false;
+
+    while (start < connection->m_command.size())
+    {
+        end = connection->m_command.find(separator, start);
+        if (end == string::npos)
+        {
+            end = connection->m_command.size();
+        }
+
+        connection->m_statements.push_back(connection->m_command.substr(start, end - start));
+        start = end + separator.size();
+    }
+    connection->m_command.clear();
+
+    g_FakeDbLibBackend->RoundTrip();
+
+    return SUCCEED;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbiordesc
+//
+// Description:
+//    The answer is there once dbsqlsend returns, so the descriptor polled
+//    for it is always readable.
+//
+int
+dbiordesc(
+    DBPROCESS* dbproc)
+{
+    static int descriptor = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    (void)dbproc;
+
+    return descriptor;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbsqlok
+//
+RETCODE
+dbsqlok(
+    DBPROCESS* dbproc)
+{
+    (void)dbproc;
+
+    return SUCCEED;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbsqlexec
+//
+RETCODE
+dbsqlexec(
+    DBPROCESS* dbproc)
+{
+    return (dbsqlsend(dbproc) == SUCCEED) ? dbsqlok(dbproc) : FAIL;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbresults
+//
+// Description:
+//    Moves to the result set of the next statement of the batch.
+//
+RETCODE
+dbresults(
+    DBPROCESS* dbproc)
+{
+    FakeConnection* connection = GetFakeConnection(dbproc);
+
+    if (connection->m_nextStatement >= connection->m_statements.size())
+    {
+        connection->m_inResults = false;
+        return NO_MORE_RESULTS;
+    }
+
+    connection->m_inResults = true;
+    connection->m_numRows = g_FakeDbLibBackend->GetNumRows(
+        connection->m_statements[connection->m_nextStatement++]);
+    connection->m_row = 0;
+    connection->m_values.resize(g_FakeDbLibBackend->GetColumnNames().size());
+
+    return SUCCEED;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbcanquery
+//
+RETCODE
+dbcanquery(
+    DBPROCESS* dbproc)
+{
+    FakeConnection* connection = GetFakeConnection(dbproc);
+
+    connection->m_row = connection->m_numRows;
+
+    return SUCCEED;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbcancel
+//
+RETCODE
+dbcancel(
+    DBPROCESS* dbproc)
+{
+    FakeConnection* connection = GetFakeConnection(dbproc);
+
+    connection->m_nextStatement = connection->m_statements.size();
+    connection->m_row = connection->m_numRows;
+
+    return SUCCEED;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbnumcols
+//
+int
+dbnumcols(
+    DBPROCESS* dbproc)
+{
+    FakeConnection* connection = GetFakeConnection(dbproc);
+
+    return connection->m_inResults ? (int)connection->m_values.size() : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbcolname
+//
+char*
+dbcolname(
+    DBPROCESS* dbproc,
+    int column)
+{
+    const vector<string>& names = g_FakeDbLibBackend->GetColumnNames();
+
+    if (column < 1 || column > dbnumcols(dbproc))
+    {
+        return NULL;
+    }
+
+    return (char*)names[column - 1].c_str();
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbnextrow
+//
+STATUS
+dbnextrow(
+    DBPROCESS* dbproc)
+{
+    FakeConnection* connection = GetFakeConnection(dbproc);
+
+    if (!connection->m_inResults || connection->m_row >= connection->m_numRows)
+    {
+        return NO_MORE_ROWS;
+    }
+
+    for (size_t i = 0; i < connection->m_values.size(); i++)
+    {
+        g_FakeDbLibBackend->GetValue(connection->m_row, i, connection->m_values[i]);
+    }
+    connection->m_row++;
+
+    return REG_ROW;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbcoltype
+//
+int
+dbcoltype(
+    DBPROCESS* dbproc,
+    int column)
+{
+    const FakeValue* value = GetCurrentValue(dbproc, column);
+
+    return value ? value->m_type : -1;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbdata
+//
+BYTE*
+dbdata(
+    DBPROCESS* dbproc,
+    int column)
+{
+    const FakeValue* value = GetCurrentValue(dbproc, column);
+
+    return value ? (BYTE*)value->m_data : NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Method: dbdatlen
+//
+DBINT
+dbdatlen(
+    DBPROCESS* dbproc,
+    int column)
+{
+    const FakeValue* value = GetCurrentValue(dbproc, column);
+
+    return value ? value->m_length : -1;
+}
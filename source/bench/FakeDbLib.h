@@ -0,0 +1,27 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: FakeDbLib.h
+//
+// Purpose:
+//   This file contains the declaration of the fake DB-Library linked into
+//   the FUSE benchmark, which answers the DB-Library calls of DBFS with
+//   the synthetic result sets of a FakeQueryBackend.
+//
+#pragma once
+
+class FakeQueryBackend;
+
+// Sets the backend whose result sets the DB-Library calls return. With
+// no QueryBackend installed (SetQueryBackend(NULL)), the queries of DBFS
+// then run their DB-Library path - connection pool, dbsqlsend, dbresults
+// and dbnextrow - against it:
+//   - every statement of a batch is one result set, with the rows of
+//     the DMV it selects from
+//   - dbsqlsend is one round trip of the backend
+//   - nothing ever fails or times out
+//
+void
+SetFakeDbLibBackend(
+    FakeQueryBackend* backend);
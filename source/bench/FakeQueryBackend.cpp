@@ -0,0 +1,367 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: FakeQueryBackend.cpp
+//
+// Purpose:
+//   This file contains the definitions of the in-process query backend
+//   used by the benchmarks.
+//
+#include "UtilsPrivate.h"
+#include "FakeQueryBackend.h"
+
+// ---------------------------------------------------------------------------
+// Method: Constructor
+//
+FakeQueryBackend::FakeQueryBackend(
+    const FakeBackendConfig& config) :
+    m_config(config),
+    m_numQueries(0)
+{
+    string text;
+
+    for (size_t i = 0; i < m_config.m_numColumns; i++)
+    {
+        m_columnNames.push_back(StringFormat("column_%zu", i + 1));
+
+        text = StringFormat("value of column %zu", i + 1);
+        text.resize(max(text.size(), m_config.m_textLength), ' ');
+        m_texts.push_back(text);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetNumRows
+//
+// Description:
+//    This method gets the number of rows of the DMV selected from by a
+//    query built by GetDmvQuery or GetDmvViewQuery.
+//
+// Returns:
+//    Number of rows.
+//
+size_t
+FakeQueryBackend::GetNumRows(
+    const string& query) const
+{
+    const string    from = "[sys].[";
+    size_t          start;
+    size_t          end;
+
+    start = query.find(from);
+    if (start != string::npos)
+    {
+        start += from.size();
+        end = query.find(']', start);
+
+        auto rows = m_config.m_dmvRows.find(query.substr(start, end - start));
+        if (rows != m_config.m_dmvRows.end())
+        {
+            return rows->second;
+        }
+    }
+
+    return m_config.m_numRows;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ExecuteQuery
+//
+// Description:
+//    This method answers a query with a synthetic result set.
+//
+// Returns:
+//    0
+//
+int
+FakeQueryBackend::ExecuteQuery(
+    const string& query,
+    ResultBuffer& output,
+    ServerInfo* serverInfo,
+    const FileFormat type,
+    std::chrono::milliseconds timeout,
+    QueryStats* stats)
+{
+    size_t      numRows;
+    LastQuery   lastQuery;
+
+    (void)serverInfo;
+    (void)timeout;
+
+    auto start = std::chrono::steady_clock::now();
+
+    RoundTrip();
+
+    if (stats)
+    {
+        stats->m_execTime.RecordSince(start);
+        lastQuery.m_execUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+    }
+
+    numRows = AnswerQuery(query, output, type);
+
+    if (stats)
+    {
+        IncrementStat(stats->m_queries);
+        IncrementStat(stats->m_rows, numRows);
+        IncrementStat(stats->m_bytes, output.GetSize());
+        stats->m_fetchTime.RecordSince(start);
+
+        lastQuery.m_fetchUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        lastQuery.m_rows = numRows;
+        lastQuery.m_bytes = output.GetSize();
+        RecordLastQuery(stats, lastQuery);
+    }
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ExecuteBatch
+//
+// Description:
+//    This method answers each query of the batch with a synthetic result
+//    set, after a single latency. The batch is one query in the count.
+//
+// Returns:
+//    0
+//
+int
+FakeQueryBackend::ExecuteBatch(
+    const vector<string>& queries,
+    const vector<FileFormat>& types,
+    vector<QueryResult>& outputs,
+    ServerInfo* serverInfo,
+    std::chrono::milliseconds timeout,
+    QueryStats* stats)
+{
+    size_t      numRows = 0;
+    size_t      numBytes = 0;
+    LastQuery   lastQuery;
+
+    (void)serverInfo;
+    (void)timeout;
+
+    auto start = std::chrono::steady_clock::now();
+
+    RoundTrip();
+
+    if (stats)
+    {
+        stats->m_execTime.RecordSince(start);
+        lastQuery.m_execUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+    }
+
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+        numRows += AnswerQuery(queries[i], *outputs[i], types[i]);
+        numBytes += outputs[i]->GetSize();
+    }
+
+    if (stats)
+    {
+        IncrementStat(stats->m_queries);
+        IncrementStat(stats->m_rows, numRows);
+        IncrementStat(stats->m_bytes, numBytes);
+        stats->m_fetchTime.RecordSince(start);
+
+        lastQuery.m_fetchUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        lastQuery.m_rows = numRows;
+        lastQuery.m_bytes = numBytes;
+        RecordLastQuery(stats, lastQuery);
+    }
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: AnswerQuery
+//
+// Description:
+//    This method serializes the synthetic result set of a query into the
+//    output and marks it complete.
+//
+// Returns:
+//    Number of rows.
+//
+size_t
+FakeQueryBackend::AnswerQuery(
+    const string& query,
+    ResultBuffer& output,
+    const FileFormat type)
+{
+    const char* name;
+    FakeValue   value;
+    size_t      numRows = 0;
+
+    RowSerializer serializer(output, type);
+
+    if (query.find("@@version") != string::npos)
+    {
+        // The server version the DMV catalog is read from.
+        //
+        static const char version[] = "Fake SQL Server (bench)";
+
+        serializer.AppendValue(NULL, 0, SYBCHAR, (const BYTE*)"version", 7);
+        serializer.EndRow();
+        serializer.AppendValue(NULL, 0, SYBCHAR, (const BYTE*)version, sizeof(version) - 1);
+        serializer.EndRow();
+        numRows = 1;
+    }
+    else if (query.find("sys.system_views") != string::npos)
+    {
+        // The DMV list of the catalog discovery.
+        //
+        serializer.AppendValue(NULL, 0, SYBCHAR, (const BYTE*)"name", 4);
+        serializer.EndRow();
+
+        for (auto&& dmvName : m_config.m_dmvNames)
+        {
+            serializer.AppendValue(NULL, 0, SYBCHAR, (const BYTE*)dmvName.data(), dmvName.size());
+            serializer.EndRow();
+        }
+        numRows = m_config.m_dmvNames.size();
+    }
+    else
+    {
+        // NDJSON keys the values by column number as there is no
+        // DB-Library connection to get the names from.
+        //
+        if (type == TYPE_TSV || type == TYPE_CSV)
+        {
+            for (size_t i = 0; i < m_columnNames.size(); i++)
+            {
+                name = m_columnNames[i].c_str();
+                serializer.AppendValue(NULL, i, SYBCHAR, (const BYTE*)name, strlen(name));
+            }
+            serializer.EndRow();
+        }
+
+        numRows = GetNumRows(query);
+        for (size_t row = 0; row < numRows; row++)
+        {
+            serializer.BeginRow();
+
+            for (size_t i = 0; i < m_config.m_numColumns; i++)
+            {
+                GetValue(row, i, value);
+                serializer.AppendValue(NULL, i, value.m_type, value.m_data, value.m_length);
+            }
+
+            serializer.EndRow();
+
+            if (output.IsCancelled())
+            {
+                break;
+            }
+        }
+    }
+
+    serializer.Finish();
+    output.Complete(0);
+
+    return numRows;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetValue
+//
+// Description:
+//    This method gets a value of the rows of a DMV. Columns alternate
+//    between an int, an nchar and a bigint.
+//
+// Returns:
+//    VOID
+//
+void
+FakeQueryBackend::GetValue(
+    size_t row,
+    size_t column,
+    FakeValue& value) const
+{
+    switch (column % 3)
+    {
+    case 0:
+        value.m_type = SYBINT4;
+        value.m_intValue = (DBINT)(row + column);
+        value.m_data = (const BYTE*)&value.m_intValue;
+        value.m_length = sizeof(value.m_intValue);
+        break;
+
+    case 1:
+        value.m_type = XSYBNCHAR;
+        value.m_data = (const BYTE*)m_texts[column].data();
+        value.m_length = m_texts[column].size();
+        break;
+
+    default:
+        value.m_type = SYBINT8;
+        value.m_bigValue = (DBBIGINT)row * 7919 - 1000;
+        value.m_data = (const BYTE*)&value.m_bigValue;
+        value.m_length = sizeof(value.m_bigValue);
+        break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetColumnNames
+//
+// Returns:
+//    The names of the columns of a DMV.
+//
+const vector<string>&
+FakeQueryBackend::GetColumnNames() const
+{
+    return m_columnNames;
+}
+
+// ---------------------------------------------------------------------------
+// Method: RoundTrip
+//
+// Returns:
+//    VOID
+//
+void
+FakeQueryBackend::RoundTrip()
+{
+    m_numQueries++;
+
+    if (m_config.m_latency.count())
+    {
+        std::this_thread::sleep_for(m_config.m_latency);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: VerifyServerInfo
+//
+// Returns:
+//    true
+//
+bool
+FakeQueryBackend::VerifyServerInfo(
+    ServerInfo* serverInfo)
+{
+    (void)serverInfo;
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetNumQueries
+//
+// Returns:
+//    Number of round trips so far.
+//
+uint64_t
+FakeQueryBackend::GetNumQueries() const
+{
+    return m_numQueries.load();
+}
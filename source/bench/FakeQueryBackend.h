@@ -0,0 +1,132 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: FakeQueryBackend.h
+//
+// Purpose:
+//   This file contains the declaration of the in-process query backend
+//   used by the benchmarks in place of a server.
+//
+#pragma once
+
+// ---------------------------------------------------------------------------
+// Structure: FakeBackendConfig
+//
+// Description:
+//    Shape of the synthetic result sets. Columns alternate between an
+//    int, an nchar(m_textLength) and a bigint, like most DMVs.
+//
+struct FakeBackendConfig
+{
+    size_t                              m_numRows;      // Rows of a DMV not in m_dmvRows
+    size_t                              m_numColumns;
+    size_t                              m_textLength;   // Width of the nchar columns
+    std::chrono::microseconds           m_latency;      // Time before the first row of a query
+    vector<string>                      m_dmvNames;     // Returned by the DMV list query
+    unordered_map<string, size_t>       m_dmvRows;      // Rows of specific DMVs
+};
+
+// ---------------------------------------------------------------------------
+// Structure: FakeValue
+//
+// Description:
+//    One value of a synthetic result set - its DB-Library type, and its
+//    data and length as dbdata/dbdatlen return them. Integers are kept
+//    in the structure itself.
+//
+struct FakeValue
+{
+    int             m_type;
+    const BYTE*     m_data;
+    DBINT           m_length;
+    DBINT           m_intValue;
+    DBBIGINT        m_bigValue;
+};
+
+//--------------------------------------------------------------------
+// Class: FakeQueryBackend
+//
+// Description:
+//  Answers every query with a synthetic result set serialized with the
+//  RowSerializer of DBFS, after the configured latency. The DMV list
+//  query at mount time gets m_dmvNames, any other query gets the rows
+//  of the DMV it selects from (or m_numRows).
+//
+//  The values are built once, so serialization and the file system are
+//  what is measured rather than the fake.
+//
+class FakeQueryBackend : public QueryBackend
+{
+public:
+    // Constructor
+    //
+    FakeQueryBackend(
+        const FakeBackendConfig& config);
+
+    // Runs a query - see QueryBackend.
+    //
+    virtual int ExecuteQuery(
+        const string& query,
+        ResultBuffer& output,
+        ServerInfo* serverInfo,
+        const FileFormat type,
+        std::chrono::milliseconds timeout,
+        QueryStats* stats);
+
+    // Runs all the queries after a single latency, like a batch sent in
+    // one round trip - see QueryBackend.
+    //
+    virtual int ExecuteBatch(
+        const vector<string>& queries,
+        const vector<FileFormat>& types,
+        vector<QueryResult>& outputs,
+        ServerInfo* serverInfo,
+        std::chrono::milliseconds timeout,
+        QueryStats* stats);
+
+    // Always succeeds.
+    //
+    virtual bool VerifyServerInfo(
+        ServerInfo* serverInfo);
+
+    // Number of round trips so far - a batch counts once.
+    //
+    uint64_t GetNumQueries() const;
+
+    // Counts a round trip and waits for the latency. Also used by the
+    // fake DB-Library (see FakeDbLib.h).
+    //
+    void RoundTrip();
+
+    // Gets the names of the columns of a DMV result set.
+    //
+    const vector<string>& GetColumnNames() const;
+
+    // Gets the number of rows of the DMV the query selects from.
+    //
+    size_t GetNumRows(
+        const string& query) const;
+
+    // Gets a value of a DMV result set the way dbdata/dbdatlen return
+    // it. The data points into the backend or into value.
+    //
+    void GetValue(
+        size_t row,
+        size_t column,
+        FakeValue& value) const;
+
+private:
+    // Serializes the synthetic result set of the query into output and
+    // completes it. Returns the number of rows.
+    //
+    size_t AnswerQuery(
+        const string& query,
+        ResultBuffer& output,
+        const FileFormat type);
+
+    FakeBackendConfig       m_config;
+    vector<string>          m_columnNames;
+    vector<string>          m_texts;        // Blank padded value of each nchar column
+    std::atomic<uint64_t>   m_numQueries;
+};
@@ -0,0 +1,889 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: FuseBench.cpp
+//
+// Purpose:
+//   Benchmark of the FUSE hot path. The FUSE operations of DBFS are
+//   called in-process (no mount, no kernel) on servers answered by
+//   FakeQueryBackend, so the numbers only depend on DBFS. Scenarios:
+//     mount               InitializeSQLFs with N servers
+//     parallel_cat        getattr/open/read/release of many DMV files on
+//                         several threads
+//     large_file          repeated reads of one large DMV file
+//     ls_custom_queries   opendir/readdir/releasedir of customQueries
+//     fanout              DMV files of the _all folder (every server)
+//     bundle              bundle file of several DMVs in one round trip
+//     bundle_result_sets  the same, through the DB-Library path of
+//                         ExecuteBatch on the fake DB-Library
+//
+//   The results are written to stdout as one JSON document.
+//
+//   Usage: fuse_bench [--servers n] [--dmvs n] [--rows n] [--columns n]
+//                     [--text-length n] [--latency-us n] [--threads n]
+//                     [--files n] [--large-rows n] [--queries n]
+//                     [--iterations n]
+//
+#include "UtilsPrivate.h"
+#include <ftw.h>
+#include "FakeQueryBackend.h"
+#include "FakeDbLib.h"
+
+#define BENCH_READ_SIZE             (128 * 1024)
+#define BENCH_LARGE_DMV_NAME        "dm_bench_large"
+#define BENCH_BUNDLE_NAME           "bench"
+#define BENCH_BUNDLE_SIZE           4
+
+// Globals of DBFS, defined in main.cpp for the file system itself.
+//
+struct SQLFsPaths g_UserPaths;
+bool g_InVerbose = false;
+LogLevel g_LogLevel = LOG_LEVEL_ERROR;
+std::unordered_map<std::string, std::shared_ptr<class ServerInfo>> g_ServerInfoMap;
+std::mutex g_ServerInfoMapLock;
+bool g_UseLogFile = false;
+bool g_RunInForeground = false;
+bool g_RunSingleThreaded = false;
+VirtualTree g_VirtualTree;
+
+// ---------------------------------------------------------------------------
+// Structure: BenchConfig
+//
+// Description:
+//    Command line settings.
+//
+struct BenchConfig
+{
+    size_t  m_numServers = 8;
+    size_t  m_numDmvs = 200;
+    size_t  m_numRows = 100;
+    size_t  m_numColumns = 12;
+    size_t  m_textLength = 32;
+    size_t  m_latencyUs = 500;
+    size_t  m_numThreads = 8;
+    size_t  m_numFiles = 2000;
+    size_t  m_largeRows = 200000;
+    size_t  m_numQueries = 100;
+    size_t  m_iterations = 5;
+};
+
+// ---------------------------------------------------------------------------
+// Structure: ScenarioResult
+//
+// Description:
+//    Outcome of one scenario. m_latenciesUs has the time of each
+//    operation (a whole cat, read or listing).
+//
+struct ScenarioResult
+{
+    string                          m_name;
+    vector<pair<string, size_t>>    m_params;
+    uint64_t                        m_bytes = 0;
+    uint64_t                        m_errors = 0;
+    double                          m_seconds = 0;
+    vector<uint64_t>                m_latenciesUs;
+};
+
+static struct fuse_operations g_Operations;
+
+// ---------------------------------------------------------------------------
+// Method: ElapsedUs
+//
+// Returns:
+//    Microseconds elapsed since start.
+//
+static uint64_t
+ElapsedUs(
+    std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// ---------------------------------------------------------------------------
+// Method: Percentile
+//
+// Returns:
+//    The given percentile of the sorted latencies.
+//
+static uint64_t
+Percentile(
+    const vector<uint64_t>& sorted,
+    double percentile)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+
+    return sorted[min(sorted.size() - 1, (size_t)(percentile / 100 * sorted.size()))];
+}
+
+// ---------------------------------------------------------------------------
+// Method: CatFile
+//
+// Description:
+//    Does what cat does through FUSE - getattr, open, read until the end
+//    and release.
+//
+// Returns:
+//    Bytes read or -errno.
+//
+static long long
+CatFile(
+    const string& path,
+    vector<char>& buffer)
+{
+    struct stat             st;
+    struct fuse_file_info   fi;
+    long long               offset = 0;
+    int                     result;
+
+    result = g_Operations.getattr(path.c_str(), &st);
+    if (result)
+    {
+        return result;
+    }
+
+    memset(&fi, 0, sizeof(fi));
+    fi.flags = O_RDONLY;
+
+    result = g_Operations.open(path.c_str(), &fi);
+    if (result)
+    {
+        return result;
+    }
+
+    while ((result = g_Operations.read(path.c_str(), buffer.data(), buffer.size(), offset, &fi)) > 0)
+    {
+        offset += result;
+    }
+
+    g_Operations.release(path.c_str(), &fi);
+
+    return (result < 0) ? result : offset;
+}
+
+// ---------------------------------------------------------------------------
+// Method: CountEntry
+//
+// Description:
+//    readdir filler counting the entries.
+//
+// Returns:
+//    0 - the listing goes on.
+//
+static int
+CountEntry(
+    void* buf,
+    const char* name,
+    const struct stat* stbuf,
+    off_t off)
+{
+    (void)name;
+    (void)stbuf;
+    (void)off;
+
+    (*(size_t*)buf)++;
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: RemoveEntry
+//
+// Description:
+//    nftw callback removing the temporary files of the benchmark.
+//
+// Returns:
+//    0
+//
+static int
+RemoveEntry(
+    const char* path,
+    const struct stat* st,
+    int flag,
+    struct FTW* ftw)
+{
+    (void)st;
+    (void)flag;
+    (void)ftw;
+
+    remove(path);
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: CreateServers
+//
+// Description:
+//    Replaces the servers of DBFS with numServers fake ones (without a
+//    connection pool - the queries never reach DB-Library). Each server
+//    has a bundle of its first BENCH_BUNDLE_SIZE DMVs.
+//
+// Returns:
+//    VOID
+//
+static void
+CreateServers(
+    const string& prefix,
+    size_t numServers,
+    size_t numDmvs,
+    const string& customQueriesPath)
+{
+    ServerInfo*     serverInfo;
+    string          servername;
+    vector<string>  bundle;
+
+    for (size_t i = 0; i < min<size_t>(numDmvs, BENCH_BUNDLE_SIZE); i++)
+    {
+        bundle.push_back(StringFormat("dm_bench_%zu", i));
+    }
+
+    std::lock_guard<std::mutex> guard(g_ServerInfoMapLock);
+
+    // Frees the servers of the previous round, with their catalog, delta
+    // tracker and result cache.
+    //
+    g_ServerInfoMap.clear();
+
+    for (size_t i = 0; i < numServers; i++)
+    {
+        servername = StringFormat("%s%zu", prefix.c_str(), i);
+
+        serverInfo = new ServerInfo();
+        serverInfo->m_hostname = "fake";
+        serverInfo->m_version = 16;
+        serverInfo->m_customQueriesPath = customQueriesPath;
+        serverInfo->m_connectionPool = NULL;
+        serverInfo->m_streamResults = false;
+        serverInfo->m_queryStatistics = false;
+        serverInfo->m_throttle = NULL;
+        serverInfo->m_resultCache = new ResultCache(GetServerStats(servername));
+        serverInfo->m_cacheTtl = std::chrono::milliseconds(0);
+        serverInfo->m_queryTimeout = std::chrono::seconds(SQLFS_DEFAULT_QUERY_TIMEOUT_SEC);
+        serverInfo->m_usePageCache = false;
+        serverInfo->m_bundles[BENCH_BUNDLE_NAME] = bundle;
+        serverInfo->m_prefetcher = NULL;
+        serverInfo->m_history = NULL;
+        serverInfo->m_sharedSnapshots = NULL;
+        serverInfo->m_deltaTracker = new DeltaTracker(servername, GetDefaultDeltaKeys());
+        serverInfo->m_catalog = new DmvCatalog(servername, serverInfo);
+
+        g_ServerInfoMap[servername] = shared_ptr<ServerInfo>(serverInfo);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: RunMount
+//
+// Description:
+//    Times InitializeSQLFs followed by loading the DMV catalogs of all the
+//    servers - until every DMV file is in the tree. Each round mounts new
+//    servers on a new dump directory. The servers of the last round are
+//    kept for the other scenarios.
+//
+//    With cached set the catalog cache is written by a first mount that
+//    is not timed, and every round mounts servers of the same names - so
+//    they load their catalogs from the cache files.
+//
+// Returns:
+//    Scenario result.
+//
+static ScenarioResult
+RunMount(
+    const BenchConfig& config,
+    const string& baseDir,
+    const string& customQueriesPath,
+    bool cached)
+{
+    ScenarioResult  result;
+    string          prefix;
+    size_t          round;
+
+    result.m_name = cached ? "mount_cached" : "mount";
+    result.m_params = { { "servers", config.m_numServers },
+                        { "dmvs", config.m_numDmvs },
+                        { "queries", config.m_numQueries } };
+
+    g_UserPaths.m_catalogCachePath.clear();
+    if (cached)
+    {
+        g_UserPaths.m_catalogCachePath = baseDir + "/catalog";
+    }
+
+    // The first round of a cached mount writes the cache.
+    //
+    round = cached ? 0 : 1;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (; round <= config.m_iterations; round++)
+    {
+        if (round == 1)
+        {
+            start = std::chrono::steady_clock::now();
+        }
+
+        // The catalog check thread must not see the servers go away.
+        //
+        StopCatalogRefresh();
+
+        // Ends with a / like the default dump directory of DBFS.
+        //
+        prefix = cached ? string("cached_server") : StringFormat("round%zu_server", round);
+        g_UserPaths.m_dumpPath = StringFormat("%s/dump_%s%zu/", baseDir.c_str(), prefix.c_str(), round);
+
+        CreateServers(prefix, config.m_numServers, config.m_numDmvs, customQueriesPath);
+
+        auto roundStart = std::chrono::steady_clock::now();
+        g_Operations.init(NULL);
+        LoadAllDmvCatalogs();
+        if (round > 0)
+        {
+            result.m_latenciesUs.push_back(ElapsedUs(roundStart));
+        }
+    }
+
+    result.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Method: RunParallelCat
+//
+// Description:
+//    Cats m_numFiles DMV files (spread over the servers and the TSV, CSV
+//    and NDJSON forms) from m_numThreads threads.
+//
+// Returns:
+//    Scenario result.
+//
+static ScenarioResult
+RunParallelCat(
+    const BenchConfig& config,
+    const vector<string>& dmvNames)
+{
+    const char*             extensions[] = { "", ".csv", ".ndjson" };
+    ScenarioResult          result;
+    vector<string>          paths;
+    std::atomic<size_t>     nextPath(0);
+    std::atomic<uint64_t>   bytes(0);
+    std::atomic<uint64_t>   errors(0);
+    std::mutex              latenciesLock;
+
+    result.m_name = "parallel_cat";
+    result.m_params = { { "threads", config.m_numThreads },
+                        { "files", config.m_numFiles },
+                        { "rows", config.m_numRows },
+                        { "columns", config.m_numColumns },
+                        { "latency_us", config.m_latencyUs } };
+
+    auto servers = GetServerInfoList();
+    for (size_t i = 0; i < config.m_numFiles && !servers.empty(); i++)
+    {
+        paths.push_back(StringFormat("/%s/%s%s",
+            servers[i % servers.size()].first.c_str(),
+            dmvNames[(i / servers.size()) % dmvNames.size()].c_str(),
+            extensions[(i / (servers.size() * dmvNames.size())) % 3]));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    RunInParallel(config.m_numThreads, config.m_numThreads,
+        [&](size_t)
+        {
+            vector<char>        buffer(BENCH_READ_SIZE);
+            vector<uint64_t>    latencies;
+            size_t              item;
+            long long           length;
+
+            while ((item = nextPath++) < paths.size())
+            {
+                auto catStart = std::chrono::steady_clock::now();
+
+                length = CatFile(paths[item], buffer);
+                latencies.push_back(ElapsedUs(catStart));
+
+                if (length < 0)
+                {
+                    errors++;
+                }
+                else
+                {
+                    bytes += length;
+                }
+            }
+
+            std::lock_guard<std::mutex> guard(latenciesLock);
+            result.m_latenciesUs.insert(result.m_latenciesUs.end(), latencies.begin(), latencies.end());
+        });
+
+    result.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.m_bytes = bytes;
+    result.m_errors = errors;
+
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Method: RunLargeFile
+//
+// Description:
+//    Cats the large DMV of the first server m_iterations times.
+//
+// Returns:
+//    Scenario result.
+//
+static ScenarioResult
+RunLargeFile(
+    const BenchConfig& config)
+{
+    ScenarioResult  result;
+    vector<char>    buffer(BENCH_READ_SIZE);
+    string          path;
+    long long       length;
+
+    result.m_name = "large_file";
+    result.m_params = { { "rows", config.m_largeRows },
+                        { "columns", config.m_numColumns },
+                        { "read_size", (size_t)BENCH_READ_SIZE } };
+
+    auto servers = GetServerInfoList();
+    if (servers.empty())
+    {
+        return result;
+    }
+    path = "/" + servers.front().first + "/" BENCH_LARGE_DMV_NAME;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < config.m_iterations; i++)
+    {
+        auto catStart = std::chrono::steady_clock::now();
+
+        length = CatFile(path, buffer);
+        result.m_latenciesUs.push_back(ElapsedUs(catStart));
+
+        if (length < 0)
+        {
+            result.m_errors++;
+        }
+        else
+        {
+            result.m_bytes += length;
+        }
+    }
+
+    result.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Method: RunListCustomQueries
+//
+// Description:
+//    Lists the customQueries folder of the first server 100 times per
+//    iteration, the way ls does.
+//
+// Returns:
+//    Scenario result.
+//
+static ScenarioResult
+RunListCustomQueries(
+    const BenchConfig& config)
+{
+    ScenarioResult          result;
+    struct fuse_file_info   fi;
+    struct stat             st;
+    string                  path;
+    size_t                  numEntries;
+
+    result.m_name = "ls_custom_queries";
+    result.m_params = { { "queries", config.m_numQueries },
+                        { "listings", config.m_iterations * 100 } };
+
+    auto servers = GetServerInfoList();
+    if (servers.empty())
+    {
+        return result;
+    }
+    path = GetCustomQueriesDirPath(servers.front().first);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < config.m_iterations * 100; i++)
+    {
+        auto listStart = std::chrono::steady_clock::now();
+
+        memset(&fi, 0, sizeof(fi));
+        numEntries = 0;
+
+        if (g_Operations.getattr(path.c_str(), &st) ||
+            g_Operations.opendir(path.c_str(), &fi))
+        {
+            result.m_errors++;
+            continue;
+        }
+
+        g_Operations.readdir(path.c_str(), &numEntries, CountEntry, 0, &fi);
+        g_Operations.releasedir(path.c_str(), &fi);
+
+        result.m_latenciesUs.push_back(ElapsedUs(listStart));
+
+        // The query files plus . and .. of the dump directory.
+        //
+        if (numEntries < config.m_numQueries)
+        {
+            result.m_errors++;
+        }
+    }
+
+    result.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Method: RunFanOut
+//
+// Description:
+//    Cats the TSV, CSV and NDJSON files of the first DMV in the fan-out
+//    folder m_iterations times each. Every cat queries all the servers.
+//
+// Returns:
+//    Scenario result.
+//
+static ScenarioResult
+RunFanOut(
+    const BenchConfig& config,
+    const vector<string>& dmvNames)
+{
+    const char*     extensions[] = { "", ".csv", ".ndjson" };
+    ScenarioResult  result;
+    vector<char>    buffer(BENCH_READ_SIZE);
+    string          path;
+    long long       length;
+
+    result.m_name = "fanout";
+    result.m_params = { { "servers", config.m_numServers },
+                        { "rows", config.m_numRows },
+                        { "latency_us", config.m_latencyUs } };
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < config.m_iterations * 3 && !dmvNames.empty(); i++)
+    {
+        path = "/" FANOUT_FOLDER_NAME "/" + dmvNames.front() + extensions[i % 3];
+
+        auto catStart = std::chrono::steady_clock::now();
+
+        length = CatFile(path, buffer);
+        result.m_latenciesUs.push_back(ElapsedUs(catStart));
+
+        if (length < 0)
+        {
+            result.m_errors++;
+        }
+        else
+        {
+            result.m_bytes += length;
+        }
+    }
+
+    result.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Method: RunBundle
+//
+// Description:
+//    Cats the bundle file of the first server m_iterations * 10 times.
+//    Each cat reads BENCH_BUNDLE_SIZE DMVs in one round trip - the
+//    round_trips parameter counts the queries of the backend.
+//
+//    With readResultSets (scenario bundle_result_sets), no backend is
+//    installed while the bundle is read, so ExecuteBatch sends it with
+//    the connection pool of the server and reads its result sets with
+//    dbresults/dbnextrow - from the fake DB-Library, answered by backend.
+//    The catalog check must be stopped, as its queries would take the
+//    same path on servers without a pool.
+//
+// Returns:
+//    Scenario result.
+//
+static ScenarioResult
+RunBundle(
+    const BenchConfig& config,
+    FakeQueryBackend& backend,
+    bool readResultSets)
+{
+    ScenarioResult  result;
+    vector<char>    buffer(BENCH_READ_SIZE);
+    string          path;
+    long long       length;
+    uint64_t        numQueries = backend.GetNumQueries();
+    ServerInfo*     serverInfo;
+
+    result.m_name = readResultSets ? "bundle_result_sets" : "bundle";
+    result.m_params = { { "members", min<size_t>(config.m_numDmvs, BENCH_BUNDLE_SIZE) },
+                        { "rows", config.m_numRows },
+                        { "latency_us", config.m_latencyUs } };
+
+    auto servers = GetServerInfoList();
+    if (servers.empty())
+    {
+        return result;
+    }
+    path = "/" + servers.front().first + "/" BUNDLE_FOLDER_NAME "/" BENCH_BUNDLE_NAME;
+    serverInfo = servers.front().second.get();
+
+    if (readResultSets)
+    {
+        serverInfo->m_connectionPool = new ConnectionPool(serverInfo->m_hostname, "bench", "",
+                                                          SQLFS_DEFAULT_POOL_SIZE,
+                                                          SQLFS_DEFAULT_POOL_IDLE_TIMEOUT_SEC,
+                                                          GetServerStats(servers.front().first));
+        SetFakeDbLibBackend(&backend);
+        SetQueryBackend(NULL);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < config.m_iterations * 10; i++)
+    {
+        auto catStart = std::chrono::steady_clock::now();
+
+        length = CatFile(path, buffer);
+        result.m_latenciesUs.push_back(ElapsedUs(catStart));
+
+        if (length < 0)
+        {
+            result.m_errors++;
+        }
+        else
+        {
+            result.m_bytes += length;
+        }
+    }
+
+    result.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.m_params.push_back({ "round_trips", backend.GetNumQueries() - numQueries });
+
+    if (readResultSets)
+    {
+        SetQueryBackend(&backend);
+        delete serverInfo->m_connectionPool;
+        serverInfo->m_connectionPool = NULL;
+    }
+
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Method: FormatResult
+//
+// Description:
+//    Formats a scenario result as a JSON object.
+//
+// Returns:
+//    JSON text.
+//
+static string
+FormatResult(
+    ScenarioResult& result)
+{
+    string  text;
+    size_t  numOps = result.m_latenciesUs.size();
+    double  seconds = max(result.m_seconds, 1e-9);
+
+    std::sort(result.m_latenciesUs.begin(), result.m_latenciesUs.end());
+
+    text = StringFormat("    {\n      \"name\": \"%s\",\n      \"params\": {", result.m_name.c_str());
+    for (size_t i = 0; i < result.m_params.size(); i++)
+    {
+        text += StringFormat("%s\"%s\": %zu", i ? ", " : " ",
+                             result.m_params[i].first.c_str(), result.m_params[i].second);
+    }
+    text += " },\n";
+
+    text += StringFormat(
+        "      \"operations\": %zu,\n"
+        "      \"errors\": %llu,\n"
+        "      \"seconds\": %.6f,\n"
+        "      \"ops_per_sec\": %.1f,\n"
+        "      \"bytes\": %llu,\n"
+        "      \"mb_per_sec\": %.1f,\n"
+        "      \"latency_us\": { \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu }\n"
+        "    }",
+        numOps,
+        (unsigned long long)result.m_errors,
+        result.m_seconds,
+        numOps / seconds,
+        (unsigned long long)result.m_bytes,
+        result.m_bytes / seconds / (1024 * 1024),
+        (unsigned long long)Percentile(result.m_latenciesUs, 50),
+        (unsigned long long)Percentile(result.m_latenciesUs, 90),
+        (unsigned long long)Percentile(result.m_latenciesUs, 99),
+        (unsigned long long)(numOps ? result.m_latenciesUs.back() : 0));
+
+    return text;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ParseBenchArguments
+//
+// Description:
+//    This method parses the command line.
+//
+// Returns:
+//    true on success - otherwise false.
+//
+static bool
+ParseBenchArguments(
+    int argc,
+    char* argv[],
+    BenchConfig& config)
+{
+    static struct option longOptions[] =
+    {
+        { "servers",        required_argument, 0, 's' },
+        { "dmvs",           required_argument, 0, 'd' },
+        { "rows",           required_argument, 0, 'r' },
+        { "columns",        required_argument, 0, 'c' },
+        { "text-length",    required_argument, 0, 't' },
+        { "latency-us",     required_argument, 0, 'l' },
+        { "threads",        required_argument, 0, 'j' },
+        { "files",          required_argument, 0, 'f' },
+        { "large-rows",     required_argument, 0, 'L' },
+        { "queries",        required_argument, 0, 'q' },
+        { "iterations",     required_argument, 0, 'i' },
+        { 0, 0, 0, 0 }
+    };
+    int     option;
+    int     idx;
+    size_t* value;
+    char*   end;
+
+    while ((option = getopt_long(argc, argv, "s:d:r:c:t:l:j:f:L:q:i:", longOptions, &idx)) != -1)
+    {
+        switch (option)
+        {
+        case 's': value = &config.m_numServers; break;
+        case 'd': value = &config.m_numDmvs; break;
+        case 'r': value = &config.m_numRows; break;
+        case 'c': value = &config.m_numColumns; break;
+        case 't': value = &config.m_textLength; break;
+        case 'l': value = &config.m_latencyUs; break;
+        case 'j': value = &config.m_numThreads; break;
+        case 'f': value = &config.m_numFiles; break;
+        case 'L': value = &config.m_largeRows; break;
+        case 'q': value = &config.m_numQueries; break;
+        case 'i': value = &config.m_iterations; break;
+        default: return false;
+        }
+
+        *value = strtoull(optarg, &end, 10);
+        if (*optarg == '\0' || *end != '\0')
+        {
+            return false;
+        }
+    }
+
+    return config.m_numServers > 0 && config.m_numDmvs > 0 &&
+           config.m_numThreads > 0 && config.m_iterations > 0;
+}
+
+int
+main(
+    int argc,
+    char* argv[])
+{
+    BenchConfig             config;
+    FakeBackendConfig       backendConfig;
+    vector<ScenarioResult>  results;
+    char                    baseDirTemplate[] = "/tmp/dbfs_bench_XXXXXX";
+    string                  baseDir;
+    string                  customQueriesPath;
+    FILE*                   queryFile;
+
+    if (!ParseBenchArguments(argc, argv, config))
+    {
+        fprintf(stderr,
+                "Usage: %s [--servers n] [--dmvs n] [--rows n] [--columns n] [--text-length n]\n"
+                "          [--latency-us n] [--threads n] [--files n] [--large-rows n]\n"
+                "          [--queries n] [--iterations n]\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (!mkdtemp(baseDirTemplate))
+    {
+        fprintf(stderr, "Could not create the temporary directory - %s\n", strerror(errno));
+        return 1;
+    }
+    baseDir = baseDirTemplate;
+
+    // The query files of the customQueries folders.
+    //
+    customQueriesPath = baseDir + "/queries";
+    mkdir(customQueriesPath.c_str(), DEFAULT_PERMISSIONS);
+    for (size_t i = 0; i < config.m_numQueries; i++)
+    {
+        queryFile = fopen(StringFormat("%s/query%zu.sql", customQueriesPath.c_str(), i).c_str(), "w");
+        if (queryFile)
+        {
+            fprintf(queryFile, "SELECT * FROM sys.dm_bench_%zu\n", i);
+            fclose(queryFile);
+        }
+    }
+
+    backendConfig.m_numRows = config.m_numRows;
+    backendConfig.m_numColumns = config.m_numColumns;
+    backendConfig.m_textLength = config.m_textLength;
+    backendConfig.m_latency = std::chrono::microseconds(config.m_latencyUs);
+    for (size_t i = 0; i < config.m_numDmvs; i++)
+    {
+        backendConfig.m_dmvNames.push_back(StringFormat("dm_bench_%zu", i));
+    }
+    backendConfig.m_dmvNames.push_back(BENCH_LARGE_DMV_NAME);
+    backendConfig.m_dmvRows[BENCH_LARGE_DMV_NAME] = config.m_largeRows;
+
+    FakeQueryBackend backend(backendConfig);
+    SetQueryBackend(&backend);
+
+    InitializeFuseOperations(&g_Operations);
+
+    results.push_back(RunMount(config, baseDir, customQueriesPath, true));
+    results.push_back(RunMount(config, baseDir, customQueriesPath, false));
+
+    backendConfig.m_dmvNames.pop_back();
+    results.push_back(RunParallelCat(config, backendConfig.m_dmvNames));
+    results.push_back(RunLargeFile(config));
+    results.push_back(RunListCustomQueries(config));
+    results.push_back(RunFanOut(config, backendConfig.m_dmvNames));
+    results.push_back(RunBundle(config, backend, false));
+
+    StopCatalogRefresh();
+    results.push_back(RunBundle(config, backend, true));
+
+    printf("{\n  \"benchmark\": \"fuse_bench\",\n  \"backend_queries\": %llu,\n  \"scenarios\": [\n",
+           (unsigned long long)backend.GetNumQueries());
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        printf("%s%s\n", FormatResult(results[i]).c_str(), (i + 1 < results.size()) ? "," : "");
+    }
+    printf("  ]\n}\n");
+
+    CreateServers("", 0, 0, "");
+    SetQueryBackend(NULL);
+    nftw(baseDir.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+
+    return 0;
+}
@@ -0,0 +1,298 @@
+//****************************************************************************
+//      Copyright (c) Microsoft Corporation. All rights reserved.
+//      Licensed under the MIT license.
+//
+// File: RowSerializerBench.cpp
+//
+// Purpose:
+//   Microbenchmark of the row serialization. Compares RowSerializer with
+//   the previous path (values bound with NTBSTRINGBIND, then strlen and
+//   one append per value and separator) on rows shaped like
+//   sys.dm_os_performance_counters: three nchar(128) columns, one bigint
+//   and one int.
+//
+//   Usage: rowserializer_bench [rows] [iterations]
+//
+#include "UtilsPrivate.h"
+
+#define BENCH_DEFAULT_ROWS          2000
+#define BENCH_DEFAULT_ITERATIONS    200
+#define BENCH_NCHAR_LEN             128
+#define BENCH_NUM_COLUMNS           5
+
+// Globals of DBFS used by the result buffers (spill and logging),
+// defined in main.cpp for the file system itself.
+//
+struct SQLFsPaths g_UserPaths;
+bool g_InVerbose = false;
+LogLevel g_LogLevel = LOG_LEVEL_ERROR;
+bool g_UseLogFile = false;
+
+// ---------------------------------------------------------------------------
+// Structure: BenchColumn
+//
+// Description:
+//    Raw value of a column the way dbdata/dbdatlen return it.
+//
+struct BenchColumn
+{
+    int             m_type;
+    vector<BYTE>    m_data;
+};
+
+typedef vector<BenchColumn> BenchRow;
+
+// ---------------------------------------------------------------------------
+// Method: MakeText
+//
+// Description:
+//    Builds a blank padded nchar value.
+//
+static BenchColumn
+MakeText(
+    const string& value)
+{
+    BenchColumn column;
+
+    column.m_type = XSYBNCHAR;
+    column.m_data.assign(value.begin(), value.end());
+    column.m_data.resize(BENCH_NCHAR_LEN, ' ');
+
+    return column;
+}
+
+// ---------------------------------------------------------------------------
+// Method: MakeInteger
+//
+// Description:
+//    Builds an int or bigint value.
+//
+template <typename T>
+static BenchColumn
+MakeInteger(
+    int type,
+    T value)
+{
+    BenchColumn column;
+
+    column.m_type = type;
+    column.m_data.resize(sizeof(T));
+    memcpy(column.m_data.data(), &value, sizeof(T));
+
+    return column;
+}
+
+// ---------------------------------------------------------------------------
+// Method: MakeRows
+//
+// Description:
+//    Builds the synthetic result set.
+//
+static vector<BenchRow>
+MakeRows(
+    size_t numRows)
+{
+    vector<BenchRow> rows(numRows);
+
+    for (size_t i = 0; i < numRows; i++)
+    {
+        rows[i].push_back(MakeText(StringFormat("SQLServer:Buffer Manager %zu", i % 40)));
+        rows[i].push_back(MakeText(StringFormat("Page life expectancy %zu", i)));
+        rows[i].push_back(MakeText((i % 3) ? StringFormat("_Total %zu", i % 7) : string()));
+        rows[i].push_back(MakeInteger<DBBIGINT>(SYBINT8, (DBBIGINT)i * 7919 - 1000));
+        rows[i].push_back(MakeInteger<DBINT>(SYBINT4, 65792 + (DBINT)(i % 5)));
+    }
+
+    return rows;
+}
+
+// ---------------------------------------------------------------------------
+// Method: SerializeLegacy
+//
+// Description:
+//    The previous path: each value is copied into its bound buffer (as
+//    NTBSTRINGBIND does - converted, blank trimmed and null terminated),
+//    then strlen and one append per value and per separator.
+//
+static void
+SerializeLegacy(
+    const vector<BenchRow>& rows,
+    ResultBuffer& output)
+{
+    vector<string>  stringVector(BENCH_NUM_COLUMNS);
+    char*           bound;
+    size_t          length;
+    long long       value;
+
+    for (auto&& column : stringVector)
+    {
+        column.resize(BENCH_NCHAR_LEN + 1);
+    }
+
+    for (auto&& row : rows)
+    {
+        // What dbnextrow does for the bound columns.
+        //
+        for (int i = 0; i < BENCH_NUM_COLUMNS; i++)
+        {
+            bound = (char*)stringVector[i].c_str();
+
+            if (row[i].m_type == XSYBNCHAR)
+            {
+                length = row[i].m_data.size();
+                while (length > 0 && row[i].m_data[length - 1] == ' ')
+                {
+                    length--;
+                }
+                memcpy(bound, row[i].m_data.data(), length);
+                bound[length] = '\0';
+            }
+            else
+            {
+                if (row[i].m_type == SYBINT8)
+                {
+                    DBBIGINT bigValue;
+                    memcpy(&bigValue, row[i].m_data.data(), sizeof(bigValue));
+                    value = bigValue;
+                }
+                else
+                {
+                    DBINT intValue;
+                    memcpy(&intValue, row[i].m_data.data(), sizeof(intValue));
+                    value = intValue;
+                }
+                snprintf(bound, BENCH_NCHAR_LEN, "%lld", value);
+            }
+        }
+
+        // What CopyAllRowData did.
+        //
+        for (int i = 0; i < BENCH_NUM_COLUMNS; i++)
+        {
+            if (i != 0)
+            {
+                output.Append('\t');
+            }
+
+            bound = (char*)stringVector[i].c_str();
+            output.Append(bound, strlen(bound));
+        }
+        output.Append('\n');
+    }
+
+    output.Complete(0);
+}
+
+// ---------------------------------------------------------------------------
+// Method: SerializeArena
+//
+// Description:
+//    The RowSerializer path. dbConn is only needed for dbconvert which
+//    these column types never use.
+//
+static void
+SerializeArena(
+    const vector<BenchRow>& rows,
+    ResultBuffer& output)
+{
+    RowSerializer serializer(output);
+
+    for (auto&& row : rows)
+    {
+        for (int i = 0; i < BENCH_NUM_COLUMNS; i++)
+        {
+            serializer.AppendValue(NULL, i, row[i].m_type,
+                                   row[i].m_data.data(), row[i].m_data.size());
+        }
+        serializer.EndRow();
+    }
+
+    serializer.Flush();
+    output.Complete(0);
+}
+
+// ---------------------------------------------------------------------------
+// Method: RunBench
+//
+// Description:
+//    Runs one serializer the given number of times and prints the time
+//    taken.
+//
+// Returns:
+//    Output of the last run (to compare the two paths).
+//
+static string
+RunBench(
+    const char* name,
+    void (*serialize)(const vector<BenchRow>&, ResultBuffer&),
+    const vector<BenchRow>& rows,
+    int iterations)
+{
+    string  lastOutput;
+    size_t  totalBytes = 0;
+    double  seconds;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; i++)
+    {
+        ResultBuffer output;
+
+        serialize(rows, output);
+        totalBytes += output.GetSize();
+
+        if (i == iterations - 1)
+        {
+            lastOutput = output.ToString();
+        }
+    }
+
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-8s %10.2f ms %12.0f rows/s %10.1f MB/s\n",
+           name,
+           seconds * 1000,
+           rows.size() * (double)iterations / seconds,
+           totalBytes / seconds / (1024 * 1024));
+
+    return lastOutput;
+}
+
+int
+main(
+    int argc,
+    char* argv[])
+{
+    size_t  numRows = BENCH_DEFAULT_ROWS;
+    int     iterations = BENCH_DEFAULT_ITERATIONS;
+    string  legacyOutput;
+    string  arenaOutput;
+
+    if (argc > 1)
+    {
+        numRows = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2)
+    {
+        iterations = atoi(argv[2]);
+    }
+    if (iterations < 1)
+    {
+        iterations = 1;
+    }
+
+    vector<BenchRow> rows = MakeRows(numRows);
+
+    printf("%zu rows x %d columns, %d iterations\n", numRows, BENCH_NUM_COLUMNS, iterations);
+
+    legacyOutput = RunBench("legacy", SerializeLegacy, rows, iterations);
+    arenaOutput = RunBench("arena", SerializeArena, rows, iterations);
+
+    if (legacyOutput != arenaOutput)
+    {
+        fprintf(stderr, "Outputs differ\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -4,7 +4,11 @@
 #
 ###############################################################
 
-CXX := clang++-3.7
+# C++17 clang. Can be overridden (make CXX=clang++-15).
+#
+ifeq ($(origin CXX),default)
+	CXX := clang++
+endif
 
 # Set platform type. Don't use += operator as it will stick in extra spaces.
 #
@@ -43,7 +47,7 @@ IGNORED_WARNINGS = -Wno-nested-anon-types \
 				   -Wignored-attributes
 
 INCLUDES=-I.
-CFLAGS=-Wall $(IGNORED_WARNINGS) $(INCLUDES) $(shell pkg-config fuse --cflags) -std=c++14
+CFLAGS=-Wall $(IGNORED_WARNINGS) $(INCLUDES) $(shell pkg-config fuse --cflags) -std=c++17
 
 # Dynamic libraries:
 #   - libpthread is needed for pthreads support.
@@ -51,7 +55,7 @@ CFLAGS=-Wall $(IGNORED_WARNINGS) $(INCLUDES) $(shell pkg-config fuse --cflags) -
 #   - libdl is needed for dynamic linking.
 #   - lsysdb is needed for using the sybase API's
 #
-LDLIBS += -lpthread -lrt -ldl $(shell pkg-config fuse --libs) -lsybdb
+LDLIBS += -lpthread -lrt -ldl $(shell pkg-config fuse --libs) -lsybdb -llz4
 
 ifeq ($(PLATFORM),$(filter $(PLATFORM),rhel suse))
 	LDLIBS += -lc++abi
@@ -61,3 +65,15 @@ ifeq ($(PLATFORM),$(filter $(PLATFORM),rhel suse))
 endif
 
 LDFLAGS += $(LDLIBS)
+
+# Flags of the build variants (see the Makefile). LTO links with lld,
+# which reads the LLVM bitcode of the objects - override LTO_LDFLAGS to
+# use another LTO-capable linker.
+#
+RELEASE_FLAGS ?= -O2
+LTO_FLAGS ?= -flto
+LTO_LDFLAGS ?= -fuse-ld=lld
+PROFILE_FLAGS = -O2 -g -fno-omit-frame-pointer -mno-omit-leaf-frame-pointer
+ASAN_FLAGS = -O1 -g -fno-omit-frame-pointer -fsanitize=address,undefined
+TSAN_FLAGS = -O1 -g -fsanitize=thread
+LLVM_PROFDATA ?= llvm-profdata
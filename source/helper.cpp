@@ -46,36 +46,15 @@ ReturnErrnoAndPrintError(
     std::string error_str)
 {
     int     result;
-    int     status;
-    FILE*   outFile;
+    char    errorBuffer[256];
 
     result = -errno;
-    (void)outFile;      //To suppress warning
-    
-    if (g_InVerbose)
-    {
-        outFile = stderr;
-        status = SUCCESS;
-
-        if (g_UseLogFile == true)
-        {
-            outFile = fopen(g_UserPaths.m_logfilePath.c_str(), "a");
-            if (!outFile)
-            {
-                status = FAILURE;
-            }
-        }
-
-        if (status == SUCCESS)
-        {
-            fprintf(outFile, "SQLFS Error in %s :: Reason - %s, Details - %s\n",
-                func, error_str.c_str(), strerror(errno));
 
-            if (outFile != stderr)
-            {
-                fclose(outFile);
-            }
-        }
+    if (IsLogEnabled(LOG_LEVEL_WARNING))
+    {
+        LogMsg(LOG_LEVEL_WARNING, "SQLFS Error in %s :: Reason - %s, Details - %s\n",
+            func, error_str.c_str(),
+            strerror_r(-result, errorBuffer, sizeof(errorBuffer)));
     }
 
     return result;
@@ -85,9 +64,12 @@ ReturnErrnoAndPrintError(
 // Method: PrintError
 //
 // Description:
-//    This method prints error message provided if verbose mode is enabled 
-//    either on STDERR or the log file depending on whether the log file
-//    paramater was passed at startup.
+//    This method logs the message provided at the info level if verbose
+//    mode is enabled, either on STDERR or the log file depending on
+//    whether the log file paramater was passed at startup.
+//
+//    The message is handed to the log thread, so it is cheap and safe to
+//    call from several threads.
 //
 // Returns:
 //    VOID
@@ -95,38 +77,11 @@ ReturnErrnoAndPrintError(
 void
 PrintMsg(const char* format, ...)
 {
-    FILE*   outFile;
     va_list argptr;
-    int     status;
-
-    (void)outFile;      //To suppress warning
-
-    if (g_InVerbose)
-    {
-        outFile = stderr;
-        status = SUCCESS;
 
-        if (g_UseLogFile == true)
-        {
-            outFile = fopen(g_UserPaths.m_logfilePath.c_str(), "a");
-            if (!outFile)
-            {
-                status = FAILURE;
-            }
-        }
-
-        if (status == SUCCESS)
-        {
-            va_start(argptr, format);
-            vfprintf(outFile, format, argptr);
-            va_end(argptr);
-
-            if (outFile != stderr)
-            {
-                fclose(outFile);
-            }
-        }
-    }
+    va_start(argptr, format);
+    LogMsgV(LOG_LEVEL_INFO, format, argptr);
+    va_end(argptr);
 }
 
 // ---------------------------------------------------------------------------
@@ -138,9 +93,6 @@ PrintMsg(const char* format, ...)
 //
 //    It searches the in-memory struct ServerInfo for this information.
 //
-//    The list is constant post initialization and read opeations will not
-//    require synchronization primitives.
-//
 // Returns:
 //    VOID
 //
@@ -151,13 +103,13 @@ GetServerDetails(
     string& username,
     string& password)
 {
-    auto search = g_ServerInfoMap.find(servername);
+    shared_ptr<ServerInfo> serverInfo = GetServerInfo(servername);
 
-    if (search != g_ServerInfoMap.end())
+    if (serverInfo)
     {
-        hostname = search->second->m_hostname;
-        username = search->second->m_username;
-        password = search->second->m_password;
+        hostname = serverInfo->m_hostname;
+        username = serverInfo->m_username;
+        password = serverInfo->m_password;
     }
     else
     {
@@ -167,91 +119,6 @@ GetServerDetails(
 }
 
 
-// ---------------------------------------------------------------------------
-// Method: CreateFile
-//
-// Description:
-//    This method creates a file with write permissions. Or truncates to zero
-//    if one already exists.
-//
-//    Note - Absolute path need to be provided to the function.
-//
-// Returns:
-//    VOID
-//
-void
-CreateFile(
-    const char* path)
-{
-    FILE*   fp;
-
-    fp = fopen(path, "w+");
-    if (!fp)
-    {
-        PrintMsg("Error creating file %s %s\n", path, strerror(errno));
-        KillSelf();
-    }
-    else
-    {
-        fclose(fp);
-    }
-
-    // Add the extended attribute indicating this is a locally created DMV
-    // file.
-    //
-    // Keep size as 0 as we do not want to store a value for the attribute
-    // - just want to create the attribute so pass in size as 0.
-    //
-    int status = setxattr(path,
-                          g_LocallyGeneratedFiles, // name
-                          "1",  // value
-                          0,    // size
-                          0);   // default value.
-    if (status)
-    {
-        PrintMsg("Error setting extended attributes for file %s : %s\n", path, strerror(errno));
-        KillSelf();
-    }
-}
-
-// ---------------------------------------------------------------------------
-// Method: IsDbfsFile
-//
-// Description:
-//  This checks if the file pointed to by the provided path is a
-//  dbfs file (created by this tool).
-//
-// Returns:
-//    true if file is a dmv - otherwise false.
-//
-bool
-IsDbfsFile(
-    const char* path)
-{
-    string fpath;
-    bool result = false;
-
-    fpath = CalculateDumpPath(path);
-
-    // Check if this is a DMV file by checking for the
-    // custom attribute.
-    //
-    int length = getxattr(fpath.c_str(),
-                          g_LocallyGeneratedFiles,
-                          NULL,
-                          0);
-
-    // We expect the length to be 0.
-    // -1 would mean that the value doesn't exist.
-    //
-    if (length >= 0)
-    {
-        result = true;
-    }
-
-    return result;
-}
-
 // ---------------------------------------------------------------------------
 // Method: CreateCustomQueriesDir
 //
@@ -260,6 +127,9 @@ IsDbfsFile(
 // custom query output file. The file is empty until it is opened. When
 // the file is opened, the content will be populated.
 //
+//    The directory is also created in the dump directory so that it can
+//    hold files the user creates there.
+//
 // Returns:
 //    VOID
 //
@@ -270,17 +140,20 @@ CreateCustomQueriesDir(
 {
     int error;
 
-    // Create the custom query folder for each server.
+    // Create the custom query folder for each server. It is already there
+    // for a server of the same name removed by a reload.
     //
     string customQueryFolderPath = dumpDir + LINUX_PATH_DELIM + CUSTOM_QUERY_FOLDER_NAME;
     error = mkdir(customQueryFolderPath.c_str(), DEFAULT_PERMISSIONS);
-    if (error == 0)
+    if (error == 0 || errno == EEXIST)
     {
+        g_VirtualTree.AddDirectory(
+            GetCustomQueriesDirPath(servername),
+            servername);
+
         // Create custom query output files.
         //
-        CreateCustomQueriesOutputFiles(
-            servername,
-            customQueryFolderPath);
+        SyncCustomQueriesOutputFiles(servername);
     }
     else
     {
@@ -289,96 +162,18 @@ CreateCustomQueriesDir(
     }
 }
 
-// ---------------------------------------------------------------------------
-// Method: CreateDMVFiles
-//
-// Description:
-//    This method creates the empty DMV files for a given server.
-//    The location of the files (as seen) is <MOUNT DIR>/<SERVER NAME>/. 
-//    Of course the files are actually getting created in the dump directory.
-//
-//    The method requests the server for the list of DMV's and based on the
-//    version of the server - may or may not create the .json files. 
-//    Only for SQL Server 2016 (version 16) does the method create the .json.
-//
-//    This only happens at startup so no issue with synchronization.
-//
-// Returns:
-//    VOID
-//
-static void
-CreateDMVFiles(
-    const string& dumpDir,
-    const string& servername,
-    const string& hostname,
-    const string& username,
-    const string& password,
-    const int version)
-{
-    string          dmvQuery;
-    string          filepath;
-    string          responseString;
-    int             error;
-    vector<string>  filenames;
-    int             numEntries;
-
-    // Query SQL server for all the DMV files to be created.
-    //
-    // ** Note **
-    // schema_id = 4 selects DMV's (leaves out INFORMATION_SCHEMA).
-    //
-    dmvQuery = "SELECT name from sys.system_views where schema_id = 4";
-    error = ExecuteQuery(dmvQuery, responseString, hostname,
-        username, password, TYPE_TSV);
-    if (error)
-    {
-        PrintMsg("Failed to query DMV list\n");
-    }
-    else
-    {
-        // Tokenising response to extract DMV names.
-        //
-        filenames = Split(responseString, '\n');
-
-        // On success, it will have at least two entries.
-        numEntries = filenames.size();
-        assert(numEntries > 1);
-
-        // We need to skip the first name because the result of the SQL Query
-        // includes the name of the column as well in the output.
-        // We do not want to create a file corresponding to the column name.
-        //
-        for (int i = 0; i < numEntries; i++)
-        {
-            if (i == 0)
-            {
-                continue;
-            }
-
-            // Create the regular file - TSV.
-            //
-            filepath = StringFormat("%s/%s", dumpDir.c_str(), filenames[i].c_str());
-            CreateFile(filepath.c_str());
-
-            if (version >= 16)
-            {
-                // Creating the json file.
-                //
-                filepath = StringFormat("%s.json", filepath.c_str());
-                CreateFile(filepath.c_str());
-            }
-        }
-    }
-}
-
 // ---------------------------------------------------------------------------
 // Method: CreateDbfsFiles
 //
 // Description:
-//    This method creates the empty DMV files and custom query files
-//    for a given server. The location of the files (as seen) is
-//    <MOUNT DIR>/<SERVER NAME>/. Of course the files are actually getting
-//    created in the dump directory.
+//    This method creates the folder and custom query files for a given
+//    server. The location of the files (as seen) is
+//    <MOUNT DIR>/<SERVER NAME>/. The files are entries of the virtual
+//    tree; only the folders are also created in the dump directory.
+//
+//    The server is not queried here. Its DMV files come from the cache
+//    file of its catalog if there is one, otherwise they are discovered
+//    when the folder is first used (see DmvCatalog).
 //
 // Returns:
 //    VOID
@@ -386,24 +181,34 @@ CreateDMVFiles(
 void
 CreateDbfsFiles(
     const string& servername,
-    const string& hostname,
-    const string& username,
-    const string& password,
-    const int version)
+    ServerInfo* serverInfo)
 {
     string          fpath;
     int             error;
 
     fpath = CalculateDumpPath(servername);
 
-    // Creating folder for this server's data.
+    // Creating folder for this server's data. It can be left over from a
+    // server of the same name removed by a reload.
     //
     error = mkdir(fpath.c_str(), DEFAULT_PERMISSIONS);
-    if (error == 0)
+    if (error == 0 || errno == EEXIST)
     {
+        g_VirtualTree.AddDirectory(LINUX_PATH_DELIM + servername, servername);
+
         CreateCustomQueriesDir(fpath, servername);
 
-        CreateDMVFiles(fpath, servername, hostname, username, password, version);
+        if (serverInfo->m_history)
+        {
+            serverInfo->m_history->CreateFolder();
+        }
+
+        if (!serverInfo->m_bundles.empty())
+        {
+            CreateBundleFolder(servername, serverInfo);
+        }
+
+        serverInfo->m_catalog->LoadCache();
     }
     else
     {
@@ -418,6 +223,27 @@ CreateDbfsFiles(
     }
 }
 
+// ---------------------------------------------------------------------------
+// Method: RemoveDbfsFiles
+//
+// Description:
+//    This method removes the folder of a server that is no longer in the
+//    config file, or is replaced by a reload, from the tree. Its folder
+//    in the dump directory is kept - it holds the files of the user and
+//    the custom query files, which a server of the same name added later
+//    picks up again.
+//
+// Returns:
+//    VOID
+//
+void
+RemoveDbfsFiles(
+    const string& servername)
+{
+    g_VirtualTree.RemoveDirectory(LINUX_PATH_DELIM + servername);
+    ForgetCustomQueries(servername);
+}
+
 // ---------------------------------------------------------------------------
 // Method: KillSelf
 //
@@ -450,10 +276,11 @@ KillSelf()
 // Returns:
 //    Pointer to ServerInfo object or NULL if the server does not exist
 //
-ServerInfo* GetServerInfo(
+shared_ptr<ServerInfo> GetServerInfo(
     const string& servername)
 {
-    ServerInfo* serverInfo = NULL;
+    shared_ptr<ServerInfo> serverInfo;
+    std::lock_guard<std::mutex> guard(g_ServerInfoMapLock);
 
     // Lookup the server name in the map
     //
@@ -466,6 +293,25 @@ ServerInfo* GetServerInfo(
     return serverInfo;
 }
 
+// ---------------------------------------------------------------------------
+// Method: GetServerInfoList
+//
+// Description:
+//    This method takes a snapshot of the server map so callers can
+//    iterate over the servers without holding the map lock (and may
+//    call back into GetServerInfo while doing so).
+//
+// Returns:
+//    List of server name and ServerInfo pairs.
+//
+vector<pair<string, shared_ptr<ServerInfo>>> GetServerInfoList()
+{
+    std::lock_guard<std::mutex> guard(g_ServerInfoMapLock);
+
+    return vector<pair<string, shared_ptr<ServerInfo>>>(
+        g_ServerInfoMap.begin(), g_ServerInfoMap.end());
+}
+
 // ---------------------------------------------------------------------------
 // Method: GetUserCustomQueryPath
 //
@@ -482,10 +328,142 @@ string GetUserCustomQueryPath(
     const string& servername)
 {
     string customQueryPath;
-    ServerInfo* serverInfo = GetServerInfo(servername);
+    shared_ptr<ServerInfo> serverInfo = GetServerInfo(servername);
     if (serverInfo)
     {
         customQueryPath = serverInfo->m_customQueriesPath;
     }
     return customQueryPath;
 }
+
+// ---------------------------------------------------------------------------
+// Method: GetDmvCacheKey
+//
+// Description:
+//    Given a DMV name and form, get the key its result is cached under in
+//    the result cache of its server.
+//
+// Returns:
+//    The cache key.
+//
+string GetDmvCacheKey(
+    const string& dmvName,
+    const FileFormat type)
+{
+    return StringFormat("%s|%d", dmvName.c_str(), type);
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetCacheTtl
+//
+// Description:
+//    Given a server and a DMV name, get how long the result of the DMV
+//    query can be served from the cache. A per-file setting from the
+//    config file takes precedence over the server wide one.
+//
+// Returns:
+//    Time to live of the cached result. Zero if it is not cached.
+//
+std::chrono::milliseconds GetCacheTtl(
+    const ServerInfo* serverInfo,
+    const string& dmvName)
+{
+    auto fileTtl = serverInfo->m_fileCacheTtl.find(dmvName);
+    if (fileTtl != serverInfo->m_fileCacheTtl.end())
+    {
+        return fileTtl->second;
+    }
+
+    return serverInfo->m_cacheTtl;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetQueryTimeout
+//
+// Description:
+//    Given a server and a DMV or custom query name, get how long its
+//    query may run before it is cancelled. A per-file setting from the
+//    config file takes precedence over the server wide one.
+//
+// Returns:
+//    Timeout of the query. Zero if it is not limited.
+//
+std::chrono::milliseconds GetQueryTimeout(
+    const ServerInfo* serverInfo,
+    const string& name)
+{
+    auto fileTimeout = serverInfo->m_fileQueryTimeout.find(name);
+    if (fileTimeout != serverInfo->m_fileQueryTimeout.end())
+    {
+        return fileTimeout->second;
+    }
+
+    return serverInfo->m_queryTimeout;
+}
+
+// ---------------------------------------------------------------------------
+// Method: RunInParallel
+//
+// Description:
+//    This method runs the given work for every index in [0, numItems) on
+//    a bounded set of threads. Each thread picks the next index until
+//    all are done. Used at startup where every server needs a login that
+//    can take up to SQLFS_MAX_LOGIN_TIMEOUT_SEC if the host is down.
+//
+// Returns:
+//    VOID. Returns once all the items are processed.
+//
+void
+RunInParallel(
+    size_t numItems,
+    size_t maxWorkers,
+    const std::function<void(size_t)>& work)
+{
+    std::atomic<size_t> nextItem(0);
+    vector<thread>      workers;
+    size_t              numWorkers;
+
+    auto worker = [&]()
+    {
+        size_t item;
+
+        while ((item = nextItem++) < numItems)
+        {
+            work(item);
+        }
+    };
+
+    numWorkers = min(numItems, maxWorkers);
+    if (numWorkers <= 1)
+    {
+        worker();
+        return;
+    }
+
+    for (size_t i = 0; i < numWorkers; i++)
+    {
+        workers.emplace_back(worker);
+    }
+
+    for (auto&& itr : workers)
+    {
+        itr.join();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: ElapsedMs
+//
+// Description:
+//    This method gets the time elapsed since the given point in time.
+//
+// Returns:
+//    Elapsed time in milliseconds.
+//
+long long
+ElapsedMs(
+    std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
@@ -15,6 +15,11 @@
 #define DEFAULT_PERMISSIONS     0777
 #define LINUX_PATH_DELIM        "/"
 
+// Maximum number of servers verified / enumerated at the same time at
+// startup.
+//
+#define SQLFS_MAX_STARTUP_WORKERS   8
+
 // This method concatenates the dump directory path to the provided 
 // relative path.
 //
@@ -30,9 +35,9 @@ ReturnErrnoAndPrintError(
     const char* func,
     string error_str);
 
-// This method prints error message provided if verbose mode is enabled 
-// either on STDERR or the log file depending on whether the log file
-// paramater was passed at startup.
+// This method logs the message provided (at the info level) if verbose
+// mode is enabled either on STDERR or the log file depending on whether
+// the log file paramater was passed at startup.
 //
 void
 PrintMsg(const char* format, ...);
@@ -47,30 +52,20 @@ GetServerDetails(
     string& username,
     string& password);
 
-// This method creates a file with write permissions. Or truncates to zero
-// if one already exists.
-//
-void
-CreateFile(
-    const char* path);
-
-// This checks if the file pointed to by the provided path is a
-// dbfs file (created by this tool).
-//
-bool
-IsDbfsFile(
-    const char* path);
-
-// This method creates the empty DMV files and custom query files for a given server.
+// This method creates the DMV files and custom query files for a given server.
 // The virtual location of the files (as seen) is <MOUNT DIR>/<SERVER NAME>/.
 //
 void
 CreateDbfsFiles(
     const string& servername,
-    const string& hostname,
-    const string& username,
-    const string& password,
-    const int version);
+    ServerInfo* serverInfo);
+
+// This method removes the folder of a server from the tree - undoing
+// CreateDbfsFiles. Its folder in the dump directory is kept.
+//
+void
+RemoveDbfsFiles(
+    const string& servername);
 
 // This method exits the program and in doing so the function DestroySQLFs
 // is called.
@@ -78,11 +73,51 @@ CreateDbfsFiles(
 void
 KillSelf();
 
-// Given a server name, get ServerInfo.
+// Given a server name, get ServerInfo. The entry stays valid while the
+// caller holds it, even if the server is removed from the mount.
 //
-ServerInfo* GetServerInfo(
+shared_ptr<ServerInfo> GetServerInfo(
     const string& servername);
 
+// Get a snapshot of all the servers to iterate over.
+//
+vector<pair<string, shared_ptr<ServerInfo>>> GetServerInfoList();
+
+// Run work(0) ... work(numItems - 1) on at most maxWorkers threads and wait
+// for all of them to finish.
+//
+void
+RunInParallel(
+    size_t numItems,
+    size_t maxWorkers,
+    const std::function<void(size_t)>& work);
+
+// Milliseconds elapsed since the given time.
+//
+long long
+ElapsedMs(
+    std::chrono::steady_clock::time_point start);
+
+// Given a DMV name and form, get the key of its result in the result
+// cache of the server.
+//
+string GetDmvCacheKey(
+    const string& dmvName,
+    const FileFormat type);
+
+// Given a server and a DMV name, get how long its result can be cached.
+//
+std::chrono::milliseconds GetCacheTtl(
+    const ServerInfo* serverInfo,
+    const string& dmvName);
+
+// Given a server and a DMV or custom query name, get how long its query
+// may run.
+//
+std::chrono::milliseconds GetQueryTimeout(
+    const ServerInfo* serverInfo,
+    const string& name);
+
 // Given a server name, get the user specified custom query directory.
 //
 string GetUserCustomQueryPath(
@@ -20,9 +20,19 @@ struct SQLFsPaths g_UserPaths;
 //
 bool g_InVerbose;
 
+// Most verbose level logged in verbose mode.
+//
+LogLevel g_LogLevel = LOG_LEVEL_INFO;
+
 // Global map used to track information for all the servers
 //
-std::unordered_map<std::string, class ServerInfo*> g_ServerInfoMap;
+std::unordered_map<std::string, std::shared_ptr<class ServerInfo>> g_ServerInfoMap;
+
+// Lock protecting g_ServerInfoMap. FUSE calls into DBFS from multiple
+// threads so the map is only accessed through GetServerInfo and
+// GetServerInfoList.
+//
+std::mutex g_ServerInfoMapLock;
 
 // Global variable used to determine if log file path was given;
 //
@@ -32,15 +42,21 @@ bool g_UseLogFile;
 //
 bool g_RunInForeground;
 
-// Value of extended attribute that specifies is this is a DMV file
-// created by the tool.
+// Global variable used to track if FUSE needs to serve requests on a
+// single thread.
 //
-// This will help decide if this is a DMV whose content
-// needs to be queried from the server.
+bool g_RunSingleThreaded;
+
+// In-memory table of the folders and files exposed by DBFS (server
+// folders, DMV files and custom query output files).
 //
-// This will just be an empty attribute set.
+VirtualTree g_VirtualTree;
+
+// Config section of each server in g_ServerInfoMap, as last loaded. A
+// reload of the config file only redoes the servers whose section
+// changed.
 //
-char g_LocallyGeneratedFiles[] = "user.isCreatedByTool";
+static SectionList g_ServerSections;
 
 // ---------------------------------------------------------------------------
 // Method: PrintUsageAndExit
@@ -64,7 +80,14 @@ PrintUsageAndExit(
         "   -d/--dump-path      :  The dump directory used. Default = \"/tmp/sqlserver\" [OPTIONAL]\n"
         "   -v/--verbose        :  Start in verbose mode [OPTIONAL]\n"
         "   -l/--log-file       :  Path to the log file (only used if in verbose mode) [OPTIONAL]\n"
+        "   -L/--log-level      :  error, warning, info or debug. Default = info [OPTIONAL]\n"
+        "   -C/--catalog-cache  :  Existing directory of the DMV catalog cache, \"\" to not cache.\n"
+        "                          Default = \"$XDG_CACHE_HOME/dbfs\" or \"~/.cache/dbfs\" [OPTIONAL]\n"
+        "   -S/--shared-path    :  Existing directory of the shared snapshot segments. Default = \"/dev/shm\" [OPTIONAL]\n"
+        "   -R/--result-memory  :  Memory kept for query results before the large ones spill (LZ4 compressed)\n"
+        "                          to the dump directory, e.g. 512MB. Default = 0 (no limit) [OPTIONAL]\n"
         "   -f                  :  Run DBFS in foreground [OPTIONAL]\n"
+        "   -s                  :  Serve requests on a single thread [OPTIONAL]\n"
         "   -h                  :  Print usage"
         "\n", command);
     exit(-EINVAL);
@@ -80,9 +103,18 @@ static struct option long_options[] =
     { "dump-path",          required_argument,          0,  'd' },
     { "verbose",            required_argument,          0,  'v' },
     { "log-file",           required_argument,          0,  'l' },
+    { "log-level",          required_argument,          0,  'L' },
+    { "catalog-cache",      required_argument,          0,  'C' },
+    { "shared-path",        required_argument,          0,  'S' },
+    { "result-memory",      required_argument,          0,  'R' },
     { 0,                    0,                          0,   0 }
 };
 
+static bool
+convertToSize(
+    string str,
+    size_t& size);
+
 // ---------------------------------------------------------------------------
 // Method: GenerateFileName
 //
@@ -145,6 +177,7 @@ ParseArguments(
     bool status;
     string dumpDirPath;
     char* tempPtr;
+    size_t resultMemory;
 
     status = false;
 
@@ -157,6 +190,18 @@ ParseArguments(
         //
         g_UserPaths.m_dumpPath = "/tmp/" + dumpDirPath + LINUX_PATH_DELIM;
 
+        tempPtr = getenv("XDG_CACHE_HOME");
+        if (tempPtr && tempPtr[0] == '/')
+        {
+            g_UserPaths.m_catalogCachePath = string(tempPtr) + "/dbfs";
+        }
+        else if ((tempPtr = getenv("HOME")) && tempPtr[0] == '/')
+        {
+            g_UserPaths.m_catalogCachePath = string(tempPtr) + "/.cache/dbfs";
+        }
+
+        g_UserPaths.m_sharedSnapshotPath = "/dev/shm";
+
         mountSet = false;
         confSet = false;
     }
@@ -166,7 +211,7 @@ ParseArguments(
     while (status)
     {
         idx = 0;
-        option = getopt_long(argc, argv, "m:c:d:hvfl:", long_options, &idx);
+        option = getopt_long(argc, argv, "m:c:d:hvfsl:L:C:S:R:", long_options, &idx);
 
         if (option == -1)
         {
@@ -218,6 +263,10 @@ ParseArguments(
             g_RunInForeground = true;
             break;
 
+        case 's':
+            g_RunSingleThreaded = true;
+            break;
+
         case 'l':
             tempPtr = realpath(optarg, NULL);
             if (tempPtr)
@@ -228,6 +277,55 @@ ParseArguments(
             }
             break;
 
+        case 'L':
+            if (!ParseLogLevel(optarg, g_LogLevel))
+            {
+                fprintf(stderr, "ERROR - Unknown log level - %s\n", optarg);
+                status = false;
+            }
+            break;
+
+        case 'C':
+            g_UserPaths.m_catalogCachePath.clear();
+            if (optarg[0] != '\0')
+            {
+                tempPtr = realpath(optarg, NULL);
+                if (!tempPtr)
+                {
+                    fprintf(stderr, "ERROR - Catalog cache directory not found - %s\n", optarg);
+                    status = false;
+                    break;
+                }
+
+                g_UserPaths.m_catalogCachePath = tempPtr;
+                free(tempPtr);
+            }
+            break;
+
+        case 'S':
+            tempPtr = realpath(optarg, NULL);
+            if (!tempPtr)
+            {
+                fprintf(stderr, "ERROR - Shared snapshot directory not found - %s\n", optarg);
+                status = false;
+                break;
+            }
+
+            g_UserPaths.m_sharedSnapshotPath = tempPtr;
+            free(tempPtr);
+            break;
+
+        case 'R':
+            if (!convertToSize(optarg, resultMemory))
+            {
+                fprintf(stderr, "ERROR - Invalid result memory - %s\n", optarg);
+                status = false;
+                break;
+            }
+
+            SetResultMemoryLimit(resultMemory);
+            break;
+
         default:
             fprintf(stderr, "ERROR - Unknown argument passed - %c\n", option);
             status = false;
@@ -382,7 +480,7 @@ CheckAllSetPaths(void)
 //
 static bool
 ParseSectionEntry(
-    map<std::string, SectionNameValuePair>::iterator sectionItr,
+    SectionList::const_iterator sectionItr,
     const string& entryName,
     string& entryValue,
     bool optional = false)
@@ -453,6 +551,392 @@ convertToInt(
     return status;
 }
 
+// ---------------------------------------------------------------------------
+// Method: convertToDouble
+//
+// Description:
+//    This method interprets the decimal value of the provided string.
+//
+// Returns:
+//    bool
+//
+static bool
+convertToDouble(
+    string str,
+    double& doubleVal)
+{
+    bool status = true;
+
+    try
+    {
+        doubleVal = stod(str);
+    }
+    // stod may throw std::invalid_argument or std::out_of_range
+    //
+    catch (exception& e)
+    {
+        PrintMsg("Unable to convert string to double. Exception: %s\n", e.what());
+        status = false;
+    }
+
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Method: convertToBool
+//
+// Description:
+//    This method interprets the boolean value of the provided string.
+//    Accepted values are true/false, yes/no and 1/0 (case insensitive).
+//
+// Returns:
+//    bool
+//
+static bool
+convertToBool(
+    string str,
+    bool& boolVal)
+{
+    bool status = true;
+
+    str = StringToLower(str);
+    if (str == "true" || str == "yes" || str == "1")
+    {
+        boolVal = true;
+    }
+    else if (str == "false" || str == "no" || str == "0")
+    {
+        boolVal = false;
+    }
+    else
+    {
+        fprintf(stderr, "Invalid boolean value \"%s\".\n", str.c_str());
+        status = false;
+    }
+
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Method: convertToDuration
+//
+// Description:
+//    This method interprets a duration written as a number followed by an
+//    optional unit - "ms", "s" or "m". A number without a unit is taken
+//    as seconds. Example: 500ms, 2s, 5.
+//
+// Returns:
+//    bool
+//
+static bool
+convertToDuration(
+    string str,
+    std::chrono::milliseconds& duration)
+{
+    bool    status;
+    int     value;
+    size_t  unitPos;
+    string  unit;
+
+    unitPos = str.find_first_not_of("0123456789");
+    unit = (unitPos == string::npos) ? "" : Trim(str.substr(unitPos));
+
+    status = (unitPos != 0) && convertToInt(str.substr(0, unitPos), value);
+    if (status)
+    {
+        if (unit == "ms")
+        {
+            duration = std::chrono::milliseconds(value);
+        }
+        else if (unit.empty() || unit == "s")
+        {
+            duration = std::chrono::seconds(value);
+        }
+        else if (unit == "m")
+        {
+            duration = std::chrono::minutes(value);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown unit \"%s\" in duration \"%s\".\n",
+                unit.c_str(), str.c_str());
+            status = false;
+        }
+    }
+
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Method: convertToSize
+//
+// Description:
+//    This method interprets a size written as a number followed by an
+//    optional unit - "K", "M" or "G" (powers of 1024, with or without a
+//    trailing "B"). A number without a unit is taken as bytes. Example:
+//    512K, 64MB, 1G.
+//
+// Returns:
+//    bool
+//
+static bool
+convertToSize(
+    string str,
+    size_t& size)
+{
+    bool    status;
+    int     value;
+    size_t  unitPos;
+    string  unit;
+
+    unitPos = str.find_first_not_of("0123456789");
+    unit = (unitPos == string::npos) ? "" : StringToLower(Trim(str.substr(unitPos)));
+
+    status = (unitPos != 0) && convertToInt(str.substr(0, unitPos), value) && (value >= 0);
+    if (status)
+    {
+        if (unit.empty() || unit == "b")
+        {
+            size = value;
+        }
+        else if (unit == "k" || unit == "kb")
+        {
+            size = (size_t)value << 10;
+        }
+        else if (unit == "m" || unit == "mb")
+        {
+            size = (size_t)value << 20;
+        }
+        else if (unit == "g" || unit == "gb")
+        {
+            size = (size_t)value << 30;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown unit \"%s\" in size \"%s\".\n",
+                unit.c_str(), str.c_str());
+            status = false;
+        }
+    }
+
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ParseDurationEntries
+//
+// Description:
+//    This method reads a per-file duration setting of a server section:
+//    "<name>" applies to all the files of the server and "<name>.<file>"
+//    overrides it for the given DMV (or custom query). For example
+//    "cacheTTL" and "cacheTTL.dm_exec_requests". serverValue is left
+//    unchanged if the section does not set it.
+//
+// Returns:
+//    bool
+//
+static bool
+ParseDurationEntries(
+    SectionList::const_iterator sectionItr,
+    const string& name,
+    std::chrono::milliseconds& serverValue,
+    unordered_map<string, std::chrono::milliseconds>& fileValues)
+{
+    const string                prefix = name + ".";
+    std::chrono::milliseconds   duration;
+    string                      value;
+    bool                        status;
+
+    fileValues.clear();
+
+    status = ParseSectionEntry(sectionItr, name, value, true);
+    if (status && !value.empty())
+    {
+        status = convertToDuration(value, serverValue);
+    }
+
+    for (auto&& entry : sectionItr->second)
+    {
+        if (!status)
+        {
+            break;
+        }
+
+        if (IsPrefix(prefix, entry.first) == 0)
+        {
+            status = convertToDuration(entry.second, duration);
+            if (status)
+            {
+                fileValues[entry.first.substr(prefix.length())] = duration;
+            }
+        }
+    }
+
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ParsePrefetchEntries
+//
+// Description:
+//    This method reads the prefetch setting of a server section - a comma
+//    separated list of <DMV file>:<interval>, for example
+//    "dm_exec_requests:2s,dm_os_wait_stats.json:10s".
+//
+// Returns:
+//    bool
+//
+static bool
+ParsePrefetchEntries(
+    SectionList::const_iterator sectionItr,
+    vector<PrefetchEntry>& entries)
+{
+    string          value;
+    vector<string>  parts;
+    PrefetchEntry   entry;
+    bool            status;
+
+    entries.clear();
+
+    status = ParseSectionEntry(sectionItr, "prefetch", value, true);
+
+    for (auto&& item : Split(value, ','))
+    {
+        if (!status)
+        {
+            break;
+        }
+
+        if (Trim(item).empty())
+        {
+            continue;
+        }
+
+        parts = SplitLast(Trim(item), ':');
+        status = (parts.size() == 2) && !Trim(parts[0]).empty() &&
+                 convertToDuration(Trim(parts[1]), entry.m_interval) &&
+                 entry.m_interval.count() > 0;
+        if (status)
+        {
+            entry.m_filename = Trim(parts[0]);
+            entries.push_back(entry);
+        }
+        else
+        {
+            fprintf(stderr, "Invalid prefetch entry \"%s\" - expected <DMV file>:<interval>.\n",
+                item.c_str());
+        }
+    }
+
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ParseDeltaKeyEntries
+//
+// Description:
+//    This method reads the delta files of a server section. Each
+//    "deltaKeys.<DMV name>" entry gives the comma separated key columns of
+//    a DMV that gets a delta file, for example
+//    "deltaKeys.dm_db_index_usage_stats=database_id,object_id,index_id".
+//    An empty value removes the delta file of one of the default DMVs.
+//
+// Returns:
+//    bool
+//
+static bool
+ParseDeltaKeyEntries(
+    SectionList::const_iterator sectionItr,
+    unordered_map<string, vector<string>>& deltaKeys)
+{
+    const string    prefix = "deltaKeys.";
+    vector<string>  keys;
+
+    deltaKeys = GetDefaultDeltaKeys();
+
+    for (auto&& entry : sectionItr->second)
+    {
+        if (IsPrefix(prefix, entry.first) != 0)
+        {
+            continue;
+        }
+
+        keys.clear();
+        for (auto&& key : Split(entry.second, ','))
+        {
+            if (!Trim(key).empty())
+            {
+                keys.push_back(Trim(key));
+            }
+        }
+
+        if (keys.empty())
+        {
+            deltaKeys.erase(entry.first.substr(prefix.length()));
+        }
+        else
+        {
+            deltaKeys[entry.first.substr(prefix.length())] = keys;
+        }
+    }
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: ParseBundleEntries
+//
+// Description:
+//    This method reads the bundles of a server section. Each
+//    "bundle.<name>" entry gives the comma separated DMV files read
+//    together in one round trip by bundle/<name>, for example
+//    "bundle.sessions=dm_exec_sessions,dm_exec_requests.json".
+//
+// Returns:
+//    bool
+//
+static bool
+ParseBundleEntries(
+    SectionList::const_iterator sectionItr,
+    map<string, vector<string>>& bundles)
+{
+    const string    prefix = "bundle.";
+    string          name;
+    vector<string>  members;
+
+    bundles.clear();
+
+    for (auto&& entry : sectionItr->second)
+    {
+        if (IsPrefix(prefix, entry.first) != 0)
+        {
+            continue;
+        }
+
+        name = entry.first.substr(prefix.length());
+
+        members.clear();
+        for (auto&& member : Split(entry.second, ','))
+        {
+            if (!Trim(member).empty())
+            {
+                members.push_back(Trim(member));
+            }
+        }
+
+        if (name.empty() || name.find('/') != string::npos || members.empty())
+        {
+            fprintf(stderr, "Invalid bundle entry \"%s\" - expected bundle.<name>=<DMV file>,...\n",
+                entry.first.c_str());
+            return false;
+        }
+
+        bundles[name] = members;
+    }
+
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // Method: QueryUserForPassword
 //
@@ -521,8 +1005,38 @@ QueryUserForPassword(
 //    password=<>
 //    version=<>
 //
+//    Optional entries:
+//    customQueriesPath=<>
+//    connectionPoolSize=<>         (default 4)
+//    connectionIdleTimeout=<sec>   (default 60)
+//    cacheTTL=<duration>           (default 0 - not cached)
+//    cacheTTL.<DMV name>=<duration>
+//    queryTimeout=<duration>       (default 30s, 0 - no limit)
+//    queryTimeout.<DMV or custom query name>=<duration>
+//    streamResults=<true/false>    (default false)
+//    queryStatistics=<true/false>  (default false)
+//    pageCache=<true/false>        (default false)
+//    volatileFiles=<DMV>,<DMV>...
+//    prefetch=<DMV file>:<interval>,...
+//    historyMemory=<size>          (default 0 - no history)
+//    deltaKeys.<DMV name>=<column>,<column>...
+//    bundle.<name>=<DMV file>,<DMV file>...
+//    sharedSnapshots=<true/false>  (default false)
+//    sharedSnapshotMemory=<size>   (default 64MB)
+//    rateLimit=<queries/sec>       (default 0 - no limit)
+//    rateBurst=<queries>           (default rateLimit, at least 1)
+//    maxConcurrentQueries=<>       (default 0 - no limit)
+//    adaptiveThrottle=<true/false> (default false)
+//
 //    All entries must be under a [server] block
 //
+//    With reload set, the servers are already mounted: sections that did
+//    not change since the last load are skipped, the servers of new or
+//    changed sections are verified and replace the running ones, and the
+//    servers whose section is gone are removed. A server that fails its
+//    verification keeps running with its previous section. The user is
+//    not asked for missing passwords.
+//
 //    - Using the BOOST program_options library. 
 //    - Given the above format, this library will read the file and segment it
 //      into the following options:
@@ -537,10 +1051,10 @@ QueryUserForPassword(
 //    bool
 //
 static bool
-ParseConfigFile(void)
+ParseConfigFile(
+    bool reload)
 { 
     INIFile         ini;
-    SectionList     sections;
     ServerInfo*     serverInfoEntry;
     string          serverName;
     string          hostname;
@@ -548,16 +1062,52 @@ ParseConfigFile(void)
     string          password;    
     string          version;
     string          customQueriesPath;
+    string          poolSize;
+    string          poolIdleTimeout;
     int             versionInt;
+    int             poolSizeInt;
+    int             poolIdleTimeoutInt;
+    string          streamResults;
+    bool            streamResultsBool;
+    string          queryStatistics;
+    bool            queryStatisticsBool;
+    string          usePageCache;
+    bool            usePageCacheBool;
+    string          volatileFiles;
+    unordered_set<string>                               volatileFileSet;
+    std::chrono::milliseconds                           cacheTtl;
+    unordered_map<string, std::chrono::milliseconds>    fileCacheTtl;
+    std::chrono::milliseconds                           queryTimeout;
+    unordered_map<string, std::chrono::milliseconds>    fileQueryTimeout;
+    vector<PrefetchEntry>                               prefetchEntries;
+    unordered_map<string, vector<string>>               deltaKeys;
+    map<string, vector<string>>                         bundles;
+    string                                              sharedSnapshots;
+    bool                                                sharedSnapshotsBool;
+    string                                              sharedSnapshotMemory;
+    size_t                                              sharedSnapshotMemorySize;
+    string                                              historyMemory;
+    size_t                                              historyMemorySize;
+    string                                              rateLimit;
+    double                                              rateLimitValue;
+    string                                              rateBurst;
+    double                                              rateBurstValue;
+    string                                              maxConcurrentQueries;
+    int                                                 maxConcurrentQueriesInt;
+    string                                              adaptiveThrottle;
+    bool                                                adaptiveThrottleBool;
     int             itrNum = 0;
-    map<std::string, SectionNameValuePair>::iterator sectionItr;
+    SectionList::const_iterator sectionItr;
+    vector<pair<string, ServerInfo*>>   pendingServers;
+    vector<char>                        verified;
+    std::chrono::steady_clock::time_point startTime;
     bool status;
 
     ini.LoadFile(g_UserPaths.m_confPath);
 
     // Fetch all the sections
     //
-    sections = ini.GetSections();
+    const SectionList& sections = ini.GetSections();
 
     // Iterate over the sections
     //
@@ -569,6 +1119,16 @@ ParseConfigFile(void)
         // are created.
         //
         serverName = sectionItr->first;
+
+        if (reload)
+        {
+            auto known = g_ServerSections.find(serverName);
+            if (known != g_ServerSections.end() && known->second == sectionItr->second)
+            {
+                continue;
+            }
+        }
+
         if (serverName.length())
         {
             PrintMsg("%d: Processing entry for section %s in configuration file:\n",
@@ -611,43 +1171,232 @@ ParseConfigFile(void)
             }
             if (status)
             {
-                status = ParseSectionEntry(sectionItr, "password", password);
+                poolSizeInt = SQLFS_DEFAULT_POOL_SIZE;
+                status = ParseSectionEntry(sectionItr, "connectionPoolSize", poolSize, true);
+                if (status && !poolSize.empty())
+                {
+                    status = convertToInt(poolSize, poolSizeInt) && (poolSizeInt > 0);
+                }
+            }
+            if (status)
+            {
+                poolIdleTimeoutInt = SQLFS_DEFAULT_POOL_IDLE_TIMEOUT_SEC;
+                status = ParseSectionEntry(sectionItr, "connectionIdleTimeout", poolIdleTimeout, true);
+                if (status && !poolIdleTimeout.empty())
+                {
+                    status = convertToInt(poolIdleTimeout, poolIdleTimeoutInt) && (poolIdleTimeoutInt >= 0);
+                }
+            }
+            if (status)
+            {
+                rateLimitValue = 0;
+                status = ParseSectionEntry(sectionItr, "rateLimit", rateLimit, true);
+                if (status && !rateLimit.empty())
+                {
+                    status = convertToDouble(rateLimit, rateLimitValue) && (rateLimitValue >= 0);
+                }
+            }
+            if (status)
+            {
+                rateBurstValue = ceil(rateLimitValue);
+                status = ParseSectionEntry(sectionItr, "rateBurst", rateBurst, true);
+                if (status && !rateBurst.empty())
+                {
+                    status = convertToDouble(rateBurst, rateBurstValue) && (rateBurstValue >= 1);
+                }
+            }
+            if (status)
+            {
+                maxConcurrentQueriesInt = 0;
+                status = ParseSectionEntry(sectionItr, "maxConcurrentQueries", maxConcurrentQueries, true);
+                if (status && !maxConcurrentQueries.empty())
+                {
+                    status = convertToInt(maxConcurrentQueries, maxConcurrentQueriesInt) &&
+                             (maxConcurrentQueriesInt >= 0);
+                }
+            }
+            if (status)
+            {
+                adaptiveThrottleBool = false;
+                status = ParseSectionEntry(sectionItr, "adaptiveThrottle", adaptiveThrottle, true);
+                if (status && !adaptiveThrottle.empty())
+                {
+                    status = convertToBool(adaptiveThrottle, adaptiveThrottleBool);
+                }
 
-                // Query user for password in case nothing in config file
+                // Adaptive mode scales the concurrency down from the size
+                // of the pool if it has no cap of its own.
                 //
-                if (!status)
+                if (status && adaptiveThrottleBool && maxConcurrentQueriesInt == 0)
                 {
-                    status = QueryUserForPassword(serverName, password);
+                    maxConcurrentQueriesInt = poolSizeInt;
                 }
             }
-
-            // Check if the credentials and/or IP are correct
-            //
             if (status)
             {
-                status = VerifyServerInfo(hostname, username, password);
+                cacheTtl = std::chrono::milliseconds(0);
+                status = ParseDurationEntries(sectionItr, "cacheTTL", cacheTtl, fileCacheTtl);
+            }
+            if (status)
+            {
+                queryTimeout = std::chrono::seconds(SQLFS_DEFAULT_QUERY_TIMEOUT_SEC);
+                status = ParseDurationEntries(sectionItr, "queryTimeout", queryTimeout, fileQueryTimeout);
+            }
+            if (status)
+            {
+                streamResultsBool = false;
+                status = ParseSectionEntry(sectionItr, "streamResults", streamResults, true);
+                if (status && !streamResults.empty())
+                {
+                    status = convertToBool(streamResults, streamResultsBool);
+                }
+            }
+            if (status)
+            {
+                queryStatisticsBool = false;
+                status = ParseSectionEntry(sectionItr, "queryStatistics", queryStatistics, true);
+                if (status && !queryStatistics.empty())
+                {
+                    status = convertToBool(queryStatistics, queryStatisticsBool);
+                }
+            }
+            if (status)
+            {
+                usePageCacheBool = false;
+                status = ParseSectionEntry(sectionItr, "pageCache", usePageCache, true);
+                if (status && !usePageCache.empty())
+                {
+                    status = convertToBool(usePageCache, usePageCacheBool);
+                }
+            }
+            if (status)
+            {
+                volatileFileSet.clear();
+                status = ParseSectionEntry(sectionItr, "volatileFiles", volatileFiles, true);
+                if (status && !volatileFiles.empty())
+                {
+                    for (auto&& name : Split(volatileFiles, ','))
+                    {
+                        if (!Trim(name).empty())
+                        {
+                            volatileFileSet.insert(Trim(name));
+                        }
+                    }
+                }
+            }
+            if (status)
+            {
+                status = ParsePrefetchEntries(sectionItr, prefetchEntries);
+            }
+            if (status)
+            {
+                historyMemorySize = 0;
+                status = ParseSectionEntry(sectionItr, "historyMemory", historyMemory, true);
+                if (status && !historyMemory.empty())
+                {
+                    status = convertToSize(historyMemory, historyMemorySize);
+                }
+                if (status && historyMemorySize && prefetchEntries.empty())
+                {
+                    PrintMsg("historyMemory of server %s has no effect without prefetch\n",
+                        serverName.c_str());
+                }
+            }
+            if (status)
+            {
+                sharedSnapshotsBool = false;
+                status = ParseSectionEntry(sectionItr, "sharedSnapshots", sharedSnapshots, true);
+                if (status && !sharedSnapshots.empty())
+                {
+                    status = convertToBool(sharedSnapshots, sharedSnapshotsBool);
+                }
+                if (status && sharedSnapshotsBool && prefetchEntries.empty())
+                {
+                    PrintMsg("sharedSnapshots of server %s has no effect without prefetch\n",
+                        serverName.c_str());
+                }
+            }
+            if (status)
+            {
+                sharedSnapshotMemorySize = SHARED_SNAPSHOT_DEFAULT_SIZE;
+                status = ParseSectionEntry(sectionItr, "sharedSnapshotMemory", sharedSnapshotMemory, true);
+                if (status && !sharedSnapshotMemory.empty())
+                {
+                    status = convertToSize(sharedSnapshotMemory, sharedSnapshotMemorySize);
+                }
+            }
+            if (status)
+            {
+                status = ParseDeltaKeyEntries(sectionItr, deltaKeys);
+            }
+            if (status)
+            {
+                status = ParseBundleEntries(sectionItr, bundles);
+            }
+            if (status)
+            {
+                status = ParseSectionEntry(sectionItr, "password", password);
+
+                // Query user for password in case nothing in config file -
+                // unless nobody is there to answer.
+                //
+                if (!status && !reload)
+                {
+                    status = QueryUserForPassword(serverName, password);
+                }
             }
 
-            // Record this entry
+            // Record this entry. It is added to the global map once the
+            // server is verified below.
             //
             if (status)
             {
                 serverInfoEntry = new ServerInfo();
                 assert(serverInfoEntry);
 
-                PrintMsg("SUCCESSFULLY added entry for server %s.\n", serverName.c_str());
-
-                // Adding entry to the global server information map
-                //
-                g_ServerInfoMap.insert(make_pair(serverName, serverInfoEntry));
-
-                // Fill in the global map with server information.
-                //
                 serverInfoEntry->m_hostname = hostname;
                 serverInfoEntry->m_username = username;
                 serverInfoEntry->m_password = password;
                 serverInfoEntry->m_version = versionInt;
                 serverInfoEntry->m_customQueriesPath = customQueriesPath;
+                serverInfoEntry->m_connectionPool = new ConnectionPool(hostname,
+                                                                       username,
+                                                                       password,
+                                                                       poolSizeInt,
+                                                                       poolIdleTimeoutInt,
+                                                                       GetServerStats(serverName));
+                serverInfoEntry->m_streamResults = streamResultsBool;
+                serverInfoEntry->m_queryStatistics = queryStatisticsBool;
+                serverInfoEntry->m_throttle =
+                    (rateLimitValue == 0 && maxConcurrentQueriesInt == 0) ? NULL :
+                    new QueryThrottle(serverName,
+                                      rateLimitValue,
+                                      rateBurstValue,
+                                      maxConcurrentQueriesInt,
+                                      adaptiveThrottleBool,
+                                      GetServerStats(serverName));
+                serverInfoEntry->m_resultCache = new ResultCache(GetServerStats(serverName),
+                                                                 serverInfoEntry->m_throttle);
+                serverInfoEntry->m_cacheTtl = cacheTtl;
+                serverInfoEntry->m_fileCacheTtl = fileCacheTtl;
+                serverInfoEntry->m_queryTimeout = queryTimeout;
+                serverInfoEntry->m_fileQueryTimeout = fileQueryTimeout;
+                serverInfoEntry->m_usePageCache = usePageCacheBool;
+                serverInfoEntry->m_volatileFiles = volatileFileSet;
+                serverInfoEntry->m_bundles = bundles;
+                serverInfoEntry->m_prefetcher = prefetchEntries.empty() ? NULL :
+                    new Prefetcher(serverName, serverInfoEntry, prefetchEntries);
+                serverInfoEntry->m_history = (historyMemorySize == 0) ? NULL :
+                    new HistoryStore(serverName, historyMemorySize);
+                serverInfoEntry->m_sharedSnapshots = !sharedSnapshotsBool ? NULL :
+                    new SharedSnapshotStore(serverName,
+                                            SharedSnapshotStore::GetPath(g_UserPaths.m_sharedSnapshotPath,
+                                                                         hostname, username),
+                                            sharedSnapshotMemorySize);
+                serverInfoEntry->m_deltaTracker = new DeltaTracker(serverName, deltaKeys);
+                serverInfoEntry->m_catalog = new DmvCatalog(serverName, serverInfoEntry);
+
+                pendingServers.push_back(make_pair(serverName, serverInfoEntry));
             }
             else
             {
@@ -656,20 +1405,125 @@ ParseConfigFile(void)
         }
     }
 
-    // Return false only if there were no entries added to the global server information map
+    // Check if the credentials and/or IP are correct. Every check is a
+    // login which can take up to SQLFS_MAX_LOGIN_TIMEOUT_SEC for a host
+    // that is down, so several servers are checked at a time.
+    //
+    verified.assign(pendingServers.size(), false);
+    startTime = std::chrono::steady_clock::now();
+
+    RunInParallel(pendingServers.size(), SQLFS_MAX_STARTUP_WORKERS,
+        [&pendingServers, &verified](size_t item)
+        {
+            auto serverStart = std::chrono::steady_clock::now();
+
+            verified[item] = VerifyServerInfo(pendingServers[item].second);
+
+            PrintMsg("Verified server %s in %lld ms - %s\n",
+                pendingServers[item].first.c_str(), ElapsedMs(serverStart),
+                verified[item] ? "succeeded" : "failed");
+        });
+
+    PrintMsg("Verified %zu server(s) in %lld ms\n",
+        pendingServers.size(), ElapsedMs(startTime));
+
+    // The catalog check runs on the servers of the map - it is paused
+    // while servers are replaced.
     //
-    if (g_ServerInfoMap.size())
+    if (reload)
     {
-        status = true;
+        StopCatalogRefresh();
     }
-    else
+
+    for (size_t i = 0; i < pendingServers.size(); i++)
     {
-        status = false;
+        serverName = pendingServers[i].first;
+        serverInfoEntry = pendingServers[i].second;
+
+        if (verified[i])
+        {
+            PrintMsg("SUCCESSFULLY added entry for server %s.\n", serverName.c_str());
+
+            // Adding entry to the global server information map
+            //
+            if (reload)
+            {
+                AddServer(serverName, serverInfoEntry);
+            }
+            else
+            {
+                std::lock_guard<std::mutex> guard(g_ServerInfoMapLock);
+                g_ServerInfoMap.insert(make_pair(serverName, shared_ptr<ServerInfo>(serverInfoEntry)));
+            }
+            g_ServerSections[serverName] = sections.at(serverName);
+        }
+        else
+        {
+            PrintMsg("FAILED to add entry for server %s. Ignoring it.\n", serverName.c_str());
+
+            DeleteServerInfo(serverInfoEntry);
+        }
+    }
+
+    // Servers that are no longer in the config file.
+    //
+    for (auto itr = g_ServerSections.begin(); reload && itr != g_ServerSections.end();)
+    {
+        if (sections.count(itr->first) == 0)
+        {
+            PrintMsg("REMOVED entry for server %s.\n", itr->first.c_str());
+
+            RemoveServer(itr->first);
+            itr = g_ServerSections.erase(itr);
+        }
+        else
+        {
+            ++itr;
+        }
+    }
+
+    if (reload)
+    {
+        StartCatalogRefresh();
+    }
+
+    // Return false only if there were no entries added to the global server information map
+    //
+    {
+        std::lock_guard<std::mutex> guard(g_ServerInfoMapLock);
+        status = !g_ServerInfoMap.empty();
     }
 
     return status;
 }
 
+// ---------------------------------------------------------------------------
+// Method: ReloadConfigFile
+//
+// Description:
+//    This method applies the changes of the config file to the running
+//    mount. A config file that cannot be parsed changes nothing.
+//
+// Returns:
+//    VOID
+//
+static void
+ReloadConfigFile()
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    try
+    {
+        ParseConfigFile(true);
+
+        PrintMsg("Reloaded config file in %lld ms\n", ElapsedMs(startTime));
+    }
+    catch (exception& e)
+    {
+        LogMsg(LOG_LEVEL_ERROR, "Config file not reloaded - %s\n", e.what());
+    }
+}
+
 // ---------------------------------------------------------------------------
 // Method: FatalSignalHandler
 //
@@ -738,7 +1592,6 @@ main(
     char* argv[])
 {
     int result = 0;
-    FILE* filePtr;
     bool status;
 
     // Rejecting request if root is trying to run this.
@@ -762,25 +1615,33 @@ main(
 
         // Open the log-file path if given and in verbose mode.
         //
-        if (g_InVerbose && g_UseLogFile)
+        status = OpenLogFile();
+        if (!status)
         {
-            filePtr = fopen(g_UserPaths.m_logfilePath.c_str(), "w");
-            if (!filePtr)
-            {
-                fprintf(stderr, "Provided log path is incorrect. "
-                    "Unable to create / open a file at that path\n"
-                    "Exiting..\n");
+            fprintf(stderr, "Provided log path is incorrect. "
+                "Unable to create / open a file at that path\n"
+                "Exiting..\n");
 
-                result = -1;
-            }
-            
-            fclose(filePtr);
+            result = -1;
+        }
+    }
+
+    // DB-Library is initialized once for the process. Server connections
+    // are pooled and stay open across queries.
+    //
+    if (!result)
+    {
+        status = InitializeDBLibrary();
+        if (!status)
+        {
+            fprintf(stderr, "Unable to initialize DB-Library.\n");
+            result = -1;
         }
     }
 
     if (!result)
     {
-        status = ParseConfigFile();
+        status = ParseConfigFile(false);
         if (!status)
         {
             fprintf(stderr, "Error in the config file content.\n");
@@ -788,11 +1649,18 @@ main(
         }
     }
 
+    if (!result)
+    {
+        SetConfigReloadHandler(ReloadConfigFile);
+    }
+
     if (!result)
     {
         result = StartFuse(argv[0]);
     }
 
+    CloseLogFile();
+
     return result;
 }
 
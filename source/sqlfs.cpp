@@ -13,11 +13,604 @@
 
 #include "UtilsPrivate.h"
 
+// ---------------------------------------------------------------------------
+// Structure: FileHandle
+//
+// Description:
+//    Per-open state of a file. A pointer to it is saved in
+//    fuse_file_info::fh by OpenLocalImpl and freed by ReleaseLocalImpl.
+//
+//    The content of a dbfs file (DMV or custom query output) is held in
+//    memory and shared with the result cache - the file in the dump
+//    directory is never written. The handle is registered as a reader of
+//    the content so that a streaming query is cancelled once all of its
+//    readers are gone. Reads of all the other files are served from the
+//    dump directory file descriptor.
+//
+struct FileHandle
+{
+    int             m_fd;           // Dump directory fd, -1 for dbfs files
+    bool            m_isDbfsFile;   // Content is a query result
+    QueryResult     m_content;      // Query result for dbfs files
+};
+
+// Results of a page cached file - the one whose size the last getattr
+// reported, and the one last handed to an open that read through the
+// page cache.
+//
+struct PageCachedContent
+{
+    std::weak_ptr<ResultBuffer>     m_sized;
+    std::weak_ptr<ResultBuffer>     m_opened;
+};
+
+// Results of each page cached file. Used to decide whether an open can
+// read through the page cache, and whether the pages the kernel cached
+// for the file are still valid.
+//
+static unordered_map<string, PageCachedContent> g_PageCachedContent;
+static std::mutex g_PageCachedContentLock;
+
+static int GetDmvFileContent(
+    const VirtualEntry& entry,
+    QueryResult& content);
+
+// Whether the mount handles FUSE interrupts - set by StartFuse. The
+// benchmarks call the operations directly, outside of a FUSE request.
+//
+static bool g_HandleInterrupts = false;
+
+// Set while the thread serves a FUSE request that can be interrupted.
+//
+static thread_local bool t_InInterruptibleRequest = false;
+
+// ---------------------------------------------------------------------------
+// Structure: InterruptibleRequest
+//
+// Description:
+//    Marks the calling FUSE thread as serving a request that can be
+//    interrupted (the reader got a signal, e.g. Ctrl-C on cat) for as
+//    long as it is in scope. The queries run for the request on this
+//    thread are then cancelled on interrupt - see IsRequestInterrupted.
+//
+struct InterruptibleRequest
+{
+    InterruptibleRequest()
+    {
+        t_InInterruptibleRequest = true;
+    }
+
+    ~InterruptibleRequest()
+    {
+        t_InInterruptibleRequest = false;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Method: IsRequestInterrupted
+//
+// Description:
+//    This method checks whether the FUSE request served by the calling
+//    thread was interrupted. fuse_interrupted is only called on threads
+//    serving a request - it has no request to look at on the others.
+//
+// Returns:
+//    bool
+//
+static bool
+IsRequestInterrupted()
+{
+    return g_HandleInterrupts && t_InInterruptibleRequest && fuse_interrupted();
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetFileHandle
+//
+// Description:
+//    This method gets the FileHandle saved in fuse_file_info.
+//
+// Returns:
+//    FileHandle pointer (NULL if the file is not open).
+//
+static FileHandle*
+GetFileHandle(
+    struct fuse_file_info* fi)
+{
+    return fi ? (FileHandle*)(fi->fh) : NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsDmvEntry
+//
+// Returns:
+//    true if the entry is a DMV file (in any form).
+//
+static bool
+IsDmvEntry(
+    const VirtualEntry& entry)
+{
+    return entry.m_type == ENTRY_DMV ||
+           entry.m_type == ENTRY_JSON_DMV ||
+           entry.m_type == ENTRY_CSV_DMV ||
+           entry.m_type == ENTRY_NDJSON_DMV;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetDmvEntryFormat
+//
+// Returns:
+//    The format of a DMV file.
+//
+static FileFormat
+GetDmvEntryFormat(
+    const VirtualEntry& entry)
+{
+    switch (entry.m_type)
+    {
+    case ENTRY_JSON_DMV:
+        return TYPE_JSON;
+
+    case ENTRY_CSV_DMV:
+        return TYPE_CSV;
+
+    case ENTRY_NDJSON_DMV:
+        return TYPE_NDJSON;
+
+    default:
+        return TYPE_TSV;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: LoadDmvCatalogs
+//
+// Description:
+//    This method makes sure the DMV files are in the tree for a path in a
+//    server folder or in the fan-out folder, which needs the catalogs of
+//    all the servers. The first path component is the folder; if
+//    withFolder is false a path that is just the folder loads nothing
+//    (so that listing the mount directory is not a discovery).
+//
+// Returns:
+//    true if a catalog may have been loaded - otherwise false.
+//
+static bool
+LoadDmvCatalogs(
+    const string& path,
+    bool withFolder)
+{
+    size_t                  end = path.find('/', 1);
+    string                  folder;
+    shared_ptr<ServerInfo>  serverInfo;
+
+    if (path.size() < 2 || (end == string::npos && !withFolder))
+    {
+        return false;
+    }
+
+    folder = path.substr(1, (end == string::npos) ? string::npos : end - 1);
+
+    if (folder == FANOUT_FOLDER_NAME && !GetServerInfo(FANOUT_FOLDER_NAME))
+    {
+        LoadAllDmvCatalogs();
+        return true;
+    }
+
+    serverInfo = GetServerInfo(folder);
+    if (!serverInfo)
+    {
+        return false;
+    }
+
+    serverInfo->m_catalog->EnsureLoaded();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Method: LookupCustomQueryCall
+//
+// Description:
+//    This method makes up the entry of a custom query file opened with
+//    arguments - <query file>@<arguments> - if the arguments are valid
+//    for the parameters of the query.
+//
+// Returns:
+//    The entry or NULL.
+//
+static VirtualEntryPtr
+LookupCustomQueryCall(
+    const string& path)
+{
+    size_t          slash = path.find_last_of('/');
+    string          filename = path.substr(slash + 1);
+    string          queryName;
+    string          arguments;
+    VirtualEntryPtr queryEntry;
+
+    if (!SplitCustomQueryCall(filename, queryName, arguments))
+    {
+        return VirtualEntryPtr();
+    }
+
+    queryEntry = g_VirtualTree.Lookup(path.substr(0, slash + 1) + queryName);
+    if (!queryEntry || queryEntry->m_type != ENTRY_CUSTOM_QUERY ||
+        !ValidateCustomQueryCall(StringFormat("%s/%s",
+                                     GetUserCustomQueryPath(queryEntry->m_servername).c_str(),
+                                     queryName.c_str()),
+                                 arguments))
+    {
+        return VirtualEntryPtr();
+    }
+
+    auto callEntry = make_shared<VirtualEntry>();
+
+    callEntry->m_type = ENTRY_CUSTOM_QUERY;
+    callEntry->m_servername = queryEntry->m_servername;
+    callEntry->m_name = filename;
+    callEntry->m_mtime = time(NULL);
+
+    return callEntry;
+}
+
+// ---------------------------------------------------------------------------
+// Method: LookupCustomQueryStatistics
+//
+// Description:
+//    This method makes up the entry of the statistics file of a custom
+//    query (or of a call with arguments) - <query file>.stats - if the
+//    server has the queryStatistics setting. Like views, these files are
+//    not listed by readdir.
+//
+// Returns:
+//    The entry or NULL.
+//
+static VirtualEntryPtr
+LookupCustomQueryStatistics(
+    const string& path)
+{
+    const size_t            suffixLength = sizeof(CUSTOM_QUERY_STATISTICS_SUFFIX) - 1;
+    string                  queryPath;
+    VirtualEntryPtr         queryEntry;
+    shared_ptr<ServerInfo>  serverInfo;
+
+    if (path.length() <= suffixLength ||
+        path.compare(path.length() - suffixLength, suffixLength, CUSTOM_QUERY_STATISTICS_SUFFIX) != 0)
+    {
+        return VirtualEntryPtr();
+    }
+
+    queryPath = path.substr(0, path.length() - suffixLength);
+    queryEntry = g_VirtualTree.Lookup(queryPath);
+    if (!queryEntry)
+    {
+        queryEntry = LookupCustomQueryCall(queryPath);
+    }
+
+    if (!queryEntry || queryEntry->m_type != ENTRY_CUSTOM_QUERY)
+    {
+        return VirtualEntryPtr();
+    }
+
+    serverInfo = GetServerInfo(queryEntry->m_servername);
+    if (!serverInfo || !serverInfo->m_queryStatistics)
+    {
+        return VirtualEntryPtr();
+    }
+
+    auto statisticsEntry = make_shared<VirtualEntry>(*queryEntry);
+
+    statisticsEntry->m_type = ENTRY_QUERY_STATISTICS;
+
+    return statisticsEntry;
+}
+
+// ---------------------------------------------------------------------------
+// Method: LookupEntry
+//
+// Description:
+//    This method looks up the entry of a path in the virtual tree. A path
+//    not in the tree of the form <DMV file>?<parameters> is a view of that
+//    DMV file - if the parameters are valid an entry is made up for it.
+//    Views are not listed by readdir. Likewise a custom query file opened
+//    with arguments (<query file>@<arguments>) and the statistics file of
+//    a custom query (<query file>.stats) get a made-up entry.
+//
+//    A path missing from a server folder whose catalog is not loaded yet
+//    is looked up again after loading it.
+//
+// Returns:
+//    The entry or NULL if the path is not a DBFS file or directory.
+//
+static VirtualEntryPtr
+LookupEntry(
+    const char* path)
+{
+    VirtualEntryPtr entry = g_VirtualTree.Lookup(path);
+
+    if (!entry && LoadDmvCatalogs(path, false))
+    {
+        entry = g_VirtualTree.Lookup(path);
+    }
+
+    VirtualEntryPtr         dmvEntry;
+    string                  pathStr = path;
+    string                  filename;
+    size_t                  slash;
+    shared_ptr<ServerInfo>  serverInfo;
+    DmvView                 view;
+
+    if (!entry)
+    {
+        entry = LookupCustomQueryCall(pathStr);
+    }
+
+    if (!entry)
+    {
+        entry = LookupCustomQueryStatistics(pathStr);
+    }
+
+    if (entry || !IsDmvViewName(pathStr))
+    {
+        return entry;
+    }
+
+    slash = pathStr.find_last_of('/');
+    filename = pathStr.substr(slash + 1);
+
+    dmvEntry = g_VirtualTree.Lookup(
+        pathStr.substr(0, pathStr.length() - filename.length()) +
+        filename.substr(0, filename.find(DMV_VIEW_SEPARATOR)));
+
+    if (dmvEntry && IsDmvEntry(*dmvEntry))
+    {
+        serverInfo = GetServerInfo(dmvEntry->m_servername);
+
+        if (serverInfo &&
+            ParseDmvView(filename, view) &&
+            ValidateDmvView(serverInfo.get(), dmvEntry->m_servername, view))
+        {
+            auto viewEntry = make_shared<VirtualEntry>();
+
+            viewEntry->m_type = ENTRY_DMV_VIEW;
+            viewEntry->m_servername = dmvEntry->m_servername;
+            viewEntry->m_name = filename;
+            viewEntry->m_mtime = time(NULL);
+
+            entry = viewEntry;
+        }
+    }
+
+    return entry;
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsVirtualFile
+//
+// Description:
+//    This method checks if the path is a file of the virtual tree (a DMV,
+//    DMV view or custom query output file).
+//
+// Returns:
+//    true if it is a virtual file - otherwise false.
+//
+static bool
+IsVirtualFile(
+    const char* path)
+{
+    VirtualEntryPtr entry = LookupEntry(path);
+
+    return entry && entry->m_type != ENTRY_DIRECTORY;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetDmvFileName
+//
+// Description:
+//    This method gets the name of the file of a DMV entry - the DMV name,
+//    with the extension of its form.
+//
+// Returns:
+//    File name.
+//
+static string
+GetDmvFileName(
+    const VirtualEntry& entry)
+{
+    return entry.m_name + GetFileFormatExtension(GetDmvEntryFormat(entry));
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetCustomQueryName
+//
+// Description:
+//    This method gets the query file a custom query entry runs - the name
+//    before the @ for a call with arguments (unless a query file has that
+//    whole name).
+//
+// Returns:
+//    The name of the query file.
+//
+static string
+GetCustomQueryName(
+    const VirtualEntry& entry,
+    string& arguments)
+{
+    string queryName = entry.m_name;
+
+    arguments.clear();
+    if (!g_VirtualTree.Lookup(VirtualTree::JoinPath(GetCustomQueriesDirPath(entry.m_servername),
+                                                    entry.m_name)))
+    {
+        SplitCustomQueryCall(entry.m_name, queryName, arguments);
+    }
+
+    return queryName;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetEntryQueryStats
+//
+// Description:
+//    This method gets the statistics the queries of a file are counted
+//    in. All the views of a DMV file are counted together, and so are all
+//    the calls of a custom query file.
+//
+// Returns:
+//    QueryStats pointer - NULL if the file is not the result of a query.
+//
+static QueryStats*
+GetEntryQueryStats(
+    const VirtualEntry& entry)
+{
+    string arguments;
+
+    if (IsDmvEntry(entry))
+    {
+        return GetQueryStats(entry.m_servername, GetDmvFileName(entry));
+    }
+
+    switch (entry.m_type)
+    {
+    case ENTRY_DMV_VIEW:
+        return GetQueryStats(entry.m_servername,
+                             entry.m_name.substr(0, entry.m_name.find(DMV_VIEW_SEPARATOR) + 1));
+
+    case ENTRY_CUSTOM_QUERY:
+    case ENTRY_QUERY_STATISTICS:
+        return GetQueryStats(entry.m_servername, GetCustomQueryName(entry, arguments));
+
+    case ENTRY_BUNDLE:
+        return GetQueryStats(entry.m_servername, BUNDLE_FOLDER_NAME LINUX_PATH_DELIM + entry.m_name);
+
+    default:
+        return NULL;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Method: IsPageCached
+//
+// Description:
+//    This method checks if the file is served through the kernel page
+//    cache. That is the case for the DMV files of a server with the
+//    pageCache setting, as long as the DMV is cached (non-zero TTL) or
+//    prefetched, and not listed in volatileFiles. All other DBFS files
+//    use direct I/O because their size is not known before they are read.
+//
+// Returns:
+//    bool
+//
+static bool
+IsPageCached(
+    const VirtualEntry& entry,
+    const ServerInfo* serverInfo)
+{
+    return serverInfo && serverInfo->m_usePageCache &&
+           IsDmvEntry(entry) &&
+           serverInfo->m_volatileFiles.count(entry.m_name) == 0 &&
+           (GetCacheTtl(serverInfo, entry.m_name).count() > 0 ||
+            (serverInfo->m_prefetcher &&
+             serverInfo->m_prefetcher->IsPrefetched(GetDmvFileName(entry))));
+}
+
+// ---------------------------------------------------------------------------
+// Method: PeekDmvFileContent
+//
+// Description:
+//    This method gets the content of a page cached DMV file if it is at
+//    hand - its prefetched snapshot, or its result in the cache - without
+//    querying the server.
+//
+// Returns:
+//    true if content was set to a complete result.
+//
+static bool
+PeekDmvFileContent(
+    const VirtualEntry& entry,
+    const ServerInfo* serverInfo,
+    QueryResult& content)
+{
+    if (serverInfo->m_prefetcher)
+    {
+        content = serverInfo->m_prefetcher->GetSnapshot(GetDmvFileName(entry));
+        if (content && content->IsComplete())
+        {
+            return true;
+        }
+    }
+
+    return serverInfo->m_resultCache->Peek(
+        GetDmvCacheKey(entry.m_name, GetDmvEntryFormat(entry)),
+        GetCacheTtl(serverInfo, entry.m_name),
+        content);
+}
+
+// ---------------------------------------------------------------------------
+// Method: SetSizedContent
+//
+// Description:
+//    This method records the content whose size getattr reported for a
+//    page cached file - NULL if it reported no size.
+//
+// Returns:
+//    VOID
+//
+static void
+SetSizedContent(
+    const string& path,
+    const QueryResult& content)
+{
+    std::lock_guard<std::mutex> guard(g_PageCachedContentLock);
+
+    g_PageCachedContent[path].m_sized = content;
+}
+
+// ---------------------------------------------------------------------------
+// Method: UsePageCache
+//
+// Description:
+//    This method checks if an open of a page cached file can read through
+//    the page cache. That is only the case if the kernel has the size of
+//    the content handed to the open - the last getattr reported it. The
+//    content is then recorded as the one of the open, and keepCache tells
+//    whether it is the same result the previous open got, in which case
+//    the pages the kernel has cached for the file can be kept.
+//
+// Returns:
+//    true if the open reads through the page cache.
+//
+static bool
+UsePageCache(
+    const string& path,
+    const QueryResult& content,
+    bool& keepCache)
+{
+    std::lock_guard<std::mutex> guard(g_PageCachedContentLock);
+
+    auto& previous = g_PageCachedContent[path];
+
+    if (previous.m_sized.lock() != content)
+    {
+        return false;
+    }
+
+    keepCache = (previous.m_opened.lock() == content);
+    previous.m_opened = content;
+
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // Method: GetattrLocalImpl
 //
 // Description:
-//    This method redirects the getattr system call to the dump directory.
+//    This method resolves the getattr system call from the virtual tree,
+//    or redirects it to the dump directory for the other files.
+//
+//    The size of a page cached file is the size of its prefetched or
+//    cached result. getattr never queries - a file whose result is not
+//    at hand has no size, and its next open reads it with direct I/O
+//    (see UsePageCache).
 //
 // Returns:
 //    0 on success and -errno on error.
@@ -29,6 +622,33 @@ GetattrLocalImpl(
 {
     int     result;
     string  fpath;
+    VirtualEntryPtr entry;
+    QueryResult content;
+    shared_ptr<ServerInfo> serverInfo;
+
+    entry = LookupEntry(path);
+    if (entry)
+    {
+        VirtualTree::FillStat(*entry, stbuf);
+
+        serverInfo = GetServerInfo(entry->m_servername);
+        if (IsPageCached(*entry, serverInfo.get()))
+        {
+            if (!PeekDmvFileContent(*entry, serverInfo.get(), content))
+            {
+                content.reset();
+            }
+            SetSizedContent(path, content);
+
+            if (content)
+            {
+                stbuf->st_size = content->GetSize();
+                stbuf->st_blocks = (stbuf->st_size + 511) / 512;
+            }
+        }
+
+        return 0;
+    }
 
     fpath = CalculateDumpPath(path);
     result = lstat(fpath.c_str(), stbuf);
@@ -48,6 +668,7 @@ GetattrLocalImpl(
 //
 // Description:
 //    This method redirects the access system call to the dump directory.
+//    Virtual files can only be read.
 //
 // Returns:
 //    0 on success and -errno on error.
@@ -60,6 +681,11 @@ AccessLocalImpl(
     int     result;
     string  fpath;
 
+    if (IsVirtualFile(path))
+    {
+        return (mask & (W_OK | X_OK)) ? -EACCES : 0;
+    }
+
     fpath = CalculateDumpPath(path);
     result = access(fpath.c_str(), mask);
     if (result == -1)
@@ -101,16 +727,18 @@ ReadlinkLocalImpl(
 }
 
 // ---------------------------------------------------------------------------
-// Method: ReaddirLocalImpl
+// Method: OpendirLocalImpl
 //
 // Description:
 //    This method redirects the opendir system call to the dump directory.
-//    If this is opening a custom query directory, it will 
-//    1. Delete all the previous files in custom query dump directory. 
-//       To ensure that if there is a query file is removed or added, 
-//       it will be reflected properly.
-//    2. Iterate the user custom query directory and create output files
-//       with the same name as the query file at custom query dump directory. 
+//    The dump directory holds the files that are not part of the virtual
+//    tree, readdir lists both.
+//
+//    If this is opening a custom query directory, the output files in
+//    the virtual tree are synced with the query files in the user custom
+//    query directory first, so added or removed queries show up. Opening
+//    a server folder, or the fan-out folder, loads the DMV catalog(s) it
+//    lists.
 //
 // Returns:
 //    0 on success and -errno on error.
@@ -123,11 +751,8 @@ OpendirLocalImpl(
     int             failed = 0;
     DIR*            dp;
     string          fpath;
-    vector<string>  tokens;
-    string          servername;
-    string          userQueriesPath;
-    string          filepath;
-    
+    VirtualEntryPtr entry;
+
     fpath = CalculateDumpPath(path);
     dp = opendir(fpath.c_str());
     if (dp != NULL)
@@ -136,30 +761,13 @@ OpendirLocalImpl(
         //
         fi->fh = (uint64_t)(dp);
 
-        // If this is a custom query dir, populate dump path with custom query 
-        // output files so that readdir can list the files.
-        //
-        if (strstr(path, CUSTOM_QUERY_FOLDER_NAME))
-        {
-            RemoveCustomQueriesOutputFiles(dp, fpath);            
-
-            // Need to rewind the directory point to the begining for readdir.
-            //
-            rewinddir(dp);
-
-            // Tokenising the path.
-            //
-            tokens = Split(path, '/');
-        
-            // Path is of the form <servername>/<filename>
-            // On success, there will be more than 1 token.
-            //
-            assert(tokens.size() > 1);
-        
-            servername = tokens[0];
-            assert(strcmp(tokens[1].c_str(), CUSTOM_QUERY_FOLDER_NAME) == 0);
+        LoadDmvCatalogs(path, true);
 
-            CreateCustomQueriesOutputFiles(servername, fpath);            
+        entry = g_VirtualTree.Lookup(path);
+        if (entry && entry->m_type == ENTRY_DIRECTORY &&
+            GetCustomQueriesDirPath(entry->m_servername) == path)
+        {
+            SyncCustomQueriesOutputFiles(entry->m_servername);
         }
     }
     else
@@ -175,7 +783,9 @@ OpendirLocalImpl(
 // Method: ReaddirLocalImpl
 //
 // Description:
-//    This method redirects the readdir system call to the dump directory.
+//    This method lists the entries of the virtual tree in the directory
+//    followed by the files of the dump directory that are not in the
+//    tree.
 //
 // Returns:
 //    0 on success and -errno on error.
@@ -193,6 +803,9 @@ ReaddirLocalImpl(
     string          fpath;
     struct stat     st;
     int             result = 0;
+    vector<string>  names;
+    VirtualEntryPtr entry;
+    bool            full = false;
 
     (void)offset;
     (void)fi;
@@ -205,8 +818,31 @@ ReaddirLocalImpl(
 
     if (!result)
     {
-        while ((de = readdir(dp)) != NULL)
+        g_VirtualTree.ListDirectory(path, names);
+
+        for (auto&& name : names)
+        {
+            entry = g_VirtualTree.Lookup(VirtualTree::JoinPath(path, name));
+            if (entry)
+            {
+                VirtualTree::FillStat(*entry, &st);
+                if (filler(buf, name.c_str(), &st, 0))
+                {
+                    full = true;
+                    break;
+                }
+            }
+        }
+
+        while (!full && (de = readdir(dp)) != NULL)
         {
+            // Folders of the tree also exist in the dump directory.
+            //
+            if (std::binary_search(names.begin(), names.end(), string(de->d_name)))
+            {
+                continue;
+            }
+
             memset(&st, 0, sizeof(st));
             st.st_ino = de->d_ino;
             st.st_mode = de->d_type << 12;
@@ -515,6 +1151,7 @@ ChownLocalImpl(
 //
 // Description:
 //    This method redirects the truncate system call to the dump directory.
+//    The virtual files cannot be truncated.
 //
 // Returns:
 //    0 on success and -errno on error.
@@ -527,6 +1164,11 @@ TruncateLocalImpl(
     int     result;
     string  fpath;
 
+    if (IsVirtualFile(path))
+    {
+        return -EPERM;
+    }
+
     fpath = CalculateDumpPath(path);
     result = truncate(fpath.c_str(), size);
     if (result == -1)
@@ -584,7 +1226,7 @@ GetFileDescriptorForPath(
 
     // If we don't already have a fd, open the file.
     //
-    if (!fi)
+    if (!GetFileHandle(fi))
     {
         fpath = CalculateDumpPath(path);
         // Open the file.
@@ -597,7 +1239,7 @@ GetFileDescriptorForPath(
     }
     else
     {
-        fd = fi->fh;
+        fd = GetFileHandle(fi)->m_fd;
     }
 }
 
@@ -617,7 +1259,7 @@ CloseFileDesciptorIfOpened(
     struct fuse_file_info* fi,
     int fd)
 {
-    if (!fi)
+    if (!GetFileHandle(fi))
     {
         int result = close(fd);
         if (result)
@@ -631,259 +1273,600 @@ CloseFileDesciptorIfOpened(
 // Method: GetDmvFileContent
 //
 // Description:
-//    This function is responsible for filling the file(DMV) being opened 
-//    with the content of that DMV from the appropriate server and form. 
+//    This function is responsible for fetching the content of the file
+//    (DMV) being opened from the appropriate server and form. 
 //
-//    The path contains the name of the server and the DMV (along with
-//    the extension. This information is extracted from the  path and an 
-//    appropriate SQL query is sent to the required server. The response of 
-//    the SQL Query is saved into the file.
+//    The server, the DMV and the form come from the entry of the file in
+//    the virtual tree. An appropriate SQL query is sent to the required
+//    server and the response of the SQL Query is returned in content.
+//    For a DMV view, the query only selects the columns and rows of the
+//    view. Views share the cache TTL of their DMV, but their results are
+//    not kept past it for the throttle.
 //
-//    path - relative path from the mount directory
+//    The response comes from the server's result cache, so the query is
+//    only sent if there is no cached result young enough and concurrent
+//    opens of the same file share one query.
 //
 // Returns:
 //    0 on success, 
-//    -errno if a system call failed,
 //    -1 on internal error.
 //
 static int
 GetDmvFileContent(
-    string path)
-{
-    int                 error = 0;
-    vector<string>      tokens;
-    string              filename;
-    string              query;
-    string              servername;
-    string              hostname;
-    string              username;
-    string              password;
-    enum FileFormat     type;
-    string              responseString;
-    string              tempString1;
-    string              tempString2;
-    string              dumpPath;
-    int                 fd;
-
-    dumpPath = CalculateDumpPath(path);
-
-    // Open the file.
+    const VirtualEntry& entry,
+    QueryResult& content)
+{
+    int                     error = 0;
+    string                  query;
+    string                  filename;
+    string                  dmvName;
+    shared_ptr<ServerInfo>  serverInfo;
+    QueryStats*             stats;
+    enum FileFormat         type;
+    DmvView                 view;
+
+    // Fetch the details for the server.
     //
-    fd = open(dumpPath.c_str(), O_WRONLY);
-    if (fd != -1)
+    serverInfo = GetServerInfo(entry.m_servername);
+
+    if (entry.m_type == ENTRY_DMV_VIEW)
     {
-        // Extract SQL server name, DMV name and type
-        // Tokenising the path.
+        // The view was validated on lookup - this only fails if the
+        // server went away since.
         //
-        tokens = Split(path, '/');
+        if (!serverInfo ||
+            !ParseDmvView(entry.m_name, view) ||
+            !ValidateDmvView(serverInfo.get(), entry.m_servername, view))
+        {
+            return -1;
+        }
 
-        // path is of the form <servername>/<filename>
-        // On success, there will be more than 1 token.
-        //
-        assert(tokens.size() > 1);
+        type = view.m_type;
+        dmvName = view.m_dmvName;
+        filename = entry.m_name;
+        query = GetDmvViewQuery(view);
+    }
+    else
+    {
+        type = GetDmvEntryFormat(entry);
+        dmvName = entry.m_name;
+        filename = GetDmvFileName(entry);
+        query = GetDmvQuery(dmvName, type);
+    }
+    stats = GetEntryQueryStats(entry);
+
+    // A prefetched file is served from its latest snapshot. Only opens
+    // before the first refresh completed go to the server.
+    //
+    if (serverInfo && serverInfo->m_prefetcher)
+    {
+        content = serverInfo->m_prefetcher->GetSnapshot(filename);
+        if (content)
+        {
+            return 0;
+        }
+    }
+
+    if (serverInfo)
+    {
+        error = serverInfo->m_resultCache->GetOrFetch(
+            GetDmvCacheKey(entry.m_name, type),
+            GetCacheTtl(serverInfo.get(), dmvName),
+            [&](QueryResult& output)
+            {
+                return StartQuery(query, serverInfo.get(), type,
+                                  GetQueryTimeout(serverInfo.get(), dmvName), output, stats);
+            },
+            content,
+            entry.m_type != ENTRY_DMV_VIEW);
+    }
+    else
+    {
+        PrintMsg("Unknown server %s\n", entry.m_servername.c_str());
+        error = -1;
+    }
+
+    if (error)
+    {
+        PrintMsg("Querying the SQL failed. error = %d\n", error);
+    }
+
+    return error;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetCustomQueryFileContent
+//
+// Description:
+//    This function runs the custom query of the file being opened. The
+//    query file has the same name in the custom query directory the
+//    user specified for the server - or the name before the @ for a
+//    call with arguments.
+//
+//    A failed query shows up as an empty file.
+//
+// Returns:
+//    0
+//
+static int
+GetCustomQueryFileContent(
+    const VirtualEntry& entry,
+    QueryResult& content)
+{
+    shared_ptr<ServerInfo>  serverInfo;
+    string                  queryFilePath;
+    string                  queryName;
+    string                  arguments;
 
-        servername = tokens[0];
-        filename = tokens[1];
+    queryName = GetCustomQueryName(entry, arguments);
 
-        // Now we have the filename - check if it's a JSON
-        // We can also check from version but need to extract the
-        // the file name in any case.
+    // Get the path to the custom query directory user specified.
+    //
+    serverInfo = GetServerInfo(entry.m_servername);
+    if (serverInfo && !serverInfo->m_customQueriesPath.empty())
+    {
+        // Construct the full path name to the query file
         //
-        size_t found = filename.find(".json");
+        queryFilePath = StringFormat("%s/%s",
+                                     serverInfo->m_customQueriesPath.c_str(),
+                                     queryName.c_str());
 
-        if (found != string::npos)
+        if (ExecuteCustomQuery(queryFilePath, arguments, serverInfo.get(), content,
+                               GetEntryQueryStats(entry)))
         {
-            // Removing the .json from the filename.
-            //
-            filename = filename.substr(0, found);
-            type = TYPE_JSON;
-            tempString1 = "SELECT * FROM [master].[sys].[";
-            tempString2 = "] FOR JSON AUTO, ROOT('info')";
+            content.reset();
         }
-        else
+    }
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetQueryStatisticsFileContent
+//
+// Description:
+//    This function gets the SET STATISTICS TIME and IO output of the last
+//    successful run of a custom query - empty if it did not run yet.
+//
+// Returns:
+//    0
+//
+static int
+GetQueryStatisticsFileContent(
+    const VirtualEntry& entry,
+    QueryResult& content)
+{
+    LastQuery lastQuery;
+
+    content = make_shared<ResultBuffer>();
+    if (GetLastQuery(GetEntryQueryStats(entry), lastQuery))
+    {
+        content->Append(lastQuery.m_statistics.data(), lastQuery.m_statistics.size());
+    }
+    content->Complete(0);
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetServerDmvFileContent
+//
+// Description:
+//    This function gets the content of a DMV file of the given server
+//    for the fan-out folder, as if /<servername>/<filename> was opened.
+//
+// Returns:
+//    0 on success, -ENOENT if the server has no such DMV file and -1 on
+//    error.
+//
+static int
+GetServerDmvFileContent(
+    const string& servername,
+    const string& filename,
+    QueryResult& content)
+{
+    VirtualEntryPtr entry = g_VirtualTree.Lookup(
+        VirtualTree::JoinPath(LINUX_PATH_DELIM + servername, filename));
+
+    if (!entry || !IsDmvEntry(*entry))
+    {
+        return -ENOENT;
+    }
+
+    return GetDmvFileContent(*entry, content);
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetDeltaFileContent
+//
+// Description:
+//    This function gets the deltas of a cumulative DMV since the previous
+//    open of its delta file. The snapshot is the content of the TSV file
+//    of the DMV, so it shares its result cache and prefetched snapshots.
+//
+// Returns:
+//    0 on success, -1 on error.
+//
+static int
+GetDeltaFileContent(
+    const VirtualEntry& entry,
+    QueryResult& content)
+{
+    shared_ptr<ServerInfo> serverInfo = GetServerInfo(entry.m_servername);
+    VirtualEntry    tsvEntry = entry;
+    QueryResult     snapshot;
+
+    if (!serverInfo)
+    {
+        return -1;
+    }
+
+    tsvEntry.m_type = ENTRY_DMV;
+
+    if (GetDmvFileContent(tsvEntry, snapshot))
+    {
+        return -1;
+    }
+
+    return serverInfo->m_deltaTracker->GetDelta(entry.m_name, snapshot, content);
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetHistoryFileContent
+//
+// Description:
+//    This function gets a past snapshot of a DMV, or all of them for the
+//    stream file, from the history of the server.
+//
+// Returns:
+//    0 on success, -ENOENT if the snapshot was dropped since the lookup.
+//
+static int
+GetHistoryFileContent(
+    const VirtualEntry& entry,
+    QueryResult& content)
+{
+    shared_ptr<ServerInfo> serverInfo = GetServerInfo(entry.m_servername);
+    size_t      slash = entry.m_name.find_last_of('/');
+
+    if (!serverInfo || !serverInfo->m_history)
+    {
+        return -ENOENT;
+    }
+
+    if (entry.m_type == ENTRY_HISTORY_STREAM)
+    {
+        return serverInfo->m_history->GetStream(entry.m_name, content);
+    }
+
+    return serverInfo->m_history->GetSnapshot(entry.m_name.substr(0, slash),
+                                              entry.m_name.substr(slash + 1), content);
+}
+
+// ---------------------------------------------------------------------------
+// Method: GetBundleFileContent
+//
+// Description:
+//    This function gets the DMV files of a bundle, read from the server
+//    in one round trip. A prefetched bundle is served from its latest
+//    snapshot. Otherwise concurrent opens of the bundle share one batch -
+//    the bundle itself is not cached, its DMV files are.
+//
+// Returns:
+//    0 on success, -1 on error.
+//
+static int
+GetBundleFileContent(
+    const VirtualEntry& entry,
+    QueryResult& content)
+{
+    shared_ptr<ServerInfo> serverInfo = GetServerInfo(entry.m_servername);
+    string      filename = BUNDLE_FOLDER_NAME LINUX_PATH_DELIM + entry.m_name;
+
+    if (!serverInfo)
+    {
+        return -1;
+    }
+
+    if (serverInfo->m_prefetcher)
+    {
+        content = serverInfo->m_prefetcher->GetSnapshot(filename);
+        if (content)
         {
-            type = TYPE_TSV;
-            tempString1 = "SELECT * FROM [master].[sys].[";
-            tempString2 = "]";
+            return 0;
         }
+    }
 
-        query = tempString1 + filename + tempString2;
+    return serverInfo->m_resultCache->GetOrFetch(
+        filename,
+        std::chrono::milliseconds(0),
+        [&](QueryResult& output)
+        {
+            return RunBundle(entry.m_servername, serverInfo.get(), entry.m_name, output);
+        },
+        content);
+}
 
-        // Fetch the details for the server.
-        //
-        GetServerDetails(servername, hostname, username, password);
+// ---------------------------------------------------------------------------
+// Method: GetStatsFileContent
+//
+// Description:
+//    This function renders the DBFS statistics for the files of the
+//    .dbfs folder. The statistics are taken when the file is opened.
+//
+// Returns:
+//    0
+//
+static int
+GetStatsFileContent(
+    const VirtualEntry& entry,
+    QueryResult& content)
+{
+    string stats = RenderStats(entry.m_type == ENTRY_STATS_PROMETHEUS);
 
-        error = ExecuteQuery(query, responseString, hostname,
-                                username, password, type);
+    content = make_shared<ResultBuffer>();
+    content->Append(stats.c_str(), stats.size());
+    content->Complete(0);
 
-        if (!error)
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Method: OpenLocalImpl
+//
+// Description:
+//    This method implements the open system call in the following manner:
+//    1. If this is a DMV - it will query the server for the content.
+//    2. If this is a custom query file, it will run the query. Its
+//       statistics file has the output of the last run.
+//    3. If this is a fan-out DMV, it will query all the servers.
+//       A delta file diffs the DMV with its previous snapshot.
+//       A history file comes from the snapshots kept in memory.
+//       A bundle file reads several DMVs in one batch.
+//    In all cases the result is kept in memory in the FileHandle.
+//    4. Otherwise it will redirect the open system call to the dump
+//       directory and save the file descriptor in the FileHandle.
+//
+//    The type of the file comes from the virtual tree.
+//    The FileHandle is saved in the fuse_file_info pointer passed in.
+//
+// Returns:
+//    0 on success, 
+//    -errno if a system call failed,
+//    -1 on internal error.
+//
+static int
+OpenLocalImpl(
+    const char* path,
+    struct fuse_file_info* fi)
+{
+    int error = 0;
+    int fd;
+    string fpath;
+    VirtualEntryPtr entry;
+    FileHandle* handle;
+    bool pageCached;
+    bool keepCache = false;
+    InterruptibleRequest request;
+
+    entry = LookupEntry(path);
+
+    handle = new FileHandle();
+    handle->m_fd = -1;
+    handle->m_isDbfsFile = entry && entry->m_type != ENTRY_DIRECTORY;
+
+    // For dbfs file, fetch the content.
+    //
+    if (handle->m_isDbfsFile)
+    {
+        if (entry->m_type == ENTRY_CUSTOM_QUERY)
         {
-            // File was already opened and it's file descriptor saved for use.
-            //
-            if (pwrite(fd, responseString.c_str(), responseString.length(), 0) == -1)
-            {
-                error = ReturnErrnoAndPrintError(__FUNCTION__, "pwrite failed");
-            }
+            error = GetCustomQueryFileContent(*entry, handle->m_content);
+        }
+        else if (entry->m_type == ENTRY_QUERY_STATISTICS)
+        {
+            error = GetQueryStatisticsFileContent(*entry, handle->m_content);
+        }
+        else if (entry->m_type == ENTRY_STATS ||
+                 entry->m_type == ENTRY_STATS_PROMETHEUS)
+        {
+            error = GetStatsFileContent(*entry, handle->m_content);
+        }
+        else if (entry->m_type == ENTRY_FANOUT_DMV)
+        {
+            error = GetFanOutFileContent(entry->m_name, GetServerDmvFileContent,
+                                         handle->m_content);
+        }
+        else if (entry->m_type == ENTRY_DELTA_DMV)
+        {
+            error = GetDeltaFileContent(*entry, handle->m_content);
+        }
+        else if (entry->m_type == ENTRY_HISTORY_SNAPSHOT ||
+                 entry->m_type == ENTRY_HISTORY_STREAM)
+        {
+            error = GetHistoryFileContent(*entry, handle->m_content);
+        }
+        else if (entry->m_type == ENTRY_BUNDLE)
+        {
+            error = GetBundleFileContent(*entry, handle->m_content);
+        }
+        else
+        {
+            error = GetDmvFileContent(*entry, handle->m_content);
+        }
+
+        if (!handle->m_content)
+        {
+            handle->m_content = make_shared<ResultBuffer>();
+            handle->m_content->Complete(0);
+        }
+        handle->m_content->AddReader();
+
+        // Keep the pages of a page cached file as long as it is opened
+        // with the same result. A page cached file whose size the kernel
+        // does not have for this result, and other files, bypass the
+        // page cache.
+        //
+        pageCached = IsPageCached(*entry, GetServerInfo(entry->m_servername).get()) &&
+                     UsePageCache(path, handle->m_content, keepCache);
+        if (pageCached)
+        {
+            fi->keep_cache = keepCache;
+        }
+        else
+        {
+            fi->direct_io = 1;
+        }
+    }
+    else
+    {
+        fpath = CalculateDumpPath(path);
+        // Open the file.
+        //
+        fd = open(fpath.c_str(), fi->flags);
+        if (fd == -1)
+        {
+            error = ReturnErrnoAndPrintError(__FUNCTION__, "open failed");
         }
         else
         {
-            PrintMsg("Querying the SQL failed. error = %d\n", error);
+            handle->m_fd = fd;
         }
-        
-        close(fd);
     }
-    else
+
+    if (error)
     {
-        error = ReturnErrnoAndPrintError(__FUNCTION__, "open failed");
+        if (handle->m_content)
+        {
+            handle->m_content->RemoveReader();
+        }
+        delete handle;
+        handle = NULL;
     }
 
+    // Save the handle for later use.
+    //
+    fi->fh = (uint64_t)handle;
 
     return error;
 }
 
 // ---------------------------------------------------------------------------
-// Method: OpenLocalImpl
+// Method: ReadLocalImpl
 //
 // Description:
-//    This method implements the open system call in the following manner:
-//    1. It will redirect the open system call to the dump directory and save
-//       file description in the fuse_file_info pointer passed in.
-//    2. If this is a DMV - it will also query the server for the content.
-//    3. If this is a custom query file, it will run the query and save
-//       the result to the output file in the dump directory
+//    This method serves the read system call from the in-memory content
+//    of a dbfs file, or redirects it to the dump directory otherwise.
+//    If the content is still streaming in, the read waits for the rows
+//    it needs.
 //
 // Returns:
-//    0 on success, 
-//    -errno if a system call failed,
-//    -1 on internal error.
+//    0 on success and -errno on error.
 //
 static int
-OpenLocalImpl(
+ReadLocalImpl(
     const char* path,
+    char* buf,
+    size_t size,
+    off_t offset,
     struct fuse_file_info* fi)
 {
-    int error = 0;
-    int fd;
-    string fpath;
-    vector<string>      tokens;
-    string servername;
-    string filename;
-    string userQueriesPath;
-    string queryFilePath;
-    ServerInfo* serverInfo;
+    int fd = 0;
+    int result = -1;
+    FileHandle* handle = GetFileHandle(fi);
+    InterruptibleRequest request;
 
-    fpath = CalculateDumpPath(path);
-    // Open the file.
-    //
-    fd = open(fpath.c_str(), fi->flags);
-    if (fd == -1)
-    {
-        error = ReturnErrnoAndPrintError(__FUNCTION__, "open failed");
-    }
-    else
+    if (handle && handle->m_isDbfsFile)
     {
-        // Save fd for later use.
-        //
-        fi->fh = fd;
+        return handle->m_content->Read(buf, size, offset, IsRequestInterrupted);
     }
 
-    if (!error)
+    // Get file descriptor
+    //
+    GetFileDescriptorForPath(path, fi, fd);
+
+    if (fd != -1)
     {
-        // For dbfs file, fetch the content.
-        //
-        if (IsDbfsFile(path))
+        result = pread(fd, buf, size, offset);
+        if (result == -1)
         {
-            if (strstr(path, CUSTOM_QUERY_FOLDER_NAME))
-            {
-                // Tokenising the path.
-                //
-                tokens = Split(path, '/');
-                
-                // Path is of the form <servername>/<customQueries>/<filename>
-                // On success, there will be more than 1 token.
-                //
-                assert(tokens.size() > 1);
-            
-                servername = tokens[0];
-                filename = tokens[2];
-                assert(strcmp(tokens[1].c_str(), CUSTOM_QUERY_FOLDER_NAME) == 0);
-
-                // Get the path to the custom query directory user specified.
-                //
-                serverInfo = GetServerInfo(servername);
-                if (serverInfo)
-                {
-                    userQueriesPath = serverInfo->m_customQueriesPath;
-
-                    if (!userQueriesPath.empty())
-                    {
-                        // Construct the full path name to the query file
-                        //
-                        queryFilePath = StringFormat("%s/%s", userQueriesPath.c_str(), filename.c_str());
-
-                        // Execute the custom query and put the output to the output file
-                        // in the dump directory.
-                        //
-                        ExecuteCustomQuery(
-                            queryFilePath,
-                            fpath,
-                            serverInfo->m_hostname, 
-                            serverInfo->m_username,
-                            serverInfo->m_password);
-                    }
-                }
-            }
-            else
-            {
-                error = GetDmvFileContent(path);
-            }
+            result = ReturnErrnoAndPrintError(__FUNCTION__, "pread failed");
         }
-    }
 
-    if (error && fd != -1)
-    {
-        close(fd);
-        fi->fh = -1;
+        CloseFileDesciptorIfOpened(fi, fd);
     }
-
-    return error;
+    return result;
 }
 
 // ---------------------------------------------------------------------------
-// Method: ReadLocalImpl
+// Method: ReadBufLocalImpl
 //
 // Description:
-//    This method redirects the read system call to the dump directory.
+//    This method is the buffer based variant of ReadLocalImpl. For files
+//    in the dump directory it hands the file descriptor to FUSE so that
+//    the data can be spliced without a copy through user space. For dbfs
+//    files it returns a buffer filled from the in-memory content (FUSE
+//    frees the memory buffers it is handed, so this is a single copy).
 //
 // Returns:
 //    0 on success and -errno on error.
 //
 static int
-ReadLocalImpl(
+ReadBufLocalImpl(
     const char* path,
-    char* buf,
+    struct fuse_bufvec** bufp,
     size_t size,
     off_t offset,
     struct fuse_file_info* fi)
 {
-    int fd = 0;
-    int result = -1;
+    struct fuse_bufvec* bufvec;
+    FileHandle*         handle = GetFileHandle(fi);
+    void*               mem = NULL;
+    int                 result;
+    InterruptibleRequest request;
 
-    // Get file descriptor
-    //
-    GetFileDescriptorForPath(path, fi, fd);
+    if (!handle)
+    {
+        return -EBADF;
+    }
 
-    if (fd != -1)
+    bufvec = (struct fuse_bufvec*)malloc(sizeof(struct fuse_bufvec));
+    if (!bufvec)
     {
-        result = pread(fd, buf, size, offset);
-        if (result == -1)
+        return -ENOMEM;
+    }
+    *bufvec = FUSE_BUFVEC_INIT(size);
+
+    if (handle->m_isDbfsFile)
+    {
+        mem = malloc(max(size, (size_t)1));
+        if (!mem)
         {
-            result = ReturnErrnoAndPrintError(__FUNCTION__, "pread failed");
+            free(bufvec);
+            return -ENOMEM;
         }
 
-        CloseFileDesciptorIfOpened(fi, fd);
+        result = handle->m_content->Read((char*)mem, size, offset, IsRequestInterrupted);
+        if (result < 0)
+        {
+            free(mem);
+            free(bufvec);
+            return result;
+        }
+
+        bufvec->buf[0].size = result;
+        bufvec->buf[0].mem = mem;
     }
-    return result;
+    else
+    {
+        bufvec->buf[0].flags = (enum fuse_buf_flags)(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+        bufvec->buf[0].fd = handle->m_fd;
+        bufvec->buf[0].pos = offset;
+    }
+
+    *bufp = bufvec;
+
+    return 0;
 }
 
 // ---------------------------------------------------------------------------
@@ -906,8 +1889,9 @@ WriteLocalImpl(
     int     fd;
     string  fpath;
     int     result = 0;
+    FileHandle* handle = GetFileHandle(fi);
 
-    if (!IsDbfsFile(path))
+    if (!(handle && handle->m_isDbfsFile))
     {
         GetFileDescriptorForPath(path, fi, fd);
 
@@ -950,7 +1934,9 @@ StatfsLocalImpl(
     int     result;
     string  fpath;
 
-    fpath = CalculateDumpPath(path);
+    // Virtual files do not exist in the dump directory.
+    //
+    fpath = IsVirtualFile(path) ? g_UserPaths.m_dumpPath : CalculateDumpPath(path);
     result = statvfs(fpath.c_str(), stbuf);
     if (result == -1)
     {
@@ -963,11 +1949,10 @@ StatfsLocalImpl(
 // Method: ReleaseLocalImpl
 //
 // Description:
-//    If the file is a DMV file - this method truncates an open DMV file 
-//    back to size 0. This effectively removes all the data that was 
-//    fetched from the server on open().
-//
-//    In all cases - close the file descriptor.
+//    This method closes the file descriptor if this file is in the dump
+//    directory and frees the FileHandle. For a dbfs file this drops the
+//    reference to its content - the memory is freed once neither the
+//    result cache nor any other open handle refers to it.
 //
 // Returns:
 //    0 on success and -errno on error.
@@ -978,25 +1963,29 @@ ReleaseLocalImpl(
     struct fuse_file_info* fi)
 {
     int result = 0;
+    FileHandle* handle = GetFileHandle(fi);
 
-    if (IsDbfsFile(path))
+    if (handle)
     {
-        // Reset the DMV file.
-        //
-        result = TruncateLocalImpl(path, 0);
-        if (result == -1)
+        if (handle->m_fd != -1)
         {
-            result = ReturnErrnoAndPrintError(__FUNCTION__,
-                                              "TruncateLocalImpl failed");
+            result = close(handle->m_fd);
+            if (result == -1)
+            {
+                result = ReturnErrnoAndPrintError(__FUNCTION__,
+                                                  "close failed");
+            }
         }
-    }
 
-    result = close(fi->fh);
-    if (result == -1)
-    {
-        result = ReturnErrnoAndPrintError(__FUNCTION__,
-                                          "close failed");
+        if (handle->m_content)
+        {
+            handle->m_content->RemoveReader();
+        }
+
+        delete handle;
+        fi->fh = 0;
     }
+
     return result;
 }
 
@@ -1043,6 +2032,14 @@ FallocateLocalImpl(
     int     fd;
     string  fpath;
     int     result = 0;
+    FileHandle* handle = GetFileHandle(fi);
+
+    if (handle && handle->m_isDbfsFile)
+    {
+        // It is not permitted to write to the dbfs file.
+        //
+        return -EPERM;
+    }
 
     GetFileDescriptorForPath(path, fi, fd);
 
@@ -1091,11 +2088,96 @@ SetxattrLocalImpl(
     return result;
 }
 
+// ---------------------------------------------------------------------------
+// Method: GetVirtualXattrs
+//
+// Description:
+//    This method computes the extended attributes of a DBFS file from the
+//    last successful query of the file:
+//      user.dbfs.server        - server the file belongs to
+//      user.dbfs.login_us      - getting a connection, logging in if none
+//                                was idle
+//      user.dbfs.exec_us       - sending the query until the first results
+//      user.dbfs.fetch_us      - reading and serializing the rows
+//      user.dbfs.rows          - rows of the result
+//      user.dbfs.bytes         - size of the result
+//      user.dbfs.cache_age_ms  - time since the query completed, i.e. the
+//                                age of the result a cache hit gets
+//    Files that are not the result of a query of their own (fan-out,
+//    delta, history and statistics files) have none, and a file that was
+//    not queried yet only has user.dbfs.server.
+//
+// Returns:
+//    VOID
+//
+static void
+GetVirtualXattrs(
+    const VirtualEntry& entry,
+    vector<pair<string, string>>& xattrs)
+{
+    QueryStats* stats = GetEntryQueryStats(entry);
+    LastQuery   lastQuery;
+
+    if (!stats)
+    {
+        return;
+    }
+
+    xattrs.emplace_back(DBFS_XATTR_PREFIX "server", entry.m_servername);
+
+    if (!GetLastQuery(stats, lastQuery))
+    {
+        return;
+    }
+
+    xattrs.emplace_back(DBFS_XATTR_PREFIX "login_us", to_string(lastQuery.m_loginUs));
+    xattrs.emplace_back(DBFS_XATTR_PREFIX "exec_us", to_string(lastQuery.m_execUs));
+    xattrs.emplace_back(DBFS_XATTR_PREFIX "fetch_us", to_string(lastQuery.m_fetchUs));
+    xattrs.emplace_back(DBFS_XATTR_PREFIX "rows", to_string(lastQuery.m_rows));
+    xattrs.emplace_back(DBFS_XATTR_PREFIX "bytes", to_string(lastQuery.m_bytes));
+    xattrs.emplace_back(DBFS_XATTR_PREFIX "cache_age_ms",
+        to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - lastQuery.m_completedAt).count()));
+}
+
+// ---------------------------------------------------------------------------
+// Method: CopyXattrValue
+//
+// Description:
+//    This method copies an extended attribute value (or name list) out
+//    with the getxattr conventions - a zero size asks for the size.
+//
+// Returns:
+//    The size of the value or -ERANGE if buf is too small.
+//
+static int
+CopyXattrValue(
+    const string& data,
+    char* buf,
+    size_t size)
+{
+    if (size == 0)
+    {
+        return (int)data.size();
+    }
+
+    if (size < data.size())
+    {
+        return -ERANGE;
+    }
+
+    memcpy(buf, data.data(), data.size());
+
+    return (int)data.size();
+}
+
 // ---------------------------------------------------------------------------
 // Method: GetxattrLocalImpl
 //
 // Description:
-//    This method redirects the getxattr system call to the dump directory.
+//    This method resolves the getxattr system call from the attributes
+//    DBFS computes for its files, or redirects it to the dump directory
+//    for the other files.
 //
 // Returns:
 //    0 on success and -errno on error.
@@ -1109,6 +2191,23 @@ GetxattrLocalImpl(
 {
     int     result;
     string  fpath;
+    VirtualEntryPtr entry;
+    vector<pair<string, string>> xattrs;
+
+    entry = LookupEntry(path);
+    if (entry && entry->m_type != ENTRY_DIRECTORY)
+    {
+        GetVirtualXattrs(*entry, xattrs);
+        for (auto&& xattr : xattrs)
+        {
+            if (xattr.first == name)
+            {
+                return CopyXattrValue(xattr.second, value, size);
+            }
+        }
+
+        return -ENODATA;
+    }
 
     fpath = CalculateDumpPath(path);
     result = lgetxattr(fpath.c_str(), name, value, size);
@@ -1123,7 +2222,9 @@ GetxattrLocalImpl(
 // Method: ListxattrLocalImpl
 //
 // Description:
-//    This method redirects the listxattr system call to the dump directory.
+//    This method lists the attributes DBFS computes for its files, or
+//    redirects the listxattr system call to the dump directory for the
+//    other files.
 //
 // Returns:
 //    0 on success and -errno on error.
@@ -1136,6 +2237,22 @@ ListxattrLocalImpl(
 {
     int     result;
     string  fpath;
+    string  names;
+    VirtualEntryPtr entry;
+    vector<pair<string, string>> xattrs;
+
+    entry = LookupEntry(path);
+    if (entry && entry->m_type != ENTRY_DIRECTORY)
+    {
+        GetVirtualXattrs(*entry, xattrs);
+        for (auto&& xattr : xattrs)
+        {
+            names += xattr.first;
+            names += '\0';
+        }
+
+        return CopyXattrValue(names, list, size);
+    }
 
     fpath = CalculateDumpPath(path);
     result = llistxattr(fpath.c_str(), list, size);
@@ -1178,7 +2295,8 @@ RemovexattrLocalImpl(
 // Description:
 //    This method gets invoked as the first step in FUSE setup.
 //    It mainly creates the dump directory (if one is not already present) 
-//    and creates the DMV's for all the servers. 
+//    and creates the folders of all the servers. Their DMV files come
+//    from the catalog cache or are discovered on first use.
 //
 // Returns:
 //    NULL
@@ -1188,10 +2306,14 @@ InitializeSQLFs(
     fuse_conn_info* conn)
 {
     int                 result;
-    class ServerInfo*   entry;
+    string              statsPath;
 
     (void)conn;
 
+    // FUSE has daemonized by now, so the log thread survives.
+    //
+    StartLogThread();
+
     // Creating the dump dir.
     //
     result = mkdir(g_UserPaths.m_dumpPath.c_str(), DEFAULT_PERMISSIONS);
@@ -1202,27 +2324,207 @@ InitializeSQLFs(
         KillSelf();
     }
 
-    // Create local DMV entries for all the servers.
+    // The statistics of DBFS itself. The folder is also created in the
+    // dump directory so that nothing can be created under that name.
+    //
+    statsPath = LINUX_PATH_DELIM STATS_FOLDER_NAME;
+    mkdir(CalculateDumpPath(statsPath).c_str(), DEFAULT_PERMISSIONS);
+
+    g_VirtualTree.AddDirectory(statsPath, "");
+    g_VirtualTree.AddFile(VirtualTree::JoinPath(statsPath, STATS_TEXT_FILE_NAME),
+                          ENTRY_STATS, "", STATS_TEXT_FILE_NAME);
+    g_VirtualTree.AddFile(VirtualTree::JoinPath(statsPath, STATS_PROMETHEUS_FILE_NAME),
+                          ENTRY_STATS_PROMETHEUS, "", STATS_PROMETHEUS_FILE_NAME);
+
+    // Files of the DMV catalogs are added to the fan-out folder as they
+    // are loaded.
+    //
+    CreateFanOutFolder();
+
+    // Create the folders of all the servers, with the DMV files of the
+    // cached catalogs. No server is queried here.
+    //
+    vector<pair<string, shared_ptr<ServerInfo>>> servers = GetServerInfoList();
+    auto startTime = std::chrono::steady_clock::now();
+
+    RunInParallel(servers.size(), SQLFS_MAX_STARTUP_WORKERS,
+        [&servers](size_t item)
+        {
+            auto serverStart = std::chrono::steady_clock::now();
+
+            CreateDbfsFiles(servers[item].first, servers[item].second.get());
+
+            PrintMsg("Created files for server %s in %lld ms\n",
+                servers[item].first.c_str(), ElapsedMs(serverStart));
+        });
+
+    PrintMsg("Created files for %zu server(s) in %lld ms\n",
+        servers.size(), ElapsedMs(startTime));
+
+    // The DMV files exist now - start refreshing the prefetched ones.
     //
-    for (auto&& itr : g_ServerInfoMap)
+    for (auto&& itr : servers)
     {
-        entry = itr.second;
-        CreateDbfsFiles(itr.first,
-            entry->m_hostname, 
-            entry->m_username,
-            entry->m_password, 
-            entry->m_version);
+        if (itr.second->m_prefetcher)
+        {
+            itr.second->m_prefetcher->Start();
+        }
     }
 
+    // Checks that the cached catalogs still match their servers.
+    //
+    StartCatalogRefresh();
+
+    // Reloads the servers when the config file changes.
+    //
+    StartConfigWatch();
+
     return nullptr;
 }
 
+// ---------------------------------------------------------------------------
+// Method: ReleaseServerInfo
+//
+// Description:
+//    This method frees everything a server entry owns. The entry itself
+//    is left alone.
+//
+// Returns:
+//    VOID
+//
+static void
+ReleaseServerInfo(
+    ServerInfo* serverInfo)
+{
+    delete serverInfo->m_catalog;
+    serverInfo->m_catalog = NULL;
+    delete serverInfo->m_deltaTracker;
+    serverInfo->m_deltaTracker = NULL;
+    delete serverInfo->m_prefetcher;
+    serverInfo->m_prefetcher = NULL;
+    delete serverInfo->m_history;
+    serverInfo->m_history = NULL;
+    delete serverInfo->m_sharedSnapshots;
+    serverInfo->m_sharedSnapshots = NULL;
+    delete serverInfo->m_resultCache;
+    serverInfo->m_resultCache = NULL;
+    delete serverInfo->m_throttle;
+    serverInfo->m_throttle = NULL;
+
+    delete serverInfo->m_connectionPool;
+    serverInfo->m_connectionPool = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Method: Destructor
+//
+// Description:
+//    Frees everything the entry owns. An entry of the server map is
+//    deleted once the map and every user that looked it up dropped it.
+//
+ServerInfo::~ServerInfo()
+{
+    ReleaseServerInfo(this);
+}
+
+// ---------------------------------------------------------------------------
+// Method: DeleteServerInfo
+//
+// Description:
+//    This method frees a server entry that was never used - one that
+//    failed its verification.
+//
+// Returns:
+//    VOID
+//
+void
+DeleteServerInfo(
+    ServerInfo* serverInfo)
+{
+    delete serverInfo;
+}
+
+// ---------------------------------------------------------------------------
+// Method: RemoveServer
+//
+// Description:
+//    This method removes a server from the mount while it is running: its
+//    entry leaves the server map, its prefetch stops and its folder is
+//    removed. Its shared snapshot segment is closed so that the publisher
+//    lock goes to the entry replacing it, and its idle connections are
+//    closed. FUSE requests and queries that looked the entry up before
+//    may still use it - it is freed, with its cache and history, when
+//    the last of them drops it.
+//
+// Returns:
+//    VOID
+//
+void
+RemoveServer(
+    const string& servername)
+{
+    shared_ptr<ServerInfo> serverInfo;
+
+    {
+        std::lock_guard<std::mutex> guard(g_ServerInfoMapLock);
+
+        auto itr = g_ServerInfoMap.find(servername);
+        if (itr == g_ServerInfoMap.end())
+        {
+            return;
+        }
+        serverInfo = itr->second;
+        g_ServerInfoMap.erase(itr);
+    }
+
+    if (serverInfo->m_prefetcher)
+    {
+        serverInfo->m_prefetcher->Stop();
+    }
+    delete serverInfo->m_sharedSnapshots;
+    serverInfo->m_sharedSnapshots = NULL;
+    serverInfo->m_connectionPool->Retire();
+
+    RemoveDbfsFiles(servername);
+}
+
+// ---------------------------------------------------------------------------
+// Method: AddServer
+//
+// Description:
+//    This method adds a verified server to the mount while it is running,
+//    replacing the server of the same name if there is one. Its folder is
+//    created like at mount time, and its prefetch started.
+//
+// Returns:
+//    VOID
+//
+void
+AddServer(
+    const string& servername,
+    ServerInfo* serverInfo)
+{
+    RemoveServer(servername);
+
+    {
+        std::lock_guard<std::mutex> guard(g_ServerInfoMapLock);
+        g_ServerInfoMap[servername] = shared_ptr<ServerInfo>(serverInfo);
+    }
+
+    CreateDbfsFiles(servername, serverInfo);
+
+    if (serverInfo->m_prefetcher)
+    {
+        serverInfo->m_prefetcher->Start();
+    }
+}
+
 // ---------------------------------------------------------------------------
 // Method: DestroySQLFs
 //
 // Description:
 //    This method gets invoked if and when FUSE instance is closing. 
-//    It deletes the dump directory and all the DMV's created in it.
+//    It closes the pooled server connections and releases DB-Library.
 //
 // Returns:
 //    VOID
@@ -1231,53 +2533,64 @@ void
 DestroySQLFs(void* userdata)
 {
     PrintMsg("Closing SQLFS\n");
+
+    StopConfigWatch();
+    WaitForStreamingQueries();
+    StopCatalogRefresh();
+
+    for (auto&& itr : GetServerInfoList())
+    {
+        ReleaseServerInfo(itr.second.get());
+    }
+
+    ShutdownDBLibrary();
 }
 
 // ---------------------------------------------------------------------------
 // Structure to map system calls to user level functions for the mount
 // directory.
 //
-static void
+void
 InitializeFuseOperations(
     struct fuse_operations* sqlFsOperations)
 {
-    sqlFsOperations->getattr = GetattrLocalImpl;
-    sqlFsOperations->readlink = ReadlinkLocalImpl;
+    sqlFsOperations->getattr = COUNTED_FUSE_OP(FUSE_OP_GETATTR, GetattrLocalImpl);
+    sqlFsOperations->readlink = COUNTED_FUSE_OP(FUSE_OP_READLINK, ReadlinkLocalImpl);
     sqlFsOperations->getdir = NULL;
-    sqlFsOperations->mknod = MknodLocalImpl;
-    sqlFsOperations->mkdir = MkdirLocalImpl;
-    sqlFsOperations->unlink = UnlinkLocalImpl;
-    sqlFsOperations->rmdir = RmdirLocalImpl;
-    sqlFsOperations->symlink = SymlinkLocalImpl;
-    sqlFsOperations->rename = RenameLocalImpl;
-    sqlFsOperations->link = LinkLocalImpl;
-    sqlFsOperations->chmod = ChmodLocalImpl;
-    sqlFsOperations->chown = ChownLocalImpl;
-    sqlFsOperations->truncate = TruncateLocalImpl;
+    sqlFsOperations->mknod = COUNTED_FUSE_OP(FUSE_OP_MKNOD, MknodLocalImpl);
+    sqlFsOperations->mkdir = COUNTED_FUSE_OP(FUSE_OP_MKDIR, MkdirLocalImpl);
+    sqlFsOperations->unlink = COUNTED_FUSE_OP(FUSE_OP_UNLINK, UnlinkLocalImpl);
+    sqlFsOperations->rmdir = COUNTED_FUSE_OP(FUSE_OP_RMDIR, RmdirLocalImpl);
+    sqlFsOperations->symlink = COUNTED_FUSE_OP(FUSE_OP_SYMLINK, SymlinkLocalImpl);
+    sqlFsOperations->rename = COUNTED_FUSE_OP(FUSE_OP_RENAME, RenameLocalImpl);
+    sqlFsOperations->link = COUNTED_FUSE_OP(FUSE_OP_LINK, LinkLocalImpl);
+    sqlFsOperations->chmod = COUNTED_FUSE_OP(FUSE_OP_CHMOD, ChmodLocalImpl);
+    sqlFsOperations->chown = COUNTED_FUSE_OP(FUSE_OP_CHOWN, ChownLocalImpl);
+    sqlFsOperations->truncate = COUNTED_FUSE_OP(FUSE_OP_TRUNCATE, TruncateLocalImpl);
     sqlFsOperations->utime = NULL;
-    sqlFsOperations->open = OpenLocalImpl;
-    sqlFsOperations->read = ReadLocalImpl;
-    sqlFsOperations->write = WriteLocalImpl;
-    sqlFsOperations->statfs = StatfsLocalImpl;
+    sqlFsOperations->open = COUNTED_FUSE_OP(FUSE_OP_OPEN, OpenLocalImpl);
+    sqlFsOperations->read = COUNTED_FUSE_OP(FUSE_OP_READ, ReadLocalImpl);
+    sqlFsOperations->write = COUNTED_FUSE_OP(FUSE_OP_WRITE, WriteLocalImpl);
+    sqlFsOperations->statfs = COUNTED_FUSE_OP(FUSE_OP_STATFS, StatfsLocalImpl);
     sqlFsOperations->flush = NULL;
-    sqlFsOperations->release = ReleaseLocalImpl;
-    sqlFsOperations->fsync = FsyncLocalImpl;
-    sqlFsOperations->setxattr = SetxattrLocalImpl;
-    sqlFsOperations->getxattr = GetxattrLocalImpl;
-    sqlFsOperations->listxattr = ListxattrLocalImpl;
-    sqlFsOperations->removexattr = RemovexattrLocalImpl;
-    sqlFsOperations->opendir = OpendirLocalImpl;
-    sqlFsOperations->readdir = ReaddirLocalImpl;
-    sqlFsOperations->releasedir = ReleasedirLocalImpl;
+    sqlFsOperations->release = COUNTED_FUSE_OP(FUSE_OP_RELEASE, ReleaseLocalImpl);
+    sqlFsOperations->fsync = COUNTED_FUSE_OP(FUSE_OP_FSYNC, FsyncLocalImpl);
+    sqlFsOperations->setxattr = COUNTED_FUSE_OP(FUSE_OP_SETXATTR, SetxattrLocalImpl);
+    sqlFsOperations->getxattr = COUNTED_FUSE_OP(FUSE_OP_GETXATTR, GetxattrLocalImpl);
+    sqlFsOperations->listxattr = COUNTED_FUSE_OP(FUSE_OP_LISTXATTR, ListxattrLocalImpl);
+    sqlFsOperations->removexattr = COUNTED_FUSE_OP(FUSE_OP_REMOVEXATTR, RemovexattrLocalImpl);
+    sqlFsOperations->opendir = COUNTED_FUSE_OP(FUSE_OP_OPENDIR, OpendirLocalImpl);
+    sqlFsOperations->readdir = COUNTED_FUSE_OP(FUSE_OP_READDIR, ReaddirLocalImpl);
+    sqlFsOperations->releasedir = COUNTED_FUSE_OP(FUSE_OP_RELEASEDIR, ReleasedirLocalImpl);
     sqlFsOperations->fsyncdir = NULL;
     sqlFsOperations->init = InitializeSQLFs;
     sqlFsOperations->destroy = DestroySQLFs;
-    sqlFsOperations->access = AccessLocalImpl;
+    sqlFsOperations->access = COUNTED_FUSE_OP(FUSE_OP_ACCESS, AccessLocalImpl);
     sqlFsOperations->create = NULL;
     sqlFsOperations->ftruncate = NULL;
     sqlFsOperations->fgetattr = NULL;
     sqlFsOperations->lock = NULL;
-    sqlFsOperations->utimens = UtimensLocalImpl;
+    sqlFsOperations->utimens = COUNTED_FUSE_OP(FUSE_OP_UTIMENS, UtimensLocalImpl);
     sqlFsOperations->bmap = NULL;
     sqlFsOperations->flag_nullpath_ok = 0;
     sqlFsOperations->flag_nopath = 0;
@@ -1286,9 +2599,9 @@ InitializeFuseOperations(
     sqlFsOperations->ioctl = NULL;
     sqlFsOperations->poll = NULL;
     sqlFsOperations->write_buf = NULL;
-    sqlFsOperations->read_buf = NULL;
+    sqlFsOperations->read_buf = COUNTED_FUSE_OP(FUSE_OP_READ_BUF, ReadBufLocalImpl);
     sqlFsOperations->flock = NULL;
-    sqlFsOperations->fallocate = FallocateLocalImpl;
+    sqlFsOperations->fallocate = COUNTED_FUSE_OP(FUSE_OP_FALLOCATE, FallocateLocalImpl);
 }
 
 // ---------------------------------------------------------------------------
@@ -1299,10 +2612,11 @@ InitializeFuseOperations(
 //    argc and argv need to be constructed to cater to the arguments 
 //    fuse_main() expects.
 //
-//    Options -o and direct_io are passed because because before a read()
-//    kernel does a query to get the size of the file but that returns zero 
-//    because only at open do we put data in the file. So this doesn't work
-//    well when kernel is using its cache (direct_io option disables that).
+//    direct_io is not passed for the whole mount. Before a read() kernel
+//    does a query to get the size of the file, which is zero for DBFS files
+//    unless it is known from the result cache. So OpenLocalImpl sets
+//    direct_io for each DBFS file that is not page cached, and the other
+//    files get the kernel cache, readahead and mmap.
 //
 // Returns:
 //    VOID
@@ -1345,14 +2659,26 @@ StartFuse(
         argv[argc++] = buffer;
     }
 
-    buffer = strdup("-o");
-    assert(buffer);
-    argv[argc++] = buffer;
+    // FUSE serves requests on multiple threads unless asked not to. The
+    // query layer is thread-safe so this is only useful for debugging.
+    //
+    if (g_RunSingleThreaded)
+    {
+        buffer = strdup("-s");
+        assert(buffer);
+        argv[argc++] = buffer;
+    }
 
-    buffer = strdup("direct_io");
+    // Let the requests waiting for a query be interrupted, so that the
+    // query is cancelled when its reader gets a signal.
+    //
+    buffer = strdup("-ointr");
     assert(buffer);
     argv[argc++] = buffer;
 
+    g_HandleInterrupts = true;
+    SetQueryInterruptCheck(IsRequestInterrupted);
+
     PrintMsg("Starting fuse\n");
 
     result = fuse_main(argc, argv, &sqlFsOperations, NULL);
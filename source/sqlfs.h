@@ -12,6 +12,10 @@
 
 #define MAX_ARGS                8
 
+// Prefix of the extended attributes DBFS computes for its files.
+//
+#define DBFS_XATTR_PREFIX       "user.dbfs."
+
 // Structure to track entries of various paths and configuration file
 //
 struct SQLFsPaths 
@@ -20,13 +24,28 @@ struct SQLFsPaths
     string m_dumpPath;
     string m_confPath;
     string m_logfilePath;
+
+    // Directory of the DMV catalog cache files - empty to not cache the
+    // catalogs.
+    //
+    string m_catalogCachePath;
+
+    // Directory of the shared snapshot segments (a tmpfs).
+    //
+    string m_sharedSnapshotPath;
 };
 
-// Structure used to track information for a server.
+// Structure used to track information for a server. The server map holds
+// its entries through shared pointers, so that an entry removed from the
+// map lives on until its last user drops it.
 //
-class ServerInfo 
+class ServerInfo : public std::enable_shared_from_this<ServerInfo>
 {
 public:
+    // Frees everything the entry owns.
+    //
+    ~ServerInfo();
+
     string m_hostname;
     string m_username;
     string m_password;
@@ -41,6 +60,97 @@ public:
     // [16] is the minimum version required for JSON output.
     //
     int m_version;
+
+    // Pool of logged in connections to this server. Created along with
+    // the entry while parsing the config file.
+    //
+    ConnectionPool* m_connectionPool;
+
+    // Whether query results are streamed to the readers as rows arrive
+    // instead of being read once the whole result is fetched.
+    //
+    bool m_streamResults;
+
+    // Whether custom queries run with SET STATISTICS TIME and IO, their
+    // output shown in the <query file>.stats file.
+    //
+    bool m_queryStatistics;
+
+    // Rate limit and concurrency cap of the queries of this server. NULL
+    // if the server has no throttle setting.
+    //
+    class QueryThrottle* m_throttle;
+
+    // Cache of DMV query results for this server.
+    //
+    ResultCache* m_resultCache;
+
+    // How long a DMV result is served from the cache. Entries in
+    // m_fileCacheTtl override m_cacheTtl for the given DMV name.
+    //
+    std::chrono::milliseconds m_cacheTtl;
+    unordered_map<string, std::chrono::milliseconds> m_fileCacheTtl;
+
+    // How long a query may run before it is cancelled - zero for no
+    // limit. Entries in m_fileQueryTimeout override m_queryTimeout for
+    // the given DMV or custom query name.
+    //
+    std::chrono::milliseconds m_queryTimeout;
+    unordered_map<string, std::chrono::milliseconds> m_fileQueryTimeout;
+
+    // Whether DMV files report the size of their cached result and are
+    // served through the kernel page cache. DMVs in m_volatileFiles (and
+    // DMVs that are not cached) always bypass the page cache.
+    //
+    bool m_usePageCache;
+    unordered_set<string> m_volatileFiles;
+
+    // DMV files (with their extension) of each bundle of the server, by
+    // bundle name.
+    //
+    map<string, vector<string>> m_bundles;
+
+    // Refreshes the DMV files of the prefetch setting in the background.
+    // NULL if the server has no prefetch setting.
+    //
+    class Prefetcher* m_prefetcher;
+
+    // Past snapshots of the prefetched DMVs. NULL if the server has no
+    // historyMemory setting.
+    //
+    class HistoryStore* m_history;
+
+    // Prefetched snapshots shared with the other DBFS instances of the
+    // host. NULL if the server has no sharedSnapshots setting.
+    //
+    class SharedSnapshotStore* m_sharedSnapshots;
+
+    // Previous snapshots of the DMVs that have a delta file.
+    //
+    class DeltaTracker* m_deltaTracker;
+
+    // DMV files of the server, discovered on first use.
+    //
+    class DmvCatalog* m_catalog;
 };
 
+// Fills in the FUSE operations of DBFS. StartFuse mounts with these -
+// the benchmarks call them directly.
+//
+void InitializeFuseOperations(struct fuse_operations* sqlFsOperations);
+
 int StartFuse(char* ProgramName);
+
+// Frees a server entry that was not added to the mount.
+//
+void DeleteServerInfo(ServerInfo* serverInfo);
+
+// Adds a server to the running mount, replacing the server of the same
+// name if there is one. Used by the reload of the config file.
+//
+void AddServer(const string& servername, ServerInfo* serverInfo);
+
+// Removes a server from the running mount. Used by the reload of the
+// config file.
+//
+void RemoveServer(const string& servername);